@@ -0,0 +1,281 @@
+#include "BackgroundModel.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define BACKGROUND_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	struct FileHeader
+	{
+		uint32_t	magic = 0x4D474256;	// 'VBGM'
+		uint32_t	version = 1;
+		int32_t		width = 0;
+		int32_t		height = 0;
+		float		depthUnits = 0;
+	};
+
+	// pixels seen in fewer than this fraction of the frames have no background
+	constexpr float MinValidFraction = 0.5f;
+}
+
+void BackgroundModel::setSettings(const Settings& a_settings)
+{
+	m_settings = a_settings;
+	m_settings.frames = std::clamp(m_settings.frames, 3, 255);
+
+	// tolerances are baked per pixel, so rebake a copy of the current model
+	if (auto model = getModel())
+	{
+		auto updated = std::make_shared<Model>(*model);
+		updateTolerance(*updated);
+		setModel(updated);
+	}
+}
+
+void BackgroundModel::startLearning()
+{
+	// a build still running owns the samples
+	if (isBuilding())
+		return;
+
+	m_learning = true;
+	m_learnedFrames = 0;
+	m_samples.clear();
+}
+
+bool BackgroundModel::isBuilding() const
+{
+	return m_build.valid() &&
+		m_build.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+void BackgroundModel::addFrame(const uint16_t* a_depth, int a_width, int a_height, float a_depthUnits)
+{
+	if (m_learning == false)
+		return;
+
+	size_t pixels = (size_t)a_width * a_height;
+
+	// a resolution change mid way starts over
+	if (m_learnedFrames > 0 &&
+		m_samples.size() != pixels * m_learnedFrames)
+		m_learnedFrames = 0;
+
+	m_samples.resize(pixels * (m_learnedFrames + 1));
+	std::copy_n(a_depth, pixels, m_samples.data() + pixels * m_learnedFrames);
+
+	if (++m_learnedFrames >= m_settings.frames)
+	{
+		m_learning = false;
+		m_build = std::async(std::launch::async, &BackgroundModel::build, this, a_width, a_height, a_depthUnits);
+	}
+}
+
+void BackgroundModel::build(int a_width, int a_height, float a_depthUnits)
+{
+	auto model = std::make_shared<Model>();
+	model->width = a_width;
+	model->height = a_height;
+	model->depthUnits = a_depthUnits;
+
+	size_t pixels = (size_t)a_width * a_height;
+	int frames = (int)(m_samples.size() / pixels);
+	int minValid = std::max(1, (int)std::ceil(frames * MinValidFraction));
+
+	model->median.assign(pixels, 0);
+	model->variance.assign(pixels, 0);
+
+	std::vector<int> rows(a_height);
+	std::iota(rows.begin(), rows.end(), 0);
+
+	std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int a_row) {
+		std::vector<uint16_t> values(frames);
+		for (size_t i = (size_t)a_row * a_width; i < (size_t)(a_row + 1) * a_width; ++i)
+		{
+			int valid = 0;
+			for (int frame = 0; frame < frames; ++frame)
+				if (uint16_t d = m_samples[frame * pixels + i])
+					values[valid++] = d;
+
+			if (valid < minValid)
+				continue;
+
+			auto middle = values.begin() + valid / 2;
+			std::nth_element(values.begin(), middle, values.begin() + valid);
+
+			double mean = 0, sumSquares = 0;
+			for (int v = 0; v < valid; ++v)
+			{
+				mean += values[v];
+				sumSquares += (double)values[v] * values[v];
+			}
+			mean /= valid;
+
+			model->median[i] = *middle;
+			model->variance[i] = (float)std::max(0.0, sumSquares / valid - mean * mean);
+		}
+	});
+
+	updateTolerance(*model);
+	setModel(model);
+
+	m_samples.clear();
+	m_samples.shrink_to_fit();
+}
+
+void BackgroundModel::updateTolerance(Model& a_model) const
+{
+	float minTolerance = m_settings.minTolerance / a_model.depthUnits;
+
+	a_model.tolerance.resize(a_model.median.size());
+	for (size_t i = 0; i < a_model.median.size(); ++i)
+	{
+		float tolerance = std::max({ minTolerance, m_settings.relativeTolerance * a_model.median[i],
+									 m_settings.sigmaScale * std::sqrt(a_model.variance[i]) });
+		a_model.tolerance[i] = a_model.median[i] == 0 ? 0 : (uint16_t)std::min(tolerance, 65535.0f);
+	}
+}
+
+std::shared_ptr<const BackgroundModel::Model> BackgroundModel::getModel() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_model;
+}
+
+void BackgroundModel::setModel(std::shared_ptr<Model> a_model)
+{
+	std::lock_guard lock(m_mutex);
+	m_model = std::move(a_model);
+}
+
+bool BackgroundModel::isValid() const
+{
+	return getModel() != nullptr;
+}
+
+size_t BackgroundModel::apply(const uint16_t* a_in, uint16_t* a_out, int a_width, int a_height) const
+{
+	auto model = getModel();
+	size_t count = (size_t)a_width * a_height;
+
+	if (model == nullptr ||
+		model->width != a_width ||
+		model->height != a_height)
+	{
+		if (a_out != a_in)
+			std::copy_n(a_in, count, a_out);
+		m_maskedFraction = 0;
+		return 0;
+	}
+
+	const uint16_t* median = model->median.data();
+	const uint16_t* tolerance = model->tolerance.data();
+	size_t masked = 0, valid = 0;
+	size_t i = 0;
+
+#ifdef BACKGROUND_SIMD
+	// 8 pixels per step: |d - median| <= tolerance with saturating unsigned arithmetic,
+	// pixels without a background have tolerance 0 so only already-zero depth matches
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(a_in + i));
+		__m128i m = _mm_loadu_si128((const __m128i*)(median + i));
+		__m128i t = _mm_loadu_si128((const __m128i*)(tolerance + i));
+
+		__m128i diff = _mm_or_si128(_mm_subs_epu16(d, m), _mm_subs_epu16(m, d));
+		__m128i match = _mm_cmpeq_epi16(_mm_subs_epu16(diff, t), zero);
+		__m128i empty = _mm_cmpeq_epi16(d, zero);
+
+		_mm_storeu_si128((__m128i*)(a_out + i), _mm_andnot_si128(match, d));
+
+		// two mask bits per 16 bit lane
+		masked += std::popcount((unsigned int)_mm_movemask_epi8(_mm_andnot_si128(empty, match))) / 2;
+		valid += 8 - std::popcount((unsigned int)_mm_movemask_epi8(empty)) / 2;
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		uint16_t d = a_in[i];
+		bool match = d != 0 && std::abs((int)d - (int)median[i]) <= tolerance[i];
+		masked += match;
+		valid += d != 0;
+		a_out[i] = match ? 0 : d;
+	}
+
+	m_maskedFraction = valid > 0 ? (float)masked / valid : 0;
+	return masked;
+}
+
+bool BackgroundModel::save(const std::string& a_filename) const
+{
+	auto model = getModel();
+	if (model == nullptr)
+		return false;
+
+	std::ofstream file(a_filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+
+	FileHeader header;
+	header.width = model->width;
+	header.height = model->height;
+	header.depthUnits = model->depthUnits;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)model->median.data(), model->median.size() * sizeof(uint16_t));
+	file.write((const char*)model->variance.data(), model->variance.size() * sizeof(float));
+
+	return file.good();
+}
+
+bool BackgroundModel::load(const std::string& a_filename)
+{
+	std::ifstream file(a_filename, std::ios::binary);
+	if (file.is_open() == false)
+		return false;
+
+	FileHeader header, expected;
+	file.read((char*)&header, sizeof(header));
+	if (file.good() == false ||
+		header.magic != expected.magic ||
+		header.version != expected.version ||
+		header.width <= 0 || header.height <= 0 ||
+		header.depthUnits <= 0)
+	{
+		std::cout << "Error: " << a_filename << " is not a background model!" << std::endl;
+		return false;
+	}
+
+	auto model = std::make_shared<Model>();
+	model->width = header.width;
+	model->height = header.height;
+	model->depthUnits = header.depthUnits;
+
+	size_t pixels = (size_t)header.width * header.height;
+	model->median.resize(pixels);
+	model->variance.resize(pixels);
+	file.read((char*)model->median.data(), pixels * sizeof(uint16_t));
+	file.read((char*)model->variance.data(), pixels * sizeof(float));
+	if (file.good() == false)
+	{
+		std::cout << "Error: " << a_filename << " is truncated!" << std::endl;
+		return false;
+	}
+
+	updateTolerance(*model);
+	setModel(model);
+	return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-pixel model of a camera's static set, learned from the median and variance of the
+// raw Z16 depth over a number of frames. Pixels that match the model are zeroed before
+// align and deprojection, so static geometry never reaches the point cloud, GPU or
+// renderer. Frames are only copied while learning, the model is built on a worker thread
+// and swapped in when done, so the previous model keeps masking in the meantime.
+class BackgroundModel
+{
+public:
+
+	struct Settings
+	{
+		int		frames = 30;				// frames learned from
+		float	sigmaScale = 3.0f;			// tolerance in standard deviations
+		float	minTolerance = 0.01f;		// metres
+		float	relativeTolerance = 0.01f;	// fraction of the background depth
+	};
+
+	BackgroundModel() = default;
+	~BackgroundModel() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings);
+
+	// discards any frames collected so far and starts collecting a_settings.frames more
+	void			startLearning();
+	bool			isLearning() const		{	return m_learning;	}
+	bool			isBuilding() const;
+	int				getLearnedFrames() const	{	return m_learnedFrames;	}
+
+	// copies a raw depth frame while learning, the last one starts the build
+	void			addFrame(const uint16_t* a_depth, int a_width, int a_height, float a_depthUnits);
+
+	bool			isValid() const;
+
+	// zeroes the pixels matching the background, a_out may alias a_in. Returns the number
+	// of pixels removed, nothing is removed if the frame size doesn't match the model.
+	size_t			apply(const uint16_t* a_in, uint16_t* a_out, int a_width, int a_height) const;
+
+	// fraction of valid pixels removed by the last apply
+	float			getMaskedFraction() const	{	return m_maskedFraction;	}
+
+	bool			save(const std::string& a_filename) const;
+	bool			load(const std::string& a_filename);
+
+private:
+
+	struct Model
+	{
+		int						width = 0;
+		int						height = 0;
+		float					depthUnits = 0;
+		std::vector<uint16_t>	median;		// raw units, 0 where the background was never seen
+		std::vector<float>		variance;	// raw units squared
+		std::vector<uint16_t>	tolerance;	// raw units, from variance and the settings
+	};
+
+	void	build(int a_width, int a_height, float a_depthUnits);
+	void	updateTolerance(Model& a_model) const;
+
+	std::shared_ptr<const Model>	getModel() const;
+	void							setModel(std::shared_ptr<Model> a_model);
+
+	Settings					m_settings;
+
+	bool						m_learning = false;
+	int							m_learnedFrames = 0;
+	std::vector<uint16_t>		m_samples;	// frames back to back
+	std::future<void>			m_build;
+
+	mutable std::mutex			m_mutex;
+	std::shared_ptr<const Model>	m_model;
+
+	mutable float				m_maskedFraction = 0;
+};
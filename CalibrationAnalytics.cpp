@@ -0,0 +1,147 @@
+#include "CalibrationAnalytics.h"
+#include <GL/glew.h>
+#include <algorithm>
+
+namespace
+{
+	// blue -> cyan -> green -> yellow -> red
+	void heatColour(float a_t, unsigned char* a_rgb)
+	{
+		a_t = std::clamp(a_t, 0.0f, 1.0f);
+		float r = std::clamp(1.5f - std::abs(4 * a_t - 3), 0.0f, 1.0f);
+		float g = std::clamp(1.5f - std::abs(4 * a_t - 2), 0.0f, 1.0f);
+		float b = std::clamp(1.5f - std::abs(4 * a_t - 1), 0.0f, 1.0f);
+		a_rgb[0] = (unsigned char)(r * 255);
+		a_rgb[1] = (unsigned char)(g * 255);
+		a_rgb[2] = (unsigned char)(b * 255);
+	}
+
+	void uploadTexture(unsigned int& a_texture, const std::vector<unsigned char>& a_rgb)
+	{
+		if (a_texture == 0)
+			glGenTextures(1, &a_texture);
+
+		glBindTexture(GL_TEXTURE_2D, a_texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, CalibrationAnalytics::GridWidth, CalibrationAnalytics::GridHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, a_rgb.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void CalibrationAnalytics::reset(unsigned int a_imageWidth, unsigned int a_imageHeight)
+{
+	m_imageWidth = std::max(1u, a_imageWidth);
+	m_imageHeight = std::max(1u, a_imageHeight);
+	m_frameCount = 0;
+	std::fill(m_coverage.begin(), m_coverage.end(), 0);
+	clearFrameErrors();
+	clearResiduals();
+}
+
+unsigned int CalibrationAnalytics::cellIndex(float a_x, float a_y) const
+{
+	auto x = std::clamp((int)(a_x * GridWidth / m_imageWidth), 0, (int)GridWidth - 1);
+	auto y = std::clamp((int)(a_y * GridHeight / m_imageHeight), 0, (int)GridHeight - 1);
+	return y * GridWidth + x;
+}
+
+void CalibrationAnalytics::addCoverage(const float* a_corners, size_t a_count)
+{
+	for (size_t i = 0; i < a_count; ++i)
+		++m_coverage[cellIndex(a_corners[i * 2], a_corners[i * 2 + 1])];
+	++m_frameCount;
+	m_dirty = true;
+}
+
+void CalibrationAnalytics::clearResiduals()
+{
+	std::fill(m_residualSum.begin(), m_residualSum.end(), 0.0f);
+	std::fill(m_residualCount.begin(), m_residualCount.end(), 0);
+	m_maxResidual = 0;
+	m_dirty = true;
+}
+
+void CalibrationAnalytics::addResidual(float a_x, float a_y, float a_error)
+{
+	auto i = cellIndex(a_x, a_y);
+	m_residualSum[i] += a_error;
+	++m_residualCount[i];
+	m_dirty = true;
+}
+
+float CalibrationAnalytics::getCoveredFraction() const
+{
+	auto covered = std::count_if(m_coverage.begin(), m_coverage.end(), [](unsigned int c) { return c > 0; });
+	return (float)covered / m_coverage.size();
+}
+
+void CalibrationAnalytics::updateTextures()
+{
+	if (m_dirty == false)
+		return;
+	m_dirty = false;
+
+	std::vector<unsigned char> rgb(GridWidth * GridHeight * 3);
+
+	// coverage, normalised to the busiest cell; empty cells stay black
+	auto maxCoverage = std::max(1u, *std::max_element(m_coverage.begin(), m_coverage.end()));
+	for (unsigned int i = 0; i < m_coverage.size(); ++i)
+	{
+		if (m_coverage[i] == 0)
+			rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = 0;
+		else
+			heatColour((float)m_coverage[i] / maxCoverage, &rgb[i * 3]);
+	}
+	uploadTexture(m_coverageTexture, rgb);
+
+	// mean residual per cell, normalised to the worst cell; cells without corners are grey
+	m_maxResidual = 0;
+	for (unsigned int i = 0; i < m_residualSum.size(); ++i)
+		if (m_residualCount[i] > 0)
+			m_maxResidual = std::max(m_maxResidual, m_residualSum[i] / m_residualCount[i]);
+
+	for (unsigned int i = 0; i < m_residualSum.size(); ++i)
+	{
+		if (m_residualCount[i] == 0)
+			rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = 64;
+		else
+			heatColour(m_maxResidual > 0 ? m_residualSum[i] / m_residualCount[i] / m_maxResidual : 0, &rgb[i * 3]);
+	}
+	uploadTexture(m_residualTexture, rgb);
+}
+
+std::string CalibrationAnalytics::suggestPlacement() const
+{
+	if (m_frameCount == 0)
+		return "Place the board in the centre of the image";
+
+	// split the image into thirds and point at the least covered region
+	static const char* rows[] = { "top", "middle", "bottom" };
+	static const char* columns[] = { "left", "centre", "right" };
+
+	unsigned int zones[3][3] = {};
+	for (unsigned int y = 0; y < GridHeight; ++y)
+		for (unsigned int x = 0; x < GridWidth; ++x)
+			if (m_coverage[y * GridWidth + x] > 0)
+				++zones[y * 3 / GridHeight][x * 3 / GridWidth];
+
+	unsigned int bestRow = 0, bestColumn = 0;
+	for (unsigned int r = 0; r < 3; ++r)
+		for (unsigned int c = 0; c < 3; ++c)
+			if (zones[r][c] < zones[bestRow][bestColumn])
+			{
+				bestRow = r;
+				bestColumn = c;
+			}
+
+	unsigned int zoneCells = (GridWidth / 3) * (GridHeight / 3);
+	if (zones[bestRow][bestColumn] >= zoneCells * 3 / 4)
+		return "Coverage is good, add tilted views of the board";
+
+	if (bestRow == 1 && bestColumn == 1)
+		return "Move the board to the centre of the image";
+	return std::string("Move the board to the ") + rows[bestRow] + " " + columns[bestColumn] + " of the image";
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Accumulates where board corners have been seen across the image plane and how well the
+// solved intrinsics reproject them, so a calibration session can be steered toward the
+// parts of the image that still lack samples.
+// Both maps are kept on a coarse grid and uploaded as small GL textures for ImGui; like
+// the rest of the camera's textures they live as long as the GL context.
+class CalibrationAnalytics
+{
+public:
+
+	static constexpr unsigned int	GridWidth = 32;
+	static constexpr unsigned int	GridHeight = 18;
+
+	// clears everything, sets the image size corners are measured in
+	void			reset(unsigned int a_imageWidth, unsigned int a_imageHeight);
+
+	// adds detected corners (interleaved x,y pixels) from one captured frame
+	void			addCoverage(const float* a_corners, size_t a_count);
+
+	// clears the per-corner residual map before a new calibration is evaluated; the
+	// per-frame errors of earlier calibrations are kept
+	void			clearResiduals();
+
+	void			clearFrameErrors()		{	m_frameErrors.clear();	}
+
+	// reprojection error in pixels of a single corner
+	void			addResidual(float a_x, float a_y, float a_error);
+
+	// RMS reprojection error of a whole frame
+	void			addFrameError(float a_error)	{	m_frameErrors.push_back(a_error);	}
+
+	// re-uploads the coverage and residual textures if they changed
+	void			updateTextures();
+
+	unsigned int	getCoverageTexture() const	{	return m_coverageTexture;	}
+	unsigned int	getResidualTexture() const	{	return m_residualTexture;	}
+	unsigned int	getFrameCount() const		{	return m_frameCount;		}
+	float			getCoveredFraction() const;
+	float			getMaxResidual() const		{	return m_maxResidual;		}
+
+	const std::vector<float>&	getFrameErrors() const	{	return m_frameErrors;	}
+
+	// human readable hint for where the board should be placed next
+	std::string		suggestPlacement() const;
+
+private:
+
+	unsigned int	cellIndex(float a_x, float a_y) const;
+
+	unsigned int	m_imageWidth = 1;
+	unsigned int	m_imageHeight = 1;
+	unsigned int	m_frameCount = 0;
+
+	std::vector<unsigned int>	m_coverage = std::vector<unsigned int>(GridWidth * GridHeight);
+	std::vector<float>			m_residualSum = std::vector<float>(GridWidth * GridHeight);
+	std::vector<unsigned int>	m_residualCount = std::vector<unsigned int>(GridWidth * GridHeight);
+	std::vector<float>			m_frameErrors;
+	float						m_maxResidual = 0;
+
+	bool			m_dirty = true;
+	unsigned int	m_coverageTexture = 0;
+	unsigned int	m_residualTexture = 0;
+};
@@ -0,0 +1,128 @@
+#include "CalibrationCache.h"
+#include "Crc32.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static_assert(sizeof(CalibrationCache::Record) % 8 == 0, "Calibration records must stay 8-byte aligned when mapped");
+
+bool CalibrationCache::open(const std::string& a_filename)
+{
+	m_filename = a_filename;
+	m_records.clear();
+	m_dirty = false;
+
+	if (m_file.open(a_filename) == false)
+		return false;
+
+	auto header = reinterpret_cast<const Header*>(m_file.data());
+	if (m_file.size() < sizeof(Header) ||
+		header->magic != Magic ||
+		header->version != Version ||
+		header->recordSize != sizeof(Record) ||
+		m_file.size() < sizeof(Header) + header->recordCount * sizeof(Record) ||
+		Crc32::compute(m_file.data() + sizeof(Header), header->recordCount * sizeof(Record)) != header->checksum)
+	{
+		std::cout << "Ignoring invalid calibration cache " << a_filename << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	return true;
+}
+
+const CalibrationCache::Record* CalibrationCache::records() const
+{
+	if (m_dirty)
+		return m_records.data();
+	if (m_file.isOpen())
+		return reinterpret_cast<const Record*>(m_file.data() + sizeof(Header));
+	return nullptr;
+}
+
+size_t CalibrationCache::recordCount() const
+{
+	if (m_dirty)
+		return m_records.size();
+	if (m_file.isOpen())
+		return reinterpret_cast<const Header*>(m_file.data())->recordCount;
+	return 0;
+}
+
+const CalibrationCache::Record* CalibrationCache::find(const std::string& a_serial, const ProfileKey& a_profile) const
+{
+	auto first = records();
+	auto count = recordCount();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (first[i].profile == a_profile &&
+			strncmp(first[i].serial, a_serial.c_str(), sizeof(Record::serial)) == 0)
+			return first + i;
+	}
+	return nullptr;
+}
+
+void CalibrationCache::store(const Record& a_record)
+{
+	if (m_dirty == false)
+	{
+		auto first = records();
+		m_records.assign(first, first + recordCount());
+		m_dirty = true;
+	}
+
+	for (auto& record : m_records)
+	{
+		if (record.profile == a_record.profile &&
+			strncmp(record.serial, a_record.serial, sizeof(Record::serial)) == 0)
+		{
+			record = a_record;
+			return;
+		}
+	}
+	m_records.push_back(a_record);
+}
+
+bool CalibrationCache::save()
+{
+	if (m_dirty == false ||
+		m_filename.empty())
+		return true;
+
+	Header header{};
+	header.magic = Magic;
+	header.version = Version;
+	header.recordSize = sizeof(Record);
+	header.recordCount = (uint32_t)m_records.size();
+	header.checksum = Crc32::compute(m_records.data(), m_records.size() * sizeof(Record));
+
+	// write beside the old file then swap, so a crash never leaves a half-written cache
+	std::string tempFilename = m_filename + ".tmp";
+	{
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+		if (file.is_open() == false)
+		{
+			std::cout << "Error: Unable to open file " << tempFilename << " for writing!" << std::endl;
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(m_records.data()), m_records.size() * sizeof(Record));
+		if (file.good() == false)
+			return false;
+	}
+
+	// the mapping has to be released before the file can be replaced on Windows
+	m_file.close();
+
+	std::error_code error;
+	std::filesystem::rename(tempFilename, m_filename, error);
+	if (error)
+	{
+		std::cout << "Error: Unable to replace " << m_filename << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	return open(m_filename);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Binary calibration store that sits alongside the YAML .cal files.
+// The file is a fixed header followed by an array of fixed-size records, so it can be
+// memory-mapped and queried in place without any parsing. The YAML files remain the
+// human-editable import/export format; records remember the YAML timestamp they came
+// from so edited .cal files get re-imported.
+class CalibrationCache
+{
+public:
+
+	static constexpr uint32_t	Magic = 0x4C414356;	// 'VCAL'
+	static constexpr uint32_t	Version = 2;
+
+	enum Flags : uint32_t
+	{
+		Intrinsics		= 1 << 0,
+		Transform		= 1 << 1,
+		DepthToColor	= 1 << 2,
+		DepthCorrection	= 1 << 3,
+	};
+
+	// stream profile the intrinsics were solved for
+	struct ProfileKey
+	{
+		uint32_t	width = 0;
+		uint32_t	height = 0;
+		uint32_t	format = 0;
+		uint32_t	fps = 0;
+
+		bool operator==(const ProfileKey&) const = default;
+	};
+
+	struct Record
+	{
+		char		serial[32] = {};
+		ProfileKey	profile;
+		uint32_t	flags = 0;
+		uint32_t	distortionCount = 0;
+		int64_t		sourceTime = 0;			// write time of the .cal this was imported from
+
+		double		cameraMatrix[9] = {};
+		double		distortion[14] = {};	// largest OpenCV distortion model
+		float		transform[16] = {};		// column-major, camera to capture space
+		float		depthToColor[16] = {};	// column-major, depth sensor to color sensor
+		double		depthCorrection[3] = {};	// see DepthCorrection::Coefficients
+	};
+
+	CalibrationCache() = default;
+	~CalibrationCache() = default;
+
+	// maps the cache file and validates magic, version and checksum. A missing or
+	// invalid file just leaves the cache empty.
+	bool			open(const std::string& a_filename);
+
+	// returns nullptr if there is no record for this serial and profile
+	const Record*	find(const std::string& a_serial, const ProfileKey& a_profile) const;
+
+	// adds or replaces a record; call save() to write it out
+	void			store(const Record& a_record);
+
+	// rewrites the cache file if any records have changed
+	bool			save();
+
+	bool			isDirty() const		{	return m_dirty;	}
+
+private:
+
+	struct Header
+	{
+		uint32_t	magic;
+		uint32_t	version;
+		uint32_t	recordSize;
+		uint32_t	recordCount;
+		uint32_t	checksum;
+		uint32_t	reserved[3];
+	};
+
+	const Record*	records() const;
+	size_t			recordCount() const;
+
+	std::string		m_filename;
+	MappedFile		m_file;
+
+	// only populated once something is stored, until then records are read from the mapping
+	std::vector<Record>	m_records;
+	bool				m_dirty = false;
+};
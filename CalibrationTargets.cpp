@@ -0,0 +1,333 @@
+#include "CalibrationTargets.h"
+#include "Gizmos.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <iostream>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+namespace
+{
+	cv::Mat toMat(const Eigen::Affine3f& a_pose)
+	{
+		cv::Mat m(4, 4, CV_32F);
+		for (int r = 0; r < 4; ++r)
+			for (int c = 0; c < 4; ++c)
+				m.at<float>(r, c) = a_pose.matrix()(r, c);
+		return m;
+	}
+
+	Eigen::Affine3f toPose(const cv::FileNode& a_node)
+	{
+		Eigen::Affine3f pose = Eigen::Affine3f::Identity();
+
+		cv::Mat m;
+		a_node >> m;
+		if (m.rows == 4 && m.cols == 4)
+		{
+			m.convertTo(m, CV_32F);
+			for (int r = 0; r < 4; ++r)
+				for (int c = 0; c < 4; ++c)
+					pose.matrix()(r, c) = m.at<float>(r, c);
+		}
+		return pose;
+	}
+
+	cv::Point3f toPoint(const Eigen::Vector3f& a_v)
+	{
+		return { a_v.x(), a_v.y(), a_v.z() };
+	}
+}
+
+CalibrationTargets::CalibrationTargets(int a_dictionary)
+	: m_dictionaryId(a_dictionary),
+	m_dictionary(cv::aruco::getPredefinedDictionary(a_dictionary))
+{
+}
+
+void CalibrationTargets::addBoard(int a_squaresX, int a_squaresY, float a_squareLength, float a_markerLength, const Eigen::Affine3f& a_pose)
+{
+	insertBoard(a_squaresX, a_squaresY, a_squareLength, a_markerLength, m_nextId, a_pose);
+}
+
+bool CalibrationTargets::addMarker(int a_id, float a_size, const Eigen::Affine3f& a_pose)
+{
+	if (isIdUsed(a_id, 1))
+	{
+		std::cout << "Error: Marker id " << a_id << " is already used by another target" << std::endl;
+		return false;
+	}
+
+	m_markers.push_back({ a_id, a_size, a_pose });
+	m_nextId = std::max(m_nextId, a_id + 1);
+	return true;
+}
+
+bool CalibrationTargets::insertBoard(int a_squaresX, int a_squaresY, float a_squareLength, float a_markerLength, int a_firstId,
+								const Eigen::Affine3f& a_pose)
+{
+	Board board;
+	board.board = cv::aruco::CharucoBoard::create(a_squaresX, a_squaresY, a_squareLength, a_markerLength, m_dictionary);
+	board.firstId = a_firstId;
+	board.pose = a_pose;
+
+	int count = (int)board.board->ids.size();
+	if (a_firstId < 0 ||
+		a_firstId + count > m_dictionary->bytesList.rows ||
+		isIdUsed(a_firstId, count))
+	{
+		std::cout << "Error: Marker ids " << a_firstId << " to " << a_firstId + count - 1 << " are taken or outside the dictionary" << std::endl;
+		return false;
+	}
+
+	// boards are created with ids from 0, shift them into their own range
+	for (auto& id : board.board->ids)
+		id += board.firstId;
+	m_nextId = std::max(m_nextId, a_firstId + count);
+
+	m_boards.push_back(board);
+	return true;
+}
+
+bool CalibrationTargets::isIdUsed(int a_firstId, int a_count) const
+{
+	for (auto& board : m_boards)
+	{
+		int lastId = board.firstId + (int)board.board->ids.size();
+		if (a_firstId < lastId && board.firstId < a_firstId + a_count)
+			return true;
+	}
+
+	for (auto& marker : m_markers)
+		if (marker.id >= a_firstId && marker.id < a_firstId + a_count)
+			return true;
+
+	return false;
+}
+
+bool CalibrationTargets::load(const std::string& a_filename)
+{
+	cv::FileStorage file(a_filename, cv::FileStorage::READ);
+	if (file.isOpened() == false)
+		return false;
+
+	int dictionary = m_dictionaryId;
+	file["dictionary"] >> dictionary;
+	if (dictionary != m_dictionaryId)
+	{
+		m_dictionaryId = dictionary;
+		m_dictionary = cv::aruco::getPredefinedDictionary(dictionary);
+	}
+
+	m_boards.clear();
+	m_markers.clear();
+	m_nextId = 0;
+
+	// boards keep the ids they were printed with, older files without first_id get the next free range
+	for (auto node : file["boards"])
+	{
+		int firstId = node["first_id"].empty() ? m_nextId : (int)node["first_id"];
+		insertBoard((int)node["squares_x"], (int)node["squares_y"],
+			(float)node["square_length"], (float)node["marker_length"], firstId, toPose(node["pose"]));
+	}
+
+	// a marker whose id falls in a board's range would be mistaken for part of it
+	for (auto node : file["markers"])
+		addMarker((int)node["id"], (float)node["size"], toPose(node["pose"]));
+
+	return m_boards.empty() == false || m_markers.empty() == false;
+}
+
+bool CalibrationTargets::save(const std::string& a_filename) const
+{
+	cv::FileStorage file(a_filename, cv::FileStorage::WRITE);
+	if (file.isOpened() == false)
+		return false;
+
+	file << "dictionary" << m_dictionaryId;
+
+	file << "boards" << "[";
+	for (auto& board : m_boards)
+	{
+		file << "{";
+		file << "squares_x" << board.board->getChessboardSize().width;
+		file << "squares_y" << board.board->getChessboardSize().height;
+		file << "square_length" << board.board->getSquareLength();
+		file << "marker_length" << board.board->getMarkerLength();
+		file << "first_id" << board.firstId;
+		file << "pose" << toMat(board.pose);
+		file << "}";
+	}
+	file << "]";
+
+	file << "markers" << "[";
+	for (auto& marker : m_markers)
+	{
+		file << "{";
+		file << "id" << marker.id;
+		file << "size" << marker.size;
+		file << "pose" << toMat(marker.pose);
+		file << "}";
+	}
+	file << "]";
+
+	return true;
+}
+
+void CalibrationTargets::exportImages(const std::string& a_directory) const
+{
+	std::filesystem::create_directories(a_directory);
+
+	for (size_t i = 0; i < m_boards.size(); ++i)
+	{
+		auto& board = m_boards[i];
+		auto size = board.board->getChessboardSize();
+
+		cv::Mat boardImage;
+		board.board->draw(cv::Size(size.width * 200, size.height * 200), boardImage);
+		cv::imwrite(std::format("{}/board{}.png", a_directory, i), boardImage);
+	}
+
+	for (auto& marker : m_markers)
+	{
+		cv::Mat markerImage;
+		m_dictionary->drawMarker(marker.id, 400, markerImage, 1);
+		cv::imwrite(std::format("{}/marker{}.png", a_directory, marker.id), markerImage);
+	}
+}
+
+CalibrationTargets::Detection CalibrationTargets::detect(const cv::Mat& a_image, const cv::Mat& a_cameraMatrix, const cv::Mat& a_distortion) const
+{
+	Detection detection;
+
+	cv::Ptr<cv::aruco::DetectorParameters> params = cv::aruco::DetectorParameters::create();
+
+	std::vector<int> markerIds;
+	std::vector<std::vector<cv::Point2f>> markerCorners;
+	cv::aruco::detectMarkers(a_image, m_dictionary, markerCorners, markerIds, params);
+	if (markerIds.empty())
+		return detection;
+
+	// boards, each takes the markers in its id range
+	for (auto& board : m_boards)
+	{
+		int lastId = board.firstId + (int)board.board->ids.size();
+
+		std::vector<int> boardIds;
+		std::vector<std::vector<cv::Point2f>> boardCorners;
+		for (size_t i = 0; i < markerIds.size(); ++i)
+		{
+			if (markerIds[i] >= board.firstId && markerIds[i] < lastId)
+			{
+				boardIds.push_back(markerIds[i]);
+				boardCorners.push_back(markerCorners[i]);
+			}
+		}
+		if (boardIds.empty())
+			continue;
+
+		std::vector<cv::Point2f> charucoCorners;
+		std::vector<int> charucoIds;
+		cv::aruco::interpolateCornersCharuco(boardCorners, boardIds, a_image, board.board, charucoCorners, charucoIds, a_cameraMatrix, a_distortion);
+		if (charucoIds.empty())
+			continue;
+
+		for (size_t i = 0; i < charucoIds.size(); ++i)
+		{
+			auto& local = board.board->chessboardCorners[charucoIds[i]];
+			detection.objectPoints.push_back(toPoint(board.pose * Eigen::Vector3f(local.x, local.y, local.z)));
+			detection.imagePoints.push_back(charucoCorners[i]);
+		}
+		++detection.boards;
+	}
+
+	// loose markers, corners in ArUco order: top-left, top-right, bottom-right, bottom-left
+	for (auto& marker : m_markers)
+	{
+		auto found = std::find(markerIds.begin(), markerIds.end(), marker.id);
+		if (found == markerIds.end())
+			continue;
+
+		float h = marker.size * 0.5f;
+		const Eigen::Vector3f local[4] = { { -h, h, 0 }, { h, h, 0 }, { h, -h, 0 }, { -h, -h, 0 } };
+
+		auto& corners = markerCorners[found - markerIds.begin()];
+		for (int i = 0; i < 4; ++i)
+		{
+			detection.objectPoints.push_back(toPoint(marker.pose * local[i]));
+			detection.imagePoints.push_back(corners[i]);
+		}
+		++detection.markers;
+	}
+
+	return detection;
+}
+
+bool CalibrationTargets::solvePose(const Detection& a_detection, const cv::Mat& a_cameraMatrix, const cv::Mat& a_distortion,
+								Eigen::Affine3f& a_cameraToCapture, float& a_rmsError) const
+{
+	if (a_detection.objectPoints.size() < 6)
+		return false;
+
+	cv::Mat rvec, tvec;
+	if (cv::solvePnP(a_detection.objectPoints, a_detection.imagePoints, a_cameraMatrix, a_distortion, rvec, tvec, false, cv::SOLVEPNP_SQPNP) == false)
+		return false;
+
+	// polish the closed form result
+	cv::solvePnPRefineLM(a_detection.objectPoints, a_detection.imagePoints, a_cameraMatrix, a_distortion, rvec, tvec);
+
+	std::vector<cv::Point2f> projected;
+	cv::projectPoints(a_detection.objectPoints, rvec, tvec, a_cameraMatrix, a_distortion, projected);
+	double sumSquared = 0;
+	for (size_t i = 0; i < projected.size(); ++i)
+	{
+		auto d = projected[i] - a_detection.imagePoints[i];
+		sumSquared += d.dot(d);
+	}
+	a_rmsError = (float)std::sqrt(sumSquared / projected.size());
+
+	// solvePnP gives capture -> camera, invert it
+	cv::Matx33d rotation;
+	cv::Rodrigues(rvec, rotation);
+
+	Eigen::Affine3f captureToCamera = Eigen::Affine3f::Identity();
+	for (int r = 0; r < 3; ++r)
+	{
+		for (int c = 0; c < 3; ++c)
+			captureToCamera.linear()(r, c) = (float)rotation(r, c);
+		captureToCamera.translation()[r] = (float)tvec.at<double>(r);
+	}
+
+	a_cameraToCapture = captureToCamera.inverse();
+	return true;
+}
+
+void CalibrationTargets::draw(Gizmos* a_gizmos) const
+{
+	Eigen::Vector4f boardColour(1, 1, 1, 1);
+	Eigen::Vector4f markerColour(1, 0.5f, 0, 1);
+
+	for (auto& board : m_boards)
+	{
+		auto size = board.board->getChessboardSize();
+		float w = size.width * board.board->getSquareLength();
+		float h = size.height * board.board->getSquareLength();
+
+		Eigen::Vector3f corners[4] = { board.pose * Eigen::Vector3f(0, 0, 0), board.pose * Eigen::Vector3f(w, 0, 0),
+									   board.pose * Eigen::Vector3f(w, h, 0), board.pose * Eigen::Vector3f(0, h, 0) };
+		for (int i = 0; i < 4; ++i)
+			a_gizmos->addLine(corners[i], corners[(i + 1) % 4], boardColour);
+	}
+
+	for (auto& marker : m_markers)
+	{
+		float h = marker.size * 0.5f;
+		Eigen::Vector3f corners[4] = { marker.pose * Eigen::Vector3f(-h, h, 0), marker.pose * Eigen::Vector3f(h, h, 0),
+									   marker.pose * Eigen::Vector3f(h, -h, 0), marker.pose * Eigen::Vector3f(-h, -h, 0) };
+		for (int i = 0; i < 4; ++i)
+			a_gizmos->addLine(corners[i], corners[(i + 1) % 4], markerColour);
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <opencv2/core.hpp>
+#include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
+
+class Gizmos;
+
+// Registry of ChArUco boards and loose ArUco markers with known poses in capture space.
+// Every target shares one dictionary, with each board owning its own range of marker ids,
+// so a single detectMarkers() pass per image finds all of them and their corners feed one
+// joint pose solve for the camera.
+class CalibrationTargets
+{
+public:
+
+	struct Board
+	{
+		cv::Ptr<cv::aruco::CharucoBoard>	board;
+		int									firstId = 0;
+		Eigen::Affine3f						pose = Eigen::Affine3f::Identity();
+	};
+
+	struct Marker
+	{
+		int				id = 0;
+		float			size = 0;	// meters, edge length
+		Eigen::Affine3f	pose = Eigen::Affine3f::Identity();
+	};
+
+	// corners of every target found in one image, paired with their capture space positions
+	struct Detection
+	{
+		std::vector<cv::Point3f>	objectPoints;
+		std::vector<cv::Point2f>	imagePoints;
+		unsigned int				boards = 0;
+		unsigned int				markers = 0;
+	};
+
+	CalibrationTargets(int a_dictionary);
+	~CalibrationTargets() = default;
+
+	// adds a board using the next unused marker ids
+	void			addBoard(int a_squaresX, int a_squaresY, float a_squareLength, float a_markerLength, const Eigen::Affine3f& a_pose);
+
+	// false if the id is already taken by a board or another marker
+	bool			addMarker(int a_id, float a_size, const Eigen::Affine3f& a_pose);
+
+	bool			load(const std::string& a_filename);
+	bool			save(const std::string& a_filename) const;
+
+	// writes printable images of every board and loose marker
+	void			exportImages(const std::string& a_directory) const;
+
+	const std::vector<Board>&	getBoards() const	{	return m_boards;	}
+	const std::vector<Marker>&	getMarkers() const	{	return m_markers;	}
+	cv::Ptr<cv::aruco::Dictionary>	getDictionary() const	{	return m_dictionary;	}
+
+	Detection		detect(const cv::Mat& a_image, const cv::Mat& a_cameraMatrix, const cv::Mat& a_distortion) const;
+
+	// solves the camera's pose in capture space from a detection, using OpenCV's camera axes
+	bool			solvePose(const Detection& a_detection, const cv::Mat& a_cameraMatrix, const cv::Mat& a_distortion,
+							Eigen::Affine3f& a_cameraToCapture, float& a_rmsError) const;
+
+	void			draw(Gizmos* a_gizmos) const;
+
+private:
+
+	// a board with its marker ids starting at a_firstId, false if any of them are taken
+	bool			insertBoard(int a_squaresX, int a_squaresY, float a_squareLength, float a_markerLength, int a_firstId,
+							const Eigen::Affine3f& a_pose);
+	bool			isIdUsed(int a_firstId, int a_count) const;
+
+	int				m_dictionaryId;
+	cv::Ptr<cv::aruco::Dictionary>	m_dictionary;
+	int				m_nextId = 0;
+
+	std::vector<Board>	m_boards;
+	std::vector<Marker>	m_markers;
+};
@@ -0,0 +1,316 @@
+#include "CaptureVolume.h"
+#include "Gizmos.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <numbers>
+#include <numeric>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define VOLUME_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// corners closer than this to the camera plane can project anywhere in the image
+	constexpr float NearPlane = 0.01f;
+
+	cv::Vec3f toVec(const Eigen::Vector3f& a_v)
+	{
+		return { a_v.x(), a_v.y(), a_v.z() };
+	}
+
+	Eigen::Vector3f toVector(const cv::FileNode& a_node, const Eigen::Vector3f& a_default)
+	{
+		cv::Vec3f v;
+		if (a_node.empty())
+			return a_default;
+		a_node >> v;
+		return { v[0], v[1], v[2] };
+	}
+}
+
+float CaptureVolume::Window::getCoverage() const
+{
+	if (!visible || width <= 0 || height <= 0)
+		return 0;
+	return float(x1 - x0) * float(y1 - y0) / (float(width) * float(height));
+}
+
+bool CaptureVolume::load(const std::string& a_filename)
+{
+	cv::FileStorage file(a_filename, cv::FileStorage::READ);
+	if (file.isOpened() == false)
+		return false;
+
+	m_center = toVector(file["center"], m_center);
+	setExtents(toVector(file["extents"], m_extents));
+	if (!file["yaw"].empty())
+		m_yaw = (float)file["yaw"];
+	return true;
+}
+
+bool CaptureVolume::save(const std::string& a_filename) const
+{
+	cv::FileStorage file(a_filename, cv::FileStorage::WRITE);
+	if (file.isOpened() == false)
+		return false;
+
+	file << "center" << toVec(m_center);
+	file << "extents" << toVec(m_extents);
+	file << "yaw" << m_yaw;
+	return true;
+}
+
+void CaptureVolume::setExtents(const Eigen::Vector3f& a_extents)
+{
+	m_extents = a_extents.cwiseMax(MinExtent);
+}
+
+Eigen::Affine3f CaptureVolume::getPose() const
+{
+	return Eigen::Translation3f(m_center) *
+		Eigen::AngleAxisf(m_yaw * std::numbers::pi_v<float> / 180, Eigen::Vector3f::UnitY());
+}
+
+CaptureVolume::Window CaptureVolume::computeWindow(int a_width, int a_height, float a_fx, float a_fy, float a_cx, float a_cy,
+												float a_depthUnits, const Eigen::Matrix4f& a_cameraToCapture) const
+{
+	Window window;
+	window.width = a_width;
+	window.height = a_height;
+	window.depthUnits = a_depthUnits;
+	window.extents = m_extents;
+
+	Eigen::Affine3f cameraToCapture(a_cameraToCapture);
+	Eigen::Affine3f cameraToBox = getPose().inverse() * cameraToCapture;
+	Eigen::Affine3f boxToCamera = cameraToBox.inverse();
+
+	// the box's depth range and image footprint are both bounded by its corners
+	float zMin = std::numeric_limits<float>::max();
+	float zMax = 0;
+	float uMin = std::numeric_limits<float>::max(), uMax = -uMin;
+	float vMin = uMin, vMax = -uMin;
+	bool behind = false;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		Eigen::Vector3f corner((i & 1) ? m_extents.x() : -m_extents.x(),
+							   (i & 2) ? m_extents.y() : -m_extents.y(),
+							   (i & 4) ? m_extents.z() : -m_extents.z());
+		Eigen::Vector3f p = boxToCamera * corner;
+
+		zMin = std::min(zMin, p.z());
+		zMax = std::max(zMax, p.z());
+		if (p.z() <= NearPlane)
+		{
+			behind = true;
+			continue;
+		}
+
+		float u = p.x() / p.z() * a_fx + a_cx;
+		float v = p.y() / p.z() * a_fy + a_cy;
+		uMin = std::min(uMin, u);
+		uMax = std::max(uMax, u);
+		vMin = std::min(vMin, v);
+		vMax = std::max(vMax, v);
+	}
+
+	if (zMax <= NearPlane)
+		return window;
+
+	if (behind)
+	{
+		window.x0 = 0;
+		window.y0 = 0;
+		window.x1 = a_width;
+		window.y1 = a_height;
+	}
+	else
+	{
+		window.x0 = std::clamp((int)std::floor(uMin), 0, a_width);
+		window.y0 = std::clamp((int)std::floor(vMin), 0, a_height);
+		window.x1 = std::clamp((int)std::ceil(uMax) + 1, 0, a_width);
+		window.y1 = std::clamp((int)std::ceil(vMax) + 1, 0, a_height);
+	}
+	if (window.x0 >= window.x1 || window.y0 >= window.y1)
+		return window;
+
+	window.depthMin = (uint16_t)std::clamp(std::floor(std::max(zMin, 0.0f) / a_depthUnits), 1.0f, 65535.0f);
+	window.depthMax = (uint16_t)std::clamp(std::ceil(zMax / a_depthUnits), 1.0f, 65535.0f);
+
+	Eigen::Matrix3f linear = cameraToBox.linear();
+	window.du = linear.col(0) / a_fx;
+	window.dv = linear.col(1) / a_fy;
+	window.ray = linear.col(2) - a_cx * window.du - a_cy * window.dv;
+	window.origin = cameraToBox.translation();
+
+	window.visible = true;
+	return window;
+}
+
+void CaptureVolume::crop(const Window& a_window, const uint16_t* a_in, uint16_t* a_out)
+{
+	int width = a_window.width;
+	size_t count = (size_t)width * a_window.height;
+	if (!a_window.visible)
+	{
+		std::memset(a_out, 0, count * sizeof(uint16_t));
+		return;
+	}
+
+	std::vector<int> rows(a_window.height);
+	std::iota(rows.begin(), rows.end(), 0);
+	std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int a_row) {
+		const uint16_t* in = a_in + (size_t)a_row * width;
+		uint16_t* out = a_out + (size_t)a_row * width;
+
+		if (a_row < a_window.y0 || a_row >= a_window.y1)
+		{
+			std::memset(out, 0, width * sizeof(uint16_t));
+			return;
+		}
+		std::memset(out, 0, a_window.x0 * sizeof(uint16_t));
+		std::memset(out + a_window.x1, 0, (width - a_window.x1) * sizeof(uint16_t));
+
+		// ray direction in box space, per meter of depth, at the start of the window
+		Eigen::Vector3f base = a_window.ray + a_row * a_window.dv + a_window.x0 * a_window.du;
+		const Eigen::Vector3f& du = a_window.du;
+		const Eigen::Vector3f& origin = a_window.origin;
+		const Eigen::Vector3f& extents = a_window.extents;
+		float units = a_window.depthUnits;
+
+		int x = a_window.x0;
+#ifdef VOLUME_SIMD
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 steps = _mm_setr_ps(0, 1, 2, 3);
+		const __m128i zero = _mm_setzero_si128();
+
+		// 8 pixels per step, as two sets of 4 floats
+		auto inside = [&](__m128i a_raw, float a_offset) {
+			__m128 z = _mm_mul_ps(_mm_cvtepi32_ps(a_raw), _mm_set1_ps(units));
+			__m128 u = _mm_add_ps(_mm_set1_ps(a_offset), steps);
+			__m128 result = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				__m128 d = _mm_add_ps(_mm_set1_ps(base[axis]), _mm_mul_ps(u, _mm_set1_ps(du[axis])));
+				__m128 p = _mm_add_ps(_mm_mul_ps(z, d), _mm_set1_ps(origin[axis]));
+				result = _mm_and_ps(result, _mm_cmple_ps(_mm_andnot_ps(sign, p), _mm_set1_ps(extents[axis])));
+			}
+			return _mm_castps_si128(result);
+		};
+
+		for (; x + 8 <= a_window.x1; x += 8)
+		{
+			__m128i raw = _mm_loadu_si128((const __m128i*)(in + x));
+			float offset = float(x - a_window.x0);
+			__m128i lo = inside(_mm_unpacklo_epi16(raw, zero), offset);
+			__m128i hi = inside(_mm_unpackhi_epi16(raw, zero), offset + 4);
+			_mm_storeu_si128((__m128i*)(out + x), _mm_and_si128(raw, _mm_packs_epi32(lo, hi)));
+		}
+#endif
+		for (; x < a_window.x1; ++x)
+		{
+			uint16_t raw = in[x];
+			out[x] = 0;
+			if (raw < a_window.depthMin || raw > a_window.depthMax)
+				continue;
+
+			Eigen::Vector3f p = raw * units * (base + float(x - a_window.x0) * du) + origin;
+			if (std::abs(p.x()) <= extents.x() &&
+				std::abs(p.y()) <= extents.y() &&
+				std::abs(p.z()) <= extents.z())
+				out[x] = raw;
+		}
+	});
+}
+
+Eigen::Vector3f CaptureVolume::getFaceAxis(int a_face) const
+{
+	Eigen::Vector3f axis = Eigen::Vector3f::Unit(a_face / 2) * ((a_face & 1) ? -1.0f : 1.0f);
+	return getPose().linear() * axis;
+}
+
+Eigen::Vector3f CaptureVolume::getHandle(int a_face) const
+{
+	return m_center + getFaceAxis(a_face) * m_extents[a_face / 2];
+}
+
+bool CaptureVolume::drag(const Eigen::Matrix4f& a_viewProjection, const Eigen::Vector2f& a_mouse, bool a_pressed)
+{
+	bool newPress = a_pressed && !m_wasPressed;
+	m_wasPressed = a_pressed;
+
+	if (!a_pressed)
+	{
+		m_dragFace = -1;
+		return false;
+	}
+
+	// the handle nearest the mouse on screen, if any is close enough
+	if (newPress)
+	{
+		float best = PickRadius;
+		for (int face = 0; face < 6; ++face)
+		{
+			Eigen::Vector4f clip = a_viewProjection * getHandle(face).homogeneous();
+			if (clip.w() <= 0) continue;
+
+			float distance = (clip.head<2>() / clip.w() - a_mouse).norm();
+			if (distance < best)
+			{
+				best = distance;
+				m_dragFace = face;
+			}
+		}
+	}
+	if (m_dragFace < 0)
+		return false;
+
+	// the point on the face's axis closest to the mouse ray
+	Eigen::Matrix4f inverse = a_viewProjection.inverse();
+	Eigen::Vector4f nearPoint = inverse * Eigen::Vector4f(a_mouse.x(), a_mouse.y(), -1, 1);
+	Eigen::Vector4f farPoint = inverse * Eigen::Vector4f(a_mouse.x(), a_mouse.y(), 1, 1);
+	Eigen::Vector3f rayOrigin = nearPoint.head<3>() / nearPoint.w();
+	Eigen::Vector3f rayDirection = (farPoint.head<3>() / farPoint.w() - rayOrigin).normalized();
+
+	Eigen::Vector3f axis = getFaceAxis(m_dragFace);
+	Eigen::Vector3f w0 = m_center - rayOrigin;
+	float b = axis.dot(rayDirection);
+	float d = axis.dot(w0);
+	float e = rayDirection.dot(w0);
+	float denominator = 1 - b * b;
+	if (denominator < 1e-6f)
+		return true;
+	float t = (b * e - d) / denominator;
+
+	// the opposite face stays where it is
+	int index = m_dragFace / 2;
+	float extent = m_extents[index];
+	float newExtent = std::max((t + extent) * 0.5f, MinExtent);
+	m_center += axis * (newExtent - extent);
+	m_extents[index] = newExtent;
+	return true;
+}
+
+void CaptureVolume::draw(Gizmos* a_gizmos, bool a_handles) const
+{
+	Eigen::Vector4f colour(0, 0.8f, 1, 1);
+	Eigen::Vector4f dragColour(1, 0.8f, 0, 1);
+
+	Eigen::Matrix4f rotation = Eigen::Matrix4f::Identity();
+	rotation.topLeftCorner<3, 3>() = getPose().linear();
+	a_gizmos->addAABB(m_center, m_extents, colour, &rotation);
+
+	if (!a_handles)
+		return;
+
+	for (int face = 0; face < 6; ++face)
+		a_gizmos->addSphere(getHandle(face), 0.03f, 8, 8, face == m_dragFace ? dragColour : colour);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+class Gizmos;
+
+// The region of capture space worth capturing: a box turned about the vertical axis.
+// For each camera it works out the window of the depth image and the depth range that can
+// possibly land inside, once per frame, so the per-pixel crop only deprojects pixels in that
+// window and everything outside is cleared with row and span fills. Pixels left are tested
+// against the box exactly. The box is edited in the viewport by dragging its face handles.
+class CaptureVolume
+{
+public:
+
+	// what of one camera's depth image can land inside the volume
+	struct Window
+	{
+		bool			visible = false;
+		int				width = 0, height = 0;	// of the whole image
+		int				x0 = 0, y0 = 0;			// inclusive
+		int				x1 = 0, y1 = 0;			// exclusive
+		uint16_t		depthMin = 0;			// raw depth units, inclusive
+		uint16_t		depthMax = 0;
+		float			depthUnits = 0.001f;
+
+		// box space position of pixel (u, v) at depth z is z * (u * du + v * dv + ray) + origin
+		Eigen::Vector3f	du = Eigen::Vector3f::Zero();
+		Eigen::Vector3f	dv = Eigen::Vector3f::Zero();
+		Eigen::Vector3f	ray = Eigen::Vector3f::Zero();
+		Eigen::Vector3f	origin = Eigen::Vector3f::Zero();
+		Eigen::Vector3f	extents = Eigen::Vector3f::Zero();
+
+		float			getCoverage() const;	// fraction of the image inside the window
+	};
+
+	CaptureVolume() = default;
+	~CaptureVolume() = default;
+
+	bool			load(const std::string& a_filename);
+	bool			save(const std::string& a_filename) const;
+
+	const Eigen::Vector3f&	getCenter() const	{	return m_center;	}
+	const Eigen::Vector3f&	getExtents() const	{	return m_extents;	}	// half sizes
+	float			getYaw() const				{	return m_yaw;		}	// degrees about +y
+
+	void			setCenter(const Eigen::Vector3f& a_center)		{	m_center = a_center;	}
+	void			setExtents(const Eigen::Vector3f& a_extents);
+	void			setYaw(float a_yaw)								{	m_yaw = a_yaw;			}
+
+	Eigen::Affine3f	getPose() const;	// box to capture space
+
+	// a_cameraToCapture maps camera space, with axes as librealsense deprojects them
+	Window			computeWindow(int a_width, int a_height, float a_fx, float a_fy, float a_cx, float a_cy,
+								float a_depthUnits, const Eigen::Matrix4f& a_cameraToCapture) const;
+
+	// copies a_in to a_out with every pixel outside the volume zeroed
+	static void		crop(const Window& a_window, const uint16_t* a_in, uint16_t* a_out);
+
+	// a_mouse in normalized device coordinates. Picks a face handle on press and moves that
+	// face while held, keeping the opposite face in place. Returns true while dragging.
+	bool			drag(const Eigen::Matrix4f& a_viewProjection, const Eigen::Vector2f& a_mouse, bool a_pressed);
+	bool			isDragging() const			{	return m_dragFace >= 0;	}
+
+	void			draw(Gizmos* a_gizmos, bool a_handles) const;
+
+private:
+
+	static constexpr float	MinExtent = 0.05f;
+	static constexpr float	PickRadius = 0.03f;		// normalized device units
+
+	Eigen::Vector3f	getFaceAxis(int a_face) const;	// capture space, outward
+	Eigen::Vector3f	getHandle(int a_face) const;
+
+	Eigen::Vector3f	m_center = Eigen::Vector3f(0, 1, 0);
+	Eigen::Vector3f	m_extents = Eigen::Vector3f(1, 1, 1);
+	float			m_yaw = 0;
+
+	int				m_dragFace = -1;
+	bool			m_wasPressed = false;
+};
@@ -0,0 +1,228 @@
+#include "ColourCodec.h"
+#include <chrono>
+#include <cstring>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace
+{
+	// QOI as specified at qoiformat.org, so the frames open in anything that reads it
+	constexpr uint8_t	QoiIndex = 0x00;
+	constexpr uint8_t	QoiDiff = 0x40;
+	constexpr uint8_t	QoiLuma = 0x80;
+	constexpr uint8_t	QoiRun = 0xC0;
+	constexpr uint8_t	QoiRgb = 0xFE;
+	constexpr uint8_t	QoiRgba = 0xFF;
+	constexpr uint8_t	QoiMask = 0xC0;
+	constexpr int		QoiMaxRun = 62;
+	constexpr size_t	QoiHeaderSize = 14;
+	constexpr uint8_t	QoiEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+	struct Pixel
+	{
+		uint8_t		r, g, b, a;
+
+		bool operator==(const Pixel&) const = default;
+	};
+
+	inline int qoiHash(const Pixel& a_pixel)
+	{
+		return (a_pixel.r * 3 + a_pixel.g * 5 + a_pixel.b * 7 + a_pixel.a * 11) & 63;
+	}
+
+	inline void writeBigEndian(uint8_t* a_out, uint32_t a_value)
+	{
+		a_out[0] = uint8_t(a_value >> 24);
+		a_out[1] = uint8_t(a_value >> 16);
+		a_out[2] = uint8_t(a_value >> 8);
+		a_out[3] = uint8_t(a_value);
+	}
+
+	inline uint32_t readBigEndian(const uint8_t* a_in)
+	{
+		return uint32_t(a_in[0]) << 24 | uint32_t(a_in[1]) << 16 | uint32_t(a_in[2]) << 8 | a_in[3];
+	}
+}
+
+bool ColourCodec::encode(const uint8_t* a_rgb, int a_width, int a_height, std::vector<uint8_t>& a_out)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	bool ok = true;
+	if (m_settings.type == Type::Qoi)
+		encodeQoi(a_rgb, a_width, a_height, a_out);
+	else
+	{
+		cv::Mat rgb(a_height, a_width, CV_8UC3, const_cast<uint8_t*>(a_rgb));
+		cv::cvtColor(rgb, m_bgr, cv::COLOR_RGB2BGR);
+		ok = cv::imencode(".jpg", m_bgr, a_out, { cv::IMWRITE_JPEG_QUALITY, m_settings.quality });
+	}
+
+	m_lastEncodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+bool ColourCodec::decode(Type a_type, const uint8_t* a_in, size_t a_size, uint8_t* a_rgb, int a_width, int a_height)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	bool ok = false;
+	if (a_type == Type::Qoi)
+		ok = decodeQoi(a_in, a_size, a_rgb, a_width, a_height);
+	else
+	{
+		cv::imdecode(cv::Mat(1, (int)a_size, CV_8U, const_cast<uint8_t*>(a_in)), cv::IMREAD_COLOR, &m_bgr);
+		if (m_bgr.cols == a_width && m_bgr.rows == a_height && m_bgr.type() == CV_8UC3)
+		{
+			cv::Mat rgb(a_height, a_width, CV_8UC3, a_rgb);
+			cv::cvtColor(m_bgr, rgb, cv::COLOR_BGR2RGB);
+			ok = true;
+		}
+	}
+
+	m_lastDecodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+void ColourCodec::encodeQoi(const uint8_t* a_rgb, int a_width, int a_height, std::vector<uint8_t>& a_out) const
+{
+	// worst case every pixel is a full QoiRgb
+	size_t pixels = (size_t)a_width * a_height;
+	a_out.resize(QoiHeaderSize + pixels * 4 + sizeof(QoiEnd));
+	uint8_t* out = a_out.data();
+
+	memcpy(out, "qoif", 4);
+	writeBigEndian(out + 4, (uint32_t)a_width);
+	writeBigEndian(out + 8, (uint32_t)a_height);
+	out[12] = 3;	// channels
+	out[13] = 0;	// sRGB
+	out += QoiHeaderSize;
+
+	Pixel index[64] = {};
+	Pixel previous{ 0, 0, 0, 255 };
+	int run = 0;
+
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		Pixel pixel{ a_rgb[i * 3], a_rgb[i * 3 + 1], a_rgb[i * 3 + 2], 255 };
+		if (pixel == previous)
+		{
+			if (++run == QoiMaxRun)
+			{
+				*out++ = uint8_t(QoiRun | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			*out++ = uint8_t(QoiRun | (run - 1));
+			run = 0;
+		}
+
+		int hash = qoiHash(pixel);
+		if (index[hash] == pixel)
+			*out++ = uint8_t(QoiIndex | hash);
+		else
+		{
+			index[hash] = pixel;
+
+			int8_t dr = int8_t(pixel.r - previous.r);
+			int8_t dg = int8_t(pixel.g - previous.g);
+			int8_t db = int8_t(pixel.b - previous.b);
+			int8_t drg = int8_t(dr - dg);
+			int8_t dbg = int8_t(db - dg);
+
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				*out++ = uint8_t(QoiDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+			else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+			{
+				*out++ = uint8_t(QoiLuma | (dg + 32));
+				*out++ = uint8_t((drg + 8) << 4 | (dbg + 8));
+			}
+			else
+			{
+				*out++ = QoiRgb;
+				*out++ = pixel.r;
+				*out++ = pixel.g;
+				*out++ = pixel.b;
+			}
+		}
+		previous = pixel;
+	}
+	if (run > 0)
+		*out++ = uint8_t(QoiRun | (run - 1));
+
+	memcpy(out, QoiEnd, sizeof(QoiEnd));
+	out += sizeof(QoiEnd);
+	a_out.resize(out - a_out.data());
+}
+
+bool ColourCodec::decodeQoi(const uint8_t* a_in, size_t a_size, uint8_t* a_rgb, int a_width, int a_height) const
+{
+	if (a_size < QoiHeaderSize + sizeof(QoiEnd) ||
+		memcmp(a_in, "qoif", 4) != 0 ||
+		readBigEndian(a_in + 4) != (uint32_t)a_width ||
+		readBigEndian(a_in + 8) != (uint32_t)a_height)
+		return false;
+
+	const uint8_t* in = a_in + QoiHeaderSize;
+	const uint8_t* end = a_in + a_size - sizeof(QoiEnd);
+
+	Pixel index[64] = {};
+	Pixel pixel{ 0, 0, 0, 255 };
+	int run = 0;
+
+	size_t pixels = (size_t)a_width * a_height;
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		if (run > 0)
+			--run;
+		else
+		{
+			// the longest op is 5 bytes, the end marker keeps a truncated stream from reading past a_size
+			if (in >= end)
+				return false;
+
+			uint8_t op = *in++;
+			if (op == QoiRgb)
+			{
+				pixel.r = in[0];
+				pixel.g = in[1];
+				pixel.b = in[2];
+				in += 3;
+			}
+			else if (op == QoiRgba)
+			{
+				pixel = { in[0], in[1], in[2], in[3] };
+				in += 4;
+			}
+			else if ((op & QoiMask) == QoiIndex)
+				pixel = index[op];
+			else if ((op & QoiMask) == QoiDiff)
+			{
+				pixel.r += ((op >> 4) & 3) - 2;
+				pixel.g += ((op >> 2) & 3) - 2;
+				pixel.b += (op & 3) - 2;
+			}
+			else if ((op & QoiMask) == QoiLuma)
+			{
+				int dg = (op & 63) - 32;
+				uint8_t next = *in++;
+				pixel.r += dg - 8 + (next >> 4);
+				pixel.g += dg;
+				pixel.b += dg - 8 + (next & 15);
+			}
+			else
+				run = op & 63;
+
+			index[qoiHash(pixel)] = pixel;
+		}
+
+		a_rgb[i * 3] = pixel.r;
+		a_rgb[i * 3 + 1] = pixel.g;
+		a_rgb[i * 3 + 2] = pixel.b;
+	}
+	return true;
+}
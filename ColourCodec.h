@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Compression of 8 bit, 3 channel colour frames for recording.
+// Jpeg goes through OpenCV's encoder (libjpeg-turbo), lossy, with the quality as the knob
+// trading size against encode time. Qoi is lossless, a single pass of run, index and small
+// difference codes that runs several times faster than Jpeg but only halves the size of
+// camera images. Pixels are RGB in and out; the Jpeg stream holds them as a viewer expects.
+// Not thread safe, keep one per encoding thread.
+class ColourCodec
+{
+public:
+
+	enum class Type
+	{
+		Jpeg,
+		Qoi,
+	};
+
+	struct Settings
+	{
+		Type	type = Type::Jpeg;
+		int		quality = 90;		// Jpeg, 1..100
+	};
+
+	ColourCodec() = default;
+	~ColourCodec() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// a_out is resized to the encoded size, false if the encoder failed
+	bool			encode(const uint8_t* a_rgb, int a_width, int a_height, std::vector<uint8_t>& a_out);
+
+	// false if a_in isn't an a_width x a_height a_type frame
+	bool			decode(Type a_type, const uint8_t* a_in, size_t a_size, uint8_t* a_rgb, int a_width, int a_height);
+
+	float			getLastEncodeMs() const	{	return m_lastEncodeMs;	}
+	float			getLastDecodeMs() const	{	return m_lastDecodeMs;	}
+
+private:
+
+	void			encodeQoi(const uint8_t* a_rgb, int a_width, int a_height, std::vector<uint8_t>& a_out) const;
+	bool			decodeQoi(const uint8_t* a_in, size_t a_size, uint8_t* a_rgb, int a_width, int a_height) const;
+
+	Settings		m_settings;
+	cv::Mat			m_bgr;				// OpenCV's channel order, reused between frames
+
+	float			m_lastEncodeMs = 0;
+	float			m_lastDecodeMs = 0;
+};
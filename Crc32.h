@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, reflected 0xEDB88320) used to checksum the binary files we write.
+// Pass the previous result as a_crc to checksum data in several pieces.
+namespace Crc32
+{
+	constexpr std::array<uint32_t, 256> makeTable()
+	{
+		std::array<uint32_t, 256> table{};
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+			table[i] = c;
+		}
+		return table;
+	}
+
+	inline constexpr std::array<uint32_t, 256> sm_table = makeTable();
+
+	inline uint32_t compute(const void* a_data, size_t a_size, uint32_t a_crc = 0)
+	{
+		auto bytes = static_cast<const uint8_t*>(a_data);
+		uint32_t c = ~a_crc;
+		for (size_t i = 0; i < a_size; ++i)
+			c = sm_table[(c ^ bytes[i]) & 0xFF] ^ (c >> 8);
+		return ~c;
+	}
+}
@@ -0,0 +1,737 @@
+#include "DepthCodec.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CODEC_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#define CODEC_SHUFFLE 1
+#endif
+
+namespace
+{
+	constexpr uint32_t	Magic = 0x36315A44;			// 'DZ16'
+
+	// alphabet: zigzagged residuals, an escape to a raw residual, then zero runs
+	constexpr uint32_t	EscapeSymbol = 238;			// residuals 0..237 code directly, |r| <= 118
+	constexpr uint32_t	RunSymbol = 239;			// runs of 1..MaxShortRun zeros
+	constexpr uint32_t	MaxShortRun = 16;
+	constexpr uint32_t	LongRunSymbol = RunSymbol + MaxShortRun;	// MaxShortRun + 1 + raw value zeros
+	static_assert(LongRunSymbol == 255);
+
+	// rANS with 16 bit renormalisation; states stay below 2^31 so the encoder's reciprocals are exact
+	constexpr uint32_t	ProbBits = 12;
+	constexpr uint32_t	ProbScale = 1 << ProbBits;
+	constexpr uint32_t	StateLow = 1 << 15;
+	constexpr int		Lanes = 8;
+	constexpr size_t	DecodeBlock = 256;			// symbols between bounds checks
+
+	struct StreamHeader
+	{
+		uint32_t	magic = Magic;
+		uint16_t	width = 0;
+		uint16_t	height = 0;
+		uint16_t	bandRows = 0;
+		uint16_t	bandCount = 0;
+		uint16_t	frequencies[256] = {};
+	};
+
+	struct BandHeader
+	{
+		uint32_t	symbolCount = 0;
+		uint32_t	wordCount = 0;
+		uint32_t	rawCount = 0;
+	};
+
+	inline uint16_t zigzag(uint16_t a_residual)
+	{
+		return uint16_t((a_residual << 1) ^ uint16_t(int16_t(a_residual) >> 15));
+	}
+
+	inline uint16_t unzigzag(uint16_t a_value)
+	{
+		return uint16_t((a_value >> 1) ^ uint16_t(0 - (a_value & 1)));
+	}
+
+	// one rANS step of a lane, the state moves to the next symbol and refills from a_in when low
+	inline uint8_t decodeSymbol(const uint32_t* a_table, const uint16_t*& a_in, uint32_t& a_state)
+	{
+		uint32_t entry = a_table[a_state & (ProbScale - 1)];
+		a_state = ((entry >> 8) & (ProbScale - 1)) * (a_state >> ProbBits) + (entry >> 20);
+		// branch free, whether a lane refills is down to the data and mispredicts too often
+		uint32_t renormalise = a_state < StateLow;
+		a_state = (a_state << (renormalise * 16)) | (*a_in & (0u - renormalise));
+		a_in += renormalise;
+		return (uint8_t)entry;
+	}
+
+#ifdef CODEC_SHUFFLE
+	// for each mask of 4 lanes that refill, the shuffle that hands them the next words in lane
+	// order, zero extended, and how many words that takes
+	struct RefillShuffles
+	{
+		alignas(16) uint8_t	shuffles[16][16];
+		uint8_t				counts[16];
+
+		constexpr RefillShuffles() : shuffles(), counts()
+		{
+			for (int mask = 0; mask < 16; ++mask)
+			{
+				int word = 0;
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					bool refill = (mask >> lane) & 1;
+					shuffles[mask][lane * 4] = refill ? uint8_t(word * 2) : 0x80;
+					shuffles[mask][lane * 4 + 1] = refill ? uint8_t(word * 2 + 1) : 0x80;
+					shuffles[mask][lane * 4 + 2] = 0x80;
+					shuffles[mask][lane * 4 + 3] = 0x80;
+					word += refill;
+				}
+				counts[mask] = uint8_t(word);
+			}
+		}
+	};
+	constexpr RefillShuffles Refill;
+
+	// decodeSymbol() for 4 lanes at once, the table lookups are the only scalar part
+	inline __m128i decodeSymbols(const uint32_t* a_table, const uint16_t*& a_in, __m128i& a_states)
+	{
+		alignas(16) uint32_t slots[4];
+		_mm_store_si128((__m128i*)slots, _mm_and_si128(a_states, _mm_set1_epi32(ProbScale - 1)));
+		__m128i entries = _mm_setr_epi32(a_table[slots[0]], a_table[slots[1]], a_table[slots[2]], a_table[slots[3]]);
+
+		// frequency * (state >> ProbBits) + bias, multiplied as even and odd lanes
+		__m128i frequencies = _mm_and_si128(_mm_srli_epi32(entries, 8), _mm_set1_epi32(ProbScale - 1));
+		__m128i quotients = _mm_srli_epi32(a_states, ProbBits);
+		__m128i even = _mm_mul_epu32(frequencies, quotients);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(frequencies, 32), _mm_srli_epi64(quotients, 32));
+		__m128i states = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08), _mm_shuffle_epi32(odd, 0x08));
+		states = _mm_add_epi32(states, _mm_srli_epi32(entries, 20));
+
+		// states stay below 2^31, so the signed compare is safe
+		__m128i refill = _mm_cmplt_epi32(states, _mm_set1_epi32(StateLow));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(refill));
+		__m128i words = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)a_in), _mm_load_si128((const __m128i*)Refill.shuffles[mask]));
+		states = _mm_or_si128(_mm_or_si128(_mm_and_si128(refill, _mm_slli_epi32(states, 16)), _mm_andnot_si128(refill, states)), words);
+		a_in += Refill.counts[mask];
+
+		a_states = states;
+		return _mm_and_si128(entries, _mm_set1_epi32(0xFF));
+	}
+#endif
+
+	// a band's lanes, stepped a symbol per lane at a time. The words are copied with a block's
+	// worth of padding so a corrupt band is caught before reading out of bounds.
+	class LaneDecoder
+	{
+	public:
+
+		void start(const uint8_t* a_words, size_t a_wordCount, size_t a_symbolCount)
+		{
+			m_words.assign(a_wordCount + DecodeBlock + 8, 0);
+			memcpy(m_words.data(), a_words, a_wordCount * sizeof(uint16_t));
+			m_end = m_words.data() + a_wordCount;
+			m_in = m_words.data();
+
+			uint32_t states[Lanes];
+			for (int lane = 0; lane < Lanes; ++lane)
+				states[lane] = m_in[lane * 2] | (uint32_t(m_in[lane * 2 + 1]) << 16);
+			m_in += Lanes * 2;
+#ifdef CODEC_SHUFFLE
+			m_low = _mm_loadu_si128((const __m128i*)states);
+			m_high = _mm_loadu_si128((const __m128i*)(states + 4));
+#else
+			std::copy(states, states + Lanes, m_states);
+#endif
+
+			m_symbols.resize(a_symbolCount + 16);
+			m_count = a_symbolCount;
+			m_next = 0;
+		}
+
+		size_t			getNext() const		{	return m_next;	}
+		bool			isOverrun() const	{	return m_in > m_end;	}
+		const uint8_t*	getSymbols() const	{	return m_symbols.data();	}
+
+		void step(const uint32_t* a_table)
+		{
+			uint8_t* symbol = m_symbols.data() + m_next;
+#ifdef CODEC_SHUFFLE
+			// lanes 0-3 refill before 4-7, the order the scalar steps read the words in
+			__m128i first = decodeSymbols(a_table, m_in, m_low);
+			__m128i second = decodeSymbols(a_table, m_in, m_high);
+			__m128i packed = _mm_packs_epi32(first, second);
+			_mm_storel_epi64((__m128i*)symbol, _mm_packus_epi16(packed, packed));
+#else
+			for (int lane = 0; lane < Lanes; ++lane)
+				symbol[lane] = decodeSymbol(a_table, m_in, m_states[lane]);
+#endif
+			m_next += Lanes;
+		}
+
+		// the rest of the band on its own, false if it was corrupt
+		bool finish(const uint32_t* a_table)
+		{
+			size_t steps = m_count & ~size_t(Lanes - 1);
+			while (m_next < steps)
+			{
+				size_t blockEnd = std::min(steps, m_next + DecodeBlock);
+				while (m_next < blockEnd)
+					step(a_table);
+				if (isOverrun())
+					return false;
+			}
+
+			// the last few symbols, lanes in order
+#ifdef CODEC_SHUFFLE
+			uint32_t states[Lanes];
+			_mm_storeu_si128((__m128i*)states, m_low);
+			_mm_storeu_si128((__m128i*)(states + 4), m_high);
+#else
+			uint32_t* states = m_states;
+#endif
+			for (int lane = 0; m_next < m_count; ++m_next, ++lane)
+				m_symbols[m_next] = decodeSymbol(a_table, m_in, states[lane]);
+			return !isOverrun();
+		}
+
+	private:
+
+		std::vector<uint16_t>	m_words;
+		const uint16_t*			m_in = nullptr;
+		const uint16_t*			m_end = nullptr;
+#ifdef CODEC_SHUFFLE
+		__m128i					m_low, m_high;
+#else
+		uint32_t				m_states[Lanes];
+#endif
+		std::vector<uint8_t>	m_symbols;
+		size_t					m_count = 0;
+		size_t					m_next = 0;
+	};
+
+	template<class Function>
+	void forEachBand(bool a_parallel, int a_count, Function a_function)
+	{
+		std::vector<int> bands(a_count);
+		std::iota(bands.begin(), bands.end(), 0);
+		if (a_parallel)
+			std::for_each(std::execution::par, bands.begin(), bands.end(), a_function);
+		else
+			std::for_each(bands.begin(), bands.end(), a_function);
+	}
+
+	// scales counts to sum to ProbScale, every symbol that occurs keeps at least 1
+	void normalize(const uint32_t* a_counts, uint16_t* a_frequencies)
+	{
+		uint64_t total = 0;
+		int used = 0;
+		for (int s = 0; s < 256; ++s)
+		{
+			total += a_counts[s];
+			used += a_counts[s] > 0;
+		}
+
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; ++s)
+		{
+			a_frequencies[s] = a_counts[s] ? (uint16_t)std::max<uint64_t>(1, a_counts[s] * ProbScale / total) : 0;
+			sum += a_frequencies[s];
+		}
+
+		// a symbol can't have the whole range, the encoder's bounds need freq < ProbScale
+		if (used < 2)
+		{
+			int only = int(std::max_element(a_frequencies, a_frequencies + 256) - a_frequencies);
+			a_frequencies[only] = ProbScale - 1;
+			a_frequencies[only == 0 ? 1 : 0] = 1;
+			return;
+		}
+
+		// rounding error goes to or comes from the most frequent symbols
+		while (sum != ProbScale)
+		{
+			int largest = int(std::max_element(a_frequencies, a_frequencies + 256) - a_frequencies);
+			if (sum < ProbScale)
+			{
+				a_frequencies[largest] += uint16_t(ProbScale - sum);
+				sum = ProbScale;
+			}
+			else
+			{
+				uint32_t take = std::min<uint32_t>(sum - ProbScale, a_frequencies[largest] - 1u);
+				a_frequencies[largest] -= uint16_t(take);
+				sum -= take;
+			}
+		}
+	}
+}
+
+size_t DepthCodec::getMaxEncodedSize(int a_width, int a_height)
+{
+	// a pixel is at most one escape, 12 bits of symbol and 16 of raw value
+	size_t bands = (size_t)a_height + 1;
+	return sizeof(StreamHeader) + bands * (sizeof(BandHeader) + (Lanes * 2 + 2) * sizeof(uint16_t)) +
+		(size_t)a_width * a_height * 4;
+}
+
+void DepthCodec::modelBand(Band& a_band, const uint16_t* a_depth, int a_width, int a_rows)
+{
+	size_t pixels = (size_t)a_width * a_rows;
+	a_band.symbols.resize(pixels + 8);
+	a_band.raw.resize(pixels);
+	std::fill(std::begin(a_band.histogram), std::end(a_band.histogram), 0);
+
+	uint8_t* symbols = a_band.symbols.data();
+	uint16_t* raw = a_band.raw.data();
+	uint32_t* histogram = a_band.histogram;
+	size_t symbolCount = 0;
+	size_t rawCount = 0;
+
+	auto emit = [&](uint32_t a_symbol) {
+		symbols[symbolCount++] = (uint8_t)a_symbol;
+		++histogram[a_symbol];
+	};
+	auto emitRun = [&](uint32_t a_length) {
+		while (a_length > 0)
+		{
+			if (a_length <= MaxShortRun)
+			{
+				emit(RunSymbol + a_length - 1);
+				return;
+			}
+			uint32_t extra = std::min<uint32_t>(a_length - MaxShortRun - 1, 0xFFFF);
+			emit(LongRunSymbol);
+			raw[rawCount++] = (uint16_t)extra;
+			a_length -= MaxShortRun + 1 + extra;
+		}
+	};
+
+	// the filled row: invalid pixels continue the row-to-row delta of the last valid one,
+	// the band's first row is predicted from zero
+	std::vector<uint16_t> up(a_width, 0);
+	std::vector<uint16_t> filled(a_width);
+	uint32_t run = 0;
+
+	for (int row = 0; row < a_rows; ++row)
+	{
+		const uint16_t* in = a_depth + (size_t)row * a_width;
+		uint16_t lastDelta = 0;
+
+#ifdef CODEC_SIMD
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i maxDirect = _mm_set1_epi16(EscapeSymbol - 1);
+
+		// 8 valid pixels whose residuals all code directly, or nothing
+		auto codeBlock = [&](int a_x) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(in + a_x));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0)
+				return false;
+
+			__m128i delta = _mm_sub_epi16(v, _mm_loadu_si128((const __m128i*)(up.data() + a_x)));
+			__m128i previous = _mm_or_si128(_mm_slli_si128(delta, 2), _mm_cvtsi32_si128(lastDelta));
+			__m128i r = _mm_sub_epi16(delta, previous);
+			__m128i z = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(z, maxDirect), zero)) != 0xFFFF)
+				return false;
+
+			_mm_storel_epi64((__m128i*)(symbols + symbolCount), _mm_packus_epi16(z, z));
+			for (int i = 0; i < 8; ++i)
+				++histogram[symbols[symbolCount + i]];
+			symbolCount += 8;
+
+			_mm_storeu_si128((__m128i*)(filled.data() + a_x), v);
+			lastDelta = (uint16_t)_mm_extract_epi16(delta, 7);
+			return true;
+		};
+#endif
+
+		for (int x = 0; x < a_width; )
+		{
+#ifdef CODEC_SIMD
+			if (run == 0 && x + 8 <= a_width && codeBlock(x))
+			{
+				x += 8;
+				continue;
+			}
+#endif
+			uint16_t v = in[x];
+			if (v == 0)
+			{
+				++run;
+				filled[x] = uint16_t(up[x] + lastDelta);
+				++x;
+				continue;
+			}
+			if (run > 0)
+			{
+				emitRun(run);
+				run = 0;
+			}
+
+			uint16_t delta = uint16_t(v - up[x]);
+			uint16_t z = zigzag(uint16_t(delta - lastDelta));
+			lastDelta = delta;
+			filled[x] = v;
+			++x;
+
+			if (z < EscapeSymbol)
+				emit(z);
+			else
+			{
+				emit(EscapeSymbol);
+				raw[rawCount++] = z;
+			}
+		}
+		std::swap(up, filled);
+	}
+	if (run > 0)
+		emitRun(run);
+
+	a_band.symbolCount = symbolCount;
+	a_band.rawCount = rawCount;
+}
+
+void DepthCodec::codeBand(Band& a_band) const
+{
+	// symbols are coded last to first so the decoder reads them forwards, lane i & 3 each
+	a_band.words.resize(a_band.symbolCount + Lanes * 2 + 2);
+	uint16_t* end = a_band.words.data() + a_band.words.size();
+	uint16_t* out = end;
+
+	// the decoder's renormalisation may read a word past the band
+	*--out = 0;
+	*--out = 0;
+
+	uint32_t states[Lanes];
+	std::fill(states, states + Lanes, StateLow);
+	const uint8_t* symbols = a_band.symbols.data();
+	for (size_t i = a_band.symbolCount; i-- > 0; )
+	{
+		const EncodeSymbol& symbol = m_encodeSymbols[symbols[i]];
+		uint32_t& state = states[i & (Lanes - 1)];
+		if (state >= symbol.maxState)
+		{
+			*--out = (uint16_t)state;
+			state >>= 16;
+		}
+		uint32_t quotient = uint32_t((uint64_t(state) * symbol.reciprocal) >> 32) >> symbol.shift;
+		state += symbol.bias + quotient * symbol.complement;
+	}
+
+	for (int lane = Lanes - 1; lane >= 0; --lane)
+	{
+		*--out = uint16_t(states[lane] >> 16);
+		*--out = (uint16_t)states[lane];
+	}
+	a_band.firstWord = size_t(out - a_band.words.data());
+}
+
+size_t DepthCodec::encode(const uint16_t* a_depth, int a_width, int a_height, uint8_t* a_out)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int bandRows = std::max(m_settings.bandRows, 1);
+	int bandCount = (a_height + bandRows - 1) / bandRows;
+	if (m_bands.size() < (size_t)bandCount)
+		m_bands.resize(bandCount);
+
+	forEachBand(m_settings.parallel, bandCount, [&](int a_band) {
+		int firstRow = a_band * bandRows;
+		modelBand(m_bands[a_band], a_depth + (size_t)firstRow * a_width, a_width, std::min(bandRows, a_height - firstRow));
+	});
+
+	// one table for the frame
+	StreamHeader header;
+	header.width = (uint16_t)a_width;
+	header.height = (uint16_t)a_height;
+	header.bandRows = (uint16_t)bandRows;
+	header.bandCount = (uint16_t)bandCount;
+
+	uint32_t counts[256] = {};
+	for (int band = 0; band < bandCount; ++band)
+		for (int s = 0; s < 256; ++s)
+			counts[s] += m_bands[band].histogram[s];
+	normalize(counts, header.frequencies);
+
+	// reciprocal form of each symbol, so the coder divides by multiplying
+	uint32_t cumulative = 0;
+	for (int s = 0; s < 256; ++s)
+	{
+		EncodeSymbol& symbol = m_encodeSymbols[s];
+		uint32_t frequency = header.frequencies[s];
+		symbol.maxState = ((StateLow >> ProbBits) << 16) * frequency;
+		symbol.complement = uint16_t(ProbScale - frequency);
+		if (frequency < 2)
+		{
+			symbol.reciprocal = ~0u;
+			symbol.shift = 0;
+			symbol.bias = cumulative + ProbScale - 1;
+		}
+		else
+		{
+			uint32_t shift = 0;
+			while (frequency > (1u << shift))
+				++shift;
+			symbol.reciprocal = uint32_t(((1ull << (shift + 31)) + frequency - 1) / frequency);
+			symbol.shift = uint16_t(shift - 1);
+			symbol.bias = cumulative;
+		}
+		cumulative += frequency;
+	}
+
+	forEachBand(m_settings.parallel, bandCount, [&](int a_band) {
+		codeBand(m_bands[a_band]);
+	});
+
+	uint8_t* out = a_out;
+	memcpy(out, &header, sizeof(StreamHeader));
+	out += sizeof(StreamHeader);
+	for (int band = 0; band < bandCount; ++band)
+	{
+		auto& data = m_bands[band];
+		BandHeader bandHeader;
+		bandHeader.symbolCount = (uint32_t)data.symbolCount;
+		bandHeader.wordCount = uint32_t(data.words.size() - data.firstWord);
+		bandHeader.rawCount = (uint32_t)data.rawCount;
+		memcpy(out, &bandHeader, sizeof(BandHeader));
+		out += sizeof(BandHeader);
+	}
+	for (int band = 0; band < bandCount; ++band)
+	{
+		auto& data = m_bands[band];
+		size_t words = (data.words.size() - data.firstWord) * sizeof(uint16_t);
+		memcpy(out, data.words.data() + data.firstWord, words);
+		out += words;
+		memcpy(out, data.raw.data(), data.rawCount * sizeof(uint16_t));
+		out += data.rawCount * sizeof(uint16_t);
+	}
+
+	m_lastEncodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return size_t(out - a_out);
+}
+
+bool DepthCodec::decode(const uint8_t* a_in, size_t a_size, uint16_t* a_out, int a_width, int a_height)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	StreamHeader header;
+	if (a_size < sizeof(StreamHeader))
+		return false;
+	memcpy(&header, a_in, sizeof(StreamHeader));
+	if (header.magic != Magic ||
+		header.width != a_width ||
+		header.height != a_height ||
+		header.bandRows == 0 ||
+		header.bandCount != (a_height + header.bandRows - 1) / header.bandRows)
+		return false;
+
+	int bandCount = header.bandCount;
+	int bandRows = header.bandRows;
+	size_t tableSize = sizeof(StreamHeader) + bandCount * sizeof(BandHeader);
+	if (a_size < tableSize)
+		return false;
+
+	// where each band's words and raw values start
+	std::vector<BandHeader> bands(bandCount);
+	std::vector<size_t> offsets(bandCount);
+	memcpy(bands.data(), a_in + sizeof(StreamHeader), bandCount * sizeof(BandHeader));
+	size_t offset = tableSize;
+	for (int band = 0; band < bandCount; ++band)
+	{
+		offsets[band] = offset;
+		if (bands[band].wordCount < Lanes * 2)
+			return false;
+		offset += ((size_t)bands[band].wordCount + bands[band].rawCount) * sizeof(uint16_t);
+	}
+	if (offset > a_size)
+		return false;
+
+	// slot -> symbol | frequency << 8 | (slot - cumulative) << 20
+	std::vector<uint32_t> table(ProbScale);
+	uint32_t cumulative = 0;
+	for (uint32_t s = 0; s < 256; ++s)
+	{
+		uint32_t frequency = header.frequencies[s];
+		if (cumulative + frequency > ProbScale)
+			return false;
+		for (uint32_t slot = 0; slot < frequency; ++slot)
+			table[cumulative + slot] = s | (frequency << 8) | (slot << 20);
+		cumulative += frequency;
+	}
+	if (cumulative != ProbScale)
+		return false;
+
+	// rANS first, straight through each band with a lane per state, then the rows
+	auto rebuildBand = [&](int a_band, const uint8_t* a_symbols) {
+		const BandHeader& band = bands[a_band];
+		int firstRow = a_band * bandRows;
+		int rows = std::min(bandRows, a_height - firstRow);
+		size_t symbolCount = band.symbolCount;
+		const uint8_t* symbol = a_symbols;
+
+		const uint16_t* raw = reinterpret_cast<const uint16_t*>(a_in + offsets[a_band] + band.wordCount * sizeof(uint16_t));
+		size_t rawIndex = 0;
+		size_t next = 0;
+
+		// symbols become pixels in one pass: the row-to-row delta is the running sum of the
+		// residuals, and runs carry it on under zeroed output
+		std::vector<uint16_t> up(a_width, 0);
+		std::vector<uint16_t> filled(a_width);
+		uint32_t pending = 0;		// zeros left of a run from the row before
+
+#ifdef CODEC_SIMD
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+		const __m128i maxDirect = _mm_set1_epi8(EscapeSymbol - 1);
+
+		// 8 zigzagged residuals summed onto the delta carried in every lane of a_carries
+		auto prefix = [&](__m128i a_codes, __m128i a_carries) {
+			__m128i sum = _mm_xor_si128(_mm_srli_epi16(a_codes, 1), _mm_sub_epi16(zero, _mm_and_si128(a_codes, one)));
+			sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 2));
+			sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 4));
+			sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 8));
+			return _mm_add_epi16(sum, a_carries);
+		};
+		auto broadcastLast = [](__m128i a_sums) {
+			__m128i last = _mm_shufflehi_epi16(a_sums, 0xFF);
+			return _mm_unpackhi_epi64(last, last);
+		};
+#endif
+
+		for (int row = 0; row < rows; ++row)
+		{
+			uint16_t* out = a_out + (size_t)(firstRow + row) * a_width;
+			uint16_t carry = 0;
+
+			for (int x = 0; x < a_width; )
+			{
+				if (pending > 0)
+				{
+					int end = x + (int)std::min<uint32_t>(pending, a_width - x);
+					pending -= end - x;
+#ifdef CODEC_SIMD
+					__m128i carries = _mm_set1_epi16((short)carry);
+					for (; x + 8 <= end; x += 8)
+					{
+						_mm_storeu_si128((__m128i*)(filled.data() + x), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(up.data() + x)), carries));
+						_mm_storeu_si128((__m128i*)(out + x), zero);
+					}
+#endif
+					for (; x < end; ++x)
+					{
+						filled[x] = uint16_t(up[x] + carry);
+						out[x] = 0;
+					}
+					continue;
+				}
+				if (next >= symbolCount)
+					return false;
+
+#ifdef CODEC_SIMD
+				// up to 16 direct residuals at once, the common case. All of a block's sums are
+				// stored, those past the last direct one are written over by what follows.
+				if (x + 8 <= a_width && next + 8 <= symbolCount)
+				{
+					__m128i codes = _mm_loadu_si128((const __m128i*)(symbol + next));
+					unsigned int direct = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(codes, maxDirect), zero));
+					if (x + 16 > a_width || next + 16 > symbolCount)
+						direct &= 0xFF;
+					int count = std::countr_one(direct);
+					if (count > 0)
+					{
+						alignas(16) uint16_t sums[16];
+						__m128i low = prefix(_mm_unpacklo_epi8(codes, zero), _mm_set1_epi16((short)carry));
+						__m128i value = _mm_add_epi16(low, _mm_loadu_si128((const __m128i*)(up.data() + x)));
+						_mm_storeu_si128((__m128i*)(filled.data() + x), value);
+						_mm_storeu_si128((__m128i*)(out + x), value);
+						_mm_store_si128((__m128i*)sums, low);
+
+						if (count > 8)
+						{
+							__m128i high = prefix(_mm_unpackhi_epi8(codes, zero), broadcastLast(low));
+							value = _mm_add_epi16(high, _mm_loadu_si128((const __m128i*)(up.data() + x + 8)));
+							_mm_storeu_si128((__m128i*)(filled.data() + x + 8), value);
+							_mm_storeu_si128((__m128i*)(out + x + 8), value);
+							_mm_store_si128((__m128i*)(sums + 8), high);
+						}
+						carry = sums[count - 1];
+						x += count;
+						next += count;
+						continue;
+					}
+				}
+#endif
+				uint32_t code = symbol[next++];
+				if (code < RunSymbol || code == LongRunSymbol)
+				{
+					if (code >= EscapeSymbol && rawIndex >= band.rawCount)
+						return false;
+					if (code == LongRunSymbol)
+					{
+						pending = MaxShortRun + 1 + raw[rawIndex++];
+						continue;
+					}
+					carry = uint16_t(carry + unzigzag(code == EscapeSymbol ? raw[rawIndex++] : (uint16_t)code));
+					filled[x] = uint16_t(up[x] + carry);
+					out[x] = filled[x];
+					++x;
+				}
+				else
+					pending = code - RunSymbol + 1;
+			}
+			std::swap(up, filled);
+		}
+		return true;
+	};
+
+	// bands go in pairs, so every step has the lanes of two independent bands in flight
+	const uint32_t* decodeTable = table.data();
+	int pairs = (bandCount + 1) / 2;
+	std::vector<char> ok(pairs, 1);
+	forEachBand(m_settings.parallel, pairs, [&](int a_pair) {
+		int first = a_pair * 2;
+		int count = std::min(2, bandCount - first);
+		LaneDecoder decoders[2];
+		for (int i = 0; i < count; ++i)
+			decoders[i].start(a_in + offsets[first + i], bands[first + i].wordCount, bands[first + i].symbolCount);
+
+		if (count == 2)
+		{
+			size_t steps = std::min(bands[first].symbolCount, bands[first + 1].symbolCount) & ~size_t(Lanes - 1);
+			while (decoders[0].getNext() < steps)
+			{
+				size_t blockEnd = std::min(steps, decoders[0].getNext() + DecodeBlock);
+				while (decoders[0].getNext() < blockEnd)
+				{
+					decoders[0].step(decodeTable);
+					decoders[1].step(decodeTable);
+				}
+				if (decoders[0].isOverrun() || decoders[1].isOverrun())
+				{
+					ok[a_pair] = 0;
+					return;
+				}
+			}
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (!decoders[i].finish(decodeTable) || !rebuildBand(first + i, decoders[i].getSymbols()))
+			{
+				ok[a_pair] = 0;
+				return;
+			}
+		}
+	});
+
+	m_lastDecodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
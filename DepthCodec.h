@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression of raw Z16 depth frames.
+// Each pixel is predicted from the pixel above plus the change its left neighbour had over
+// the pixel above it, so a residual is the row-to-row delta differenced along the row and
+// smooth surfaces code to values near zero. Runs of invalid (zero) pixels are coded as one
+// run symbol each and predict as if the surface carried on. Residuals, runs and escapes
+// share a 256 symbol alphabet coded with static 8-way interleaved rANS, one frequency
+// table per frame. The frame is cut into bands of rows coded independently, so both
+// directions run the bands in parallel. Decoding steps the 8 states of two bands side by
+// side, 4 lanes to a register where SSSE3 is available, then rebuilds each row with a
+// prefix sum over up to 16 residuals at a time. Not thread safe, keep one per thread.
+class DepthCodec
+{
+public:
+
+	struct Settings
+	{
+		int		bandRows = 32;		// rows coded independently of the band above
+		bool	parallel = true;	// bands across threads, off to measure a single core
+	};
+
+	DepthCodec() = default;
+	~DepthCodec() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// bytes a_out needs for any a_width x a_height frame
+	static size_t	getMaxEncodedSize(int a_width, int a_height);
+
+	// returns the encoded size, a_out must hold getMaxEncodedSize() bytes
+	size_t			encode(const uint16_t* a_depth, int a_width, int a_height, uint8_t* a_out);
+
+	// false if a_in isn't an a_width x a_height frame from encode()
+	bool			decode(const uint8_t* a_in, size_t a_size, uint16_t* a_out, int a_width, int a_height);
+
+	float			getLastEncodeMs() const	{	return m_lastEncodeMs;	}
+	float			getLastDecodeMs() const	{	return m_lastDecodeMs;	}
+
+private:
+
+	// one band's symbols and the 16 bit values escapes and long runs carry
+	struct Band
+	{
+		std::vector<uint8_t>	symbols;
+		std::vector<uint16_t>	raw;
+		std::vector<uint16_t>	words;		// rANS output, written back to front
+		size_t					firstWord = 0;
+		size_t					symbolCount = 0;
+		size_t					rawCount = 0;
+		uint32_t				histogram[256] = {};
+	};
+
+	void			modelBand(Band& a_band, const uint16_t* a_depth, int a_width, int a_rows);
+	void			codeBand(Band& a_band) const;
+
+	Settings				m_settings;
+	std::vector<Band>		m_bands;
+
+	// rANS encoder symbols, see codeBand()
+	struct EncodeSymbol
+	{
+		uint32_t	maxState = 0;
+		uint32_t	reciprocal = 0;
+		uint32_t	bias = 0;
+		uint16_t	complement = 0;
+		uint16_t	shift = 0;
+	};
+	EncodeSymbol			m_encodeSymbols[256];
+
+	float					m_lastEncodeMs = 0;
+	float					m_lastDecodeMs = 0;
+};
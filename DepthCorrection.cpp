@@ -0,0 +1,85 @@
+#include "DepthCorrection.h"
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+// samples closer together than this can't tell a quadratic from a line
+static constexpr float QuadraticMinSpread = 1.0f;
+static constexpr size_t MinSamples = 20;
+
+void DepthCorrection::addSample(float a_measured, float a_expected)
+{
+	if (a_measured > 0 && a_expected > 0)
+		m_samples.push_back({ a_measured, a_expected });
+}
+
+void DepthCorrection::clearSamples()
+{
+	m_samples.clear();
+}
+
+bool DepthCorrection::fit()
+{
+	if (m_samples.size() < MinSamples)
+		return false;
+
+	auto [nearest, furthest] = std::minmax_element(m_samples.begin(), m_samples.end(),
+		[](const Sample& a, const Sample& b) { return a.measured < b.measured; });
+	int terms = furthest->measured - nearest->measured >= QuadraticMinSpread ? 3 : 2;
+
+	Eigen::MatrixXd A(m_samples.size(), terms);
+	Eigen::VectorXd b(m_samples.size());
+	for (size_t i = 0; i < m_samples.size(); ++i)
+	{
+		double z = m_samples[i].measured;
+		A(i, 0) = 1;
+		A(i, 1) = z;
+		if (terms == 3)
+			A(i, 2) = z * z;
+		b(i) = m_samples[i].expected;
+	}
+
+	Eigen::VectorXd x = A.colPivHouseholderQr().solve(b);
+	if (x.allFinite() == false)
+		return false;
+
+	Coefficients coefficients = { x(0), x(1), terms == 3 ? x(2) : 0.0 };
+	setCoefficients(coefficients);
+	m_fitError = (float)std::sqrt((A * x - b).squaredNorm() / m_samples.size());
+	return true;
+}
+
+void DepthCorrection::setCoefficients(const Coefficients& a_coefficients)
+{
+	m_coefficients = a_coefficients;
+	m_tableUnits = 0;
+}
+
+bool DepthCorrection::isIdentity() const
+{
+	return m_coefficients == Coefficients{ 0, 1, 0 };
+}
+
+void DepthCorrection::prepare(float a_depthUnits)
+{
+	if (a_depthUnits == m_tableUnits)
+		return;
+
+	m_table.resize(65536);
+	m_table[0] = 0;	// invalid stays invalid
+	for (unsigned int raw = 1; raw < 65536; ++raw)
+	{
+		double z = raw * (double)a_depthUnits;
+		double corrected = m_coefficients[0] + m_coefficients[1] * z + m_coefficients[2] * z * z;
+		m_table[raw] = (uint16_t)std::clamp(std::lround(corrected / a_depthUnits), 0l, 65535l);
+	}
+	m_tableUnits = a_depthUnits;
+}
+
+void DepthCorrection::apply(const uint16_t* a_in, uint16_t* a_out, size_t a_count) const
+{
+	auto table = m_table.data();
+	for (size_t i = 0; i < a_count; ++i)
+		a_out[i] = table[a_in[i]];
+}
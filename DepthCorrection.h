@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-camera depth correction fitted from board planes seen at several distances.
+// Maps measured depth to true depth with a low order polynomial, baked into a table
+// indexed by the raw Z16 value so applying it costs one lookup per pixel ahead of
+// deprojection.
+class DepthCorrection
+{
+public:
+
+	// true = c0 + c1 * measured + c2 * measured^2, in meters
+	using Coefficients = std::array<double, 3>;
+
+	DepthCorrection() = default;
+	~DepthCorrection() = default;
+
+	void			addSample(float a_measured, float a_expected);
+	void			clearSamples();
+	size_t			getSampleCount() const	{	return m_samples.size();	}
+
+	// least squares fit of the samples. Falls back to scale/offset when the samples
+	// don't span enough depth to constrain the quadratic term.
+	bool			fit();
+
+	// RMS of the fit residuals in meters
+	float			getFitError() const		{	return m_fitError;	}
+
+	const Coefficients&	getCoefficients() const	{	return m_coefficients;	}
+	void			setCoefficients(const Coefficients& a_coefficients);
+
+	bool			isIdentity() const;
+
+	// rebuilds the raw lookup table if the depth units have changed
+	void			prepare(float a_depthUnits);
+
+	// a_out may alias a_in
+	void			apply(const uint16_t* a_in, uint16_t* a_out, size_t a_count) const;
+
+private:
+
+	struct Sample
+	{
+		float	measured;
+		float	expected;
+	};
+
+	std::vector<Sample>		m_samples;
+	Coefficients			m_coefficients = { 0, 1, 0 };
+	float					m_fitError = 0;
+
+	std::vector<uint16_t>	m_table;
+	float					m_tableUnits = 0;
+};
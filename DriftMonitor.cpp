@@ -0,0 +1,345 @@
+#include "DriftMonitor.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+
+#include <Eigen/SVD>
+#include <Eigen/LU>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// points handled between looks at the clock in the per-point loops
+	constexpr unsigned int DeadlineStride = 1024;
+
+	// points bucketed into cells of the pairing distance, sorted by cell key so a
+	// neighbourhood lookup is a handful of binary searches
+	class SortedGrid
+	{
+	public:
+
+		// false if the deadline passed first, the grid is then unusable
+		bool build(std::vector<Eigen::Vector3f>&& a_points, float a_cellSize, Clock::time_point a_deadline)
+		{
+			m_invCellSize = 1.0f / a_cellSize;
+
+			std::vector<std::pair<uint64_t, unsigned int>> order(a_points.size());
+			for (unsigned int i = 0; i < a_points.size(); ++i)
+			{
+				if ((i & (DeadlineStride - 1)) == 0 && Clock::now() > a_deadline)
+					return false;
+				order[i] = { key(cell(a_points[i])), i };
+			}
+			std::sort(order.begin(), order.end());
+			if (Clock::now() > a_deadline)
+				return false;
+
+			m_keys.resize(order.size());
+			m_points.resize(order.size());
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				m_keys[i] = order[i].first;
+				m_points[i] = a_points[order[i].second];
+			}
+			return true;
+		}
+
+		bool nearest(const Eigen::Vector3f& a_point, float a_maxDistance, Eigen::Vector3f& a_nearest) const
+		{
+			float best = a_maxDistance * a_maxDistance;
+			bool found = false;
+
+			Eigen::Vector3i c = cell(a_point);
+			for (int z = -1; z <= 1; ++z)
+				for (int y = -1; y <= 1; ++y)
+					for (int x = -1; x <= 1; ++x)
+					{
+						auto k = key(c + Eigen::Vector3i(x, y, z));
+						auto range = std::equal_range(m_keys.begin(), m_keys.end(), k);
+						for (auto i = range.first - m_keys.begin(); i < range.second - m_keys.begin(); ++i)
+						{
+							float d = (m_points[i] - a_point).squaredNorm();
+							if (d < best)
+							{
+								best = d;
+								a_nearest = m_points[i];
+								found = true;
+							}
+						}
+					}
+
+			return found;
+		}
+
+	private:
+
+		Eigen::Vector3i cell(const Eigen::Vector3f& a_point) const
+		{
+			return (a_point * m_invCellSize).array().floor().cast<int>();
+		}
+
+		static uint64_t key(const Eigen::Vector3i& a_cell)
+		{
+			// 21 bits per axis, biased so negative cells sort correctly
+			constexpr int bias = 1 << 20;
+			return ((uint64_t)((a_cell.x() + bias) & 0x1FFFFF) << 42) |
+				((uint64_t)((a_cell.y() + bias) & 0x1FFFFF) << 21) |
+				(uint64_t)((a_cell.z() + bias) & 0x1FFFFF);
+		}
+
+		float							m_invCellSize = 1;
+		std::vector<uint64_t>			m_keys;
+		std::vector<Eigen::Vector3f>	m_points;
+	};
+}
+
+DriftMonitor::DriftMonitor()
+{
+	m_thread = std::thread(&DriftMonitor::run, this);
+}
+
+DriftMonitor::~DriftMonitor()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+bool DriftMonitor::isSubmissionDue() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_settings.enabled && m_wantSnapshots;
+}
+
+void DriftMonitor::submit(unsigned int a_camera, const float* a_vertices, size_t a_count, size_t a_stride,
+						const Eigen::Affine3f& a_transform)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (m_settings.enabled == false ||
+		m_wantSnapshots == false)
+		return;
+
+	if (m_snapshots.size() <= a_camera)
+		m_snapshots.resize(a_camera + 1);
+
+	auto& snapshot = m_snapshots[a_camera];
+	snapshot.points.clear();
+	snapshot.fresh = true;
+
+	if (a_count == 0)
+		return;
+
+	// stride through the cloud rather than copy it, invalid (zero) depth is skipped
+	size_t step = std::max<size_t>(1, a_count / (m_settings.maxPoints * 2));
+	auto bytes = reinterpret_cast<const unsigned char*>(a_vertices);
+	for (size_t i = 0; i < a_count && snapshot.points.size() < m_settings.maxPoints; i += step)
+	{
+		auto v = reinterpret_cast<const float*>(bytes + i * a_stride);
+		if (v[2] <= 0)
+			continue;
+
+		// same Y flip as pc.vert
+		snapshot.points.push_back(a_transform * Eigen::Vector3f(v[0], -v[1], v[2]));
+	}
+}
+
+DriftMonitor::Result DriftMonitor::getResult(unsigned int a_camera) const
+{
+	std::lock_guard lock(m_mutex);
+	return a_camera < m_results.size() ? m_results[a_camera] : Result{};
+}
+
+bool DriftMonitor::takeCorrection(unsigned int a_camera, Eigen::Affine3f& a_correction)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (m_settings.applyCorrections == false ||
+		a_camera >= m_pendingCorrection.size() ||
+		m_pendingCorrection[a_camera] == false)
+		return false;
+
+	m_pendingCorrection[a_camera] = false;
+
+	// only step part of the way each round so noise in a single estimate can't yank the camera
+	auto& correction = m_results[a_camera].correction;
+	Eigen::Quaternionf rotation = Eigen::Quaternionf::Identity().slerp(m_settings.correctionRate, Eigen::Quaternionf(correction.linear()));
+
+	a_correction = Eigen::Affine3f::Identity();
+	a_correction.linear() = rotation.toRotationMatrix();
+	a_correction.translation() = correction.translation() * m_settings.correctionRate;
+	return true;
+}
+
+DriftMonitor::Settings DriftMonitor::getSettings() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_settings;
+}
+
+void DriftMonitor::setSettings(const Settings& a_settings)
+{
+	std::lock_guard lock(m_mutex);
+	m_settings = a_settings;
+}
+
+float DriftMonitor::getLastRoundMs() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_lastRoundMs;
+}
+
+void DriftMonitor::run()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+
+	std::unique_lock lock(m_mutex);
+	while (m_quit == false)
+	{
+		m_wake.wait_for(lock, std::chrono::duration<float, std::milli>(m_settings.intervalMs));
+		if (m_quit)
+			break;
+
+		if (m_settings.enabled == false)
+			continue;
+
+		std::vector<Snapshot> snapshots;
+		std::swap(snapshots, m_snapshots);
+		auto settings = m_settings;
+		m_wantSnapshots = false;
+
+		lock.unlock();
+
+		std::vector<Result> results;
+		auto start = Clock::now();
+		evaluate(snapshots, settings, results);
+		float elapsed = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+		lock.lock();
+
+		m_lastRoundMs = elapsed;
+		m_wantSnapshots = true;
+
+		if (m_results.size() < results.size())
+		{
+			m_results.resize(results.size());
+			m_pendingCorrection.resize(results.size(), false);
+		}
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			if (results[i].valid == false)
+				continue;
+			m_results[i] = results[i];
+			m_pendingCorrection[i] = true;
+		}
+	}
+}
+
+void DriftMonitor::evaluate(std::vector<Snapshot>& a_snapshots, const Settings& a_settings, std::vector<Result>& a_results)
+{
+	auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(a_settings.budgetMs));
+
+	a_results.assign(a_snapshots.size(), Result{});
+
+	// everyone is aligned to the anchor, so without its points there is nothing to go on
+	unsigned int anchor = a_settings.anchorCamera;
+	if (anchor >= a_snapshots.size() ||
+		a_snapshots[anchor].fresh == false ||
+		a_snapshots[anchor].points.empty())
+		return;
+
+	std::vector<Eigen::Vector3f> source;
+	std::vector<Eigen::Vector3f> target;
+
+	for (unsigned int camera = 0; camera < a_snapshots.size(); ++camera)
+	{
+		auto& snapshot = a_snapshots[camera];
+		if (snapshot.fresh == false ||
+			snapshot.points.empty())
+			continue;
+
+		// everyone else's points are the reference
+		std::vector<Eigen::Vector3f> reference;
+		for (unsigned int other = 0; other < a_snapshots.size(); ++other)
+			if (other != camera)
+				reference.insert(reference.end(), a_snapshots[other].points.begin(), a_snapshots[other].points.end());
+		if (reference.empty())
+			continue;
+
+		// out of budget, whatever hasn't been evaluated waits for the next round
+		SortedGrid grid;
+		if (grid.build(std::move(reference), a_settings.maxPairDistance, deadline) == false)
+			break;
+
+		Result& result = a_results[camera];
+		Eigen::Affine3f correction = Eigen::Affine3f::Identity();
+		bool expired = false;
+
+		for (unsigned int iteration = 0; iteration < a_settings.maxIterations && expired == false; ++iteration)
+		{
+			source.clear();
+			target.clear();
+
+			double sumSquared = 0;
+			for (size_t i = 0; i < snapshot.points.size(); ++i)
+			{
+				if ((i & (DeadlineStride - 1)) == 0 && Clock::now() > deadline)
+				{
+					expired = true;
+					break;
+				}
+
+				Eigen::Vector3f p = correction * snapshot.points[i];
+				Eigen::Vector3f nearest;
+				if (grid.nearest(p, a_settings.maxPairDistance, nearest))
+				{
+					source.push_back(p);
+					target.push_back(nearest);
+					sumSquared += (nearest - p).squaredNorm();
+				}
+			}
+
+			// a pass cut short pairs too few points to trust, keep what the earlier ones found
+			if (expired ||
+				source.size() < a_settings.minPairs)
+				break;
+
+			if (iteration == 0)
+			{
+				result.rmsError = (float)std::sqrt(sumSquared / source.size());
+				result.overlap = (unsigned int)source.size();
+				result.valid = true;
+			}
+
+			if (camera == anchor)
+				break;
+
+			auto src = Eigen::Map<const Eigen::Matrix3Xf>(source[0].data(), 3, source.size());
+			auto dst = Eigen::Map<const Eigen::Matrix3Xf>(target[0].data(), 3, target.size());
+			correction = Eigen::Affine3f(Eigen::umeyama(src, dst, false)) * correction;
+
+			if (Clock::now() > deadline)
+				expired = true;
+		}
+
+		result.correction = correction;
+		result.translation = correction.translation().norm();
+		result.rotation = Eigen::AngleAxisf(correction.linear()).angle() * 180.0f / std::numbers::pi_v<float>;
+
+		if (expired)
+			break;
+	}
+}
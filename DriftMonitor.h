@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Watches for cameras whose extrinsics have drifted (a bumped tripod, etc.) by running a
+// point-to-point ICP between each camera's overlap and the other cameras' points.
+// Work happens on a low-priority background thread that wakes once per interval and is
+// cut off when it exceeds its time budget, so it never competes with capture.
+// The main thread only hands over small decimated snapshots.
+class DriftMonitor
+{
+public:
+
+	struct Settings
+	{
+		bool	enabled = false;
+		bool	applyCorrections = false;	// feed small corrections back through takeCorrection()
+		unsigned int	anchorCamera = 0;	// reference the others are aligned to, never corrected; no round without it
+		float	correctionRate = 0.25f;		// fraction of the estimated correction applied per round
+		float	intervalMs = 1000;			// time between rounds
+		float	budgetMs = 5;				// CPU time allowed per round
+		float	maxPairDistance = 0.03f;	// points further apart than this are not overlap
+		unsigned int	maxPoints = 4000;	// per camera snapshot
+		unsigned int	minPairs = 200;		// fewer overlapping pairs than this gives no estimate
+		unsigned int	maxIterations = 8;
+	};
+
+	struct Result
+	{
+		bool			valid = false;
+		float			rmsError = 0;		// meters, current alignment residual in the overlap
+		float			translation = 0;	// meters, magnitude of the estimated correction
+		float			rotation = 0;		// degrees, magnitude of the estimated correction
+		unsigned int	overlap = 0;		// number of paired points
+		Eigen::Affine3f	correction = Eigen::Affine3f::Identity();	// capture space
+	};
+
+	DriftMonitor();
+	~DriftMonitor();
+
+	// copies a decimated set of camera-space points (xyz floats, a_stride bytes apart) with the
+	// camera-to-capture-space transform they were drawn with. Cheap; does nothing until the
+	// next round is due.
+	void		submit(unsigned int a_camera, const float* a_vertices, size_t a_count, size_t a_stride,
+						const Eigen::Affine3f& a_transform);
+
+	bool		isSubmissionDue() const;
+
+	Result		getResult(unsigned int a_camera) const;
+
+	// returns true and the partial capture-space correction to pre-multiply into the camera's
+	// transform, once per round
+	bool		takeCorrection(unsigned int a_camera, Eigen::Affine3f& a_correction);
+
+	Settings	getSettings() const;
+	void		setSettings(const Settings& a_settings);
+
+	float		getLastRoundMs() const;
+
+private:
+
+	struct Snapshot
+	{
+		std::vector<Eigen::Vector3f>	points;		// capture space
+		bool							fresh = false;
+	};
+
+	void		run();
+	void		evaluate(std::vector<Snapshot>& a_snapshots, const Settings& a_settings, std::vector<Result>& a_results);
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	bool					m_wantSnapshots = true;
+
+	Settings				m_settings;
+	std::vector<Snapshot>	m_snapshots;
+	std::vector<Result>		m_results;
+	std::vector<bool>		m_pendingCorrection;
+	float					m_lastRoundMs = 0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+// Open addressing hash map from 64-bit keys, linear probing over a power-of-two table.
+// Keys and values live in flat arrays so lookups touch one or two cache lines, which is
+// what the per-point voxel hashing passes need. ~0 is reserved as the empty key and
+// there is no erase, tables are cleared and rebuilt instead.
+template <typename Value>
+class FlatHashMap
+{
+public:
+
+	static constexpr uint64_t	EmptyKey = ~0ull;
+
+	FlatHashMap(size_t a_capacity = 1024)	{	reserve(a_capacity);	}
+
+	size_t	size() const		{	return m_size;			}
+	size_t	capacity() const	{	return m_keys.size();	}
+
+	void	clear()
+	{
+		std::fill(m_keys.begin(), m_keys.end(), EmptyKey);
+		m_size = 0;
+	}
+
+	// keeps the load factor under a half for a_count entries
+	void	reserve(size_t a_count)
+	{
+		size_t capacity = 16;
+		while (capacity < a_count * 2)
+			capacity <<= 1;
+		if (capacity > m_keys.size())
+			rehash(capacity);
+	}
+
+	Value*	find(uint64_t a_key)
+	{
+		return find(a_key, hash(a_key));
+	}
+
+	const Value*	find(uint64_t a_key) const
+	{
+		return const_cast<FlatHashMap*>(this)->find(a_key);
+	}
+
+	// for callers that already hashed the key, e.g. to pick a shard
+	Value*	find(uint64_t a_key, uint64_t a_hash)
+	{
+		for (size_t i = a_hash & m_mask; ; i = (i + 1) & m_mask)
+		{
+			if (m_keys[i] == a_key)
+				return &m_values[i];
+			if (m_keys[i] == EmptyKey)
+				return nullptr;
+		}
+	}
+
+	const Value*	find(uint64_t a_key, uint64_t a_hash) const
+	{
+		return const_cast<FlatHashMap*>(this)->find(a_key, a_hash);
+	}
+
+	// returns the stored value and whether it was newly inserted
+	std::pair<Value*, bool>	insert(uint64_t a_key, const Value& a_value)
+	{
+		if ((m_size + 1) * 2 > m_keys.size())
+			rehash(m_keys.size() * 2);
+
+		for (size_t i = hash(a_key) & m_mask; ; i = (i + 1) & m_mask)
+		{
+			if (m_keys[i] == a_key)
+				return { &m_values[i], false };
+			if (m_keys[i] == EmptyKey)
+			{
+				m_keys[i] = a_key;
+				m_values[i] = a_value;
+				++m_size;
+				return { &m_values[i], true };
+			}
+		}
+	}
+
+	template <typename Function>
+	void	forEach(Function a_function) const
+	{
+		for (size_t i = 0; i < m_keys.size(); ++i)
+			if (m_keys[i] != EmptyKey)
+				a_function(m_keys[i], m_values[i]);
+	}
+
+	// splitmix64 finaliser, packed voxel coordinates are far from random
+	static uint64_t	hash(uint64_t a_key)
+	{
+		a_key ^= a_key >> 30;
+		a_key *= 0xBF58476D1CE4E5B9ull;
+		a_key ^= a_key >> 27;
+		a_key *= 0x94D049BB133111EBull;
+		a_key ^= a_key >> 31;
+		return a_key;
+	}
+
+private:
+
+	void	rehash(size_t a_capacity)
+	{
+		std::vector<uint64_t> keys(a_capacity, EmptyKey);
+		std::vector<Value> values(a_capacity);
+		size_t mask = a_capacity - 1;
+
+		for (size_t i = 0; i < m_keys.size(); ++i)
+		{
+			if (m_keys[i] == EmptyKey)
+				continue;
+			size_t j = hash(m_keys[i]) & mask;
+			while (keys[j] != EmptyKey)
+				j = (j + 1) & mask;
+			keys[j] = m_keys[i];
+			values[j] = std::move(m_values[i]);
+		}
+
+		m_keys = std::move(keys);
+		m_values = std::move(values);
+		m_mask = mask;
+	}
+
+	std::vector<uint64_t>	m_keys;
+	std::vector<Value>		m_values;
+	size_t					m_mask = 0;
+	size_t					m_size = 0;
+};
+
+// packs integer voxel/block coordinates into a key, 21 bits per axis
+inline uint64_t packVoxelKey(const Eigen::Vector3i& a_coord)
+{
+	constexpr int bias = 1 << 20;
+	return ((uint64_t)((a_coord.x() + bias) & 0x1FFFFF) << 42) |
+		((uint64_t)((a_coord.y() + bias) & 0x1FFFFF) << 21) |
+		(uint64_t)((a_coord.z() + bias) & 0x1FFFFF);
+}
+
+inline Eigen::Vector3i unpackVoxelKey(uint64_t a_key)
+{
+	constexpr int bias = 1 << 20;
+	return { (int)((a_key >> 42) & 0x1FFFFF) - bias, (int)((a_key >> 21) & 0x1FFFFF) - bias, (int)(a_key & 0x1FFFFF) - bias };
+}
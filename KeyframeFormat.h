@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "SessionFormat.h"
+
+// On-disk layout of a session's keyframe sidecar (.vck), written next to the .vcs it
+// describes so a long recording can be browsed without touching its streams.
+//
+//	FileHeader, SessionFormat::CameraInfo[cameraCount]	headerSize bytes
+//	record, record, ...									recordSize bytes each
+//
+// A keyframe is taken from each camera every intervalMs of that camera's own clock, counted
+// from its first frame, the same time base playback steps by. Each record is one camera's
+// keyframe: a RecordHeader, the depth histogram and an RGB8 thumbnail, padded to
+// recordSize. Records are fixed size and only appended, in the order they were taken, so a
+// reader walks them from the header and stops at the first one that is torn or missing its
+// magic; there is no footer to lose. Everything is little-endian.
+namespace KeyframeFormat
+{
+	constexpr uint32_t	FileMagic = 0x59454B56;		// 'VKEY'
+	constexpr uint32_t	RecordMagic = 0x52464B56;	// 'VKFR'
+	constexpr uint32_t	Version = 1;
+
+	constexpr size_t	RecordAlignment = 64;
+
+	constexpr size_t	alignUp(size_t a_size, size_t a_alignment)	{	return (a_size + a_alignment - 1) & ~(a_alignment - 1);	}
+
+	enum RecordFlags : uint16_t
+	{
+		HasDepth		= 1 << 0,
+		HasThumbnail	= 1 << 1,
+	};
+
+	struct FileHeader
+	{
+		uint32_t	magic = FileMagic;
+		uint32_t	version = Version;
+		uint32_t	headerSize = 0;		// bytes, where the first record starts
+		uint32_t	cameraCount = 0;
+		int64_t		startTime = 0;		// the session's, system clock, ns since the epoch
+		float		intervalMs = 0;		// between keyframes of a camera
+		uint32_t	recordSize = 0;		// bytes including padding
+		uint32_t	thumbnailWidth = 0;
+		uint32_t	thumbnailHeight = 0;
+		uint32_t	histogramBins = 0;
+		float		histogramMaxDepth = 0;	// m, the last bin also counts everything further
+		uint32_t	reserved[4] = {};
+	};
+
+	// followed by uint32_t histogram[histogramBins] then the thumbnail's rows, tightly packed
+	struct RecordHeader
+	{
+		uint32_t	magic = RecordMagic;
+		uint32_t	keyframe = 0;		// time since the camera's first frame over intervalMs
+		uint16_t	camera = 0;			// into the CameraInfo array
+		uint16_t	flags = 0;
+		uint32_t	points = 0;			// pixels with depth
+		double		timestamp = 0;		// ms, the frame's device timestamp
+		double		time = 0;			// ms since the camera's first frame
+		uint64_t	frameNumber = 0;
+		uint32_t	reserved[2] = {};
+	};
+
+	static_assert(sizeof(FileHeader) == 64);
+	static_assert(sizeof(RecordHeader) == 48);
+
+	inline size_t recordSize(size_t a_histogramBins, size_t a_thumbnailWidth, size_t a_thumbnailHeight)
+	{
+		return alignUp(sizeof(RecordHeader) + a_histogramBins * sizeof(uint32_t) + a_thumbnailWidth * a_thumbnailHeight * 3, RecordAlignment);
+	}
+
+	// the sidecar of a session, its extension swapped for .vck
+	inline std::string sidecarName(const std::string& a_session)
+	{
+		size_t dot = a_session.find_last_of('.');
+		size_t slash = a_session.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return a_session + ".vck";
+		return a_session.substr(0, dot) + ".vck";
+	}
+}
@@ -0,0 +1,94 @@
+#include "KeyframeIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace KeyframeFormat;
+
+bool KeyframeIndex::open(const std::string& a_filename)
+{
+	close();
+
+	if (!m_file.open(a_filename))
+		return false;
+
+	if (m_file.size() < sizeof(FileHeader))
+	{
+		std::cout << "Error: " << a_filename << " is too small for a keyframe index" << std::endl;
+		close();
+		return false;
+	}
+
+	memcpy(&m_header, m_file.data(), sizeof(FileHeader));
+	if (m_header.magic != FileMagic || m_header.version != Version || m_header.headerSize > m_file.size() ||
+		m_header.recordSize != recordSize(m_header.histogramBins, m_header.thumbnailWidth, m_header.thumbnailHeight) ||
+		m_header.cameraCount == 0 || m_header.intervalMs <= 0)
+	{
+		std::cout << "Error: " << a_filename << " is not a keyframe index this build can read" << std::endl;
+		close();
+		return false;
+	}
+
+	// records only ever go on the end, the first torn one is where writing stopped
+	for (uint64_t offset = m_header.headerSize; offset + m_header.recordSize <= m_file.size(); offset += m_header.recordSize)
+	{
+		auto record = reinterpret_cast<const RecordHeader*>(m_file.data() + offset);
+		if (record->magic != RecordMagic || record->camera >= m_header.cameraCount)
+			break;
+
+		size_t keyframe = record->keyframe;
+		if (keyframe >= m_keyframeCount)
+		{
+			m_keyframeCount = keyframe + 1;
+			m_records.resize(m_keyframeCount * m_header.cameraCount, 0);
+		}
+		m_records[keyframe * m_header.cameraCount + record->camera] = offset;
+	}
+
+	m_filename = a_filename;
+	return true;
+}
+
+void KeyframeIndex::close()
+{
+	m_file.close();
+	m_filename.clear();
+	m_header = FileHeader();
+	m_keyframeCount = 0;
+	m_records.clear();
+}
+
+size_t KeyframeIndex::findKeyframe(double a_time) const
+{
+	if (m_keyframeCount == 0 || a_time <= 0)
+		return 0;
+	return std::min((size_t)std::floor(a_time / m_header.intervalMs), m_keyframeCount - 1);
+}
+
+KeyframeIndex::KeyframeView KeyframeIndex::getKeyframe(size_t a_keyframe, size_t a_camera) const
+{
+	KeyframeView view;
+	if (a_keyframe >= m_keyframeCount || a_camera >= m_header.cameraCount)
+		return view;
+
+	uint64_t offset = m_records[a_keyframe * m_header.cameraCount + a_camera];
+	if (offset == 0)
+		return view;
+
+	const uint8_t* record = m_file.data() + offset;
+	view.header = reinterpret_cast<const RecordHeader*>(record);
+	view.histogram = reinterpret_cast<const uint32_t*>(record + sizeof(RecordHeader));
+	if (view.header->flags & HasThumbnail)
+		view.thumbnail = record + sizeof(RecordHeader) + m_header.histogramBins * sizeof(uint32_t);
+	return view;
+}
+
+uint64_t KeyframeIndex::getPointCount(size_t a_keyframe) const
+{
+	uint64_t points = 0;
+	for (size_t camera = 0; camera < m_header.cameraCount; ++camera)
+		if (auto view = getKeyframe(a_keyframe, camera))
+			points += view.header->points;
+	return points;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "KeyframeFormat.h"
+#include "MappedFile.h"
+
+// Read access to a session's keyframe sidecar (see KeyframeFormat.h), for browsing a long
+// recording without opening its streams. The file is memory mapped and opening only walks
+// the record headers into a keyframe by camera table, so thumbnails, histograms and point
+// counts are views straight into the mapping and any keyframe is a lookup away. A sidecar
+// still being written can be opened; it shows the keyframes taken so far.
+// Views stay valid until the index is closed or opens another file.
+class KeyframeIndex
+{
+public:
+
+	struct KeyframeView
+	{
+		const KeyframeFormat::RecordHeader*	header = nullptr;
+		const uint32_t*		histogram = nullptr;	// histogramBins counts
+		const uint8_t*		thumbnail = nullptr;	// RGB8, thumbnailWidth x thumbnailHeight, if HasThumbnail
+
+		explicit operator bool() const		{	return header != nullptr;	}
+	};
+
+	KeyframeIndex() = default;
+
+	bool			open(const std::string& a_filename);
+	void			close();
+
+	bool			isOpen() const			{	return m_file.isOpen();	}
+	const std::string&	getFilename() const	{	return m_filename;		}
+
+	const KeyframeFormat::FileHeader&	getHeader() const	{	return m_header;	}
+	size_t			getCameraCount() const	{	return m_header.cameraCount;	}
+	size_t			getKeyframeCount() const	{	return m_keyframeCount;		}	// the latest taken by any camera, plus one
+	double			getIntervalMs() const	{	return m_header.intervalMs;		}
+
+	// the keyframe at or before a_time, ms since each camera's first frame
+	size_t			findKeyframe(double a_time) const;
+
+	// empty if the camera has no record for that keyframe
+	KeyframeView	getKeyframe(size_t a_keyframe, size_t a_camera) const;
+
+	// pixels with depth at that keyframe summed over the cameras
+	uint64_t		getPointCount(size_t a_keyframe) const;
+
+private:
+
+	MappedFile		m_file;
+	std::string		m_filename;
+
+	KeyframeFormat::FileHeader	m_header;
+	size_t			m_keyframeCount = 0;
+	std::vector<uint64_t>	m_records;		// keyframe * cameraCount + camera, offset or 0 if missing
+};
@@ -0,0 +1,279 @@
+#include "KeyframeWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace KeyframeFormat;
+
+namespace
+{
+	// samples per thumbnail pixel along each axis, spread over the pixels it covers
+	constexpr int	ThumbnailSamples = 4;
+
+	// how a colour format's pixels are laid out, by rs2_format
+	struct ColourLayout
+	{
+		int		bytes = 0;				// per pixel, 0 if the format isn't understood
+		int		r = 0, g = 0, b = 0;	// byte offsets within a pixel
+	};
+
+	ColourLayout colourLayout(uint32_t a_format)
+	{
+		switch (a_format)
+		{
+		case 4:	return { 2, 0, 0, 0 };		// YUYV, luma only
+		case 5:	return { 3, 0, 1, 2 };		// RGB8
+		case 6:	return { 3, 2, 1, 0 };		// BGR8
+		case 7:	return { 4, 0, 1, 2 };		// RGBA8
+		case 8:	return { 4, 2, 1, 0 };		// BGRA8
+		case 9:	return { 1, 0, 0, 0 };		// Y8
+		}
+		return {};
+	}
+}
+
+KeyframeWriter::~KeyframeWriter()
+{
+	stop();
+}
+
+bool KeyframeWriter::start(const std::string& a_filename, const std::vector<SessionFormat::CameraInfo>& a_cameras, int64_t a_startTime)
+{
+	stop();
+
+	m_active = m_settings;
+	m_active.intervalMs = std::max(m_active.intervalMs, 1.0f);
+	m_active.thumbnailWidth = std::max(m_active.thumbnailWidth, 1);
+	m_active.histogramBins = std::max(m_active.histogramBins, 1);
+
+	// the thumbnail takes the first camera's colour aspect, or its depth's without colour
+	int thumbnailHeight = m_active.thumbnailWidth;
+	if (!a_cameras.empty())
+	{
+		auto& stream = a_cameras[0].colour.width > 0 ? a_cameras[0].colour : a_cameras[0].depth;
+		if (stream.width > 0)
+			thumbnailHeight = std::max(1, (int)std::lround((double)m_active.thumbnailWidth * stream.height / stream.width));
+	}
+
+	// records are small and written one at a time, so this goes through the OS cache
+	if (!m_file.open(a_filename, false))
+		return false;
+
+	m_header = FileHeader();
+	m_header.headerSize = (uint32_t)(sizeof(FileHeader) + a_cameras.size() * sizeof(SessionFormat::CameraInfo));
+	m_header.cameraCount = (uint32_t)a_cameras.size();
+	m_header.startTime = a_startTime;
+	m_header.intervalMs = m_active.intervalMs;
+	m_header.recordSize = (uint32_t)recordSize(m_active.histogramBins, m_active.thumbnailWidth, thumbnailHeight);
+	m_header.thumbnailWidth = (uint32_t)m_active.thumbnailWidth;
+	m_header.thumbnailHeight = (uint32_t)thumbnailHeight;
+	m_header.histogramBins = (uint32_t)m_active.histogramBins;
+	m_header.histogramMaxDepth = m_active.histogramMaxDepth;
+
+	std::vector<uint8_t> header(m_header.headerSize);
+	memcpy(header.data(), &m_header, sizeof(FileHeader));
+	if (!a_cameras.empty())
+		memcpy(header.data() + sizeof(FileHeader), a_cameras.data(), a_cameras.size() * sizeof(SessionFormat::CameraInfo));
+	if (!m_file.write(header.data(), header.size()))
+	{
+		std::cout << "Error: Unable to write keyframe header to " << a_filename << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	m_filename = a_filename;
+	m_cameras = a_cameras;
+	m_firstTimestamp.assign(a_cameras.size(), -1);
+	m_nextKeyframe.assign(a_cameras.size(), 0);
+	m_queue.clear();
+	m_free.clear();
+	m_failed = false;
+	m_quit = false;
+	m_keyframesWritten = 0;
+	m_bytesWritten = header.size();
+	m_keyframesBuilt = 0;
+	m_buildNs = 0;
+
+	m_thread = std::thread(&KeyframeWriter::run, this);
+	m_recording = true;
+	return true;
+}
+
+void KeyframeWriter::stop()
+{
+	if (!m_recording)
+		return;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	m_file.close();
+	m_free.clear();
+	m_recording = false;
+}
+
+bool KeyframeWriter::addFrame(const SessionFormat::FrameHeader& a_header, const void* a_depth, const void* a_colour)
+{
+	if (!m_recording || a_header.camera >= m_cameras.size() || (!a_depth && !a_colour))
+		return false;
+
+	// due once the camera's clock reaches the next multiple of the interval since its first frame
+	size_t camera = a_header.camera;
+	if (m_firstTimestamp[camera] < 0)
+		m_firstTimestamp[camera] = a_header.timestamp;
+	double time = a_header.timestamp - m_firstTimestamp[camera];
+	auto keyframe = (int64_t)std::floor(time / m_active.intervalMs);
+	if (keyframe < m_nextKeyframe[camera])
+		return false;
+	m_nextKeyframe[camera] = keyframe + 1;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<uint8_t> record;
+	{
+		std::lock_guard lock(m_mutex);
+		if (!m_free.empty())
+		{
+			record = std::move(m_free.back());
+			m_free.pop_back();
+		}
+	}
+	record.assign(m_header.recordSize, 0);
+
+	auto& info = m_cameras[camera];
+	RecordHeader header;
+	header.keyframe = (uint32_t)keyframe;
+	header.camera = a_header.camera;
+	header.timestamp = a_header.timestamp;
+	header.time = time;
+	header.frameNumber = a_header.frameNumber;
+
+	// payloads smaller than the camera's frames are left out rather than read past
+	auto layout = colourLayout(info.colour.format);
+	auto histogram = reinterpret_cast<uint32_t*>(record.data() + sizeof(RecordHeader));
+	uint8_t* thumbnail = record.data() + sizeof(RecordHeader) + m_header.histogramBins * sizeof(uint32_t);
+	if (a_depth && info.depth.width > 0 && a_header.depthSize >= (size_t)info.depth.width * info.depth.height * sizeof(uint16_t))
+	{
+		header.points = buildHistogram(info, static_cast<const uint16_t*>(a_depth), histogram);
+		header.flags |= HasDepth;
+	}
+	if (a_colour && layout.bytes > 0 && info.colour.width > 0 && a_header.colourSize >= (size_t)info.colour.width * info.colour.height * layout.bytes)
+	{
+		buildThumbnail(info, static_cast<const uint8_t*>(a_colour), thumbnail);
+		header.flags |= HasThumbnail;
+	}
+	memcpy(record.data(), &header, sizeof(RecordHeader));
+
+	m_buildNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	++m_keyframesBuilt;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(record));
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+void KeyframeWriter::buildThumbnail(const SessionFormat::CameraInfo& a_camera, const uint8_t* a_colour, uint8_t* a_out) const
+{
+	auto layout = colourLayout(a_camera.colour.format);
+	int width = (int)a_camera.colour.width, height = (int)a_camera.colour.height;
+	int thumbnailWidth = (int)m_header.thumbnailWidth, thumbnailHeight = (int)m_header.thumbnailHeight;
+	size_t stride = (size_t)width * layout.bytes;
+
+	for (int ty = 0; ty < thumbnailHeight; ++ty)
+	{
+		for (int tx = 0; tx < thumbnailWidth; ++tx)
+		{
+			uint32_t sum[3] = {};
+			for (int sy = 0; sy < ThumbnailSamples; ++sy)
+			{
+				int y = std::min(height - 1, (int)(((double)ty + (sy + 0.5) / ThumbnailSamples) * height / thumbnailHeight));
+				const uint8_t* row = a_colour + (size_t)y * stride;
+				for (int sx = 0; sx < ThumbnailSamples; ++sx)
+				{
+					int x = std::min(width - 1, (int)(((double)tx + (sx + 0.5) / ThumbnailSamples) * width / thumbnailWidth));
+					const uint8_t* pixel = row + (size_t)x * layout.bytes;
+					sum[0] += pixel[layout.r];
+					sum[1] += pixel[layout.g];
+					sum[2] += pixel[layout.b];
+				}
+			}
+
+			constexpr uint32_t count = ThumbnailSamples * ThumbnailSamples;
+			uint8_t* out = a_out + ((size_t)ty * thumbnailWidth + tx) * 3;
+			for (int channel = 0; channel < 3; ++channel)
+				out[channel] = (uint8_t)((sum[channel] + count / 2) / count);
+		}
+	}
+}
+
+uint32_t KeyframeWriter::buildHistogram(const SessionFormat::CameraInfo& a_camera, const uint16_t* a_depth, uint32_t* a_out) const
+{
+	// bins by raw value, so the loop is a multiply and a clamp
+	int bins = (int)m_header.histogramBins;
+	float scale = a_camera.depthUnits * bins / std::max(m_header.histogramMaxDepth, 0.001f);
+	size_t count = (size_t)a_camera.depth.width * a_camera.depth.height;
+
+	uint32_t points = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint16_t depth = a_depth[i];
+		if (depth == 0)
+			continue;
+		++a_out[std::min((int)(depth * scale), bins - 1)];
+		++points;
+	}
+	return points;
+}
+
+void KeyframeWriter::run()
+{
+	for (;;)
+	{
+		std::vector<uint8_t> record;
+		{
+			std::unique_lock lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			record = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		// records after a failed write would be misplaced, readers stop at the torn one anyway
+		if (!m_failed)
+		{
+			if (m_file.write(record.data(), record.size()))
+			{
+				++m_keyframesWritten;
+				m_bytesWritten += record.size();
+			}
+			else
+			{
+				std::cout << "Error: Unable to write to " << m_filename << ", keyframes stopped" << std::endl;
+				m_failed = true;
+			}
+		}
+
+		std::lock_guard lock(m_mutex);
+		m_free.push_back(std::move(record));
+	}
+}
+
+KeyframeWriter::Stats KeyframeWriter::getStats() const
+{
+	Stats stats;
+	stats.keyframesWritten = m_keyframesWritten;
+	stats.bytesWritten = m_bytesWritten;
+	if (uint64_t built = m_keyframesBuilt)
+		stats.buildMs = float(double(m_buildNs) / 1e6 / double(built));
+	return stats;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "KeyframeFormat.h"
+#include "SessionFormat.h"
+#include "UnbufferedFile.h"
+
+// Writes a session's keyframe sidecar (see KeyframeFormat.h) from the same raw frames the
+// session is recorded from, so it is there the moment recording stops, and is also what
+// builds one for a session after the fact. A frame only costs anything when its camera is
+// due a keyframe: then the thumbnail is box filtered down from the colour, a few samples per
+// thumbnail pixel, and the depth is counted into the histogram, on the calling thread. The
+// record is handed to a writer thread, so a busy disk never holds up capture, and each one
+// is written as soon as it is taken so a reader can follow a recording in progress.
+class KeyframeWriter
+{
+public:
+
+	struct Settings
+	{
+		float			intervalMs = 1000;
+		int				thumbnailWidth = 96;	// height follows the first camera's aspect
+		int				histogramBins = 32;
+		float			histogramMaxDepth = 8;	// m
+	};
+
+	struct Stats
+	{
+		uint64_t		keyframesWritten = 0;
+		uint64_t		bytesWritten = 0;
+		float			buildMs = 0;			// average per keyframe on the calling thread
+	};
+
+	KeyframeWriter() = default;
+	~KeyframeWriter();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}	// takes effect on the next start()
+
+	// a_startTime is the session's, see SessionFormat::FileHeader
+	bool			start(const std::string& a_filename, const std::vector<SessionFormat::CameraInfo>& a_cameras, int64_t a_startTime);
+	void			stop();
+
+	bool			isRecording() const		{	return m_recording;	}
+	const std::string&	getFilename() const	{	return m_filename;	}
+
+	// a frame as SessionRecorder::addFrame takes it, uncompressed: depth as Z16 and colour in
+	// the camera's format, the header's sizes theirs. Returns true if it was taken as a
+	// keyframe. Each camera's frames must come from one thread at a time, in time order.
+	bool			addFrame(const SessionFormat::FrameHeader& a_header, const void* a_depth, const void* a_colour);
+
+	Stats			getStats() const;
+
+private:
+
+	void			buildThumbnail(const SessionFormat::CameraInfo& a_camera, const uint8_t* a_colour, uint8_t* a_out) const;
+	uint32_t		buildHistogram(const SessionFormat::CameraInfo& a_camera, const uint16_t* a_depth, uint32_t* a_out) const;
+	void			run();
+
+	Settings				m_settings;
+	Settings				m_active;			// as of start()
+	std::string				m_filename;
+	UnbufferedFile			m_file;
+	bool					m_recording = false;
+	bool					m_failed = false;	// a write failed, the rest is dropped
+	std::vector<SessionFormat::CameraInfo>	m_cameras;
+	KeyframeFormat::FileHeader	m_header;
+
+	// per camera, only touched by the thread adding its frames
+	std::vector<double>		m_firstTimestamp;
+	std::vector<int64_t>	m_nextKeyframe;
+
+	// shared with the writer thread
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	std::deque<std::vector<uint8_t>>	m_queue;
+	std::vector<std::vector<uint8_t>>	m_free;	// records to build into, reused
+
+	std::atomic<uint64_t>	m_keyframesWritten = 0;
+	std::atomic<uint64_t>	m_bytesWritten = 0;
+	std::atomic<uint64_t>	m_keyframesBuilt = 0;
+	std::atomic<uint64_t>	m_buildNs = 0;
+};
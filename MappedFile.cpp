@@ -0,0 +1,124 @@
+#include "MappedFile.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& a_filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(a_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size{};
+	if (GetFileSizeEx(file, &size) == FALSE ||
+		size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = (size_t)size.QuadPart;
+#else
+	int file = ::open(a_filename.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info{};
+	if (fstat(file, &info) != 0 ||
+		info.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	if (view == MAP_FAILED)
+	{
+		::close(file);
+		return false;
+	}
+
+	m_file = file;
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = (size_t)info.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != nullptr)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data != nullptr)
+		munmap((void*)m_data, m_size);
+	if (m_file >= 0)
+		::close(m_file);
+	m_file = -1;
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void MappedFile::prefetch(size_t a_offset, size_t a_size) const
+{
+	if (m_data == nullptr ||
+		a_offset >= m_size)
+		return;
+
+	// whole pages, the hints work on those
+	const size_t page = 4096;
+	size_t begin = a_offset & ~(page - 1);
+	size_t end = std::min(a_offset + a_size, m_size);
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range{ (void*)(m_data + begin), end - begin };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)(m_data + begin), end - begin, MADV_WILLNEED);
+#endif
+}
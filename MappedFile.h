@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+// The mapping stays valid until close() is called or the object is destroyed.
+class MappedFile
+{
+public:
+
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool				open(const std::string& a_filename);
+	void				close();
+
+	bool				isOpen() const	{	return m_data != nullptr;	}
+	const unsigned char*	data() const	{	return m_data;				}
+	size_t				size() const	{	return m_size;				}
+
+	// asks the OS to start reading a range in ahead of it being touched
+	void				prefetch(size_t a_offset, size_t a_size) const;
+
+private:
+
+	const unsigned char*	m_data = nullptr;
+	size_t				m_size = 0;
+
+#ifdef _WIN32
+	void*				m_file = nullptr;
+	void*				m_mapping = nullptr;
+#else
+	int					m_file = -1;
+#endif
+};
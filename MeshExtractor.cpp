@@ -0,0 +1,324 @@
+#include "MeshExtractor.h"
+#include "MarchingCubesTables.h"
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+
+#include <Eigen/Geometry>
+
+namespace
+{
+	constexpr int S = TsdfVolume::BlockSize;
+	constexpr int N = S + 1;	// block voxels plus the +x/+y/+z neighbour layer
+
+	// corner offsets and, for each edge, the corner it starts from and its axis
+	constexpr int CornerOffset[8][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+										 { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } };
+	constexpr int EdgeCorners[12][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 }, { 4, 5 }, { 5, 6 },
+										 { 7, 6 }, { 4, 7 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+	constexpr int EdgeAxis[12] = { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 };
+
+	inline int localIndex(int x, int y, int z)
+	{
+		return (z * N + y) * N + x;
+	}
+
+	// the block's voxels with the first layer of its +x/+y/+z neighbours copied around them
+	struct LocalGrid
+	{
+		float		tsdf[N * N * N];
+		uint16_t	weight[N * N * N];
+		uint8_t		rgb[N * N * N * 3];
+
+		void gather(const TsdfVolume& a_volume, const TsdfVolume::Block& a_block)
+		{
+			std::fill(std::begin(weight), std::end(weight), 0);
+
+			for (int nz = 0; nz <= 1; ++nz)
+				for (int ny = 0; ny <= 1; ++ny)
+					for (int nx = 0; nx <= 1; ++nx)
+					{
+						const TsdfVolume::Block* block = &a_block;
+						if (nx | ny | nz)
+							block = a_volume.findBlock(a_block.coord + Eigen::Vector3i(nx, ny, nz));
+						if (block == nullptr)
+							continue;
+
+						// neighbours only contribute their first voxel layer along the offset axes
+						int x0 = nx * S, x1 = nx ? N : S;
+						int y0 = ny * S, y1 = ny ? N : S;
+						int z0 = nz * S, z1 = nz ? N : S;
+						for (int z = z0; z < z1; ++z)
+							for (int y = y0; y < y1; ++y)
+								for (int x = x0; x < x1; ++x)
+								{
+									int voxel = ((z - z0) * S + (y - y0)) * S + (x - x0);
+									int i = localIndex(x, y, z);
+									tsdf[i] = block->tsdf[voxel];
+									weight[i] = block->weight[voxel];
+									rgb[i * 3] = block->rgb[voxel * 3];
+									rgb[i * 3 + 1] = block->rgb[voxel * 3 + 1];
+									rgb[i * 3 + 2] = block->rgb[voxel * 3 + 2];
+								}
+					}
+		}
+	};
+}
+
+void TriangleMesh::clear()
+{
+	positions.clear();
+	normals.clear();
+	colours.clear();
+	indices.clear();
+}
+
+bool TriangleMesh::savePly(const std::string& a_filename) const
+{
+	std::ofstream file(a_filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+
+	file << "ply\nformat binary_little_endian 1.0\n"
+		<< "element vertex " << positions.size() << "\n"
+		<< "property float x\nproperty float y\nproperty float z\n"
+		<< "property float nx\nproperty float ny\nproperty float nz\n"
+		<< "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+		<< "element face " << indices.size() / 3 << "\n"
+		<< "property list uchar uint vertex_indices\n"
+		<< "end_header\n";
+
+	std::vector<char> buffer;
+	buffer.reserve(positions.size() * 27);
+	auto append = [&](const void* a_data, size_t a_size) {
+		buffer.insert(buffer.end(), (const char*)a_data, (const char*)a_data + a_size);
+	};
+
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		append(positions[i].data(), sizeof(float) * 3);
+		append(normals[i].data(), sizeof(float) * 3);
+		append(&colours[i * 3], 3);
+	}
+	file.write(buffer.data(), buffer.size());
+
+	buffer.clear();
+	buffer.reserve(indices.size() / 3 * 13);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint8_t count = 3;
+		append(&count, 1);
+		append(&indices[i], sizeof(uint32_t) * 3);
+	}
+	file.write(buffer.data(), buffer.size());
+
+	return file.good();
+}
+
+void MeshExtractor::clear()
+{
+	m_blockMeshIndex.clear();
+	m_blockMeshes.clear();
+	m_mesh.clear();
+	m_lastTick = 0;
+	++m_revision;
+}
+
+void MeshExtractor::polygonise(const TsdfVolume& a_volume, const TsdfVolume::Block& a_block, BlockMesh& a_mesh) const
+{
+	a_mesh.positions.clear();
+	a_mesh.normals.clear();
+	a_mesh.colours.clear();
+	a_mesh.indices.clear();
+
+	LocalGrid grid;
+	grid.gather(a_volume, a_block);
+
+	// vertex already emitted on each local voxel edge, indexed by voxel * 3 + axis
+	int32_t edgeVertex[N * N * N * 3];
+	std::fill(std::begin(edgeVertex), std::end(edgeVertex), -1);
+
+	const float voxelSize = a_volume.getSettings().voxelSize;
+	const Eigen::Vector3f origin = (a_block.coord.cast<float>() * S + Eigen::Vector3f::Constant(0.5f)) * voxelSize;
+
+	for (int z = 0; z < S; ++z)
+		for (int y = 0; y < S; ++y)
+			for (int x = 0; x < S; ++x)
+			{
+				int corners[8];
+				int caseIndex = 0;
+				bool observed = true;
+				for (int c = 0; c < 8; ++c)
+				{
+					corners[c] = localIndex(x + CornerOffset[c][0], y + CornerOffset[c][1], z + CornerOffset[c][2]);
+					observed &= grid.weight[corners[c]] > 0;
+					if (grid.tsdf[corners[c]] < 0)
+						caseIndex |= 1 << c;
+				}
+
+				if (observed == false ||
+					MarchingCubes::EdgeTable[caseIndex] == 0)
+					continue;
+
+				int vertices[12];
+				for (int e = 0; e < 12; ++e)
+				{
+					if ((MarchingCubes::EdgeTable[caseIndex] & (1 << e)) == 0)
+						continue;
+
+					int a = corners[EdgeCorners[e][0]];
+					int b = corners[EdgeCorners[e][1]];
+					auto& cached = edgeVertex[a * 3 + EdgeAxis[e]];
+					if (cached < 0)
+					{
+						float t = grid.tsdf[a] / (grid.tsdf[a] - grid.tsdf[b]);
+
+						Eigen::Vector3f p(float(x + CornerOffset[EdgeCorners[e][0]][0]),
+										  float(y + CornerOffset[EdgeCorners[e][0]][1]),
+										  float(z + CornerOffset[EdgeCorners[e][0]][2]));
+						p[EdgeAxis[e]] += t;
+
+						cached = (int32_t)a_mesh.positions.size();
+						a_mesh.positions.push_back(origin + p * voxelSize);
+						a_mesh.normals.push_back(Eigen::Vector3f::Zero());
+						for (int k = 0; k < 3; ++k)
+							a_mesh.colours.push_back((uint8_t)(grid.rgb[a * 3 + k] + t * (grid.rgb[b * 3 + k] - grid.rgb[a * 3 + k])));
+					}
+					vertices[e] = cached;
+				}
+
+				auto triangles = MarchingCubes::TriTable[caseIndex];
+				for (int i = 0; triangles[i] >= 0; i += 3)
+				{
+					uint32_t v0 = vertices[triangles[i]];
+					uint32_t v1 = vertices[triangles[i + 1]];
+					uint32_t v2 = vertices[triangles[i + 2]];
+					a_mesh.indices.insert(a_mesh.indices.end(), { v0, v1, v2 });
+
+					// area weighted vertex normals
+					Eigen::Vector3f n = (a_mesh.positions[v1] - a_mesh.positions[v0]).cross(a_mesh.positions[v2] - a_mesh.positions[v0]);
+					a_mesh.normals[v0] += n;
+					a_mesh.normals[v1] += n;
+					a_mesh.normals[v2] += n;
+				}
+			}
+
+	for (auto& n : a_mesh.normals)
+		n.normalize();
+}
+
+void MeshExtractor::extract(const TsdfVolume& a_volume, const std::vector<uint64_t>& a_keys)
+{
+	// slots are handed out up front so the parallel pass only touches its own mesh
+	std::vector<std::pair<const TsdfVolume::Block*, uint32_t>> work;
+	work.reserve(a_keys.size());
+	for (auto key : a_keys)
+	{
+		auto block = a_volume.findBlock(unpackVoxelKey(key));
+		if (block == nullptr && m_blockMeshIndex.find(key) == nullptr)
+			continue;
+
+		auto slot = m_blockMeshIndex.insert(key, (uint32_t)m_blockMeshes.size());
+		if (slot.second)
+			m_blockMeshes.emplace_back();
+		work.push_back({ block, *slot.first });
+	}
+
+	std::for_each(std::execution::par, work.begin(), work.end(), [&](const std::pair<const TsdfVolume::Block*, uint32_t>& a_work) {
+		if (a_work.first != nullptr)
+			polygonise(a_volume, *a_work.first, m_blockMeshes[a_work.second]);
+		else
+			m_blockMeshes[a_work.second] = BlockMesh{};
+	});
+
+	m_lastBlockCount = work.size();
+	assemble();
+}
+
+bool MeshExtractor::update(const TsdfVolume& a_volume)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	if (a_volume.getGeneration() != m_generation)
+	{
+		clear();
+		m_generation = a_volume.getGeneration();
+	}
+
+	std::vector<const TsdfVolume::Block*> updated;
+	a_volume.getBlocksUpdatedSince(m_lastTick, updated);
+	m_lastTick = a_volume.getTick();
+	if (updated.empty())
+		return false;
+
+	// cells in the -x/-y/-z neighbours read this block's first voxel layer, so they are dirty too
+	FlatHashMap<uint8_t> dirty(updated.size() * 8);
+	std::vector<uint64_t> keys;
+	keys.reserve(updated.size() * 2);
+	for (auto block : updated)
+		for (int z = -1; z <= 0; ++z)
+			for (int y = -1; y <= 0; ++y)
+				for (int x = -1; x <= 0; ++x)
+				{
+					auto key = packVoxelKey(block->coord + Eigen::Vector3i(x, y, z));
+					if (dirty.insert(key, 0).second)
+						keys.push_back(key);
+				}
+
+	extract(a_volume, keys);
+
+	m_lastUpdateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+void MeshExtractor::rebuild(const TsdfVolume& a_volume)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_blockMeshIndex.clear();
+	m_blockMeshes.clear();
+	m_generation = a_volume.getGeneration();
+	m_lastTick = a_volume.getTick();
+
+	std::vector<uint64_t> keys;
+	keys.reserve(a_volume.getBlocks().size());
+	for (auto& block : a_volume.getBlocks())
+		keys.push_back(packVoxelKey(block->coord));
+
+	extract(a_volume, keys);
+
+	m_lastRebuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MeshExtractor::assemble()
+{
+	size_t vertexCount = 0, indexCount = 0;
+	for (auto& block : m_blockMeshes)
+	{
+		vertexCount += block.positions.size();
+		indexCount += block.indices.size();
+	}
+
+	m_mesh.clear();
+	m_mesh.positions.reserve(vertexCount);
+	m_mesh.normals.reserve(vertexCount);
+	m_mesh.colours.reserve(vertexCount * 3);
+	m_mesh.indices.reserve(indexCount);
+
+	for (auto& block : m_blockMeshes)
+	{
+		uint32_t base = (uint32_t)m_mesh.positions.size();
+		m_mesh.positions.insert(m_mesh.positions.end(), block.positions.begin(), block.positions.end());
+		m_mesh.normals.insert(m_mesh.normals.end(), block.normals.begin(), block.normals.end());
+		m_mesh.colours.insert(m_mesh.colours.end(), block.colours.begin(), block.colours.end());
+		for (auto index : block.indices)
+			m_mesh.indices.push_back(base + index);
+	}
+
+	++m_revision;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "FlatHashMap.h"
+#include "TsdfVolume.h"
+
+// Indexed triangle mesh in capture space
+struct TriangleMesh
+{
+	std::vector<Eigen::Vector3f>	positions;
+	std::vector<Eigen::Vector3f>	normals;
+	std::vector<uint8_t>			colours;	// rgb per vertex
+	std::vector<uint32_t>			indices;
+
+	void	clear();
+
+	// binary little-endian PLY
+	bool	savePly(const std::string& a_filename) const;
+};
+
+// Marching cubes over a TsdfVolume that only re-polygonises the blocks integrated since
+// the last update, plus the neighbours whose boundary cells read those blocks' voxels.
+// Each block keeps its own small mesh, rebuilt in parallel, and the per-block meshes are
+// concatenated into one indexed mesh.
+class MeshExtractor
+{
+public:
+
+	MeshExtractor() = default;
+	~MeshExtractor() = default;
+
+	// incremental, returns true if the mesh changed
+	bool				update(const TsdfVolume& a_volume);
+
+	// re-polygonises every block regardless of what changed
+	void				rebuild(const TsdfVolume& a_volume);
+
+	void				clear();
+
+	const TriangleMesh&	getMesh() const				{	return m_mesh;				}
+	uint64_t			getRevision() const			{	return m_revision;			}
+	size_t				getLastBlockCount() const	{	return m_lastBlockCount;	}
+	float				getLastUpdateMs() const		{	return m_lastUpdateMs;		}
+	float				getLastRebuildMs() const	{	return m_lastRebuildMs;		}
+
+private:
+
+	struct BlockMesh
+	{
+		std::vector<Eigen::Vector3f>	positions;
+		std::vector<Eigen::Vector3f>	normals;
+		std::vector<uint8_t>			colours;
+		std::vector<uint32_t>			indices;
+	};
+
+	void				polygonise(const TsdfVolume& a_volume, const TsdfVolume::Block& a_block, BlockMesh& a_mesh) const;
+	void				extract(const TsdfVolume& a_volume, const std::vector<uint64_t>& a_keys);
+	void				assemble();
+
+	FlatHashMap<uint32_t>	m_blockMeshIndex;	// packed block coord -> index into m_blockMeshes
+	std::vector<BlockMesh>	m_blockMeshes;
+
+	TriangleMesh		m_mesh;
+	uint64_t			m_lastTick = 0;
+	uint64_t			m_generation = 0;
+	uint64_t			m_revision = 0;
+
+	size_t				m_lastBlockCount = 0;
+	float				m_lastUpdateMs = 0;
+	float				m_lastRebuildMs = 0;
+};
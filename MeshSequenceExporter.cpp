@@ -0,0 +1,304 @@
+#include "MeshSequenceExporter.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+MeshSequenceExporter::~MeshSequenceExporter()
+{
+	stop();
+}
+
+bool MeshSequenceExporter::start(const std::string& a_directory)
+{
+	stop();
+
+	std::error_code error;
+	std::filesystem::create_directories(a_directory, error);
+	if (error)
+	{
+		std::cout << "Error: Unable to create export directory " << a_directory << std::endl;
+		return false;
+	}
+
+	m_active = m_settings;
+	m_directory = a_directory;
+
+	unsigned int threads = m_active.threads;
+	if (threads == 0)
+		threads = std::max(2u, std::thread::hardware_concurrency() / 2);
+
+	// at least a frame per worker, or some would never have one
+	m_free.clear();
+	for (unsigned int i = 0; i < std::max(m_active.backlog, threads); ++i)
+		m_free.push_back(std::make_unique<Job>());
+
+	m_workers.clear();
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		auto worker = std::make_unique<Worker>();
+		worker->volume.setSettings(m_active.volume);
+		worker->simplifier.setSettings(m_active.simplifier);
+		worker->baker.setSettings(m_active.baker);
+		worker->codec.setSettings({ ColourCodec::Type::Jpeg, m_active.jpegQuality });
+		m_workers.push_back(std::move(worker));
+	}
+
+	m_quit = false;
+	m_busy = 0;
+	m_framesWritten = 0;
+	m_framesDropped = 0;
+	m_framesEmpty = 0;
+	m_trianglesWritten = 0;
+	m_bytesWritten = 0;
+	m_reconstructNs = 0;
+	m_simplifyNs = 0;
+	m_bakeNs = 0;
+	m_writeNs = 0;
+	m_start = std::chrono::steady_clock::now();
+
+	for (unsigned int i = 0; i < threads; ++i)
+		m_threads.emplace_back(&MeshSequenceExporter::run, this, (size_t)i);
+
+	m_running = true;
+	return true;
+}
+
+void MeshSequenceExporter::stop()
+{
+	if (!m_running)
+		return;
+
+	// the workers drain the queue before they see m_quit
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+
+	m_workers.clear();
+	m_free.clear();
+	m_running = false;
+}
+
+bool MeshSequenceExporter::add(const std::string& a_name, const TriangleMesh& a_mesh, const std::vector<TextureBaker::Camera>& a_cameras)
+{
+	if (!m_running)
+		return false;
+
+	auto job = takeJob();
+	if (!job)
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	job->name = a_name;
+	job->reconstruct = false;
+	job->mesh = a_mesh;
+	copyCameras(a_cameras, *job);
+	queueJob(std::move(job));
+	return true;
+}
+
+bool MeshSequenceExporter::add(const std::string& a_name, const std::vector<TsdfVolume::DepthInput>& a_depth,
+	const std::vector<TextureBaker::Camera>& a_cameras)
+{
+	if (!m_running)
+		return false;
+
+	auto job = takeJob();
+	if (!job)
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	job->name = a_name;
+	job->reconstruct = true;
+	job->depth.clear();
+	job->depthData.resize(a_depth.size());
+	for (size_t i = 0; i < a_depth.size(); ++i)
+	{
+		auto input = a_depth[i];
+		if (input.depth)
+		{
+			auto& data = job->depthData[i];
+			data.assign(input.depth, input.depth + (size_t)input.width * input.height);
+			input.depth = data.data();
+		}
+		// the atlas has the colour, the volume only needs depth
+		input.colour = nullptr;
+		job->depth.push_back(input);
+	}
+	copyCameras(a_cameras, *job);
+	queueJob(std::move(job));
+	return true;
+}
+
+void MeshSequenceExporter::copyCameras(const std::vector<TextureBaker::Camera>& a_cameras, Job& a_job) const
+{
+	a_job.cameras.clear();
+	a_job.colourData.resize(a_cameras.size());
+	for (size_t i = 0; i < a_cameras.size(); ++i)
+	{
+		auto camera = a_cameras[i];
+		if (camera.rgb)
+		{
+			auto& data = a_job.colourData[i];
+			data.resize((size_t)camera.width * camera.height * 3);
+			for (int y = 0; y < camera.height; ++y)
+				std::copy_n(camera.rgb + (size_t)y * camera.stride, camera.width * 3, &data[(size_t)y * camera.width * 3]);
+			camera.rgb = data.data();
+			camera.stride = camera.width * 3;
+		}
+		a_job.cameras.push_back(camera);
+	}
+}
+
+std::unique_ptr<MeshSequenceExporter::Job> MeshSequenceExporter::takeJob()
+{
+	std::unique_lock lock(m_mutex);
+	if (m_active.wait)
+		m_freed.wait(lock, [this] { return !m_free.empty(); });
+	if (m_free.empty())
+		return nullptr;
+	auto job = std::move(m_free.back());
+	m_free.pop_back();
+	return job;
+}
+
+void MeshSequenceExporter::queueJob(std::unique_ptr<Job> a_job)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(a_job));
+	}
+	m_wake.notify_one();
+}
+
+void MeshSequenceExporter::run(size_t a_worker)
+{
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+		if (m_queue.empty())
+			break;
+
+		auto job = std::move(m_queue.front());
+		m_queue.pop_front();
+		++m_busy;
+		lock.unlock();
+
+		process(*m_workers[a_worker], *job);
+
+		lock.lock();
+		--m_busy;
+		m_free.push_back(std::move(job));
+		m_freed.notify_one();
+	}
+}
+
+void MeshSequenceExporter::process(Worker& a_worker, Job& a_job)
+{
+	using Clock = std::chrono::steady_clock;
+	auto elapsedNs = [](Clock::time_point a_from) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - a_from).count();
+	};
+
+	auto start = Clock::now();
+	const TriangleMesh* mesh = &a_job.mesh;
+	if (a_job.reconstruct)
+	{
+		a_worker.volume.clear();
+		a_worker.volume.integrate(a_job.depth);
+		a_worker.extractor.rebuild(a_worker.volume);
+		mesh = &a_worker.extractor.getMesh();
+	}
+	uint64_t reconstructNs = elapsedNs(start);
+
+	start = Clock::now();
+	a_worker.simplifier.simplify(*mesh, a_worker.simplified);
+	uint64_t simplifyNs = elapsedNs(start);
+
+	if (a_worker.simplified.indices.empty())
+	{
+		++m_framesEmpty;
+		return;
+	}
+
+	// the volume had no colour for its vertices, what no camera sees is grey rather than black
+	if (a_job.reconstruct)
+		std::fill(a_worker.simplified.colours.begin(), a_worker.simplified.colours.end(), (uint8_t)128);
+
+	start = Clock::now();
+	a_worker.baker.bake(a_worker.simplified, a_job.cameras, a_worker.textured);
+	uint64_t bakeNs = elapsedNs(start);
+
+	start = Clock::now();
+	auto& textured = a_worker.textured;
+	std::string filename = m_directory + "/" + a_job.name + (m_active.format == Format::Glb ? ".glb" : ".obj");
+	bool written = a_worker.codec.encode(textured.atlas.data(), textured.atlasWidth, textured.atlasHeight, a_worker.image);
+	if (written)
+		written = m_active.format == Format::Glb ? textured.saveGlb(filename, a_worker.image, "image/jpeg") :
+			textured.saveObj(filename, a_worker.image, "jpg");
+	if (!written)
+	{
+		std::cout << "Error: Writing " << filename << " failed" << std::endl;
+		++m_framesDropped;
+		return;
+	}
+	uint64_t writeNs = elapsedNs(start);
+
+	uint64_t bytes = 0;
+	std::error_code error;
+	auto extensions = m_active.format == Format::Glb ? std::vector<const char*>{ ".glb" } : std::vector<const char*>{ ".obj", ".mtl", ".jpg" };
+	for (const char* extension : extensions)
+	{
+		auto path = m_directory + "/" + a_job.name + extension;
+		if (std::filesystem::exists(path, error))
+			bytes += std::filesystem::file_size(path, error);
+	}
+
+	m_reconstructNs += reconstructNs;
+	m_simplifyNs += simplifyNs;
+	m_bakeNs += bakeNs;
+	m_writeNs += writeNs;
+	m_trianglesWritten += textured.indices.size() / 3;
+	m_bytesWritten += bytes;
+	++m_framesWritten;
+}
+
+MeshSequenceExporter::Stats MeshSequenceExporter::getStats() const
+{
+	Stats stats;
+	stats.framesWritten = m_framesWritten;
+	stats.framesDropped = m_framesDropped;
+	stats.framesEmpty = m_framesEmpty;
+	stats.trianglesWritten = m_trianglesWritten;
+	stats.bytesWritten = m_bytesWritten;
+	if (uint64_t frames = stats.framesWritten)
+	{
+		auto averageMs = [frames](uint64_t a_ns) { return float(double(a_ns) / 1e6 / double(frames)); };
+		stats.reconstructMs = averageMs(m_reconstructNs);
+		stats.simplifyMs = averageMs(m_simplifyNs);
+		stats.bakeMs = averageMs(m_bakeNs);
+		stats.writeMs = averageMs(m_writeNs);
+		stats.secondsPerFrame = (stats.reconstructMs + stats.simplifyMs + stats.bakeMs + stats.writeMs) / 1000;
+	}
+	if (!m_running)
+		return stats;
+
+	{
+		std::lock_guard lock(m_mutex);
+		stats.threads = (unsigned int)m_threads.size();
+		stats.queued = (unsigned int)m_queue.size() + m_busy;
+	}
+	stats.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count();
+	if (stats.seconds > 0)
+		stats.framesPerSecond = float(stats.framesWritten) / stats.seconds;
+	return stats;
+}
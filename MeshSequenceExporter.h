@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ColourCodec.h"
+#include "MeshExtractor.h"
+#include "MeshSimplifier.h"
+#include "TextureBaker.h"
+#include "TsdfVolume.h"
+
+// Exports textured mesh sequences, one GLB, or OBJ with its material and JPEG atlas, per
+// frame. A frame is either a mesh that is already extracted, as the live volume has, or the
+// depth of every camera, reconstructed into a volume of its own so each frame stands alone.
+// Either way the mesh is simplified and cleaned (see MeshSimplifier), an atlas baked from
+// the frame's colour images (see TextureBaker) and the file written.
+// add() copies what it is given, since capture reuses its buffers, and returns. A pool of
+// workers takes the frames from a bounded backlog, each running a frame end to end with its
+// own volume, simplifier, baker and encoder, so frames are processed in parallel. Past the
+// backlog live frames are dropped and counted, a batch export waits for a worker instead.
+class MeshSequenceExporter
+{
+public:
+
+	enum class Format
+	{
+		Glb,
+		Obj,
+	};
+
+	struct Settings
+	{
+		Format			format = Format::Glb;
+		TsdfVolume::Settings		volume;			// frames reconstructed from depth
+		MeshSimplifier::Settings	simplifier;
+		TextureBaker::Settings		baker;
+		int				jpegQuality = 90;
+		unsigned int	threads = 0;			// 0 is half the cores, at least 2
+		unsigned int	backlog = 4;			// frames waiting on the workers
+		bool			wait = false;			// add() waits on a full backlog rather than dropping
+	};
+
+	struct Stats
+	{
+		uint64_t		framesWritten = 0;
+		uint64_t		framesDropped = 0;
+		uint64_t		framesEmpty = 0;		// nothing left to write after cleaning
+		uint64_t		trianglesWritten = 0;
+		uint64_t		bytesWritten = 0;
+		unsigned int	queued = 0;				// waiting for or being processed
+		unsigned int	threads = 0;
+		float			seconds = 0;			// since start
+		float			secondsPerFrame = 0;	// a worker's time for one frame
+		float			framesPerSecond = 0;	// written, across the workers
+		float			reconstructMs = 0;		// averages per frame of each stage
+		float			simplifyMs = 0;
+		float			bakeMs = 0;
+		float			writeMs = 0;			// encoding the atlas included
+	};
+
+	MeshSequenceExporter() = default;
+	~MeshSequenceExporter();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}	// takes effect on the next start()
+
+	// files go to a_directory, which is created
+	bool			start(const std::string& a_directory);
+	void			stop();
+	bool			isRunning() const		{	return m_running;	}
+	const std::string&	getDirectory() const	{	return m_directory;	}
+
+	// a_name is the file name without extension. Both return false if the frame was dropped.
+	bool			add(const std::string& a_name, const TriangleMesh& a_mesh, const std::vector<TextureBaker::Camera>& a_cameras);
+	bool			add(const std::string& a_name, const std::vector<TsdfVolume::DepthInput>& a_depth,
+						const std::vector<TextureBaker::Camera>& a_cameras);
+
+	Stats			getStats() const;
+
+private:
+
+	struct Job
+	{
+		std::string		name;
+		bool			reconstruct = false;
+		TriangleMesh	mesh;
+		std::vector<TsdfVolume::DepthInput>		depth;		// pointing into depthData
+		std::vector<std::vector<uint16_t>>		depthData;
+		std::vector<TextureBaker::Camera>		cameras;	// pointing into colourData
+		std::vector<std::vector<uint8_t>>		colourData;
+	};
+
+	struct Worker
+	{
+		TsdfVolume		volume;
+		MeshExtractor	extractor;
+		MeshSimplifier	simplifier;
+		TextureBaker	baker;
+		ColourCodec		codec;
+		TriangleMesh	simplified;
+		TexturedMesh	textured;
+		std::vector<uint8_t>	image;
+	};
+
+	std::unique_ptr<Job>	takeJob();
+	void			queueJob(std::unique_ptr<Job> a_job);
+	void			copyCameras(const std::vector<TextureBaker::Camera>& a_cameras, Job& a_job) const;
+	void			run(size_t a_worker);
+	void			process(Worker& a_worker, Job& a_job);
+
+	Settings				m_settings;
+	Settings				m_active;			// as of start()
+	std::string				m_directory;
+	bool					m_running = false;
+	std::chrono::steady_clock::time_point	m_start;
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;				// workers, for a queued frame
+	std::condition_variable	m_freed;			// add(), for a free job when waiting
+	std::vector<std::thread>	m_threads;
+	std::vector<std::unique_ptr<Worker>>	m_workers;
+	bool					m_quit = false;
+	std::deque<std::unique_ptr<Job>>	m_queue;
+	std::vector<std::unique_ptr<Job>>	m_free;
+	unsigned int			m_busy = 0;
+
+	std::atomic<uint64_t>	m_framesWritten = 0;
+	std::atomic<uint64_t>	m_framesDropped = 0;
+	std::atomic<uint64_t>	m_framesEmpty = 0;
+	std::atomic<uint64_t>	m_trianglesWritten = 0;
+	std::atomic<uint64_t>	m_bytesWritten = 0;
+	std::atomic<uint64_t>	m_reconstructNs = 0;
+	std::atomic<uint64_t>	m_simplifyNs = 0;
+	std::atomic<uint64_t>	m_bakeNs = 0;
+	std::atomic<uint64_t>	m_writeNs = 0;
+};
@@ -0,0 +1,143 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <chrono>
+
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/clean.h>
+#include <vcg/complex/algorithms/local_optimization.h>
+#include <vcg/complex/algorithms/local_optimization/tri_edge_collapse_quadric.h>
+#include <vcg/complex/algorithms/update/bounding.h>
+#include <vcg/complex/algorithms/update/normal.h>
+#include <vcg/complex/algorithms/update/topology.h>
+
+namespace
+{
+	// the mesh as vcglib's quadric collapse wants it, see its tridecimator sample
+	class Vertex;
+	class Edge;
+	class Face;
+
+	struct UsedTypes : public vcg::UsedTypes<vcg::Use<Vertex>::AsVertexType, vcg::Use<Edge>::AsEdgeType, vcg::Use<Face>::AsFaceType> {};
+
+	class Vertex : public vcg::Vertex<UsedTypes, vcg::vertex::VFAdj, vcg::vertex::Coord3f, vcg::vertex::Normal3f,
+		vcg::vertex::Color4b, vcg::vertex::Mark, vcg::vertex::BitFlags>
+	{
+	public:
+
+		vcg::math::Quadric<double>&	Qd()	{	return m_quadric;	}
+
+	private:
+
+		vcg::math::Quadric<double>	m_quadric;
+	};
+
+	class Edge : public vcg::Edge<UsedTypes> {};
+
+	class Face : public vcg::Face<UsedTypes, vcg::face::VFAdj, vcg::face::FFAdj, vcg::face::VertexRef, vcg::face::BitFlags> {};
+
+	class Mesh : public vcg::tri::TriMesh<std::vector<Vertex>, std::vector<Face>> {};
+
+	using VertexPair = vcg::tri::BasicVertexPair<Vertex>;
+
+	class Collapse : public vcg::tri::TriEdgeCollapseQuadric<Mesh, VertexPair, Collapse, vcg::tri::QInfoStandard<Vertex>>
+	{
+	public:
+
+		using Base = vcg::tri::TriEdgeCollapseQuadric<Mesh, VertexPair, Collapse, vcg::tri::QInfoStandard<Vertex>>;
+
+		Collapse(const VertexPair& a_pair, int a_mark, vcg::BaseParameterClass* a_parameters) : Base(a_pair, a_mark, a_parameters) {}
+	};
+
+	void compact(Mesh& a_mesh)
+	{
+		vcg::tri::Allocator<Mesh>::CompactVertexVector(a_mesh);
+		vcg::tri::Allocator<Mesh>::CompactFaceVector(a_mesh);
+	}
+}
+
+void MeshSimplifier::simplify(const TriangleMesh& a_in, TriangleMesh& a_out)
+{
+	auto start = std::chrono::steady_clock::now();
+	a_out.clear();
+
+	Mesh mesh;
+	size_t vertexCount = a_in.positions.size();
+	size_t triangleCount = a_in.indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		m_lastSimplifyMs = 0;
+		return;
+	}
+
+	bool colours = a_in.colours.size() == vertexCount * 3;
+	auto vertex = vcg::tri::Allocator<Mesh>::AddVertices(mesh, vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i, ++vertex)
+	{
+		auto& p = a_in.positions[i];
+		vertex->P() = vcg::Point3f(p.x(), p.y(), p.z());
+		if (colours)
+			vertex->C() = vcg::Color4b(a_in.colours[i * 3], a_in.colours[i * 3 + 1], a_in.colours[i * 3 + 2], 255);
+		else
+			vertex->C() = vcg::Color4b(128, 128, 128, 255);
+	}
+	auto face = vcg::tri::Allocator<Mesh>::AddFaces(mesh, triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t, ++face)
+		for (int corner = 0; corner < 3; ++corner)
+			face->V(corner) = &mesh.vert[a_in.indices[t * 3 + corner]];
+
+	// cleaned first, so neither the seams nor the floaters cost the collapse any time
+	vcg::tri::Clean<Mesh>::RemoveDuplicateVertex(mesh);
+	vcg::tri::Clean<Mesh>::RemoveDuplicateFace(mesh);
+	vcg::tri::Clean<Mesh>::RemoveDegenerateFace(mesh);
+	if (m_settings.minComponentTriangles > 0)
+	{
+		compact(mesh);
+		vcg::tri::UpdateTopology<Mesh>::FaceFace(mesh);
+		vcg::tri::Clean<Mesh>::RemoveSmallConnectedComponentsSize(mesh, (int)m_settings.minComponentTriangles);
+	}
+	vcg::tri::Clean<Mesh>::RemoveUnreferencedVertex(mesh);
+	compact(mesh);
+
+	int target = (int)(mesh.fn * std::clamp(m_settings.targetRatio, 0.0f, 1.0f));
+	if (target < mesh.fn)
+	{
+		vcg::tri::TriEdgeCollapseQuadricParameter parameters;
+		parameters.QualityThr = 0.3;			// as tridecimator, avoids slivers the baker can't texture
+		parameters.NormalCheck = true;			// no collapse may fold a triangle over
+		parameters.OptimalPlacement = true;
+		parameters.PreserveTopology = false;
+
+		vcg::tri::UpdateBounding<Mesh>::Box(mesh);
+		vcg::LocalOptimization<Mesh> optimization(mesh, &parameters);
+		optimization.Init<Collapse>();
+		optimization.SetTargetSimplices(target);
+		while (mesh.fn > target && optimization.DoOptimization())
+			;
+		optimization.Finalize<Collapse>();
+		compact(mesh);
+	}
+
+	// area weighted, as the triangles' unnormalised normals sum
+	vcg::tri::UpdateNormal<Mesh>::PerVertex(mesh);
+	vcg::tri::UpdateNormal<Mesh>::NormalizePerVertex(mesh);
+
+	a_out.positions.resize(mesh.vn);
+	a_out.normals.resize(mesh.vn);
+	a_out.colours.resize((size_t)mesh.vn * 3);
+	for (int i = 0; i < mesh.vn; ++i)
+	{
+		auto& v = mesh.vert[i];
+		a_out.positions[i] = Eigen::Vector3f(v.P()[0], v.P()[1], v.P()[2]);
+		Eigen::Vector3f normal(v.N()[0], v.N()[1], v.N()[2]);
+		a_out.normals[i] = normal.allFinite() && normal.squaredNorm() > 0 ? normal : Eigen::Vector3f::UnitZ();
+		for (int channel = 0; channel < 3; ++channel)
+			a_out.colours[i * 3 + channel] = v.C()[channel];
+	}
+
+	a_out.indices.resize((size_t)mesh.fn * 3);
+	for (int t = 0; t < mesh.fn; ++t)
+		for (int corner = 0; corner < 3; ++corner)
+			a_out.indices[t * 3 + corner] = (uint32_t)vcg::tri::Index(mesh, mesh.face[t].V(corner));
+
+	m_lastSimplifyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
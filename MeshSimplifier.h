@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshExtractor.h"
+
+// Simplifies and cleans a marching cubes mesh for export with vcglib (third_party/vcglib).
+// Cleaning welds the vertices the blocks duplicate along their seams, drops degenerate and
+// duplicate triangles, and drops connected pieces under a minimum size, the floaters stray
+// depth leaves in the volume. Simplification is Garland and Heckbert's quadric edge
+// collapse: the edge whose collapse adds the least squared distance to the planes of the
+// triangles around it goes first, to the point that minimises it, so flat areas lose their
+// vertices while creases and corners stay where they were. Normals are rebuilt after.
+class MeshSimplifier
+{
+public:
+
+	struct Settings
+	{
+		float			targetRatio = 0.2f;			// triangles kept of those left after cleaning, 1 only cleans
+		unsigned int	minComponentTriangles = 200;	// smaller connected pieces are dropped, 0 keeps them all
+	};
+
+	MeshSimplifier() = default;
+	~MeshSimplifier() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// a_out may not be a_in
+	void			simplify(const TriangleMesh& a_in, TriangleMesh& a_out);
+
+	float			getLastSimplifyMs() const	{	return m_lastSimplifyMs;	}
+
+private:
+
+	Settings		m_settings;
+	float			m_lastSimplifyMs = 0;
+};
@@ -0,0 +1,132 @@
+#include "MeshWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+MeshWriter::~MeshWriter()
+{
+	stop();
+}
+
+bool MeshWriter::start(const std::string& a_directory)
+{
+	stop();
+
+	std::error_code error;
+	std::filesystem::create_directories(a_directory, error);
+	if (error)
+	{
+		std::cout << "Error: Unable to create export directory " << a_directory << std::endl;
+		return false;
+	}
+
+	m_directory = a_directory;
+	m_queue.clear();
+	m_free.clear();
+	for (unsigned int i = 0; i < std::max(m_settings.backlog, 1u); ++i)
+		m_free.push_back(std::make_unique<Job>());
+
+	m_quit = false;
+	m_busy = 0;
+	m_meshesWritten = 0;
+	m_meshesDropped = 0;
+	m_lastCopyMs = 0;
+	m_lastWriteMs = 0;
+
+	m_thread = std::thread(&MeshWriter::run, this);
+	m_running = true;
+	return true;
+}
+
+void MeshWriter::stop()
+{
+	if (!m_running)
+		return;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	m_free.clear();
+	m_running = false;
+}
+
+bool MeshWriter::add(const std::string& a_name, const TriangleMesh& a_mesh)
+{
+	if (!m_running)
+		return false;
+
+	std::unique_ptr<Job> job;
+	{
+		std::lock_guard lock(m_mutex);
+		if (!m_free.empty())
+		{
+			job = std::move(m_free.back());
+			m_free.pop_back();
+		}
+	}
+	if (!job)
+	{
+		++m_meshesDropped;
+		return false;
+	}
+
+	// assignment keeps the job's capacity, so after the first few meshes this is only a copy
+	auto start = std::chrono::steady_clock::now();
+	job->name = a_name;
+	job->mesh.positions = a_mesh.positions;
+	job->mesh.normals = a_mesh.normals;
+	job->mesh.colours = a_mesh.colours;
+	job->mesh.indices = a_mesh.indices;
+	m_lastCopyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(job));
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+void MeshWriter::run()
+{
+	for (;;)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			++m_busy;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		if (job->mesh.savePly((std::filesystem::path(m_directory) / (job->name + ".ply")).string()))
+			++m_meshesWritten;
+		m_lastWriteMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::lock_guard lock(m_mutex);
+		m_free.push_back(std::move(job));
+		--m_busy;
+	}
+}
+
+MeshWriter::Stats MeshWriter::getStats() const
+{
+	Stats stats;
+	stats.meshesWritten = m_meshesWritten;
+	stats.meshesDropped = m_meshesDropped;
+	stats.copyMs = m_lastCopyMs;
+	stats.writeMs = m_lastWriteMs;
+
+	std::lock_guard lock(m_mutex);
+	stats.queued = (unsigned int)m_queue.size() + m_busy;
+	return stats;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MeshExtractor.h"
+
+// Writes a sequence of extracted meshes as PLY (see TriangleMesh::savePly) on a thread of its
+// own, so a frame only pays for copying the mesh, not for packing and writing it. The copy goes
+// into a mesh the writer has finished with, whose vectors keep their capacity, and when every
+// one of them is still waiting on the disk the mesh is dropped and counted rather than held.
+class MeshWriter
+{
+public:
+
+	struct Settings
+	{
+		unsigned int	backlog = 2;			// meshes waiting on the writer before any are dropped
+	};
+
+	struct Stats
+	{
+		uint64_t		meshesWritten = 0;
+		uint64_t		meshesDropped = 0;
+		unsigned int	queued = 0;				// waiting for or being written
+		float			copyMs = 0;				// add()'s own cost for the last mesh
+		float			writeMs = 0;			// the writer's for the last mesh
+	};
+
+	MeshWriter() = default;
+	~MeshWriter();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}	// takes effect on the next start()
+
+	// files go to a_directory, which is created
+	bool			start(const std::string& a_directory);
+
+	// waits for the queued meshes to be written
+	void			stop();
+	bool			isRunning() const		{	return m_running;	}
+
+	// a_name is the file name without extension, returns false if the mesh was dropped
+	bool			add(const std::string& a_name, const TriangleMesh& a_mesh);
+
+	Stats			getStats() const;
+
+private:
+
+	struct Job
+	{
+		std::string		name;
+		TriangleMesh	mesh;
+	};
+
+	void			run();
+
+	Settings				m_settings;
+	std::string				m_directory;
+	bool					m_running = false;
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	std::deque<std::unique_ptr<Job>>	m_queue;
+	std::vector<std::unique_ptr<Job>>	m_free;
+	unsigned int			m_busy = 0;
+
+	std::atomic<uint64_t>	m_meshesWritten = 0;
+	std::atomic<uint64_t>	m_meshesDropped = 0;
+	std::atomic<float>		m_lastCopyMs = 0;
+	std::atomic<float>		m_lastWriteMs = 0;
+};
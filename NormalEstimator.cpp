@@ -0,0 +1,418 @@
+#include "NormalEstimator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define NORMALS_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	inline void accumulate(float* a_sums, const float* a_row, size_t a_count, bool a_subtract)
+	{
+		size_t i = 0;
+#ifdef NORMALS_SIMD
+		for (; i + 4 <= a_count; i += 4)
+		{
+			__m128 sums = _mm_loadu_ps(a_sums + i);
+			__m128 row = _mm_loadu_ps(a_row + i);
+			_mm_storeu_ps(a_sums + i, a_subtract ? _mm_sub_ps(sums, row) : _mm_add_ps(sums, row));
+		}
+#endif
+		for (; i < a_count; ++i)
+			a_sums[i] += a_subtract ? -a_row[i] : a_row[i];
+	}
+}
+
+void NormalEstimator::setSettings(const Settings& a_settings)
+{
+	m_settings = a_settings;
+	m_settings.radius = std::clamp(m_settings.radius, 1, 15);
+	m_settings.step = std::clamp(m_settings.step, 1, 4);
+}
+
+void NormalEstimator::compute(const float* a_vertices, int a_width, int a_height)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	const int step = std::clamp(m_settings.step, 1, 4);
+	if (a_width != m_outWidth ||
+		a_height != m_outHeight ||
+		step != m_step)
+	{
+		m_step = step;
+		m_outWidth = a_width;
+		m_outHeight = a_height;
+		m_width = (a_width + step - 1) / step;
+		m_height = (a_height + step - 1) / step;
+
+		size_t count = (size_t)m_width * m_height;
+		m_x.resize(count);
+		m_y.resize(count);
+		m_z.resize(count);
+		m_sampleNormals.resize(step > 1 ? count * 3 : 0);
+		m_normals.resize((size_t)a_width * a_height * 3);
+		m_bands.resize((m_height + BandRows - 1) / BandRows);
+	}
+
+	// the box covers the same pixels whatever the step
+	m_radius = std::max(1, (m_settings.radius + step / 2) / step);
+
+	std::vector<int> rows(m_height);
+	std::iota(rows.begin(), rows.end(), 0);
+	std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int a_row) {
+		splitPlanes(a_vertices, a_row);
+	});
+
+	std::vector<int> bands(m_bands.size());
+	std::iota(bands.begin(), bands.end(), 0);
+	std::for_each(std::execution::par, bands.begin(), bands.end(), [&](int a_band) {
+		computeBand(a_band);
+	});
+
+	if (step > 1)
+	{
+		rows.resize(m_outHeight);
+		std::iota(rows.begin(), rows.end(), 0);
+		std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int a_row) {
+			upsampleRow(a_vertices, a_row);
+		});
+	}
+
+	m_lastComputeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void NormalEstimator::splitPlanes(const float* a_vertices, int a_row)
+{
+	size_t begin = (size_t)a_row * m_width;
+	float* x = m_x.data() + begin;
+	float* y = m_y.data() + begin;
+	float* z = m_z.data() + begin;
+
+	if (m_step > 1)
+	{
+		const float* v = a_vertices + (size_t)a_row * m_step * m_outWidth * 3;
+		for (int i = 0; i < m_width; ++i)
+		{
+			const float* p = v + (size_t)i * m_step * 3;
+			x[i] = p[0];
+			y[i] = p[1];
+			z[i] = p[2];
+		}
+		return;
+	}
+
+	const float* v = a_vertices + begin * 3;
+	int i = 0;
+
+#ifdef NORMALS_SIMD
+	// deinterleave xyz xyz xyz xyz, as in PointCloudFusion
+	for (; i + 4 <= m_width; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(v + i * 3);
+		__m128 b = _mm_loadu_ps(v + i * 3 + 4);
+		__m128 c = _mm_loadu_ps(v + i * 3 + 8);
+
+		__m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1));
+		__m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bb = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+		__m128 aa = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+		__m128 cc = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+
+		_mm_storeu_ps(x + i, _mm_shuffle_ps(a, bc, _MM_SHUFFLE(3, 1, 3, 0)));
+		_mm_storeu_ps(y + i, _mm_shuffle_ps(ab, bb, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(z + i, _mm_shuffle_ps(aa, cc, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+#endif
+
+	for (; i < m_width; ++i)
+	{
+		x[i] = v[i * 3];
+		y[i] = v[i * 3 + 1];
+		z[i] = v[i * 3 + 2];
+	}
+}
+
+void NormalEstimator::upsampleRow(const float* a_vertices, int a_row)
+{
+	// each point takes the normal of the sample at the top left of its step x step cell,
+	// as long as it has depth itself
+	const float* v = a_vertices + (size_t)a_row * m_outWidth * 3;
+	const float* samples = m_sampleNormals.data() + (size_t)(a_row / m_step) * m_width * 3;
+	float* out = m_normals.data() + (size_t)a_row * m_outWidth * 3;
+	for (int x = 0; x < m_outWidth; ++x)
+	{
+		const float* n = samples + (size_t)(x / m_step) * 3;
+		bool valid = v[x * 3 + 2] > 0;
+		out[x * 3] = valid ? n[0] : 0;
+		out[x * 3 + 1] = valid ? n[1] : 0;
+		out[x * 3 + 2] = valid ? n[2] : 0;
+	}
+}
+
+void NormalEstimator::gradientRow(int a_row, float* a_out) const
+{
+	const int w = m_width;
+	const size_t centre = (size_t)a_row * w;
+
+	// border rows have no column gradient, point their neighbours at themselves and mask it off
+	const bool interior = a_row > 0 && a_row < m_height - 1;
+	const size_t up = interior ? centre - w : centre;
+	const size_t down = interior ? centre + w : centre;
+	// the gradient spans 2 * step pixels, so a slanted surface changes depth step times as much
+	const float k = m_settings.maxDepthChange * m_step;
+
+	auto scalar = [&](int x) {
+		float* out = a_out + (size_t)x * Channels;
+		float zc = m_z[centre + x];
+
+		bool alongRow = zc > 0 && x > 0 && x < w - 1;
+		if (alongRow)
+		{
+			float zl = m_z[centre + x - 1], zr = m_z[centre + x + 1];
+			alongRow = zl > 0 && zr > 0 && std::abs(zr - zl) <= k * zc;
+		}
+		bool alongColumn = zc > 0 && interior;
+		if (alongColumn)
+		{
+			float zu = m_z[up + x], zd = m_z[down + x];
+			alongColumn = zu > 0 && zd > 0 && std::abs(zd - zu) <= k * zc;
+		}
+
+		out[0] = alongRow ? m_x[centre + x + 1] - m_x[centre + x - 1] : 0;
+		out[1] = alongRow ? m_y[centre + x + 1] - m_y[centre + x - 1] : 0;
+		out[2] = alongRow ? m_z[centre + x + 1] - m_z[centre + x - 1] : 0;
+		out[3] = alongColumn ? m_x[down + x] - m_x[up + x] : 0;
+		out[4] = alongColumn ? m_y[down + x] - m_y[up + x] : 0;
+		out[5] = alongColumn ? m_z[down + x] - m_z[up + x] : 0;
+		out[6] = alongRow ? 1.0f : 0;
+		out[7] = alongColumn ? 1.0f : 0;
+	};
+
+	int x = 0;
+	scalar(x++);
+
+#ifdef NORMALS_SIMD
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 oneValue = _mm_set1_ps(1.0f);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 depthChange = _mm_set1_ps(k);
+	const __m128 interiorMask = interior ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+
+	// x + 4 stays inside the row, so the right hand loads never run past it
+	for (; x + 4 < w; x += 4)
+	{
+		const size_t c = centre + x;
+		__m128 zc = _mm_loadu_ps(&m_z[c]);
+		__m128 limit = _mm_mul_ps(depthChange, zc);
+		__m128 centreValid = _mm_cmpgt_ps(zc, zero);
+
+		__m128 zl = _mm_loadu_ps(&m_z[c - 1]), zr = _mm_loadu_ps(&m_z[c + 1]);
+		__m128 alongRow = _mm_and_ps(_mm_and_ps(centreValid, _mm_cmpgt_ps(zl, zero)), _mm_cmpgt_ps(zr, zero));
+		alongRow = _mm_and_ps(alongRow, _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(zr, zl), absMask), limit));
+
+		__m128 zu = _mm_loadu_ps(&m_z[up + x]), zd = _mm_loadu_ps(&m_z[down + x]);
+		__m128 alongColumn = _mm_and_ps(_mm_and_ps(centreValid, _mm_cmpgt_ps(zu, zero)), _mm_cmpgt_ps(zd, zero));
+		alongColumn = _mm_and_ps(_mm_and_ps(alongColumn, interiorMask), _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(zd, zu), absMask), limit));
+
+		__m128 rx = _mm_and_ps(alongRow, _mm_sub_ps(_mm_loadu_ps(&m_x[c + 1]), _mm_loadu_ps(&m_x[c - 1])));
+		__m128 ry = _mm_and_ps(alongRow, _mm_sub_ps(_mm_loadu_ps(&m_y[c + 1]), _mm_loadu_ps(&m_y[c - 1])));
+		__m128 rz = _mm_and_ps(alongRow, _mm_sub_ps(zr, zl));
+		__m128 cx = _mm_and_ps(alongColumn, _mm_sub_ps(_mm_loadu_ps(&m_x[down + x]), _mm_loadu_ps(&m_x[up + x])));
+		__m128 cy = _mm_and_ps(alongColumn, _mm_sub_ps(_mm_loadu_ps(&m_y[down + x]), _mm_loadu_ps(&m_y[up + x])));
+		__m128 cz = _mm_and_ps(alongColumn, _mm_sub_ps(zd, zu));
+		__m128 rowCount = _mm_and_ps(alongRow, oneValue);
+		__m128 columnCount = _mm_and_ps(alongColumn, oneValue);
+
+		// 4 pixels of 8 channels each, planar to interleaved
+		_MM_TRANSPOSE4_PS(rx, ry, rz, cx);
+		_MM_TRANSPOSE4_PS(cy, cz, rowCount, columnCount);
+
+		float* out = a_out + (size_t)x * Channels;
+		_mm_storeu_ps(out, rx);
+		_mm_storeu_ps(out + 4, cy);
+		_mm_storeu_ps(out + 8, ry);
+		_mm_storeu_ps(out + 12, cz);
+		_mm_storeu_ps(out + 16, rz);
+		_mm_storeu_ps(out + 20, rowCount);
+		_mm_storeu_ps(out + 24, cx);
+		_mm_storeu_ps(out + 28, columnCount);
+	}
+#endif
+
+	for (; x < w; ++x)
+		scalar(x);
+}
+
+void NormalEstimator::boxRow(const float* a_gradients, float* a_out, int a_radius) const
+{
+	// sliding sum over [x - r, x + r], clipped to the row
+	const int w = m_width;
+	const int r = std::min(a_radius, w - 1);
+
+#ifdef NORMALS_SIMD
+	__m128 low = _mm_setzero_ps(), high = _mm_setzero_ps();
+	for (int x = 0; x < r; ++x)
+	{
+		low = _mm_add_ps(low, _mm_loadu_ps(a_gradients + x * Channels));
+		high = _mm_add_ps(high, _mm_loadu_ps(a_gradients + x * Channels + 4));
+	}
+	for (int x = 0; x < w; ++x)
+	{
+		if (x + r < w)
+		{
+			low = _mm_add_ps(low, _mm_loadu_ps(a_gradients + (x + r) * Channels));
+			high = _mm_add_ps(high, _mm_loadu_ps(a_gradients + (x + r) * Channels + 4));
+		}
+		_mm_storeu_ps(a_out + x * Channels, low);
+		_mm_storeu_ps(a_out + x * Channels + 4, high);
+		if (x - r >= 0)
+		{
+			low = _mm_sub_ps(low, _mm_loadu_ps(a_gradients + (x - r) * Channels));
+			high = _mm_sub_ps(high, _mm_loadu_ps(a_gradients + (x - r) * Channels + 4));
+		}
+	}
+#else
+	float sums[Channels] = {};
+	for (int x = 0; x < r; ++x)
+		for (int c = 0; c < Channels; ++c)
+			sums[c] += a_gradients[x * Channels + c];
+	for (int x = 0; x < w; ++x)
+	{
+		for (int c = 0; c < Channels; ++c)
+		{
+			if (x + r < w)
+				sums[c] += a_gradients[(x + r) * Channels + c];
+			a_out[x * Channels + c] = sums[c];
+			if (x - r >= 0)
+				sums[c] -= a_gradients[(x - r) * Channels + c];
+		}
+	}
+#endif
+}
+
+void NormalEstimator::normalRow(int a_row, const float* a_sums)
+{
+	const int w = m_width;
+	const size_t centre = (size_t)a_row * w;
+	const float side = 2.0f * m_radius + 1;
+	const float minCount = std::max(1.0f, m_settings.minSupport * side * side);
+	float* normals = (m_step > 1 ? m_sampleNormals.data() : m_normals.data()) + centre * 3;
+
+	int x = 0;
+
+#ifdef NORMALS_SIMD
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f), threeHalves = _mm_set1_ps(1.5f);
+	const __m128 minSupport = _mm_set1_ps(minCount);
+	const __m128 minLength = _mm_set1_ps(1e-20f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	// each 4 float store spills one float into the next pixel, which x + 4 < w keeps in the row
+	for (; x + 4 < w; x += 4)
+	{
+		const float* s = a_sums + (size_t)x * Channels;
+		__m128 rx = _mm_loadu_ps(s), ry = _mm_loadu_ps(s + 8), rz = _mm_loadu_ps(s + 16), cx = _mm_loadu_ps(s + 24);
+		__m128 cy = _mm_loadu_ps(s + 4), cz = _mm_loadu_ps(s + 12), rowCount = _mm_loadu_ps(s + 20), columnCount = _mm_loadu_ps(s + 28);
+		_MM_TRANSPOSE4_PS(rx, ry, rz, cx);
+		_MM_TRANSPOSE4_PS(cy, cz, rowCount, columnCount);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(ry, cz), _mm_mul_ps(rz, cy));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(rz, cx), _mm_mul_ps(rx, cz));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(rx, cy), _mm_mul_ps(ry, cx));
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+
+		// rsqrt with one Newton step
+		__m128 inverse = _mm_rsqrt_ps(length2);
+		inverse = _mm_mul_ps(inverse, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, length2), _mm_mul_ps(inverse, inverse))));
+
+		// face the camera at the origin
+		__m128 px = _mm_loadu_ps(&m_x[centre + x]), py = _mm_loadu_ps(&m_y[centre + x]), pz = _mm_loadu_ps(&m_z[centre + x]);
+		__m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz));
+		inverse = _mm_xor_ps(inverse, _mm_and_ps(_mm_cmpgt_ps(facing, zero), signBit));
+
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(pz, zero), _mm_cmpgt_ps(length2, minLength));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(rowCount, minSupport), _mm_cmpge_ps(columnCount, minSupport)));
+		inverse = _mm_and_ps(valid, inverse);
+
+		nx = _mm_mul_ps(nx, inverse);
+		ny = _mm_mul_ps(ny, inverse);
+		nz = _mm_mul_ps(nz, inverse);
+		__m128 unused = zero;
+		_MM_TRANSPOSE4_PS(nx, ny, nz, unused);
+
+		float* out = normals + (size_t)x * 3;
+		_mm_storeu_ps(out, nx);
+		_mm_storeu_ps(out + 3, ny);
+		_mm_storeu_ps(out + 6, nz);
+		_mm_storeu_ps(out + 9, unused);
+	}
+#endif
+
+	for (; x < w; ++x)
+	{
+		const float* s = a_sums + (size_t)x * Channels;
+		float* out = normals + (size_t)x * 3;
+		out[0] = out[1] = out[2] = 0;
+
+		float pz = m_z[centre + x];
+		if (pz <= 0 || s[6] < minCount || s[7] < minCount)
+			continue;
+
+		float nx = s[1] * s[5] - s[2] * s[4];
+		float ny = s[2] * s[3] - s[0] * s[5];
+		float nz = s[0] * s[4] - s[1] * s[3];
+		float length2 = nx * nx + ny * ny + nz * nz;
+		if (length2 <= 1e-20f)
+			continue;
+
+		float inverse = 1.0f / std::sqrt(length2);
+		if (nx * m_x[centre + x] + ny * m_y[centre + x] + nz * pz > 0)
+			inverse = -inverse;
+		out[0] = nx * inverse;
+		out[1] = ny * inverse;
+		out[2] = nz * inverse;
+	}
+}
+
+void NormalEstimator::computeBand(int a_band)
+{
+	const int w = m_width;
+	const int r = m_radius;
+	const int ringRows = 2 * r + 1;
+	const size_t rowFloats = (size_t)w * Channels;
+
+	auto& band = m_bands[a_band];
+	band.gradients.resize(rowFloats);
+	band.ring.resize(rowFloats * ringRows);
+	band.sums.assign(rowFloats, 0);
+
+	auto addRow = [&](int a_row) {
+		float* slot = band.ring.data() + (a_row % ringRows) * rowFloats;
+		gradientRow(a_row, band.gradients.data());
+		boxRow(band.gradients.data(), slot, r);
+		accumulate(band.sums.data(), slot, rowFloats, false);
+	};
+
+	int y0 = a_band * BandRows;
+	int y1 = std::min(m_height, y0 + BandRows);
+
+	// warm up with the rows above and below the band's first row
+	for (int row = std::max(0, y0 - r); row <= std::min(m_height - 1, y0 + r); ++row)
+		addRow(row);
+
+	for (int y = y0; y < y1; ++y)
+	{
+		normalRow(y, band.sums.data());
+
+		// slide the box down a row, the leaving row's slot is reused by the arriving one
+		if (y - r >= 0)
+			accumulate(band.sums.data(), band.ring.data() + ((y - r) % ringRows) * rowFloats, rowFloats, true);
+		if (y + r + 1 < m_height)
+			addRow(y + r + 1);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-point normals for an organized point cloud (one point per depth pixel, as produced
+// by rs2::pointcloud), without any neighbour search. The horizontal and vertical 3D
+// gradients at each pixel are box filtered over a (2r+1)^2 window and the normal is their
+// cross product, oriented towards the camera. Gradients that span a depth discontinuity
+// or an invalid pixel are left out of the box sums, so normals don't bend around edges.
+// The box sums are the same as reading them from integral images, but are kept as sliding
+// row and column sums over bands of rows, so the working set stays in cache and large sums
+// don't lose float precision. Every stage runs 4 pixels at a time with SSE.
+// By default the normals are estimated on every second pixel of every second row, with the
+// box and the gradients scaled to match, and each point takes the normal of the sample it
+// is nearest, a quarter of the work for a box that covers the same surface.
+class NormalEstimator
+{
+public:
+
+	struct Settings
+	{
+		int		radius = 4;				// box half size in pixels
+		float	maxDepthChange = 0.05f;	// relative depth step between neighbouring pixels that counts as an edge
+		float	minSupport = 0.25f;		// fraction of the box that must have valid gradients
+		int		step = 2;				// pixels between samples along rows and columns, 1 is every pixel
+	};
+
+	NormalEstimator() = default;
+	~NormalEstimator() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings);
+
+	// a_vertices are xyz floats in camera space, row major a_width x a_height, z = 0 invalid
+	void			compute(const float* a_vertices, int a_width, int a_height);
+
+	// xyz per point, zero where no normal could be estimated
+	const float*	getNormals() const		{	return m_normals.data();	}
+	size_t			getCount() const		{	return (size_t)m_outWidth * m_outHeight;	}
+
+	float			getLastComputeMs() const	{	return m_lastComputeMs;	}
+
+private:
+
+	// gradient x, y, z along the row, then along the column, then the two valid counts
+	static constexpr int	Channels = 8;
+	static constexpr int	BandRows = 32;
+
+	struct Band
+	{
+		std::vector<float>	gradients;	// one row, Channels per pixel
+		std::vector<float>	ring;		// horizontal box sums of the last 2r+1 rows
+		std::vector<float>	sums;		// vertical sum of the ring, the full box
+	};
+
+	void	splitPlanes(const float* a_vertices, int a_row);
+	void	upsampleRow(const float* a_vertices, int a_row);
+	void	gradientRow(int a_row, float* a_out) const;
+	void	boxRow(const float* a_gradients, float* a_out, int a_radius) const;
+	void	normalRow(int a_row, const float* a_sums);
+	void	computeBand(int a_band);
+
+	Settings				m_settings;
+
+	int						m_step = 1;		// as of the last compute()
+	int						m_radius = 1;	// in samples
+	int						m_outWidth = 0;	// the points'
+	int						m_outHeight = 0;
+	int						m_width = 0;	// the samples'
+	int						m_height = 0;
+	std::vector<float>		m_x, m_y, m_z;	// sampled vertices split into planes
+	std::vector<Band>		m_bands;
+	std::vector<float>		m_sampleNormals;	// when sampling every step pixels
+	std::vector<float>		m_normals;
+
+	float					m_lastComputeMs = 0;
+};
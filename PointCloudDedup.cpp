@@ -0,0 +1,234 @@
+#include "PointCloudDedup.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+// points per parallel chunk in the keying and scatter passes
+static constexpr size_t ChunkSize = 32768;
+
+bool PointCloudDedup::process(const std::shared_ptr<const FusedPointCloud>& a_cloud)
+{
+	if (a_cloud == nullptr ||
+		a_cloud->frame == m_lastFrame)
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// reuse the back buffer unless a reader is still holding it
+	std::shared_ptr<FusedPointCloud> cloud;
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_back != nullptr && m_back.use_count() == 1)
+			cloud = m_back;
+		m_back = nullptr;
+	}
+	if (cloud == nullptr)
+		cloud = std::make_shared<FusedPointCloud>();
+
+	if (m_shards.empty())
+		m_shards.resize(ShardCount);
+
+	bucket(*a_cloud);
+	accumulate();
+	output(*a_cloud, *cloud);
+
+	m_lastFrame = a_cloud->frame;
+	m_dedupRatio = a_cloud->count > 0 ? 1.0f - (float)cloud->count / a_cloud->count : 0;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_back = std::move(m_front);
+		m_front = std::move(cloud);
+	}
+
+	m_lastDedupMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+std::shared_ptr<const FusedPointCloud> PointCloudDedup::acquire() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_front;
+}
+
+void PointCloudDedup::bucket(const FusedPointCloud& a_cloud)
+{
+	size_t count = a_cloud.count;
+	size_t chunkCount = std::max<size_t>(1, (count + ChunkSize - 1) / ChunkSize);
+	std::vector<size_t> chunks(chunkCount);
+	std::iota(chunks.begin(), chunks.end(), 0);
+
+	m_keys.resize(count);
+	m_shardIds.resize(count);
+	m_chunkCounts.assign(chunkCount * ShardCount, 0);
+
+	const float scale = 1.0f / m_voxelSize;
+
+	// voxel and shard of every point, counted per chunk so the scatter needs no atomics
+	std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t a_chunk) {
+		size_t* counts = &m_chunkCounts[a_chunk * ShardCount];
+		size_t end = std::min(count, (a_chunk + 1) * ChunkSize);
+		for (size_t i = a_chunk * ChunkSize; i < end; ++i)
+		{
+			auto key = packVoxelKey({ (int)std::floor(a_cloud.x[i] * scale), (int)std::floor(a_cloud.y[i] * scale), (int)std::floor(a_cloud.z[i] * scale) });
+			int shard = (int)(FlatHashMap<uint32_t>::hash(key) >> (64 - ShardBits));
+			m_keys[i] = key;
+			m_shardIds[i] = (uint8_t)shard;
+			++counts[shard];
+		}
+	});
+
+	// turn the counts into each chunk's write position within each shard
+	size_t offset = 0;
+	for (int shard = 0; shard < ShardCount; ++shard)
+	{
+		m_shards[shard].begin = offset;
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			size_t chunkShardCount = m_chunkCounts[chunk * ShardCount + shard];
+			m_chunkCounts[chunk * ShardCount + shard] = offset;
+			offset += chunkShardCount;
+		}
+		m_shards[shard].end = offset;
+	}
+
+	m_points.resize(count);
+	m_voxelIds.resize(count);
+
+	std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t a_chunk) {
+		size_t* positions = &m_chunkCounts[a_chunk * ShardCount];
+		size_t end = std::min(count, (a_chunk + 1) * ChunkSize);
+		for (size_t i = a_chunk * ChunkSize; i < end; ++i)
+		{
+			uint8_t camera = a_cloud.camera[i];
+
+			// confidence is cos(off axis angle) / depth^2, with cos = depth / distance
+			Eigen::Vector3f ray = Eigen::Vector3f(a_cloud.x[i], a_cloud.y[i], a_cloud.z[i]) - a_cloud.cameraOrigin[camera];
+			float depth = std::max(ray.dot(a_cloud.cameraAxis[camera]), 0.01f);
+
+			m_points[positions[m_shardIds[i]]++] = { m_keys[i], a_cloud.x[i], a_cloud.y[i], a_cloud.z[i],
+				1.0f / (depth * std::max(ray.norm(), depth)), a_cloud.r[i], a_cloud.g[i], a_cloud.b[i], camera };
+		}
+	});
+}
+
+void PointCloudDedup::accumulate()
+{
+	std::for_each(std::execution::par, m_shards.begin(), m_shards.end(), [&](Shard& a_shard) {
+		a_shard.index.clear();
+		a_shard.voxels.clear();
+
+		// points arrive in camera then pixel order, so runs of them share a voxel
+		uint64_t lastKey = FlatHashMap<uint32_t>::EmptyKey;
+		uint32_t voxelId = 0;
+
+		for (size_t i = a_shard.begin; i < a_shard.end; ++i)
+		{
+			auto& point = m_points[i];
+			if (point.key != lastKey)
+			{
+				auto slot = a_shard.index.insert(point.key, (uint32_t)a_shard.voxels.size());
+				if (slot.second)
+					a_shard.voxels.push_back({});
+				lastKey = point.key;
+				voxelId = *slot.first;
+			}
+
+			auto& voxel = a_shard.voxels[voxelId];
+			voxel.weight += point.weight;
+			voxel.x += point.x * point.weight;
+			voxel.y += point.y * point.weight;
+			voxel.z += point.z * point.weight;
+			voxel.r += point.r * point.weight;
+			voxel.g += point.g * point.weight;
+			voxel.b += point.b * point.weight;
+			voxel.cameras |= 1ull << (point.camera % MaxCameras);
+			++voxel.count;
+			if (point.weight > voxel.bestWeight)
+			{
+				voxel.bestWeight = point.weight;
+				voxel.bestCamera = point.camera;
+			}
+			m_voxelIds[i] = voxelId;
+		}
+	});
+}
+
+void PointCloudDedup::output(const FusedPointCloud& a_cloud, FusedPointCloud& a_out)
+{
+	const size_t cameraCount = a_cloud.cameraCount.size();
+
+	// output points per shard and camera, one per merged voxel and every point of the others
+	std::for_each(std::execution::par, m_shards.begin(), m_shards.end(), [&](Shard& a_shard) {
+		a_shard.cameraOffsets.assign(cameraCount, 0);
+		for (auto& voxel : a_shard.voxels)
+		{
+			bool merged = (voxel.cameras & (voxel.cameras - 1)) != 0;
+			a_shard.cameraOffsets[voxel.bestCamera] += merged ? 1 : voxel.count;
+		}
+	});
+
+	// camera major, shard minor, so the output keeps the per-camera ranges
+	size_t total = 0;
+	std::vector<size_t> offsets(cameraCount), counts(cameraCount);
+	for (size_t camera = 0; camera < cameraCount; ++camera)
+	{
+		offsets[camera] = total;
+		for (auto& shard : m_shards)
+		{
+			size_t count = shard.cameraOffsets[camera];
+			shard.cameraOffsets[camera] = total;
+			total += count;
+		}
+		counts[camera] = total - offsets[camera];
+	}
+
+	a_out.resize(total, cameraCount);
+	a_out.frame = a_cloud.frame;
+	a_out.cameraOffset = offsets;
+	a_out.cameraCount = counts;
+	a_out.cameraOrigin = a_cloud.cameraOrigin;
+	a_out.cameraAxis = a_cloud.cameraAxis;
+
+	std::vector<size_t> merged(m_shards.size());
+
+	std::for_each(std::execution::par, m_shards.begin(), m_shards.end(), [&](Shard& a_shard) {
+		auto write = [&](uint8_t a_camera, float a_x, float a_y, float a_z, uint8_t a_r, uint8_t a_g, uint8_t a_b) {
+			size_t out = a_shard.cameraOffsets[a_camera]++;
+			a_out.x[out] = a_x;
+			a_out.y[out] = a_y;
+			a_out.z[out] = a_z;
+			a_out.r[out] = a_r;
+			a_out.g[out] = a_g;
+			a_out.b[out] = a_b;
+			a_out.camera[out] = a_camera;
+		};
+
+		size_t mergedVoxels = 0;
+		for (auto& voxel : a_shard.voxels)
+		{
+			if ((voxel.cameras & (voxel.cameras - 1)) == 0)
+				continue;
+
+			float weight = 1.0f / voxel.weight;
+			write(voxel.bestCamera, voxel.x * weight, voxel.y * weight, voxel.z * weight,
+				  (uint8_t)(voxel.r * weight + 0.5f), (uint8_t)(voxel.g * weight + 0.5f), (uint8_t)(voxel.b * weight + 0.5f));
+			++mergedVoxels;
+		}
+		merged[&a_shard - m_shards.data()] = mergedVoxels;
+
+		for (size_t i = a_shard.begin; i < a_shard.end; ++i)
+		{
+			auto& voxel = a_shard.voxels[m_voxelIds[i]];
+			if ((voxel.cameras & (voxel.cameras - 1)) != 0)
+				continue;
+
+			auto& point = m_points[i];
+			write(point.camera, point.x, point.y, point.z, point.r, point.g, point.b);
+		}
+	});
+
+	m_mergedVoxels = std::accumulate(merged.begin(), merged.end(), size_t(0));
+}
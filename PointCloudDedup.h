@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "PointCloudFusion.h"
+
+// Merges the points that several cameras contribute to the same fine voxel of a fused
+// cloud, so overlap zones are rendered and exported once. Points inside a merged voxel
+// are averaged weighted by their camera's confidence, which falls off with depth squared
+// (stereo depth error) and with the angle off the camera's axis. Voxels seen by a single
+// camera pass through untouched. The output keeps the fused cloud's per-camera grouping,
+// merged points belonging to the camera that contributed the most weight.
+class PointCloudDedup
+{
+public:
+
+	PointCloudDedup() = default;
+	~PointCloudDedup() = default;
+
+	float	getVoxelSize() const				{	return m_voxelSize;		}
+	void	setVoxelSize(float a_voxelSize)		{	m_voxelSize = a_voxelSize;	}
+
+	// dedups a fused cloud, does nothing and returns false if that frame was already done
+	bool	process(const std::shared_ptr<const FusedPointCloud>& a_cloud);
+
+	// latest deduplicated cloud, stays valid for as long as the caller holds it
+	std::shared_ptr<const FusedPointCloud>	acquire() const;
+
+	// fraction of the input points removed by the last pass
+	float	getDedupRatio() const		{	return m_dedupRatio;	}
+	size_t	getMergedVoxels() const		{	return m_mergedVoxels;	}
+	float	getLastDedupMs() const		{	return m_lastDedupMs;	}
+
+private:
+
+	static constexpr int	ShardBits = 6;
+	static constexpr int	ShardCount = 1 << ShardBits;
+	static constexpr int	MaxCameras = 64;	// cameras per voxel are tracked in a 64 bit mask
+
+	// a fused point copied into shard order, so the per-shard passes read sequentially
+	struct Point
+	{
+		uint64_t	key;
+		float		x, y, z;
+		float		weight;
+		uint8_t		r, g, b;
+		uint8_t		camera;
+	};
+
+	struct Voxel
+	{
+		float		weight;
+		float		x, y, z;	// weighted sums
+		float		r, g, b;
+		uint64_t	cameras;	// mask of contributing camera ids
+		uint32_t	count;
+		float		bestWeight;
+		uint8_t		bestCamera;
+	};
+
+	struct Shard
+	{
+		FlatHashMap<uint32_t>	index;		// packed voxel -> voxels
+		std::vector<Voxel>		voxels;
+		size_t					begin = 0;	// range of m_points
+		size_t					end = 0;
+		std::vector<size_t>		cameraOffsets;	// output position per camera
+	};
+
+	void	bucket(const FusedPointCloud& a_cloud);
+	void	accumulate();
+	void	output(const FusedPointCloud& a_cloud, FusedPointCloud& a_out);
+
+	float					m_voxelSize = 0.002f;
+
+	std::vector<Shard>		m_shards;
+	std::vector<uint64_t>	m_keys;			// per input point
+	std::vector<uint8_t>	m_shardIds;
+	std::vector<Point>		m_points;		// input points grouped by shard
+	std::vector<uint32_t>	m_voxelIds;		// voxel of each m_points entry within its shard
+	std::vector<size_t>		m_chunkCounts;	// chunk * ShardCount
+
+	mutable std::mutex					m_mutex;
+	std::shared_ptr<FusedPointCloud>	m_front;
+	std::shared_ptr<FusedPointCloud>	m_back;
+	uint64_t							m_lastFrame = 0;
+
+	float					m_dedupRatio = 0;
+	size_t					m_mergedVoxels = 0;
+	float					m_lastDedupMs = 0;
+};
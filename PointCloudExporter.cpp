@@ -0,0 +1,430 @@
+#include "PointCloudExporter.h"
+#include "UnbufferedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <iostream>
+#include <numeric>
+#include <string>
+
+#include <Eigen/Geometry>
+
+namespace
+{
+	constexpr size_t	BlockPoints = 1 << 16;		// points packed per task
+
+	template<class Function>
+	void forEachBlock(size_t a_count, Function a_function)
+	{
+		std::vector<size_t> blocks((a_count + BlockPoints - 1) / BlockPoints);
+		std::iota(blocks.begin(), blocks.end(), 0);
+		std::for_each(std::execution::par, blocks.begin(), blocks.end(), a_function);
+	}
+
+	size_t recordSize(PointCloudExporter::Format a_format, bool a_normals)
+	{
+		// PLY keeps colour as three bytes, PCD packs it into one 4 byte field
+		size_t size = sizeof(float) * (a_normals ? 6 : 3);
+		return size + (a_format == PointCloudExporter::Format::Ply ? 3 : sizeof(uint32_t));
+	}
+
+	std::string makeHeader(PointCloudExporter::Format a_format, bool a_normals, size_t a_count)
+	{
+		std::string header;
+		if (a_format == PointCloudExporter::Format::Ply)
+		{
+			header = "ply\nformat binary_little_endian 1.0\n";
+			header += "element vertex " + std::to_string(a_count) + "\n";
+			header += "property float x\nproperty float y\nproperty float z\n";
+			if (a_normals)
+				header += "property float nx\nproperty float ny\nproperty float nz\n";
+			header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+			header += "end_header\n";
+		}
+		else
+		{
+			// rgb is PCL's packed float, 0x00RRGGBB read as a float
+			header = "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n";
+			header += a_normals ? "FIELDS x y z normal_x normal_y normal_z rgb\nSIZE 4 4 4 4 4 4 4\nTYPE F F F F F F F\nCOUNT 1 1 1 1 1 1 1\n" :
+				"FIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F F\nCOUNT 1 1 1 1\n";
+			header += "WIDTH " + std::to_string(a_count) + "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\n";
+			header += "POINTS " + std::to_string(a_count) + "\nDATA binary\n";
+		}
+		return header;
+	}
+
+	inline uint8_t* writeRecord(uint8_t* a_out, PointCloudExporter::Format a_format, const Eigen::Vector3f& a_position,
+		const Eigen::Vector3f* a_normal, const uint8_t* a_rgb)
+	{
+		memcpy(a_out, a_position.data(), sizeof(float) * 3);
+		a_out += sizeof(float) * 3;
+		if (a_normal)
+		{
+			memcpy(a_out, a_normal->data(), sizeof(float) * 3);
+			a_out += sizeof(float) * 3;
+		}
+		if (a_format == PointCloudExporter::Format::Ply)
+		{
+			memcpy(a_out, a_rgb, 3);
+			return a_out + 3;
+		}
+		uint32_t rgb = uint32_t(a_rgb[0]) << 16 | uint32_t(a_rgb[1]) << 8 | a_rgb[2];
+		memcpy(a_out, &rgb, sizeof(rgb));
+		return a_out + sizeof(rgb);
+	}
+}
+
+uint8_t* PointCloudExporter::Image::reserve(size_t a_size)
+{
+	// room to pad the last block for unbuffered writes
+	size_t needed = UnbufferedFile::alignUp(a_size);
+	if (needed > capacity)
+	{
+		storage = std::make_unique<uint8_t[]>(needed + UnbufferedFile::Alignment);
+		auto address = reinterpret_cast<uintptr_t>(storage.get());
+		data = storage.get() + (UnbufferedFile::alignUp(address) - address);
+		capacity = needed;
+	}
+	size = a_size;
+	return data;
+}
+
+PointCloudExporter::~PointCloudExporter()
+{
+	stop();
+}
+
+bool PointCloudExporter::start(const std::string& a_directory)
+{
+	stop();
+
+	std::error_code error;
+	std::filesystem::create_directories(a_directory, error);
+	if (error)
+	{
+		std::cout << "Error: Unable to create export directory " << a_directory << std::endl;
+		return false;
+	}
+
+	m_active = m_settings;
+	m_directory = a_directory;
+
+	m_free.clear();
+	for (unsigned int i = 0; i < std::max(m_active.backlog, 1u); ++i)
+		m_free.push_back(std::make_unique<Job>());
+
+	unsigned int threads = m_active.threads;
+	if (threads == 0)
+		threads = std::max(2u, std::thread::hardware_concurrency() / 2);
+
+	m_quit = false;
+	m_framesAdded = 0;
+	m_framesWritten = 0;
+	m_framesDropped = 0;
+	m_pointsWritten = 0;
+	m_bytesWritten = 0;
+	m_lastCopyMs = 0;
+	m_start = std::chrono::steady_clock::now();
+
+	m_writing.assign(threads, std::chrono::steady_clock::time_point::max());
+	for (unsigned int i = 0; i < threads; ++i)
+		m_threads.emplace_back(&PointCloudExporter::run, this, (size_t)i);
+
+	m_running = true;
+	return true;
+}
+
+void PointCloudExporter::stop()
+{
+	if (!m_running)
+		return;
+
+	// the writers drain the queue before they see m_quit
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+
+	m_free.clear();
+	m_running = false;
+}
+
+bool PointCloudExporter::add(const std::string& a_name, const Input& a_input)
+{
+	if (!m_running)
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+	++m_framesAdded;
+
+	auto job = takeJob();
+	if (!job)
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	job->name = a_name;
+	job->fused.reset();
+	copyInput(a_input, m_active.normals, *job);
+	job->added = start;
+	queueJob(std::move(job));
+
+	m_lastCopyMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+bool PointCloudExporter::add(const std::string& a_name, std::shared_ptr<const FusedPointCloud> a_cloud)
+{
+	if (!m_running || !a_cloud)
+		return false;
+
+	++m_framesAdded;
+
+	auto job = takeJob();
+	if (!job)
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	job->name = a_name;
+	job->fused = std::move(a_cloud);
+	job->points = 0;
+	job->added = std::chrono::steady_clock::now();
+	queueJob(std::move(job));
+	return true;
+}
+
+std::unique_ptr<PointCloudExporter::Job> PointCloudExporter::takeJob()
+{
+	std::unique_lock lock(m_mutex);
+	if (m_active.wait)
+		m_freed.wait(lock, [this] { return !m_free.empty(); });
+	if (m_free.empty())
+		return nullptr;
+	auto job = std::move(m_free.back());
+	m_free.pop_back();
+	return job;
+}
+
+void PointCloudExporter::queueJob(std::unique_ptr<Job> a_job)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(a_job));
+	}
+	m_wake.notify_one();
+}
+
+void PointCloudExporter::run(size_t a_thread)
+{
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+		if (m_queue.empty())
+			break;
+
+		auto job = std::move(m_queue.front());
+		m_queue.pop_front();
+		m_writing[a_thread] = job->added;
+		lock.unlock();
+
+		// a fused cloud is let go once packed so fusion can reuse it
+		if (job->fused)
+		{
+			job->points = packFused(*job->fused, m_active.format, job->image);
+			job->fused.reset();
+		}
+		else
+			job->points = packInput(job->input, m_active.format, m_active.normals, job->image);
+
+		if (write(*job))
+		{
+			++m_framesWritten;
+			m_pointsWritten += job->points;
+			m_bytesWritten += job->image.size;
+		}
+		else
+			++m_framesDropped;
+
+		lock.lock();
+		m_writing[a_thread] = std::chrono::steady_clock::time_point::max();
+		m_free.push_back(std::move(job));
+		m_freed.notify_one();
+	}
+}
+
+bool PointCloudExporter::write(const Job& a_job) const
+{
+	std::string filename = m_directory + "/" + a_job.name + (m_active.format == Format::Ply ? ".ply" : ".pcd");
+
+	UnbufferedFile file;
+	if (!file.open(filename, m_active.unbuffered))
+		return false;
+
+	// unbuffered writes are whole blocks, the padding is cut off again after
+	bool written;
+	size_t size = a_job.image.size;
+	if (file.isUnbuffered())
+	{
+		size_t padded = UnbufferedFile::alignUp(size);
+		memset(a_job.image.data + size, 0, padded - size);
+		written = file.write(a_job.image.data, padded) && file.truncate(size);
+	}
+	else
+		written = file.write(a_job.image.data, size);
+
+	if (!written)
+		std::cout << "Error: Writing " << filename << " failed" << std::endl;
+	return written;
+}
+
+void PointCloudExporter::copyInput(const Input& a_input, bool a_normals, Job& a_job)
+{
+	// assignment keeps the job's capacity, so after the first few clouds this is only a copy
+	Input& input = a_job.input;
+	input = a_input;
+	a_job.vertices.assign(a_input.vertices, a_input.vertices + a_input.count * 3);
+	input.vertices = a_job.vertices.data();
+	if (a_input.texcoords)
+	{
+		a_job.texcoords.assign(a_input.texcoords, a_input.texcoords + a_input.count * 2);
+		input.texcoords = a_job.texcoords.data();
+	}
+	input.normals = nullptr;
+	if (a_normals && a_input.normals)
+	{
+		a_job.normals.assign(a_input.normals, a_input.normals + a_input.count * 3);
+		input.normals = a_job.normals.data();
+	}
+
+	if (a_input.colour)
+	{
+		size_t row = (size_t)a_input.colourWidth * 3;
+		a_job.colour.resize(row * a_input.colourHeight);
+		for (int y = 0; y < a_input.colourHeight; ++y)
+			memcpy(a_job.colour.data() + y * row, a_input.colour + (size_t)y * a_input.colourStride, row);
+		input.colour = a_job.colour.data();
+		input.colourStride = (int)row;
+	}
+}
+
+size_t PointCloudExporter::packInput(const Input& a_input, Format a_format, bool a_normals, Image& a_out)
+{
+	bool normals = a_normals && a_input.normals;
+	const float* v = a_input.vertices;
+
+	// valid points per block first, so every block knows where its records go
+	size_t blocks = (a_input.count + BlockPoints - 1) / BlockPoints;
+	std::vector<size_t> offsets(blocks + 1, 0);
+	forEachBlock(a_input.count, [&](size_t a_block) {
+		size_t end = std::min(a_input.count, (a_block + 1) * BlockPoints);
+		size_t valid = 0;
+		for (size_t i = a_block * BlockPoints; i < end; ++i)
+			valid += v[i * 3 + 2] > 0;
+		offsets[a_block + 1] = valid;
+	});
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	size_t count = offsets.back();
+	size_t record = recordSize(a_format, normals);
+	std::string header = makeHeader(a_format, normals, count);
+	uint8_t* out = a_out.reserve(header.size() + count * record);
+	memcpy(out, header.data(), header.size());
+	out += header.size();
+
+	Eigen::Affine3f transform(a_input.transform);
+	Eigen::Matrix3f rotation = transform.linear();
+	forEachBlock(a_input.count, [&](size_t a_block) {
+		size_t end = std::min(a_input.count, (a_block + 1) * BlockPoints);
+		uint8_t* o = out + offsets[a_block] * record;
+		for (size_t i = a_block * BlockPoints; i < end; ++i)
+		{
+			if (v[i * 3 + 2] <= 0)
+				continue;
+
+			Eigen::Vector3f position = transform * Eigen::Vector3f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+			Eigen::Vector3f normal;
+			if (normals)
+				normal = rotation * Eigen::Vector3f(a_input.normals[i * 3], a_input.normals[i * 3 + 1], a_input.normals[i * 3 + 2]);
+
+			// nearest colour pixel, as PointCloudFusion samples it
+			uint8_t white[3] = { 255, 255, 255 };
+			const uint8_t* rgb = white;
+			if (a_input.colour && a_input.texcoords)
+			{
+				int x = std::clamp((int)(a_input.texcoords[i * 2] * a_input.colourWidth), 0, a_input.colourWidth - 1);
+				int y = std::clamp((int)(a_input.texcoords[i * 2 + 1] * a_input.colourHeight), 0, a_input.colourHeight - 1);
+				rgb = a_input.colour + y * a_input.colourStride + x * 3;
+			}
+
+			o = writeRecord(o, a_format, position, normals ? &normal : nullptr, rgb);
+		}
+	});
+	return count;
+}
+
+size_t PointCloudExporter::packFused(const FusedPointCloud& a_cloud, Format a_format, Image& a_out)
+{
+	size_t count = a_cloud.count;
+	size_t record = recordSize(a_format, false);
+	std::string header = makeHeader(a_format, false, count);
+	uint8_t* out = a_out.reserve(header.size() + count * record);
+	memcpy(out, header.data(), header.size());
+	out += header.size();
+
+	forEachBlock(count, [&](size_t a_block) {
+		size_t end = std::min(count, (a_block + 1) * BlockPoints);
+		uint8_t* o = out + a_block * BlockPoints * record;
+		for (size_t i = a_block * BlockPoints; i < end; ++i)
+		{
+			uint8_t rgb[3] = { a_cloud.r[i], a_cloud.g[i], a_cloud.b[i] };
+			o = writeRecord(o, a_format, Eigen::Vector3f(a_cloud.x[i], a_cloud.y[i], a_cloud.z[i]), nullptr, rgb);
+		}
+	});
+	return count;
+}
+
+PointCloudExporter::Stats PointCloudExporter::getStats() const
+{
+	Stats stats;
+	stats.framesWritten = m_framesWritten;
+	stats.framesDropped = m_framesDropped;
+	stats.pointsWritten = m_pointsWritten;
+	stats.bytesWritten = m_bytesWritten;
+	stats.copyMs = m_lastCopyMs;
+	if (!m_running)
+		return stats;
+
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard lock(m_mutex);
+		stats.threads = (unsigned int)m_threads.size();
+		auto oldest = m_queue.empty() ? now : m_queue.front()->added;
+		for (auto& added : m_writing)
+		{
+			if (added == std::chrono::steady_clock::time_point::max())
+				continue;
+			oldest = std::min(oldest, added);
+			++stats.queued;
+		}
+		stats.queued += (unsigned int)m_queue.size();
+		stats.lagMs = std::chrono::duration<float, std::milli>(now - oldest).count();
+	}
+
+	stats.seconds = std::chrono::duration<float>(now - m_start).count();
+	if (stats.seconds > 0)
+	{
+		stats.addedPerSecond = float(m_framesAdded) / stats.seconds;
+		stats.writtenPerSecond = float(stats.framesWritten) / stats.seconds;
+		stats.writeMBps = float(double(stats.bytesWritten) / 1e6 / stats.seconds);
+	}
+	return stats;
+}
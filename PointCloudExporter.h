@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "PointCloudFusion.h"
+
+// Exports point cloud sequences as binary little-endian PLY or PCD, one file per cloud per
+// frame: position, colour and, when the cloud has them, normals. A camera's arrays are copied
+// as they are added, since the buffers they come from are reused next frame, and a fused
+// cloud is shared, so it is only referenced; either way the writer packs the file image. A
+// pool of writer threads takes the clouds from a bounded backlog and writes each with one call,
+// optionally unbuffered. When the disk can't keep up the backlog fills and clouds are
+// dropped and counted, or with wait set add() blocks until a writer frees one, as a batch
+// export wants; getStats() reports how far behind the writers are.
+class PointCloudExporter
+{
+public:
+
+	enum class Format
+	{
+		Ply,
+		Pcd,
+	};
+
+	struct Settings
+	{
+		Format			format = Format::Ply;
+		bool			normals = true;			// written when the cloud has them
+		bool			unbuffered = false;		// bypass the OS cache, see UnbufferedFile
+		unsigned int	threads = 0;			// 0 is half the cores, at least 2
+		unsigned int	backlog = 12;			// clouds waiting on the writers before any are dropped
+		bool			wait = false;			// add() waits on a full backlog rather than dropping
+	};
+
+	// one camera's points, as PointCloudFusion::Input; z <= 0 is skipped
+	struct Input
+	{
+		const float*	vertices = nullptr;		// xyz, camera space
+		const float*	texcoords = nullptr;	// uv into colour, optional
+		const float*	normals = nullptr;		// xyz, camera space, optional
+		size_t			count = 0;
+
+		Eigen::Matrix4f	transform = Eigen::Matrix4f::Identity();	// camera space to export space
+
+		const uint8_t*	colour = nullptr;		// RGB8, optional
+		int				colourWidth = 0;
+		int				colourHeight = 0;
+		int				colourStride = 0;		// bytes per row
+	};
+
+	struct Stats
+	{
+		uint64_t		framesWritten = 0;		// clouds, each is a file
+		uint64_t		framesDropped = 0;
+		uint64_t		pointsWritten = 0;
+		uint64_t		bytesWritten = 0;
+		unsigned int	queued = 0;				// waiting for or being written
+		unsigned int	threads = 0;
+		float			seconds = 0;			// since start
+		float			addedPerSecond = 0;		// clouds handed to add()
+		float			writtenPerSecond = 0;
+		float			writeMBps = 0;
+		float			lagMs = 0;				// age of the oldest cloud not written yet
+		float			copyMs = 0;				// add()'s own cost for the last camera cloud
+	};
+
+	PointCloudExporter() = default;
+	~PointCloudExporter();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}	// takes effect on the next start()
+
+	// files go to a_directory, which is created
+	bool			start(const std::string& a_directory);
+	void			stop();
+	bool			isRunning() const		{	return m_running;	}
+	const std::string&	getDirectory() const	{	return m_directory;	}
+
+	// a_name is the file name without extension. Returns false if the cloud was dropped.
+	bool			add(const std::string& a_name, const Input& a_input);
+	bool			add(const std::string& a_name, std::shared_ptr<const FusedPointCloud> a_cloud);
+
+	Stats			getStats() const;
+
+private:
+
+	// a file image, aligned and zero padded for unbuffered writes
+	struct Image
+	{
+		std::unique_ptr<uint8_t[]>	storage;
+		uint8_t*					data = nullptr;
+		size_t						capacity = 0;
+		size_t						size = 0;
+
+		uint8_t*	reserve(size_t a_size);
+	};
+
+	struct Job
+	{
+		std::string								name;
+		std::shared_ptr<const FusedPointCloud>	fused;		// packed when set, else input is
+		Input									input;		// into the copies below
+		std::vector<float>						vertices;
+		std::vector<float>						texcoords;
+		std::vector<float>						normals;
+		std::vector<uint8_t>					colour;		// rows tightly packed
+		Image									image;
+		size_t									points = 0;
+		std::chrono::steady_clock::time_point	added;
+	};
+
+	std::unique_ptr<Job>	takeJob();
+	void			queueJob(std::unique_ptr<Job> a_job);
+	void			run(size_t a_thread);
+	bool			write(const Job& a_job) const;
+
+	// a_input's arrays into a_job, which keeps their capacity between clouds
+	static void		copyInput(const Input& a_input, bool a_normals, Job& a_job);
+
+	// the whole file for a cloud into a_out, returns the number of points
+	static size_t	packInput(const Input& a_input, Format a_format, bool a_normals, Image& a_out);
+	static size_t	packFused(const FusedPointCloud& a_cloud, Format a_format, Image& a_out);
+
+	Settings				m_settings;
+	Settings				m_active;			// as of start()
+	std::string				m_directory;
+	bool					m_running = false;
+	std::chrono::steady_clock::time_point	m_start;
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::condition_variable	m_freed;			// add(), for a free job when waiting
+	std::vector<std::thread>	m_threads;
+	bool					m_quit = false;
+	std::deque<std::unique_ptr<Job>>	m_queue;
+	std::vector<std::unique_ptr<Job>>	m_free;
+	std::vector<std::chrono::steady_clock::time_point>	m_writing;	// when each writer's cloud was added, max() when idle
+
+	std::atomic<uint64_t>	m_framesAdded = 0;
+	std::atomic<uint64_t>	m_framesWritten = 0;
+	std::atomic<uint64_t>	m_framesDropped = 0;
+	std::atomic<uint64_t>	m_pointsWritten = 0;
+	std::atomic<uint64_t>	m_bytesWritten = 0;
+	std::atomic<float>		m_lastCopyMs = 0;
+};
@@ -0,0 +1,212 @@
+#include "PointCloudFusion.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#define FUSION_SIMD 1
+#include <immintrin.h>
+#endif
+
+// slack past count so a 4-wide store at the last point stays inside the arrays
+static constexpr size_t SimdSlack = 4;
+
+void FusedPointCloud::resize(size_t a_count, size_t a_cameras)
+{
+	count = a_count;
+	x.resize(a_count + SimdSlack);
+	y.resize(a_count + SimdSlack);
+	z.resize(a_count + SimdSlack);
+	r.resize(a_count);
+	g.resize(a_count);
+	b.resize(a_count);
+	camera.resize(a_count);
+	cameraOffset.assign(a_cameras, 0);
+	cameraCount.assign(a_cameras, 0);
+	cameraOrigin.assign(a_cameras, Eigen::Vector3f::Zero());
+	cameraAxis.assign(a_cameras, Eigen::Vector3f::UnitZ());
+}
+
+namespace
+{
+	inline void sampleColour(const PointCloudFusion::Input& a_input, size_t a_index, FusedPointCloud& a_out, size_t a_outIndex)
+	{
+		if (a_input.colour == nullptr ||
+			a_input.texcoords == nullptr)
+		{
+			a_out.r[a_outIndex] = a_out.g[a_outIndex] = a_out.b[a_outIndex] = 255;
+			return;
+		}
+
+		int u = std::clamp((int)(a_input.texcoords[a_index * 2] * a_input.colourWidth), 0, a_input.colourWidth - 1);
+		int v = std::clamp((int)(a_input.texcoords[a_index * 2 + 1] * a_input.colourHeight), 0, a_input.colourHeight - 1);
+		auto pixel = a_input.colour + v * a_input.colourStride + u * 3;
+		a_out.r[a_outIndex] = pixel[0];
+		a_out.g[a_outIndex] = pixel[1];
+		a_out.b[a_outIndex] = pixel[2];
+	}
+
+#ifdef FUSION_SIMD
+	// pshufb masks that move the lanes set in a 4 bit mask to the front
+	struct LeftPackTable
+	{
+		__m128i	masks[16];
+
+		LeftPackTable()
+		{
+			for (int m = 0; m < 16; ++m)
+			{
+				alignas(16) uint8_t bytes[16];
+				int lane = 0;
+				for (int i = 0; i < 4; ++i)
+					if (m & (1 << i))
+					{
+						for (int k = 0; k < 4; ++k)
+							bytes[lane * 4 + k] = (uint8_t)(i * 4 + k);
+						++lane;
+					}
+				for (; lane < 4; ++lane)
+					for (int k = 0; k < 4; ++k)
+						bytes[lane * 4 + k] = 0x80;
+				masks[m] = _mm_load_si128((const __m128i*)bytes);
+			}
+		}
+	};
+
+	const LeftPackTable sm_leftPack;
+
+	inline __m128 leftPack(__m128 a_v, int a_mask)
+	{
+		return _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(a_v), sm_leftPack.masks[a_mask]));
+	}
+#endif
+}
+
+size_t PointCloudFusion::countValid(const Input& a_input)
+{
+	size_t valid = 0;
+	for (size_t i = 0; i < a_input.count; ++i)
+		valid += a_input.vertices[i * 3 + 2] > 0;
+	return valid;
+}
+
+void PointCloudFusion::transformCamera(const Input& a_input, uint8_t a_camera, FusedPointCloud& a_out)
+{
+	const auto& m = a_input.transform;
+	const float* v = a_input.vertices;
+
+	size_t out = a_out.cameraOffset[a_camera];
+	const size_t end = out + a_out.cameraCount[a_camera];
+	size_t i = 0;
+
+	std::memset(a_out.camera.data() + out, a_camera, end - out);
+
+#ifdef FUSION_SIMD
+	const __m128 m00 = _mm_set1_ps(m(0, 0)), m01 = _mm_set1_ps(m(0, 1)), m02 = _mm_set1_ps(m(0, 2)), m03 = _mm_set1_ps(m(0, 3));
+	const __m128 m10 = _mm_set1_ps(m(1, 0)), m11 = _mm_set1_ps(m(1, 1)), m12 = _mm_set1_ps(m(1, 2)), m13 = _mm_set1_ps(m(1, 3));
+	const __m128 m20 = _mm_set1_ps(m(2, 0)), m21 = _mm_set1_ps(m(2, 1)), m22 = _mm_set1_ps(m(2, 2)), m23 = _mm_set1_ps(m(2, 3));
+	const __m128 zero = _mm_setzero_ps();
+
+	// 4 points per step; stop while a full 4-wide store still lands inside this camera's
+	// range so we never write over the neighbouring camera's points
+	for (; i + 4 <= a_input.count && out + 4 <= end; i += 4)
+	{
+		// deinterleave xyz xyz xyz xyz
+		__m128 a = _mm_loadu_ps(v + i * 3);
+		__m128 b = _mm_loadu_ps(v + i * 3 + 4);
+		__m128 c = _mm_loadu_ps(v + i * 3 + 8);
+
+		__m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 2, 1));
+		__m128 px = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(3, 1, 3, 0));
+		__m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bb = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+		__m128 py = _mm_shuffle_ps(ab, bb, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 aa = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+		__m128 cc = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+		__m128 pz = _mm_shuffle_ps(aa, cc, _MM_SHUFFLE(2, 0, 2, 0));
+
+		int mask = _mm_movemask_ps(_mm_cmpgt_ps(pz, zero));
+		if (mask == 0)
+			continue;
+
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m01, py)), _mm_add_ps(_mm_mul_ps(m02, pz), m03));
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, px), _mm_mul_ps(m11, py)), _mm_add_ps(_mm_mul_ps(m12, pz), m13));
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, px), _mm_mul_ps(m21, py)), _mm_add_ps(_mm_mul_ps(m22, pz), m23));
+
+		_mm_storeu_ps(a_out.x.data() + out, leftPack(tx, mask));
+		_mm_storeu_ps(a_out.y.data() + out, leftPack(ty, mask));
+		_mm_storeu_ps(a_out.z.data() + out, leftPack(tz, mask));
+
+		for (int lane = 0; lane < 4; ++lane)
+			if (mask & (1 << lane))
+				sampleColour(a_input, i + lane, a_out, out++);
+	}
+#endif
+
+	for (; i < a_input.count && out < end; ++i)
+	{
+		if (v[i * 3 + 2] <= 0)
+			continue;
+
+		Eigen::Vector4f p = m * Eigen::Vector4f(v[i * 3], v[i * 3 + 1], v[i * 3 + 2], 1);
+		a_out.x[out] = p.x();
+		a_out.y[out] = p.y();
+		a_out.z[out] = p.z();
+		sampleColour(a_input, i, a_out, out++);
+	}
+}
+
+void PointCloudFusion::fuse(const std::vector<Input>& a_inputs)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// reuse the back buffer unless a reader is still holding it
+	std::shared_ptr<FusedPointCloud> cloud;
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_back != nullptr && m_back.use_count() == 1)
+			cloud = m_back;
+		m_back = nullptr;
+	}
+	if (cloud == nullptr)
+		cloud = std::make_shared<FusedPointCloud>();
+
+	std::vector<size_t> counts(a_inputs.size());
+	std::vector<unsigned int> cameras(a_inputs.size());
+	std::iota(cameras.begin(), cameras.end(), 0);
+
+	std::for_each(std::execution::par, cameras.begin(), cameras.end(), [&](unsigned int camera) {
+		counts[camera] = countValid(a_inputs[camera]);
+	});
+
+	cloud->resize(std::accumulate(counts.begin(), counts.end(), size_t(0)), a_inputs.size());
+	cloud->frame = ++m_frame;
+	std::exclusive_scan(counts.begin(), counts.end(), cloud->cameraOffset.begin(), size_t(0));
+	cloud->cameraCount = counts;
+	for (size_t camera = 0; camera < a_inputs.size(); ++camera)
+	{
+		cloud->cameraOrigin[camera] = a_inputs[camera].transform.block<3, 1>(0, 3);
+		cloud->cameraAxis[camera] = a_inputs[camera].transform.block<3, 1>(0, 2).normalized();
+	}
+
+	std::for_each(std::execution::par, cameras.begin(), cameras.end(), [&](unsigned int camera) {
+		transformCamera(a_inputs[camera], (uint8_t)camera, *cloud);
+	});
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_back = std::move(m_front);
+		m_front = std::move(cloud);
+	}
+
+	m_lastFuseMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::shared_ptr<const FusedPointCloud> PointCloudFusion::acquire() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_front;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <Eigen/Core>
+
+// Every camera's points transformed into capture space and packed into one
+// structure-of-arrays buffer, colour sampled from each camera's colour frame.
+// Arrays may be longer than count (SIMD slack), only [0, count) is valid.
+struct FusedPointCloud
+{
+	size_t					count = 0;
+	uint64_t				frame = 0;
+
+	std::vector<float>		x, y, z;
+	std::vector<uint8_t>	r, g, b;
+	std::vector<uint8_t>	camera;
+
+	// first point and number of points for each camera id
+	std::vector<size_t>		cameraOffset;
+	std::vector<size_t>		cameraCount;
+
+	// each camera's position and viewing direction in capture space
+	std::vector<Eigen::Vector3f>	cameraOrigin;
+	std::vector<Eigen::Vector3f>	cameraAxis;
+
+	void	resize(size_t a_count, size_t a_cameras);
+};
+
+// Builds the fused cloud in parallel per camera and double buffers it, so readers can
+// hold on to the last fused cloud while the next one is being built.
+class PointCloudFusion
+{
+public:
+
+	struct Input
+	{
+		const float*	vertices = nullptr;		// xyz, camera space
+		const float*	texcoords = nullptr;	// uv into colour, optional
+		size_t			count = 0;
+
+		Eigen::Matrix4f	transform = Eigen::Matrix4f::Identity();	// camera space to capture space
+
+		const uint8_t*	colour = nullptr;		// RGB8, optional
+		int				colourWidth = 0;
+		int				colourHeight = 0;
+		int				colourStride = 0;		// bytes per row
+	};
+
+	PointCloudFusion() = default;
+	~PointCloudFusion() = default;
+
+	// fuses the inputs, camera ids are their index, then publishes the result
+	void	fuse(const std::vector<Input>& a_inputs);
+
+	// latest published cloud, stays valid for as long as the caller holds it
+	std::shared_ptr<const FusedPointCloud>	acquire() const;
+
+	float	getLastFuseMs() const	{	return m_lastFuseMs;	}
+
+private:
+
+	static size_t	countValid(const Input& a_input);
+	static void		transformCamera(const Input& a_input, uint8_t a_camera, FusedPointCloud& a_out);
+
+	mutable std::mutex					m_mutex;
+	std::shared_ptr<FusedPointCloud>	m_front;
+	std::shared_ptr<FusedPointCloud>	m_back;
+	uint64_t							m_frame = 0;
+	float								m_lastFuseMs = 0;
+};
@@ -0,0 +1,242 @@
+#include "PointFilter.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+void PointFilter::process(const float* a_vertices, const float* a_texcoords, size_t a_count, const float* a_normals)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	accumulate(a_vertices, a_texcoords, a_normals, a_count);
+	if (m_settings.outlierMode != OutlierMode::None)
+		rejectOutliers();
+	output(a_vertices, a_texcoords, a_normals, a_count);
+
+	m_lastFilterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PointFilter::accumulate(const float* a_vertices, const float* a_texcoords, const float* a_normals, size_t a_count)
+{
+	// sized by last frame's bricks, not points, so clearing and probing stay in cache
+	m_brickIndex.clear();
+	m_bricks.clear();
+	m_voxels.clear();
+	m_pointVoxels.resize(a_count);
+	m_inputCount = 0;
+
+	const float scale = 1.0f / m_settings.voxelSize;
+
+	// neighbouring pixels usually share a brick, so a run only probes the map once
+	uint64_t lastKey = FlatHashMap<uint32_t>::EmptyKey;
+	Brick* brick = nullptr;
+
+	for (size_t i = 0; i < a_count; ++i)
+	{
+		auto p = a_vertices + i * 3;
+		if (p[2] == 0)
+		{
+			m_pointVoxels[i] = NoVoxel;
+			continue;
+		}
+
+		Eigen::Vector3i coord((int)std::floor(p[0] * scale), (int)std::floor(p[1] * scale), (int)std::floor(p[2] * scale));
+		Eigen::Vector3i brickCoord(coord.x() >> BrickBits, coord.y() >> BrickBits, coord.z() >> BrickBits);
+		auto key = packVoxelKey(brickCoord);
+		if (key != lastKey)
+		{
+			auto slot = m_brickIndex.insert(key, (uint32_t)m_bricks.size());
+			if (slot.second)
+			{
+				m_bricks.push_back({ brickCoord, 0 });
+				std::fill(std::begin(m_bricks.back().voxels), std::end(m_bricks.back().voxels), NoVoxel);
+			}
+			lastKey = key;
+			brick = &m_bricks[*slot.first];
+		}
+
+		constexpr int mask = BrickSize - 1;
+		int cell = ((coord.z() & mask) * BrickSize + (coord.y() & mask)) * BrickSize + (coord.x() & mask);
+		uint32_t& voxelId = brick->voxels[cell];
+		if (voxelId == NoVoxel)
+		{
+			brick->occupied |= 1ull << cell;
+			voxelId = (uint32_t)m_voxels.size();
+			m_voxels.push_back({ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, true });
+		}
+
+		auto& voxel = m_voxels[voxelId];
+		voxel.x += p[0];
+		voxel.y += p[1];
+		voxel.z += p[2];
+		if (a_texcoords)
+		{
+			voxel.u += a_texcoords[i * 2];
+			voxel.v += a_texcoords[i * 2 + 1];
+		}
+		if (a_normals)
+		{
+			voxel.nx += a_normals[i * 3];
+			voxel.ny += a_normals[i * 3 + 1];
+			voxel.nz += a_normals[i * 3 + 2];
+		}
+		++voxel.count;
+		m_pointVoxels[i] = voxelId;
+		++m_inputCount;
+	}
+}
+
+void PointFilter::rejectOutliers()
+{
+	static_assert(BrickVoxels == 64, "occupancy is a 64 bit mask");
+
+	// the voxels of a brick on its low and high face along each axis
+	constexpr uint64_t faces[3][2] = {
+		{ 0x1111111111111111ull, 0x8888888888888888ull },
+		{ 0x000F000F000F000Full, 0xF000F000F000F000ull },
+		{ 0x000000000000FFFFull, 0xFFFF000000000000ull } };
+
+	// a brick's counts with a one voxel border taken from its neighbours
+	constexpr int P = BrickSize + 2;
+	uint32_t counts[P * P * P];
+
+	for (auto& brick : m_bricks)
+	{
+		std::fill(std::begin(counts), std::end(counts), 0);
+
+		for (int bz = -1; bz <= 1; ++bz)
+			for (int by = -1; by <= 1; ++by)
+				for (int bx = -1; bx <= 1; ++bx)
+				{
+					// only neighbours some voxel of this brick touches are looked up, and only
+					// their voxels facing it are read
+					const int offset[3] = { bx, by, bz };
+					uint64_t touching = brick.occupied, facing = ~0ull;
+					for (int axis = 0; axis < 3; ++axis)
+						if (offset[axis] != 0)
+						{
+							touching &= faces[axis][offset[axis] > 0];
+							facing &= faces[axis][offset[axis] < 0];
+						}
+					if (touching == 0)
+						continue;
+
+					const Brick* neighbour = &brick;
+					if (bx | by | bz)
+					{
+						auto found = m_brickIndex.find(packVoxelKey(brick.coord + Eigen::Vector3i(bx, by, bz)));
+						if (found == nullptr)
+							continue;
+						neighbour = &m_bricks[*found];
+					}
+
+					for (uint64_t cells = neighbour->occupied & facing; cells != 0; cells &= cells - 1)
+					{
+						int cell = std::countr_zero(cells);
+						int x = (cell & (BrickSize - 1)) + 1 + bx * BrickSize;
+						int y = ((cell >> BrickBits) & (BrickSize - 1)) + 1 + by * BrickSize;
+						int z = (cell >> (BrickBits * 2)) + 1 + bz * BrickSize;
+						counts[(z * P + y) * P + x] = m_voxels[neighbour->voxels[cell]].count;
+					}
+				}
+
+		for (uint64_t cells = brick.occupied; cells != 0; cells &= cells - 1)
+		{
+			int cell = std::countr_zero(cells);
+			int x = cell & (BrickSize - 1);
+			int y = (cell >> BrickBits) & (BrickSize - 1);
+			int z = cell >> (BrickBits * 2);
+
+			uint32_t neighbours = 0;
+			for (int dz = 0; dz < 3; ++dz)
+				for (int dy = 0; dy < 3; ++dy)
+				{
+					const uint32_t* row = &counts[((z + dz) * P + y + dy) * P + x];
+					neighbours += row[0] + row[1] + row[2];
+				}
+			m_voxels[brick.voxels[cell]].neighbours = neighbours;
+		}
+	}
+
+	float threshold = (float)m_settings.minNeighbours;
+	if (m_settings.outlierMode == OutlierMode::Statistical && !m_voxels.empty())
+	{
+		double sum = 0, sumSquares = 0;
+		for (auto& voxel : m_voxels)
+		{
+			sum += voxel.neighbours;
+			sumSquares += (double)voxel.neighbours * voxel.neighbours;
+		}
+
+		double mean = sum / m_voxels.size();
+		double stdDev = std::sqrt(std::max(0.0, sumSquares / m_voxels.size() - mean * mean));
+		threshold = (float)(mean - m_settings.stdDevRatio * stdDev);
+	}
+
+	for (auto& voxel : m_voxels)
+		voxel.keep = voxel.neighbours >= threshold;
+}
+
+void PointFilter::output(const float* a_vertices, const float* a_texcoords, const float* a_normals, size_t a_count)
+{
+	// voxel centroids when downsampling, otherwise the surviving points in their input order
+	m_count = 0;
+	for (auto& voxel : m_voxels)
+		if (voxel.keep)
+			m_count += m_settings.downsample ? 1 : voxel.count;
+
+	m_vertices.resize(m_count * 3);
+	m_texcoords.resize(m_count * 2);
+	m_normals.resize(a_normals ? m_count * 3 : 0);
+
+	float* vertex = m_vertices.data();
+	float* texcoord = m_texcoords.data();
+	float* normal = a_normals ? m_normals.data() : nullptr;
+
+	if (m_settings.downsample)
+	{
+		for (auto& voxel : m_voxels)
+		{
+			if (voxel.keep == false)
+				continue;
+
+			float weight = 1.0f / voxel.count;
+			*vertex++ = voxel.x * weight;
+			*vertex++ = voxel.y * weight;
+			*vertex++ = voxel.z * weight;
+			*texcoord++ = voxel.u * weight;
+			*texcoord++ = voxel.v * weight;
+
+			// mean direction, zero if the voxel had no usable normals
+			if (normal)
+			{
+				float length = std::sqrt(voxel.nx * voxel.nx + voxel.ny * voxel.ny + voxel.nz * voxel.nz);
+				float scale = length > 0 ? 1.0f / length : 0;
+				*normal++ = voxel.nx * scale;
+				*normal++ = voxel.ny * scale;
+				*normal++ = voxel.nz * scale;
+			}
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < a_count; ++i)
+	{
+		uint32_t voxelId = m_pointVoxels[i];
+		if (voxelId == NoVoxel || m_voxels[voxelId].keep == false)
+			continue;
+
+		std::copy_n(a_vertices + i * 3, 3, vertex);
+		vertex += 3;
+		if (a_texcoords)
+			std::copy_n(a_texcoords + i * 2, 2, texcoord);
+		else
+			texcoord[0] = texcoord[1] = 0;
+		texcoord += 2;
+		if (normal)
+		{
+			std::copy_n(a_normals + i * 3, 3, normal);
+			normal += 3;
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "FlatHashMap.h"
+
+// Voxel-grid downsampling and outlier removal for one camera's points, meant to sit
+// between rs2::pointcloud::calculate() and the GPU upload. Voxels are grouped into bricks
+// of 4x4x4 kept in a FlatHashMap, so a point only probes the map when it lands in another
+// brick than the point before, which in image order is every few pixels, and finds its
+// voxel in the brick's dense slots. Each camera has its own filter, run on the calling
+// thread, and the cameras are filtered in parallel by the caller.
+// Outliers are judged by voxel density: the number of points in the 3x3x3 voxels around
+// a point's voxel, either against a fixed minimum (radius) or against the mean and
+// standard deviation over all occupied voxels (statistical). The neighbourhoods are summed
+// a brick at a time from its counts and those of the 26 bricks around it, each found once.
+class PointFilter
+{
+public:
+
+	enum class OutlierMode : int
+	{
+		None,
+		Radius,
+		Statistical,
+	};
+
+	struct Settings
+	{
+		bool		downsample = false;
+		float		voxelSize = 0.005f;		// metres, also the outlier neighbourhood cell
+
+		OutlierMode	outlierMode = OutlierMode::None;
+		int			minNeighbours = 8;		// radius, points in the neighbourhood
+		float		stdDevRatio = 1.0f;		// statistical, keep above mean - ratio * stddev
+	};
+
+	PointFilter() = default;
+	~PointFilter() = default;
+
+	const Settings&	getSettings() const				{	return m_settings;		}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	bool			isEnabled() const	{	return m_settings.downsample || m_settings.outlierMode != OutlierMode::None;	}
+
+	// filters rs2::points style arrays, xyz vertices, optional uv texcoords and optional xyz
+	// normals, zero depth is invalid
+	void			process(const float* a_vertices, const float* a_texcoords, size_t a_count, const float* a_normals = nullptr);
+
+	// the last filtered points, same layout as the inputs
+	const float*	getVertices() const		{	return m_vertices.data();	}
+	const float*	getTexcoords() const	{	return m_texcoords.data();	}
+	const float*	getNormals() const		{	return m_normals.data();	}	// if normals were passed in
+	size_t			getCount() const		{	return m_count;				}
+
+	size_t			getInputCount() const	{	return m_inputCount;	}	// valid input points
+	float			getLastFilterMs() const	{	return m_lastFilterMs;	}
+
+private:
+
+	static constexpr int		BrickBits = 2;
+	static constexpr int		BrickSize = 1 << BrickBits;
+	static constexpr int		BrickVoxels = BrickSize * BrickSize * BrickSize;
+	static constexpr uint32_t	NoVoxel = ~0u;
+
+	struct Brick
+	{
+		Eigen::Vector3i	coord;
+		uint64_t		occupied;				// a bit per voxel
+		uint32_t		voxels[BrickVoxels];	// into m_voxels, x fastest
+	};
+
+	struct Voxel
+	{
+		float		x, y, z;	// sums
+		float		u, v;
+		float		nx, ny, nz;
+		uint32_t	count;
+		uint32_t	neighbours;
+		bool		keep;
+	};
+
+	void	accumulate(const float* a_vertices, const float* a_texcoords, const float* a_normals, size_t a_count);
+	void	rejectOutliers();
+	void	output(const float* a_vertices, const float* a_texcoords, const float* a_normals, size_t a_count);
+
+	Settings				m_settings;
+
+	FlatHashMap<uint32_t>	m_brickIndex;	// packed brick coord -> m_bricks
+	std::vector<Brick>		m_bricks;
+	std::vector<Voxel>		m_voxels;
+	std::vector<uint32_t>	m_pointVoxels;	// per input point, NoVoxel where invalid
+
+	std::vector<float>		m_vertices;
+	std::vector<float>		m_texcoords;
+	std::vector<float>		m_normals;
+	size_t					m_count = 0;
+	size_t					m_inputCount = 0;
+	float					m_lastFilterMs = 0;
+};
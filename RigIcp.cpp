@@ -0,0 +1,551 @@
+#include "RigIcp.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+#include <Eigen/Cholesky>
+
+namespace
+{
+	// a coarser pixel averages the source depths close to the nearest of its four, so a
+	// pixel that straddles an edge takes the foreground rather than a point in mid air
+	constexpr float DownsampleTolerance = 0.03f;
+
+	template<typename Fn>
+	void parallelRows(int a_rows, Fn&& a_fn)
+	{
+		std::vector<int> rows(a_rows);
+		std::iota(rows.begin(), rows.end(), 0);
+		std::for_each(std::execution::par, rows.begin(), rows.end(), a_fn);
+	}
+}
+
+void RigIcp::PairSums::add(const PairSums& a_other)
+{
+	for (int i = 0; i < 21; ++i)
+	{
+		ss[i] += a_other.ss[i];
+		tt[i] += a_other.tt[i];
+	}
+	for (int i = 0; i < 36; ++i)
+		st[i] += a_other.st[i];
+	for (int i = 0; i < 6; ++i)
+	{
+		bs[i] += a_other.bs[i];
+		bt[i] += a_other.bt[i];
+	}
+	error += a_other.error;
+	pairs += a_other.pairs;
+}
+
+RigIcp::RigIcp()
+{
+	m_thread = std::thread(&RigIcp::run, this);
+}
+
+RigIcp::~RigIcp()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+RigIcp::Settings RigIcp::getSettings() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_settings;
+}
+
+void RigIcp::setSettings(const Settings& a_settings)
+{
+	std::lock_guard lock(m_mutex);
+	m_settings = a_settings;
+}
+
+bool RigIcp::isBusy() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_submitted;
+}
+
+bool RigIcp::submit(const std::vector<Input>& a_inputs)
+{
+	// the thread only reads the snapshot while a submission is pending, so it is filled unlocked
+	if (isBusy())
+		return false;
+
+	m_snapshot = a_inputs;
+	m_snapshotDepth.resize(a_inputs.size());
+	for (size_t i = 0; i < a_inputs.size(); ++i)
+	{
+		auto& input = m_snapshot[i];
+		if (!input.depth || input.width <= 0 || input.height <= 0)
+			continue;
+
+		m_snapshotDepth[i].assign(input.depth, input.depth + (size_t)input.width * input.height);
+		input.depth = m_snapshotDepth[i].data();
+	}
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_submitted = true;
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+bool RigIcp::takeResults(std::vector<Result>& a_results)
+{
+	std::lock_guard lock(m_mutex);
+	if (!m_solved)
+		return false;
+
+	m_solved = false;
+	a_results = m_snapshotResults;
+	return true;
+}
+
+void RigIcp::run()
+{
+	std::unique_lock lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this] { return m_quit || m_submitted; });
+		if (m_quit)
+			return;
+
+		lock.unlock();
+		bool solved = solve(m_snapshot);
+		lock.lock();
+
+		if (solved)
+		{
+			m_snapshotResults = m_results;
+			m_solved = true;
+		}
+		m_submitted = false;
+	}
+}
+
+bool RigIcp::solve(const std::vector<Input>& a_inputs)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_solveSettings = getSettings();
+
+	m_results.assign(a_inputs.size(), Result());
+
+	// cameras are kept between solves so the pyramid buffers are reused
+	size_t count = 0;
+	for (auto& input : a_inputs)
+		if (input.depth && input.width > 0 && input.height > 0)
+			++count;
+	if (count < 2)
+		return false;
+	m_cameras.resize(count);
+
+	bool anyFixed = false;
+	for (unsigned int i = 0, camera = 0; i < a_inputs.size(); ++i)
+	{
+		auto& input = a_inputs[i];
+		if (!input.depth || input.width <= 0 || input.height <= 0)
+			continue;
+
+		auto& c = m_cameras[camera++];
+		c.index = i;
+		c.fixed = input.fixed;
+		c.pose = Eigen::Affine3f(input.cameraToCapture);
+		c.initialPose = c.pose;
+		c.captureToCamera = c.pose.inverse();
+		anyFixed |= c.fixed;
+	}
+	if (!anyFixed)
+		m_cameras.front().fixed = true;
+
+	std::for_each(std::execution::par, m_cameras.begin(), m_cameras.end(), [&](Camera& a_camera) {
+		buildPyramid(a_inputs[a_camera.index], a_camera);
+	});
+
+	auto pyramidDone = std::chrono::steady_clock::now();
+	m_lastPyramidMs = std::chrono::duration<float, std::milli>(pyramidDone - start).count();
+
+	int levels = (int)m_cameras.front().levels.size();
+	auto gate = [&](int a_level) {
+		return m_solveSettings.maxDistance * std::pow(0.5f, float(levels - 1 - a_level));
+	};
+
+	// residual of every pair a camera takes part in, from either side
+	std::vector<Reduction> reductions;
+	auto rms = [&](unsigned int a_camera, unsigned int& a_pairs) {
+		double error = 0;
+		a_pairs = 0;
+		for (size_t s = 0; s < m_cameras.size(); ++s)
+		{
+			for (size_t t = 0; t < m_cameras.size(); ++t)
+			{
+				if (s != a_camera && t != a_camera) continue;
+				error += reductions[s][t].error;
+				a_pairs += reductions[s][t].pairs;
+			}
+		}
+		return a_pairs ? (float)std::sqrt(error / a_pairs) : 0.0f;
+	};
+
+	reduce(0, gate(0), reductions);
+	for (unsigned int i = 0; i < m_cameras.size(); ++i)
+	{
+		unsigned int pairs;
+		m_results[m_cameras[i].index].rmsBefore = rms(i, pairs);
+	}
+
+	for (int level = levels - 1; level >= 0; --level)
+	{
+		float maxDistance = gate(level);
+
+		for (int iteration = 0; iteration < m_solveSettings.iterations; ++iteration)
+		{
+			reduce(level, maxDistance, reductions);
+
+			// the finest level's residual, as of the last iteration
+			if (level == 0)
+				for (unsigned int i = 0; i < m_cameras.size(); ++i)
+					m_results[m_cameras[i].index].rmsAfter = rms(i, m_results[m_cameras[i].index].pairs);
+
+			// cameras with too little overlap stay put this iteration
+			int unknowns = 0;
+			for (unsigned int i = 0; i < m_cameras.size(); ++i)
+			{
+				unsigned int pairs;
+				rms(i, pairs);
+				auto& c = m_cameras[i];
+				c.unknown = !c.fixed && pairs >= m_solveSettings.minPairs ? unknowns++ : -1;
+			}
+			if (!unknowns) break;
+
+			Eigen::MatrixXd a = Eigen::MatrixXd::Zero(unknowns * 6, unknowns * 6);
+			Eigen::VectorXd b = Eigen::VectorXd::Zero(unknowns * 6);
+
+			auto addSymmetric = [&](int a_block, const double* a_upper) {
+				for (int row = 0, k = 0; row < 6; ++row)
+					for (int col = row; col < 6; ++col, ++k)
+					{
+						a(a_block * 6 + row, a_block * 6 + col) += a_upper[k];
+						if (col != row)
+							a(a_block * 6 + col, a_block * 6 + row) += a_upper[k];
+					}
+			};
+
+			for (size_t s = 0; s < m_cameras.size(); ++s)
+			{
+				for (size_t t = 0; t < m_cameras.size(); ++t)
+				{
+					auto& sums = reductions[s][t];
+					if (!sums.pairs) continue;
+
+					int us = m_cameras[s].unknown;
+					int ut = m_cameras[t].unknown;
+					if (us >= 0)
+					{
+						addSymmetric(us, sums.ss);
+						b.segment<6>(us * 6) += Eigen::Map<const Eigen::Matrix<double, 6, 1>>(sums.bs);
+					}
+					if (ut >= 0)
+					{
+						addSymmetric(ut, sums.tt);
+						b.segment<6>(ut * 6) += Eigen::Map<const Eigen::Matrix<double, 6, 1>>(sums.bt);
+					}
+					if (us >= 0 && ut >= 0)
+					{
+						Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> st(sums.st);
+						a.block<6, 6>(us * 6, ut * 6) += st;
+						a.block<6, 6>(ut * 6, us * 6) += st.transpose();
+					}
+				}
+			}
+
+			// light damping keeps a degenerate view (a single wall) from sliding along itself
+			a.diagonal().array() += 1e-6 * a.trace() / a.rows();
+
+			Eigen::LDLT<Eigen::MatrixXd> ldlt(a);
+			if (ldlt.info() != Eigen::Success) break;
+			Eigen::VectorXd x = ldlt.solve(-b);
+			if (!x.allFinite()) break;
+
+			bool moved = false;
+			for (auto& c : m_cameras)
+			{
+				if (c.unknown < 0) continue;
+
+				Eigen::Vector3f rotation = x.segment<3>(c.unknown * 6).cast<float>();
+				Eigen::Vector3f translation = x.segment<3>(c.unknown * 6 + 3).cast<float>();
+				float angle = rotation.norm();
+
+				Eigen::Affine3f delta = Eigen::Affine3f::Identity();
+				if (angle > 0)
+					delta.linear() = Eigen::AngleAxisf(angle, rotation / angle).toRotationMatrix();
+				delta.translation() = translation;
+
+				c.pose = delta * c.pose;
+				c.captureToCamera = c.pose.inverse();
+
+				m_results[c.index].valid = true;
+				moved |= angle > 1e-4f || translation.norm() > 1e-4f;
+			}
+
+			if (!moved) break;
+		}
+	}
+
+	for (auto& c : m_cameras)
+		m_results[c.index].correction = c.pose * c.initialPose.inverse();
+
+	m_lastSolveMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pyramidDone).count();
+	return true;
+}
+
+void RigIcp::buildPyramid(const Input& a_input, Camera& a_camera)
+{
+	int levels = std::max(m_solveSettings.levels, 1);
+	a_camera.levels.resize(levels);
+
+	Level full;
+	full.width = a_input.width;
+	full.height = a_input.height;
+	full.fx = a_input.fx;
+	full.fy = a_input.fy;
+	full.cx = a_input.cx;
+	full.cy = a_input.cy;
+	full.depth.resize((size_t)full.width * full.height);
+
+	float maxDepth = m_solveSettings.maxDepth;
+	parallelRows(full.height, [&](int a_row) {
+		size_t begin = (size_t)a_row * full.width;
+		for (int x = 0; x < full.width; ++x)
+		{
+			float z = a_input.depth[begin + x] * a_input.depthUnits;
+			full.depth[begin + x] = z < maxDepth ? z : 0;
+		}
+	});
+
+	// halve until the finest level fits, so colour-aligned depth isn't matched at full resolution
+	while (full.width > m_solveSettings.maxWidth && full.width >= 4 && full.height >= 4)
+	{
+		Level half;
+		downsample(full, half);
+		full = std::move(half);
+	}
+
+	auto& finest = a_camera.levels[0];
+	finest.width = full.width;
+	finest.height = full.height;
+	finest.fx = full.fx;
+	finest.fy = full.fy;
+	finest.cx = full.cx;
+	finest.cy = full.cy;
+	finest.depth = std::move(full.depth);
+
+	for (int level = 1; level < levels; ++level)
+		downsample(a_camera.levels[level - 1], a_camera.levels[level]);
+
+	for (int level = 0; level < levels; ++level)
+	{
+		auto& l = a_camera.levels[level];
+		l.vertices.resize(l.depth.size() * 3);
+
+		parallelRows(l.height, [&](int a_row) {
+			size_t begin = (size_t)a_row * l.width;
+			float y = (a_row - l.cy) / l.fy;
+			for (int x = 0; x < l.width; ++x)
+			{
+				float z = l.depth[begin + x];
+				float* v = &l.vertices[(begin + x) * 3];
+				v[0] = (x - l.cx) / l.fx * z;
+				v[1] = y * z;
+				v[2] = z;
+			}
+		});
+
+		// coarse levels need a smaller box, a pixel there already covers several, and their
+		// depth steps between neighbours are as many times larger
+		auto settings = l.normals.getSettings();
+		settings.radius = level == 0 ? 3 : 2;
+		settings.maxDepthChange = NormalEstimator::Settings().maxDepthChange * a_input.width / l.width;
+		l.normals.setSettings(settings);
+		l.normals.compute(l.vertices.data(), l.width, l.height);
+
+		const float* normals = l.normals.getNormals();
+		l.surfels.resize(l.depth.size());
+		for (size_t i = 0; i < l.surfels.size(); ++i)
+		{
+			auto& surfel = l.surfels[i];
+			surfel.point = Eigen::Map<const Eigen::Vector3f>(&l.vertices[i * 3]);
+			surfel.normal = Eigen::Map<const Eigen::Vector3f>(normals + i * 3);
+			if (l.depth[i] <= 0 || surfel.normal.squaredNorm() < 0.25f)
+				surfel.normal.setZero();
+		}
+	}
+}
+
+void RigIcp::downsample(const Level& a_source, Level& a_target) const
+{
+	a_target.width = a_source.width / 2;
+	a_target.height = a_source.height / 2;
+	a_target.fx = a_source.fx * 0.5f;
+	a_target.fy = a_source.fy * 0.5f;
+	a_target.cx = (a_source.cx + 0.5f) * 0.5f - 0.5f;
+	a_target.cy = (a_source.cy + 0.5f) * 0.5f - 0.5f;
+	a_target.depth.resize((size_t)a_target.width * a_target.height);
+
+	parallelRows(a_target.height, [&](int a_row) {
+		const float* top = &a_source.depth[(size_t)a_row * 2 * a_source.width];
+		const float* bottom = top + a_source.width;
+		float* out = &a_target.depth[(size_t)a_row * a_target.width];
+
+		for (int x = 0; x < a_target.width; ++x)
+		{
+			float samples[4] = { top[x * 2], top[x * 2 + 1], bottom[x * 2], bottom[x * 2 + 1] };
+
+			float nearest = 0;
+			for (float z : samples)
+				if (z > 0 && (nearest == 0 || z < nearest))
+					nearest = z;
+
+			float sum = 0;
+			int count = 0;
+			for (float z : samples)
+			{
+				if (z > 0 && z - nearest <= nearest * DownsampleTolerance)
+				{
+					sum += z;
+					++count;
+				}
+			}
+			out[x] = count ? sum / count : 0;
+		}
+	});
+}
+
+void RigIcp::reduce(int a_level, float a_maxDistance, std::vector<Reduction>& a_out) const
+{
+	// one task per band of rows of every camera
+	std::vector<std::pair<unsigned int, int>> tasks;
+	for (unsigned int source = 0; source < m_cameras.size(); ++source)
+	{
+		int bands = (m_cameras[source].levels[a_level].height + BandRows - 1) / BandRows;
+		for (int band = 0; band < bands; ++band)
+			tasks.emplace_back(source, band);
+	}
+
+	std::vector<Reduction> partial(tasks.size(), Reduction(m_cameras.size()));
+	std::vector<size_t> indices(tasks.size());
+	std::iota(indices.begin(), indices.end(), 0);
+	std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t a_task) {
+		reduceBand(tasks[a_task].first, a_level, a_maxDistance, tasks[a_task].second, partial[a_task]);
+	});
+
+	a_out.assign(m_cameras.size(), Reduction(m_cameras.size()));
+	for (size_t task = 0; task < tasks.size(); ++task)
+		for (size_t target = 0; target < m_cameras.size(); ++target)
+			a_out[tasks[task].first][target].add(partial[task][target]);
+}
+
+void RigIcp::reduceBand(unsigned int a_source, int a_level, float a_maxDistance, int a_band, Reduction& a_out) const
+{
+	auto& source = m_cameras[a_source].levels[a_level];
+	int rowBegin = a_band * BandRows;
+	int rowEnd = std::min(rowBegin + BandRows, source.height);
+	// the coarsest level is all there is to go on at first, every pixel of it counts
+	int stride = a_level < (int)m_cameras[a_source].levels.size() - 1 ? std::max(m_solveSettings.stride, 1) : 1;
+
+	float maxDistance2 = a_maxDistance * a_maxDistance;
+	float huber = m_solveSettings.huber;
+
+	// a source point is paired and gated in the target camera's space, where its depth and
+	// normals already are, and only the pair is taken to capture space
+	auto& sourceCamera = m_cameras[a_source];
+	std::vector<Eigen::Affine3f> sourceToTarget(m_cameras.size());
+	for (size_t other = 0; other < m_cameras.size(); ++other)
+		sourceToTarget[other] = m_cameras[other].captureToCamera * sourceCamera.pose;
+
+	for (int row = rowBegin; row < rowEnd; ++row)
+	{
+		if (row % stride) continue;
+
+		for (int x = 0; x < source.width; x += stride)
+		{
+			auto& surfel = source.surfels[(size_t)row * source.width + x];
+			if (surfel.normal.squaredNorm() == 0) continue;
+
+			// pair with the closest compatible surface point any other camera sees along its ray to p
+			int best = -1;
+			size_t bestPixel = 0;
+			float bestDistance2 = maxDistance2;
+
+			for (unsigned int other = 0; other < m_cameras.size(); ++other)
+			{
+				if (other == a_source) continue;
+
+				auto& target = m_cameras[other].levels[a_level];
+				Eigen::Vector3f p = sourceToTarget[other] * surfel.point;
+				if (p.z() <= 0) continue;
+
+				// truncation after the offset rounds, as the bounds check drops anything below -0.5
+				float w = 1.0f / p.z();
+				float u = p.x() * w * target.fx + target.cx + 0.5f;
+				float v = p.y() * w * target.fy + target.cy + 0.5f;
+				if (!(u >= 0 && v >= 0 && u < target.width && v < target.height)) continue;
+
+				size_t j = (size_t)v * target.width + (size_t)u;
+				auto& candidate = target.surfels[j];
+				float distance2 = (p - candidate.point).squaredNorm();
+				if (distance2 >= bestDistance2 || candidate.normal.squaredNorm() == 0 ||
+					(sourceToTarget[other].linear() * surfel.normal).dot(candidate.normal) < m_solveSettings.minNormalDot) continue;
+
+				bestDistance2 = distance2;
+				best = (int)other;
+				bestPixel = j;
+			}
+			if (best < 0) continue;
+
+			// r = (p - q).n, linearised for small capture-space rotations w and translations t
+			// applied to p and to q: dr/dws = p x n, dr/dts = n, dr/dwt = -(q x n), dr/dtt = -n
+			auto& targetCamera = m_cameras[best];
+			auto& pair = targetCamera.levels[a_level].surfels[bestPixel];
+			Eigen::Vector3f p = sourceCamera.pose * surfel.point;
+			Eigen::Vector3f q = targetCamera.pose * pair.point;
+			Eigen::Vector3f nq = targetCamera.pose.linear() * pair.normal;
+
+			float r = (p - q).dot(nq);
+			Eigen::Vector3f pn = p.cross(nq);
+			Eigen::Vector3f qn = q.cross(nq);
+			float js[6] = { pn.x(), pn.y(), pn.z(), nq.x(), nq.y(), nq.z() };
+			float jt[6] = { -qn.x(), -qn.y(), -qn.z(), -nq.x(), -nq.y(), -nq.z() };
+
+			float absR = std::abs(r);
+			double weight = absR <= huber ? 1.0 : huber / absR;
+
+			auto& sums = a_out[best];
+			for (int a = 0, k = 0; a < 6; ++a)
+			{
+				double ws = weight * js[a];
+				double wt = weight * jt[a];
+				sums.bs[a] += ws * r;
+				sums.bt[a] += wt * r;
+				for (int b = 0; b < 6; ++b)
+					sums.st[a * 6 + b] += ws * jt[b];
+				for (int b = a; b < 6; ++b, ++k)
+				{
+					sums.ss[k] += ws * js[b];
+					sums.tt[k] += wt * jt[b];
+				}
+			}
+			sums.error += (double)r * r;
+			++sums.pairs;
+		}
+	}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "NormalEstimator.h"
+
+// Refines the extrinsics of every camera in the rig at once with point-to-plane ICP against
+// the other cameras' depth, coarse to fine over organized depth pyramids. Correspondences
+// come from projective data association: a point is projected into each other camera's
+// depth image and paired with the pixel it lands on, so there is no neighbour search and
+// each lookup is constant time. All cameras move together in one Gauss-Newton step: every
+// pair adds to the 6x6 blocks of both the camera the point came from and the camera it was
+// paired with, those blocks are reduced over bands of rows in parallel, and the joint
+// system is solved for every camera that isn't fixed. If none are fixed the first camera
+// is held still so the rig can't drift as a whole.
+// Pairs are found and gated in the target camera's own space, so only the sampled source
+// points are moved each iteration, never a whole level.
+// solve() runs on the caller's thread. submit() instead copies the depth and hands it to a
+// thread of its own, like DriftMonitor, and takeResults() collects the outcome once it is
+// done, so a periodic refinement never holds up a frame.
+class RigIcp
+{
+public:
+
+	struct Settings
+	{
+		int				levels = 3;
+		int				maxWidth = 480;			// the finest level is halved until it fits
+		int				iterations = 3;			// per level
+		int				stride = 2;				// source pixels sampled in each direction, on all but the coarsest level
+		float			maxDistance = 0.05f;	// meters, pairing gate at the coarsest level, halved per finer level
+		float			minNormalDot = 0.8f;	// cos of the largest angle between paired normals
+		float			huber = 0.01f;			// meters, residuals beyond this are down-weighted
+		float			maxDepth = 4.0f;
+		unsigned int	minPairs = 200;			// fewer pairs than this leaves the camera where it is
+	};
+
+	// one camera's depth, with camera axes as librealsense deprojects them
+	struct Input
+	{
+		const uint16_t*	depth = nullptr;
+		int				width = 0;
+		int				height = 0;
+		float			depthUnits = 0.001f;
+		float			fx = 0, fy = 0, cx = 0, cy = 0;
+
+		Eigen::Matrix4f	cameraToCapture = Eigen::Matrix4f::Identity();
+		bool			fixed = false;
+	};
+
+	struct Result
+	{
+		bool			valid = false;
+		float			rmsBefore = 0;		// meters, point-to-plane residual over the finest level pairs
+		float			rmsAfter = 0;		// as of the last iteration
+		unsigned int	pairs = 0;			// at the finest level, with this camera on either side
+		Eigen::Affine3f	correction = Eigen::Affine3f::Identity();	// capture space, pre-multiplies the pose
+	};
+
+	RigIcp();
+	~RigIcp();
+
+	Settings		getSettings() const;
+	void			setSettings(const Settings& a_settings);	// takes effect on the next solve
+
+	// builds the pyramids from the inputs (cameras without depth are left out) and refines
+	// every camera that isn't fixed. Returns false when fewer than two cameras have depth.
+	// Not to be mixed with submit().
+	bool			solve(const std::vector<Input>& a_inputs);
+
+	// of the last solve()
+	const Result&	getResult(unsigned int a_camera) const	{	return m_results[a_camera];	}
+	size_t			getCameraCount() const	{	return m_results.size();	}
+
+	// copies the inputs' depth for the background thread to solve. Returns false, copying
+	// nothing, while the last submission is still being solved.
+	bool			submit(const std::vector<Input>& a_inputs);
+	bool			isBusy() const;
+
+	// true once per solved submission, with its results indexed like its inputs
+	bool			takeResults(std::vector<Result>& a_results);
+
+	float			getLastPyramidMs() const	{	return m_lastPyramidMs;	}
+	float			getLastSolveMs() const		{	return m_lastSolveMs;	}
+
+private:
+
+	static constexpr int	BandRows = 16;
+
+	struct Surfel
+	{
+		Eigen::Vector3f	point;
+		Eigen::Vector3f	normal;		// zero marks the pixel unusable, on either side of a pair
+	};
+
+	struct Level
+	{
+		int				width = 0;
+		int				height = 0;
+		float			fx = 0, fy = 0, cx = 0, cy = 0;
+		std::vector<float>	depth;			// meters, 0 invalid
+		std::vector<float>	vertices;		// xyz camera space
+		NormalEstimator		normals;
+
+		// camera space, a pixel's point and normal side by side for the pairing
+		std::vector<Surfel>	surfels;
+	};
+
+	struct Camera
+	{
+		unsigned int		index = 0;		// into the inputs
+		bool				fixed = false;
+		Eigen::Affine3f		pose = Eigen::Affine3f::Identity();	// camera to capture
+		Eigen::Affine3f		initialPose = Eigen::Affine3f::Identity();
+		Eigen::Affine3f		captureToCamera = Eigen::Affine3f::Identity();
+		int					unknown = -1;	// block of the joint system, -1 when fixed
+		std::vector<Level>	levels;
+	};
+
+	// normal equation terms of the pairs from one source camera to one target camera,
+	// with Js and Jt the residual's derivatives by each camera's motion
+	struct PairSums
+	{
+		double			ss[21] = {};	// upper triangle of Js'Js
+		double			st[36] = {};	// Js'Jt
+		double			tt[21] = {};	// upper triangle of Jt'Jt
+		double			bs[6] = {};		// Js'r
+		double			bt[6] = {};		// Jt'r
+		double			error = 0;		// sum of r^2
+		unsigned int	pairs = 0;
+
+		void			add(const PairSums& a_other);
+	};
+
+	// one source camera's sums, per target camera
+	using Reduction = std::vector<PairSums>;
+
+	void		run();
+	void		buildPyramid(const Input& a_input, Camera& a_camera);
+	void		downsample(const Level& a_source, Level& a_target) const;
+	void		reduce(int a_level, float a_maxDistance, std::vector<Reduction>& a_out) const;
+	void		reduceBand(unsigned int a_source, int a_level, float a_maxDistance, int a_band, Reduction& a_out) const;
+
+	Settings				m_settings;
+	Settings				m_solveSettings;	// as of the solve in progress
+	std::vector<Camera>		m_cameras;
+	std::vector<Result>		m_results;
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	bool					m_submitted = false;	// the snapshot is waiting for or being solved
+	bool					m_solved = false;		// a solve has finished that takeResults() hasn't returned
+	std::vector<Input>		m_snapshot;				// pointing into m_snapshotDepth
+	std::vector<std::vector<uint16_t>>	m_snapshotDepth;
+	std::vector<Result>		m_snapshotResults;
+
+	std::atomic<float>		m_lastPyramidMs = 0;
+	std::atomic<float>		m_lastSolveMs = 0;
+};
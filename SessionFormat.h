@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of a recorded capture session (.vcs).
+//
+//	FileHeader, CameraInfo[cameraCount]		padded to headerSize
+//	chunk 0: ChunkHeader, frames...			padded to Alignment
+//	chunk 1: ...
+//	checkpoint: CheckpointHeader, IndexEntry[]	padded to Alignment
+//	chunk n: ...
+//	IndexEntry[entryCount]					padded so Footer ends the file
+//	Footer
+//
+// The file is only ever appended to. Each frame is one camera's depth and colour with its
+// metadata: a FrameHeader followed by the depth then the colour payload, each padded to
+// PayloadAlignment so mapped views of them are aligned. Every chunk and the index start
+// on an Alignment boundary, so the whole file can be written with unbuffered I/O.
+// Checkpoints go between chunks now and then, each indexing the frames of the chunks since
+// the one before. Chunks and checkpoints both start with their magic then their size, so
+// a file that never got its footer is recovered by hopping from header to header, reading
+// the frame headers only of the chunks after the last checkpoint.
+// Everything is little-endian.
+namespace SessionFormat
+{
+	constexpr uint32_t	FileMagic = 0x53455356;		// 'VSES'
+	constexpr uint32_t	ChunkMagic = 0x4B484356;	// 'VCHK'
+	constexpr uint32_t	FrameMagic = 0x4D524656;	// 'VFRM'
+	constexpr uint32_t	FooterMagic = 0x58444956;	// 'VIDX'
+	constexpr uint32_t	CheckpointMagic = 0x504B4356;	// 'VCKP'
+	constexpr uint32_t	Version = 1;
+
+	constexpr size_t	Alignment = 4096;
+	constexpr size_t	PayloadAlignment = 64;
+
+	constexpr size_t	alignUp(size_t a_size, size_t a_alignment)	{	return (a_size + a_alignment - 1) & ~(a_alignment - 1);	}
+
+	// how a payload is stored
+	enum Codec : uint32_t
+	{
+		Raw = 0,
+		DepthRans = 1,		// Z16 through DepthCodec, lossless
+		Jpeg = 2,			// colour through ColourCodec
+		Qoi = 3,			// colour through ColourCodec, lossless
+	};
+
+	enum FrameFlags : uint16_t
+	{
+		HasDepth	= 1 << 0,
+		HasColour	= 1 << 1,
+	};
+
+	// a video stream as librealsense described it, intrinsics included
+	struct StreamInfo
+	{
+		uint32_t	width = 0;
+		uint32_t	height = 0;
+		uint32_t	format = 0;		// rs2_format
+		uint32_t	fps = 0;
+		float		fx = 0, fy = 0, cx = 0, cy = 0;
+		uint32_t	model = 0;		// rs2_distortion
+		float		coeffs[5] = {};
+		uint32_t	reserved[2] = {};
+	};
+
+	struct CameraInfo
+	{
+		char		serial[32] = {};
+		StreamInfo	depth;
+		StreamInfo	colour;
+		float		depthUnits = 0.001f;		// meters per depth unit
+		float		depthCorrection[3] = {};	// see DepthCorrection::Coefficients
+		float		depthToColor[16] = {};		// column-major, depth sensor to colour sensor
+		uint32_t	reserved[4] = {};
+	};
+
+	struct FileHeader
+	{
+		uint32_t	magic = FileMagic;
+		uint32_t	version = Version;
+		uint32_t	headerSize = 0;		// bytes, where the first chunk starts
+		uint32_t	cameraCount = 0;
+		int64_t		startTime = 0;		// system clock, ns since the epoch
+		uint32_t	chunkSize = 0;		// capacity the recorder used, chunks may be smaller
+		uint32_t	reserved[9] = {};
+	};
+
+	struct ChunkHeader
+	{
+		uint32_t	magic = ChunkMagic;
+		uint32_t	index = 0;
+		uint64_t	size = 0;			// bytes including this header and padding, the next chunk follows
+		uint32_t	frameCount = 0;
+		uint32_t	reserved[11] = {};
+	};
+
+	// laid out as ChunkHeader up to size, so either can be stepped over without knowing which
+	struct CheckpointHeader
+	{
+		uint32_t	magic = CheckpointMagic;
+		uint32_t	index = 0;			// checkpoints before this one
+		uint64_t	size = 0;			// bytes including this header and padding, the next chunk follows
+		uint32_t	entryCount = 0;		// IndexEntry, one per frame of the chunks since the last checkpoint
+		uint32_t	entryChecksum = 0;	// CRC-32 of the entries
+		uint32_t	chunkCount = 0;		// chunks before this checkpoint
+		uint32_t	reserved[9] = {};
+	};
+
+	struct FrameHeader
+	{
+		uint32_t	magic = FrameMagic;
+		uint16_t	camera = 0;			// into the CameraInfo array
+		uint16_t	flags = 0;
+		uint64_t	frameNumber = 0;	// of the depth frame, or the colour frame without depth
+		double		timestamp = 0;		// ms, depth frame's device timestamp
+		double		colourTimestamp = 0;
+		int64_t		systemTime = 0;		// system clock, ns since the epoch, when the frameset arrived
+		uint32_t	depthCodec = Raw;
+		uint32_t	depthSize = 0;		// bytes, before padding
+		uint32_t	colourCodec = Raw;
+		uint32_t	colourSize = 0;
+		float		transform[16] = {};	// column-major, depth sensor to capture space when captured
+		uint32_t	reserved[2] = {};
+	};
+
+	struct IndexEntry
+	{
+		uint64_t	offset = 0;			// of the FrameHeader, from the start of the file
+		uint64_t	frameNumber = 0;
+		double		timestamp = 0;
+		uint32_t	size = 0;			// bytes of header and padded payloads
+		uint16_t	camera = 0;
+		uint16_t	flags = 0;
+	};
+
+	struct Footer
+	{
+		uint32_t	magic = FooterMagic;
+		uint32_t	version = Version;
+		uint64_t	indexOffset = 0;
+		uint64_t	entryCount = 0;
+		uint32_t	indexChecksum = 0;	// CRC-32 of the entries
+		uint32_t	chunkCount = 0;
+		uint32_t	reserved[8] = {};
+	};
+
+	static_assert(sizeof(StreamInfo) == 64);
+	static_assert(sizeof(CameraInfo) == 256);
+	static_assert(sizeof(FileHeader) == 64);
+	static_assert(sizeof(ChunkHeader) == 64);
+	static_assert(sizeof(CheckpointHeader) == 64);
+	static_assert(offsetof(CheckpointHeader, size) == offsetof(ChunkHeader, size));
+	static_assert(sizeof(FrameHeader) == 128);
+	static_assert(sizeof(IndexEntry) == 32);
+	static_assert(sizeof(Footer) == 64);
+
+	inline size_t frameSize(size_t a_depthSize, size_t a_colourSize)
+	{
+		return sizeof(FrameHeader) + alignUp(a_depthSize, PayloadAlignment) + alignUp(a_colourSize, PayloadAlignment);
+	}
+}
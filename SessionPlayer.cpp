@@ -0,0 +1,244 @@
+#include "SessionPlayer.h"
+#include "Crc32.h"
+#include "SessionRecovery.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace SessionFormat;
+
+bool SessionPlayer::open(const std::string& a_filename)
+{
+	close();
+
+	if (!m_file.open(a_filename))
+	{
+		std::cout << "Error: Unable to open session " << a_filename << std::endl;
+		return false;
+	}
+
+	const uint8_t* data = m_file.data();
+	size_t size = m_file.size();
+
+	if (size < sizeof(FileHeader))
+	{
+		std::cout << "Error: " << a_filename << " is not a session" << std::endl;
+		close();
+		return false;
+	}
+	memcpy(&m_header, data, sizeof(FileHeader));
+	if (m_header.magic != FileMagic ||
+		m_header.version != Version ||
+		m_header.headerSize > size ||
+		sizeof(FileHeader) + (size_t)m_header.cameraCount * sizeof(CameraInfo) > m_header.headerSize)
+	{
+		std::cout << "Error: " << a_filename << " is not a session" << std::endl;
+		close();
+		return false;
+	}
+
+	m_cameras.resize(m_header.cameraCount);
+	memcpy(m_cameras.data(), data + sizeof(FileHeader), m_cameras.size() * sizeof(CameraInfo));
+	m_index.resize(m_cameras.size());
+
+	if (!readIndex())
+	{
+		m_recovered = true;
+		if (!scanChunks())
+		{
+			std::cout << "Error: No frames in session " << a_filename << std::endl;
+			close();
+			return false;
+		}
+	}
+
+	// frames are appended as they arrive, cameras interleaved, so this is mostly in order already
+	for (auto& entries : m_index)
+		std::stable_sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+			return a.timestamp < b.timestamp;
+		});
+
+	m_filename = a_filename;
+	return true;
+}
+
+void SessionPlayer::close()
+{
+	m_file.close();
+	m_filename.clear();
+	m_recovered = false;
+	m_header = {};
+	m_cameras.clear();
+	m_index.clear();
+}
+
+bool SessionPlayer::readIndex()
+{
+	const uint8_t* data = m_file.data();
+	size_t size = m_file.size();
+	if (size < m_header.headerSize + sizeof(Footer))
+		return false;
+
+	Footer footer;
+	memcpy(&footer, data + size - sizeof(Footer), sizeof(Footer));
+	if (footer.magic != FooterMagic ||
+		footer.version != Version ||
+		footer.indexOffset < m_header.headerSize ||
+		footer.indexOffset > size - sizeof(Footer) ||
+		footer.entryCount > (size - sizeof(Footer) - footer.indexOffset) / sizeof(IndexEntry))
+		return false;
+
+	const uint8_t* entries = data + footer.indexOffset;
+	size_t entriesSize = footer.entryCount * sizeof(IndexEntry);
+	if (Crc32::compute(entries, entriesSize) != footer.indexChecksum)
+	{
+		std::cout << "Error: Session index checksum mismatch, rebuilding it" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < footer.entryCount; ++i)
+	{
+		IndexEntry entry;
+		memcpy(&entry, entries + i * sizeof(IndexEntry), sizeof(IndexEntry));
+		if (entry.camera < m_index.size())
+			m_index[entry.camera].push_back(entry);
+	}
+	return true;
+}
+
+bool SessionPlayer::scanChunks()
+{
+	SessionRecovery::Result result;
+	if (!SessionRecovery::scan(m_file.data(), m_file.size(), m_header, result))
+		return false;
+
+	size_t frames = 0;
+	for (auto& entry : result.entries)
+	{
+		if (entry.camera < m_index.size())
+		{
+			m_index[entry.camera].push_back(entry);
+			++frames;
+		}
+	}
+	return frames > 0;
+}
+
+size_t SessionPlayer::getTotalFrameCount() const
+{
+	size_t count = 0;
+	for (auto& entries : m_index)
+		count += entries.size();
+	return count;
+}
+
+double SessionPlayer::getStartTimestamp(size_t a_camera) const
+{
+	auto& entries = m_index[a_camera];
+	return entries.empty() ? 0 : entries.front().timestamp;
+}
+
+double SessionPlayer::getEndTimestamp(size_t a_camera) const
+{
+	auto& entries = m_index[a_camera];
+	return entries.empty() ? 0 : entries.back().timestamp;
+}
+
+size_t SessionPlayer::findFrame(size_t a_camera, double a_timestamp) const
+{
+	auto& entries = m_index[a_camera];
+	auto next = std::upper_bound(entries.begin(), entries.end(), a_timestamp, [](double t, const IndexEntry& e) {
+		return t < e.timestamp;
+	});
+	return next == entries.begin() ? 0 : size_t(next - entries.begin()) - 1;
+}
+
+SessionPlayer::FrameView SessionPlayer::getFrame(size_t a_camera, size_t a_index) const
+{
+	FrameView view;
+	if (a_camera >= m_index.size() ||
+		a_index >= m_index[a_camera].size())
+		return view;
+
+	auto& entry = m_index[a_camera][a_index];
+	if (entry.offset + sizeof(FrameHeader) > m_file.size())
+		return view;
+
+	auto header = reinterpret_cast<const FrameHeader*>(m_file.data() + entry.offset);
+	size_t depthOffset = sizeof(FrameHeader);
+	size_t colourOffset = depthOffset + alignUp(header->depthSize, PayloadAlignment);
+	if (header->magic != FrameMagic ||
+		entry.offset + frameSize(header->depthSize, header->colourSize) > m_file.size())
+		return view;
+
+	view.header = header;
+	if (header->flags & HasDepth)
+		view.depth = m_file.data() + entry.offset + depthOffset;
+	if (header->flags & HasColour)
+		view.colour = m_file.data() + entry.offset + colourOffset;
+	return view;
+}
+
+bool SessionPlayer::decodeDepth(const FrameView& a_view, uint16_t* a_out)
+{
+	return decodeDepth(a_view, a_out, m_depthCodec);
+}
+
+bool SessionPlayer::decodeDepth(const FrameView& a_view, uint16_t* a_out, DepthCodec& a_codec) const
+{
+	if (!a_view.depth || a_view.header->camera >= m_cameras.size())
+		return false;
+
+	auto& header = *a_view.header;
+	auto& stream = m_cameras[header.camera].depth;
+	size_t size = (size_t)stream.width * stream.height * sizeof(uint16_t);
+	switch (header.depthCodec)
+	{
+	case Raw:
+		if (header.depthSize != size)
+			return false;
+		memcpy(a_out, a_view.depth, size);
+		return true;
+	case DepthRans:
+		return a_codec.decode(static_cast<const uint8_t*>(a_view.depth), header.depthSize, a_out, (int)stream.width, (int)stream.height);
+	default:
+		return false;
+	}
+}
+
+bool SessionPlayer::decodeColour(const FrameView& a_view, uint8_t* a_out)
+{
+	return decodeColour(a_view, a_out, m_colourCodec);
+}
+
+bool SessionPlayer::decodeColour(const FrameView& a_view, uint8_t* a_out, ColourCodec& a_codec) const
+{
+	if (!a_view.colour || a_view.header->camera >= m_cameras.size())
+		return false;
+
+	auto& header = *a_view.header;
+	auto& stream = m_cameras[header.camera].colour;
+	switch (header.colourCodec)
+	{
+	case Raw:
+		memcpy(a_out, a_view.colour, header.colourSize);
+		return true;
+	case Jpeg:
+		return a_codec.decode(ColourCodec::Type::Jpeg, a_view.colour, header.colourSize, a_out, (int)stream.width, (int)stream.height);
+	case Qoi:
+		return a_codec.decode(ColourCodec::Type::Qoi, a_view.colour, header.colourSize, a_out, (int)stream.width, (int)stream.height);
+	default:
+		return false;
+	}
+}
+
+void SessionPlayer::prefetch(size_t a_camera, size_t a_index, size_t a_count) const
+{
+	if (a_camera >= m_index.size())
+		return;
+
+	auto& entries = m_index[a_camera];
+	size_t end = std::min(a_index + a_count, entries.size());
+	for (size_t i = a_index; i < end; ++i)
+		m_file.prefetch(entries[i].offset, entries[i].size);
+}
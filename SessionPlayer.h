@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ColourCodec.h"
+#include "DepthCodec.h"
+#include "MappedFile.h"
+#include "SessionFormat.h"
+
+// Random access to a recorded session (see SessionFormat.h). The file is memory mapped and
+// frames are handed out as views straight into the mapping, so nothing is read or copied
+// until a payload is touched. Each camera gets its own index sorted by device timestamp,
+// making a seek a binary search. When the footer is missing (a recording that never
+// stopped cleanly) the index is rebuilt from the chunks and checkpoints, see
+// SessionRecovery. Compressed payloads stay compressed in the view, decodeDepth() and
+// decodeColour() expand them.
+// Views stay valid until the player is closed or opens another file.
+class SessionPlayer
+{
+public:
+
+	struct FrameView
+	{
+		const SessionFormat::FrameHeader*	header = nullptr;
+		const void*			depth = nullptr;	// header->depthSize bytes of header->depthCodec
+		const uint8_t*		colour = nullptr;	// header->colourSize bytes of header->colourCodec
+
+		explicit operator bool() const		{	return header != nullptr;	}
+	};
+
+	SessionPlayer() = default;
+
+	bool			open(const std::string& a_filename);
+	void			close();
+
+	bool			isOpen() const			{	return m_file.isOpen();	}
+	const std::string&	getFilename() const	{	return m_filename;		}
+	bool			wasRecovered() const	{	return m_recovered;		}	// index rebuilt from the chunks
+
+	const SessionFormat::FileHeader&	getHeader() const	{	return m_header;	}
+	const std::vector<SessionFormat::CameraInfo>&	getCameras() const	{	return m_cameras;	}
+
+	size_t			getFrameCount(size_t a_camera) const	{	return m_index[a_camera].size();	}
+	size_t			getTotalFrameCount() const;
+	uint64_t		getFileSize() const		{	return m_file.size();	}
+
+	// ms, device clock of that camera
+	double			getTimestamp(size_t a_camera, size_t a_index) const	{	return m_index[a_camera][a_index].timestamp;	}
+	double			getStartTimestamp(size_t a_camera) const;
+	double			getEndTimestamp(size_t a_camera) const;
+
+	// the last frame at or before a_timestamp, or the first frame if there is none before it
+	size_t			findFrame(size_t a_camera, double a_timestamp) const;
+
+	// empty if the entry doesn't point at a frame inside the file
+	FrameView		getFrame(size_t a_camera, size_t a_index) const;
+
+	// a_view's depth as Z16 into a_out, which holds the camera's depth width x height.
+	// False if the payload is corrupt or in a codec this build doesn't know. The decoders are
+	// the player's own, so one thread decodes at a time.
+	bool			decodeDepth(const FrameView& a_view, uint16_t* a_out);
+
+	// a_view's colour in the camera's recorded format, a_out holds its width x height
+	bool			decodeColour(const FrameView& a_view, uint8_t* a_out);
+
+	// as above with the caller's decoders, so threads holding their own decode at once
+	bool			decodeDepth(const FrameView& a_view, uint16_t* a_out, DepthCodec& a_codec) const;
+	bool			decodeColour(const FrameView& a_view, uint8_t* a_out, ColourCodec& a_codec) const;
+
+	// starts reading a_count frames from a_index in, ahead of playback reaching them
+	void			prefetch(size_t a_camera, size_t a_index, size_t a_count) const;
+
+private:
+
+	bool			readIndex();
+	bool			scanChunks();
+
+	MappedFile		m_file;
+	std::string		m_filename;
+	bool			m_recovered = false;
+	DepthCodec		m_depthCodec;
+	ColourCodec		m_colourCodec;
+
+	SessionFormat::FileHeader	m_header;
+	std::vector<SessionFormat::CameraInfo>	m_cameras;
+	std::vector<std::vector<SessionFormat::IndexEntry>>	m_index;	// per camera, by timestamp
+};
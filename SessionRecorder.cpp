@@ -0,0 +1,610 @@
+#include "SessionRecorder.h"
+#include "Crc32.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+using namespace SessionFormat;
+
+namespace
+{
+	// zeroed, Alignment aligned block of a_size bytes owned by a_storage
+	uint8_t* allocateAligned(size_t a_size, std::unique_ptr<uint8_t[]>& a_storage)
+	{
+		a_storage = std::make_unique<uint8_t[]>(a_size + Alignment);
+		auto address = reinterpret_cast<uintptr_t>(a_storage.get());
+		return a_storage.get() + (alignUp(address, Alignment) - address);
+	}
+}
+
+SessionRecorder::~SessionRecorder()
+{
+	stop();
+}
+
+void SessionRecorder::setSettings(const Settings& a_settings)
+{
+	m_settings = a_settings;
+	m_settings.chunkSize = alignUp(std::max<size_t>(m_settings.chunkSize, 1 << 20), Alignment);
+	m_settings.bufferCount = std::max(m_settings.bufferCount, 2u);
+}
+
+bool SessionRecorder::start(const std::string& a_filename, const std::vector<CameraInfo>& a_cameras)
+{
+	stop();
+
+	m_active = m_settings;
+
+	if (!m_file.open(a_filename, m_active.unbuffered))
+		return false;
+
+	// header and camera descriptions, padded so the first chunk is aligned
+	size_t headerSize = alignUp(sizeof(FileHeader) + a_cameras.size() * sizeof(CameraInfo), Alignment);
+	std::unique_ptr<uint8_t[]> storage;
+	uint8_t* block = allocateAligned(headerSize, storage);
+
+	FileHeader header;
+	header.headerSize = (uint32_t)headerSize;
+	header.cameraCount = (uint32_t)a_cameras.size();
+	header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	header.chunkSize = (uint32_t)m_active.chunkSize;
+	memcpy(block, &header, sizeof(FileHeader));
+	if (!a_cameras.empty())
+		memcpy(block + sizeof(FileHeader), a_cameras.data(), a_cameras.size() * sizeof(CameraInfo));
+
+	if (!m_file.write(block, headerSize))
+	{
+		std::cout << "Error: Unable to write session header to " << a_filename << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	// without its sidecar the session still records, it's only slower to browse
+	if (m_active.keyframes)
+	{
+		m_keyframes.setSettings(m_active.keyframe);
+		if (!m_keyframes.start(KeyframeFormat::sidecarName(a_filename), a_cameras, header.startTime))
+			std::cout << "Error: Unable to write keyframes for " << a_filename << std::endl;
+	}
+
+	m_filename = a_filename;
+	m_cameras = a_cameras;
+	m_nextOffset = headerSize;
+	m_chunkIndex = 0;
+	m_index.clear();
+	m_current.reset();
+	m_queue.clear();
+
+	// the whole pool up front, allocating and faulting in 32 MiB mid-capture costs a frame or two
+	m_free.clear();
+	for (unsigned int i = 0; i < m_active.bufferCount; ++i)
+		m_free.push_back(makeChunk());
+
+	// likewise the encoders' backlog, sized for the largest camera
+	size_t depthSize = 0, colourSize = 0;
+	for (auto& camera : a_cameras)
+	{
+		depthSize = std::max<size_t>(depthSize, (size_t)camera.depth.width * camera.depth.height * sizeof(uint16_t));
+		colourSize = std::max<size_t>(colourSize, (size_t)camera.colour.width * camera.colour.height * 3);
+	}
+	m_jobs.clear();
+	m_freeJobs.clear();
+	m_busyJobs = 0;
+	bool encoding = m_active.compressDepth || m_active.compressColour;
+	for (unsigned int i = 0; encoding && i < m_active.encodeBacklog; ++i)
+	{
+		auto job = std::make_unique<EncodeJob>();
+		job->depth.reserve(depthSize);
+		job->colour.reserve(colourSize);
+		m_freeJobs.push_back(std::move(job));
+	}
+	m_failed = false;
+	m_quit = false;
+	m_framesWritten = 0;
+	m_framesDropped = 0;
+	m_bytesWritten = headerSize;
+	m_writeNs = 0;
+	m_depthRawBytes = 0;
+	m_depthStoredBytes = 0;
+	m_colourRawBytes = 0;
+	m_colourStoredBytes = 0;
+	m_depthEncodeNs = 0;
+	m_depthEncodes = 0;
+	m_colourEncodeNs = 0;
+	m_colourEncodes = 0;
+	m_start = std::chrono::steady_clock::now();
+	m_checkpointed = 0;
+	m_checkpointIndex = 0;
+	m_lastCheckpoint = m_start;
+	m_checkpointsWritten = 0;
+	m_syncs = 0;
+	m_syncNs = 0;
+
+	// the header goes to the disk with the first sync, without it nothing is recoverable
+	m_unsyncedBytes = headerSize;
+	m_unsyncedSince = m_start;
+
+	m_thread = std::thread(&SessionRecorder::run, this);
+
+	m_quitEncoders = false;
+	unsigned int encoders = m_active.encoderThreads;
+	if (unsigned int cores = std::thread::hardware_concurrency(); encoders == 0)
+		encoders = cores > 4 ? cores - 2 : 2;
+	for (unsigned int i = 0; encoding && i < encoders; ++i)
+		m_encoders.emplace_back(&SessionRecorder::encode, this);
+
+	m_recording = true;
+	return true;
+}
+
+void SessionRecorder::stop()
+{
+	if (!m_recording)
+		return;
+
+	// frames still with the encoders go in before the last chunk is queued
+	stopEncoders();
+
+	if (m_current && m_current->frames > 0)
+		queueChunk();
+	m_current.reset();
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	// without every chunk on disk the offsets would be wrong, leave the index off
+	if (!m_failed && !writeIndex())
+		std::cout << "Error: Unable to write the session index to " << m_filename << std::endl;
+	if (!m_failed && m_active.sync)
+		syncFile();
+
+	m_file.close();
+	m_keyframes.stop();
+	m_free.clear();
+	m_freeJobs.clear();
+	m_recording = false;
+}
+
+void SessionRecorder::stopEncoders()
+{
+	{
+		std::lock_guard lock(m_encodeMutex);
+		m_quitEncoders = true;
+	}
+	m_encodeWake.notify_all();
+	for (auto& encoder : m_encoders)
+		encoder.join();
+	m_encoders.clear();
+}
+
+std::unique_ptr<SessionRecorder::Chunk> SessionRecorder::makeChunk() const
+{
+	auto chunk = std::make_unique<Chunk>();
+	chunk->data = allocateAligned(m_active.chunkSize, chunk->storage);
+	return chunk;
+}
+
+bool SessionRecorder::takeChunk()
+{
+	{
+		std::unique_lock lock(m_mutex);
+		if (!m_active.dropFrames)
+			m_freed.wait(lock, [this] { return !m_free.empty(); });
+		if (m_free.empty())
+			return false;
+		m_current = std::move(m_free.back());
+		m_free.pop_back();
+	}
+
+	m_current->used = sizeof(ChunkHeader);
+	m_current->frames = 0;
+	m_current->entries.clear();
+	m_current->taken = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool SessionRecorder::addFrame(const FrameHeader& a_header, const void* a_depth, const void* a_colour)
+{
+	if (!m_recording)
+		return false;
+
+	FrameHeader header = a_header;
+	header.depthSize = a_depth ? a_header.depthSize : 0;
+	header.colourSize = a_colour ? a_header.colourSize : 0;
+	m_keyframes.addFrame(header, a_depth, a_colour);
+	if (!compressesDepth(header) && !compressesColour(header))
+		return commitFrame(header, a_depth, a_colour);
+
+	// copied for the encoders, the caller's frame can go as soon as this returns
+	std::unique_ptr<EncodeJob> job;
+	{
+		std::unique_lock lock(m_encodeMutex);
+		if (!m_active.dropFrames)
+			m_jobFreed.wait(lock, [this] { return !m_freeJobs.empty(); });
+		if (m_freeJobs.empty())
+		{
+			++m_framesDropped;
+			return false;
+		}
+		job = std::move(m_freeJobs.back());
+		m_freeJobs.pop_back();
+	}
+
+	job->header = header;
+	job->hasDepth = header.depthSize > 0;
+	job->hasColour = header.colourSize > 0;
+	if (job->hasDepth)
+		job->depth.assign(static_cast<const uint8_t*>(a_depth), static_cast<const uint8_t*>(a_depth) + header.depthSize);
+	if (job->hasColour)
+		job->colour.assign(static_cast<const uint8_t*>(a_colour), static_cast<const uint8_t*>(a_colour) + header.colourSize);
+
+	{
+		std::lock_guard lock(m_encodeMutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_encodeWake.notify_one();
+	return true;
+}
+
+bool SessionRecorder::commitFrame(const FrameHeader& a_header, const void* a_depth, const void* a_colour)
+{
+	size_t depthSize = a_depth ? a_header.depthSize : 0;
+	size_t colourSize = a_colour ? a_header.colourSize : 0;
+	size_t size = frameSize(depthSize, colourSize);
+
+	std::lock_guard commit(m_commitMutex);
+
+	if (m_failed ||
+		sizeof(ChunkHeader) + size > m_active.chunkSize)
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	if (m_current && m_current->used + size > m_active.chunkSize)
+		queueChunk();
+	if (!m_current && !takeChunk())
+	{
+		++m_framesDropped;
+		return false;
+	}
+
+	uint8_t* out = m_current->data + m_current->used;
+	memset(out, 0, size);
+
+	FrameHeader header = a_header;
+	header.magic = FrameMagic;
+	header.depthSize = (uint32_t)depthSize;
+	header.colourSize = (uint32_t)colourSize;
+	header.flags = (depthSize ? HasDepth : 0) | (colourSize ? HasColour : 0);
+	memcpy(out, &header, sizeof(FrameHeader));
+	if (depthSize)
+		memcpy(out + sizeof(FrameHeader), a_depth, depthSize);
+	if (colourSize)
+		memcpy(out + sizeof(FrameHeader) + alignUp(depthSize, PayloadAlignment), a_colour, colourSize);
+
+	// what the payloads would have taken raw, for the ratios
+	if (header.camera < m_cameras.size())
+	{
+		auto& camera = m_cameras[header.camera];
+		m_depthRawBytes += header.depthCodec == Raw ? depthSize : (size_t)camera.depth.width * camera.depth.height * sizeof(uint16_t);
+		m_colourRawBytes += header.colourCodec == Raw ? colourSize : (size_t)camera.colour.width * camera.colour.height * 3;
+		m_depthStoredBytes += depthSize;
+		m_colourStoredBytes += colourSize;
+	}
+
+	IndexEntry entry;
+	entry.offset = m_current->used;
+	entry.frameNumber = header.frameNumber;
+	entry.timestamp = header.timestamp;
+	entry.size = (uint32_t)size;
+	entry.camera = header.camera;
+	entry.flags = header.flags;
+	m_current->entries.push_back(entry);
+
+	m_current->used += size;
+	++m_current->frames;
+
+	// when frames come slower than a chunk fills, this bounds what a crash can lose
+	if (m_active.chunkIntervalMs > 0 &&
+		std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_current->taken).count() >= m_active.chunkIntervalMs)
+		queueChunk();
+	return true;
+}
+
+bool SessionRecorder::compressesDepth(const FrameHeader& a_header) const
+{
+	if (!m_active.compressDepth || a_header.depthSize == 0 || a_header.depthCodec != Raw || a_header.camera >= m_cameras.size())
+		return false;
+	auto& stream = m_cameras[a_header.camera].depth;
+	return a_header.depthSize == (size_t)stream.width * stream.height * sizeof(uint16_t);
+}
+
+bool SessionRecorder::compressesColour(const FrameHeader& a_header) const
+{
+	if (!m_active.compressColour || a_header.colourSize == 0 || a_header.colourCodec != Raw || a_header.camera >= m_cameras.size())
+		return false;
+	auto& stream = m_cameras[a_header.camera].colour;
+	return a_header.colourSize == (size_t)stream.width * stream.height * 3;
+}
+
+void SessionRecorder::queueChunk()
+{
+	auto& chunk = *m_current;
+
+	ChunkHeader header;
+	header.index = m_chunkIndex++;
+	header.size = alignUp(chunk.used, Alignment);
+	header.frameCount = chunk.frames;
+	memcpy(chunk.data, &header, sizeof(ChunkHeader));
+	memset(chunk.data + chunk.used, 0, header.size - chunk.used);
+
+	// the chunk's place in the file is fixed now, so its frames can go in the index
+	for (auto& entry : chunk.entries)
+	{
+		entry.offset += m_nextOffset;
+		m_index.push_back(entry);
+	}
+	m_nextOffset += header.size;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(m_current));
+	}
+	m_wake.notify_one();
+
+	if (m_active.checkpointIntervalMs > 0 && m_index.size() > m_checkpointed &&
+		std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_lastCheckpoint).count() >= m_active.checkpointIntervalMs)
+		queueCheckpoint();
+}
+
+void SessionRecorder::queueCheckpoint()
+{
+	// a few KiB, so allocated here rather than taking a chunk buffer capture could use
+	size_t count = m_index.size() - m_checkpointed;
+	size_t entriesSize = count * sizeof(IndexEntry);
+	auto checkpoint = std::make_unique<Chunk>();
+	checkpoint->checkpoint = true;
+	checkpoint->used = alignUp(sizeof(CheckpointHeader) + entriesSize, Alignment);
+	checkpoint->data = allocateAligned(checkpoint->used, checkpoint->storage);
+
+	CheckpointHeader header;
+	header.index = m_checkpointIndex++;
+	header.size = checkpoint->used;
+	header.entryCount = (uint32_t)count;
+	header.entryChecksum = Crc32::compute(m_index.data() + m_checkpointed, entriesSize);
+	header.chunkCount = m_chunkIndex;
+	memcpy(checkpoint->data, &header, sizeof(CheckpointHeader));
+	memcpy(checkpoint->data + sizeof(CheckpointHeader), m_index.data() + m_checkpointed, entriesSize);
+
+	m_checkpointed = m_index.size();
+	m_nextOffset += header.size;
+	m_lastCheckpoint = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push_back(std::move(checkpoint));
+	}
+	m_wake.notify_one();
+}
+
+void SessionRecorder::run()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+#endif
+
+	auto syncInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(m_active.syncIntervalMs));
+	auto waiting = [this] { return m_quit || !m_queue.empty(); };
+
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		// what's written is synced on time even when nothing more comes to write
+		if (m_active.sync && m_unsyncedBytes > 0 && !m_failed)
+			m_wake.wait_until(lock, m_unsyncedSince + syncInterval, waiting);
+		else
+			m_wake.wait(lock, waiting);
+		if (m_queue.empty())
+		{
+			if (m_quit)
+				break;
+			lock.unlock();
+			if (!m_failed)
+				syncFile();
+			lock.lock();
+			continue;
+		}
+
+		auto chunk = std::move(m_queue.front());
+		m_queue.pop_front();
+		lock.unlock();
+
+		// a checkpoint's size is where a chunk's is, see SessionFormat.h
+		auto header = reinterpret_cast<const ChunkHeader*>(chunk->data);
+		auto start = std::chrono::steady_clock::now();
+		if (!m_failed && m_file.write(chunk->data, header->size))
+		{
+			m_writeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			m_bytesWritten += header->size;
+			m_framesWritten += chunk->frames;
+			if (chunk->checkpoint)
+				++m_checkpointsWritten;
+
+			if (m_unsyncedBytes == 0)
+				m_unsyncedSince = start;
+			m_unsyncedBytes += header->size;
+
+			// a checkpoint is only any use once it and the chunks it lists are on the disk
+			if (m_active.sync && (chunk->checkpoint || m_unsyncedBytes >= m_active.syncBytes ||
+				std::chrono::steady_clock::now() - m_unsyncedSince >= syncInterval))
+				syncFile();
+		}
+		else
+		{
+			if (!m_failed)
+				std::cout << "Error: Writing " << m_filename << " failed, the rest of the session is dropped" << std::endl;
+			m_failed = true;
+			m_framesDropped += chunk->frames;
+		}
+
+		lock.lock();
+		if (!chunk->checkpoint)
+		{
+			m_free.push_back(std::move(chunk));
+			m_freed.notify_one();
+		}
+	}
+}
+
+bool SessionRecorder::syncFile()
+{
+	auto start = std::chrono::steady_clock::now();
+	if (!m_file.sync())
+	{
+		if (!m_failed)
+			std::cout << "Error: Syncing " << m_filename << " failed, the rest of the session is dropped" << std::endl;
+		m_failed = true;
+		return false;
+	}
+	m_syncNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	++m_syncs;
+	m_unsyncedBytes = 0;
+	return true;
+}
+
+void SessionRecorder::encode()
+{
+	// the pool is the parallelism, each frame is encoded on one thread
+	DepthCodec depthCodec;
+	auto depthSettings = depthCodec.getSettings();
+	depthSettings.parallel = false;
+	depthCodec.setSettings(depthSettings);
+	ColourCodec colourCodec;
+	colourCodec.setSettings(m_active.colour);
+	std::vector<uint8_t> depth, colour;
+
+	std::unique_lock lock(m_encodeMutex);
+	while (true)
+	{
+		m_encodeWake.wait(lock, [this] { return m_quitEncoders || !m_jobs.empty(); });
+		if (m_jobs.empty())
+			break;
+
+		auto job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+		++m_busyJobs;
+		lock.unlock();
+
+		// anything that doesn't come out smaller is kept raw
+		FrameHeader header = job->header;
+		const void* depthPayload = job->hasDepth ? job->depth.data() : nullptr;
+		const void* colourPayload = job->hasColour ? job->colour.data() : nullptr;
+		auto& camera = m_cameras[header.camera];
+
+		if (compressesDepth(header))
+		{
+			int width = (int)camera.depth.width, height = (int)camera.depth.height;
+			depth.resize(DepthCodec::getMaxEncodedSize(width, height));
+			size_t size = depthCodec.encode(reinterpret_cast<const uint16_t*>(job->depth.data()), width, height, depth.data());
+			m_depthEncodeNs += uint64_t(depthCodec.getLastEncodeMs() * 1e6f);
+			++m_depthEncodes;
+			if (size < header.depthSize)
+			{
+				header.depthCodec = DepthRans;
+				header.depthSize = (uint32_t)size;
+				depthPayload = depth.data();
+			}
+		}
+
+		if (compressesColour(header) &&
+			colourCodec.encode(job->colour.data(), (int)camera.colour.width, (int)camera.colour.height, colour))
+		{
+			m_colourEncodeNs += uint64_t(colourCodec.getLastEncodeMs() * 1e6f);
+			++m_colourEncodes;
+			if (colour.size() < header.colourSize)
+			{
+				header.colourCodec = m_active.colour.type == ColourCodec::Type::Jpeg ? Jpeg : Qoi;
+				header.colourSize = (uint32_t)colour.size();
+				colourPayload = colour.data();
+			}
+		}
+
+		commitFrame(header, depthPayload, colourPayload);
+
+		lock.lock();
+		--m_busyJobs;
+		m_freeJobs.push_back(std::move(job));
+		m_jobFreed.notify_one();
+	}
+}
+
+bool SessionRecorder::writeIndex()
+{
+	// the footer ends the file, right after the entries and any padding
+	size_t indexSize = m_index.size() * sizeof(IndexEntry);
+	size_t blockSize = alignUp(indexSize + sizeof(Footer), Alignment);
+	std::unique_ptr<uint8_t[]> storage;
+	uint8_t* block = allocateAligned(blockSize, storage);
+
+	if (indexSize)
+		memcpy(block, m_index.data(), indexSize);
+
+	Footer footer;
+	footer.indexOffset = m_nextOffset;
+	footer.entryCount = m_index.size();
+	footer.indexChecksum = Crc32::compute(m_index.data(), indexSize);
+	footer.chunkCount = m_chunkIndex;
+	memcpy(block + blockSize - sizeof(Footer), &footer, sizeof(Footer));
+
+	if (!m_file.write(block, blockSize))
+		return false;
+	m_bytesWritten += blockSize;
+	return true;
+}
+
+SessionRecorder::Stats SessionRecorder::getStats() const
+{
+	Stats stats;
+	stats.framesWritten = m_framesWritten;
+	stats.framesDropped = m_framesDropped;
+	stats.bytesWritten = m_bytesWritten;
+	{
+		std::lock_guard lock(m_mutex);
+		stats.queuedChunks = (unsigned int)m_queue.size();
+	}
+	if (m_recording)
+		stats.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count();
+	if (uint64_t ns = m_writeNs)
+		stats.writeMBps = float(double(m_bytesWritten) / 1e6 / (double(ns) / 1e9));
+	{
+		std::lock_guard lock(m_encodeMutex);
+		stats.encoderThreads = (unsigned int)m_encoders.size();
+		stats.encodingFrames = (unsigned int)m_jobs.size() + m_busyJobs;
+	}
+	if (uint64_t stored = m_depthStoredBytes)
+		stats.depthRatio = float(double(m_depthRawBytes) / double(stored));
+	if (uint64_t stored = m_colourStoredBytes)
+		stats.colourRatio = float(double(m_colourRawBytes) / double(stored));
+	if (uint64_t count = m_depthEncodes)
+		stats.depthEncodeMs = float(double(m_depthEncodeNs) / 1e6 / double(count));
+	if (uint64_t count = m_colourEncodes)
+		stats.colourEncodeMs = float(double(m_colourEncodeNs) / 1e6 / double(count));
+	stats.keyframesWritten = m_keyframes.getStats().keyframesWritten;
+	stats.checkpoints = m_checkpointsWritten;
+	stats.syncs = m_syncs;
+	if (uint64_t count = m_syncs)
+		stats.syncMs = float(double(m_syncNs) / 1e6 / double(count));
+	stats.unsyncedBytes = m_unsyncedBytes;
+	return stats;
+}
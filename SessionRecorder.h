@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ColourCodec.h"
+#include "DepthCodec.h"
+#include "KeyframeWriter.h"
+#include "SessionFormat.h"
+#include "UnbufferedFile.h"
+
+// Records every camera's frames into one append-only session file (see SessionFormat.h).
+// Capture copies each frame into the current chunk buffer and moves on; full chunks are
+// queued to a dedicated I/O thread that writes them with single large aligned writes,
+// unbuffered. The buffer pool is fixed, so when the disk falls behind for longer than the
+// pool can absorb, frames are dropped and counted instead of ever blocking capture (unless
+// Settings::dropFrames is off).
+// Depth (see DepthCodec) and colour (see ColourCodec) can be compressed on the way in. Those
+// frames are copied to a pool of encoder threads instead, which add them to the chunk once
+// encoded, so frames land in the file in the order they finish; the player sorts by time.
+// The encoders take a bounded backlog and capture drops frames past it, the same as the disk.
+// Stopping drains the queue and appends the frame index and footer.
+// A take that never stops is still recoverable (see SessionRecovery). A chunk is queued
+// once it's full or old enough, so a crash costs at most that long, and every so often a
+// checkpoint indexing the chunks since the last one goes in after them. The I/O thread
+// syncs what it has written once it's old or big enough, and after each checkpoint, so the
+// cost of durability lands on it in batches rather than on capture.
+// Alongside the session a keyframe sidecar is written from the raw frames (see
+// KeyframeWriter), so the recording can be browsed as soon as it stops.
+class SessionRecorder
+{
+public:
+
+	struct Settings
+	{
+		size_t			chunkSize = 32 << 20;	// bytes per chunk buffer
+		unsigned int	bufferCount = 8;		// chunk buffers, the backlog capture can run ahead by
+		bool			unbuffered = true;
+		bool			dropFrames = true;		// false waits for a free buffer instead, for offline conversion
+		bool			compressDepth = true;	// Z16 through DepthCodec
+		bool			compressColour = true;	// 3 byte colour through ColourCodec
+		ColourCodec::Settings	colour;
+		unsigned int	encoderThreads = 0;		// 0 leaves two cores for capture and rendering
+		unsigned int	encodeBacklog = 16;		// frames waiting on the encoders before capture drops any
+		bool			keyframes = true;		// write the sidecar
+		float			chunkIntervalMs = 1000;	// a chunk is queued once full or this old, 0 waits until it's full
+		float			checkpointIntervalMs = 10000;	// between checkpoints, 0 leaves them out
+		bool			sync = true;			// sync to the disk when either of these is reached
+		float			syncIntervalMs = 1000;	// since the oldest unsynced write
+		size_t			syncBytes = 256 << 20;	// unsynced
+		KeyframeWriter::Settings	keyframe;
+	};
+
+	struct Stats
+	{
+		uint64_t		framesWritten = 0;
+		uint64_t		framesDropped = 0;
+		uint64_t		bytesWritten = 0;
+		unsigned int	queuedChunks = 0;
+		float			seconds = 0;			// since start
+		float			writeMBps = 0;			// average while the I/O thread was writing
+		unsigned int	encoderThreads = 0;
+		unsigned int	encodingFrames = 0;		// queued for or being encoded
+		float			depthRatio = 1;			// raw over stored bytes
+		float			colourRatio = 1;
+		float			depthEncodeMs = 0;		// per frame on one encoder thread
+		float			colourEncodeMs = 0;
+		uint64_t		keyframesWritten = 0;
+		uint64_t		checkpoints = 0;		// written
+		uint64_t		syncs = 0;
+		float			syncMs = 0;				// average
+		uint64_t		unsyncedBytes = 0;		// written but not yet known to be on the disk
+	};
+
+	SessionRecorder() = default;
+	~SessionRecorder();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings);	// takes effect on the next start()
+
+	bool			start(const std::string& a_filename, const std::vector<SessionFormat::CameraInfo>& a_cameras);
+	void			stop();
+
+	bool			isRecording() const		{	return m_recording;	}
+	const std::string&	getFilename() const	{	return m_filename;	}
+
+	// copies one camera's frame into the session, a_header says which camera and how big the
+	// payloads are. Never waits on the disk or the encoders; returns false if the frame had to
+	// be dropped.
+	bool			addFrame(const SessionFormat::FrameHeader& a_header, const void* a_depth, const void* a_colour);
+
+	Stats			getStats() const;
+
+private:
+
+	struct Chunk
+	{
+		std::unique_ptr<uint8_t[]>	storage;
+		uint8_t*					data = nullptr;		// Alignment aligned
+		size_t						used = 0;
+		uint32_t					frames = 0;
+		std::vector<SessionFormat::IndexEntry>	entries;	// offsets from the start of the chunk
+		std::chrono::steady_clock::time_point	taken;		// when its first frame went in
+		bool						checkpoint = false;	// a CheckpointHeader and entries, not from the pool
+	};
+
+	// a frame copied out for the encoders, its buffers are kept from frame to frame
+	struct EncodeJob
+	{
+		SessionFormat::FrameHeader	header;
+		std::vector<uint8_t>		depth;
+		std::vector<uint8_t>		colour;
+		bool						hasDepth = false;
+		bool						hasColour = false;
+	};
+
+	bool			commitFrame(const SessionFormat::FrameHeader& a_header, const void* a_depth, const void* a_colour);
+	std::unique_ptr<Chunk>	makeChunk() const;
+	bool			takeChunk();
+	void			queueChunk();
+	void			queueCheckpoint();
+	bool			syncFile();
+	void			run();
+	void			encode();
+	void			stopEncoders();
+	bool			writeIndex();
+	bool			compressesDepth(const SessionFormat::FrameHeader& a_header) const;
+	bool			compressesColour(const SessionFormat::FrameHeader& a_header) const;
+
+	Settings				m_settings;
+	Settings				m_active;			// as of start()
+	std::string				m_filename;
+	UnbufferedFile			m_file;
+	KeyframeWriter			m_keyframes;
+	bool					m_recording = false;
+	std::atomic<bool>		m_failed = false;	// a write failed, the rest of the session is dropped
+
+	// filled by capture and the encoders, under m_commitMutex
+	std::mutex				m_commitMutex;
+	std::unique_ptr<Chunk>	m_current;
+	uint64_t				m_nextOffset = 0;	// file offset of the next chunk queued
+	uint32_t				m_chunkIndex = 0;
+	std::vector<SessionFormat::IndexEntry>	m_index;
+	size_t					m_checkpointed = 0;	// entries of m_index in a checkpoint
+	uint32_t				m_checkpointIndex = 0;
+	std::chrono::steady_clock::time_point	m_lastCheckpoint;
+	std::chrono::steady_clock::time_point	m_start;
+	std::vector<SessionFormat::CameraInfo>	m_cameras;
+
+	// encoder pool
+	mutable std::mutex		m_encodeMutex;
+	std::condition_variable	m_encodeWake;
+	std::condition_variable	m_jobFreed;
+	std::vector<std::thread>	m_encoders;
+	bool					m_quitEncoders = false;
+	std::deque<std::unique_ptr<EncodeJob>>	m_jobs;
+	std::vector<std::unique_ptr<EncodeJob>>	m_freeJobs;
+	unsigned int			m_busyJobs = 0;		// taken by an encoder
+
+	// shared with the I/O thread
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::condition_variable	m_freed;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	std::deque<std::unique_ptr<Chunk>>	m_queue;
+	std::vector<std::unique_ptr<Chunk>>	m_free;
+	std::chrono::steady_clock::time_point	m_unsyncedSince;	// I/O thread only
+
+	std::atomic<uint64_t>	m_framesWritten = 0;
+	std::atomic<uint64_t>	m_framesDropped = 0;
+	std::atomic<uint64_t>	m_bytesWritten = 0;
+	std::atomic<uint64_t>	m_writeNs = 0;
+	std::atomic<uint64_t>	m_depthRawBytes = 0;
+	std::atomic<uint64_t>	m_depthStoredBytes = 0;
+	std::atomic<uint64_t>	m_colourRawBytes = 0;
+	std::atomic<uint64_t>	m_colourStoredBytes = 0;
+	std::atomic<uint64_t>	m_depthEncodeNs = 0;
+	std::atomic<uint64_t>	m_depthEncodes = 0;
+	std::atomic<uint64_t>	m_colourEncodeNs = 0;
+	std::atomic<uint64_t>	m_colourEncodes = 0;
+	std::atomic<uint64_t>	m_checkpointsWritten = 0;
+	std::atomic<uint64_t>	m_unsyncedBytes = 0;
+	std::atomic<uint64_t>	m_syncs = 0;
+	std::atomic<uint64_t>	m_syncNs = 0;
+};
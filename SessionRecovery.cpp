@@ -0,0 +1,200 @@
+#include "SessionRecovery.h"
+#include "Crc32.h"
+#include "MappedFile.h"
+#include "UnbufferedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace SessionFormat;
+
+namespace
+{
+	// the same checks SessionPlayer makes before trusting a footer
+	bool hasIndex(const uint8_t* a_data, size_t a_size, const FileHeader& a_header)
+	{
+		if (a_size < a_header.headerSize + sizeof(Footer))
+			return false;
+
+		Footer footer;
+		memcpy(&footer, a_data + a_size - sizeof(Footer), sizeof(Footer));
+		if (footer.magic != FooterMagic ||
+			footer.version != Version ||
+			footer.indexOffset < a_header.headerSize ||
+			footer.indexOffset > a_size - sizeof(Footer) ||
+			footer.entryCount > (a_size - sizeof(Footer) - footer.indexOffset) / sizeof(IndexEntry))
+			return false;
+		return Crc32::compute(a_data + footer.indexOffset, footer.entryCount * sizeof(IndexEntry)) == footer.indexChecksum;
+	}
+}
+
+bool SessionRecovery::scan(const uint8_t* a_data, size_t a_size, const FileHeader& a_header, Result& a_result)
+{
+	a_result = Result();
+
+	// chunks no checkpoint has listed the frames of, the last ones after the latest checkpoint
+	std::vector<uint64_t> unindexed;
+	size_t sinceCheckpoint = 0;
+
+	// stops at the first chunk that was never written
+	uint64_t offset = a_header.headerSize;
+	while (offset + sizeof(ChunkHeader) <= a_size)
+	{
+		ChunkHeader chunk;
+		memcpy(&chunk, a_data + offset, sizeof(ChunkHeader));
+		if ((chunk.magic != ChunkMagic && chunk.magic != CheckpointMagic) ||
+			chunk.size < sizeof(ChunkHeader))
+			break;
+
+		bool whole = chunk.size <= a_size - offset;
+		if (chunk.magic == ChunkMagic)
+		{
+			unindexed.push_back(offset);
+			++a_result.chunks;
+		}
+		else if (whole)
+		{
+			// a checkpoint lists the chunks since the one before, a bad one leaves them to be scanned
+			CheckpointHeader checkpoint;
+			memcpy(&checkpoint, a_data + offset, sizeof(CheckpointHeader));
+			const uint8_t* entries = a_data + offset + sizeof(CheckpointHeader);
+			size_t entriesSize = (size_t)checkpoint.entryCount * sizeof(IndexEntry);
+			if (sizeof(CheckpointHeader) + entriesSize <= checkpoint.size &&
+				Crc32::compute(entries, entriesSize) == checkpoint.entryChecksum)
+			{
+				size_t first = a_result.entries.size();
+				a_result.entries.resize(first + checkpoint.entryCount);
+				memcpy(a_result.entries.data() + first, entries, entriesSize);
+				a_result.checkpointedFrames += checkpoint.entryCount;
+				++a_result.checkpoints;
+				unindexed.resize(sinceCheckpoint);
+			}
+			sinceCheckpoint = unindexed.size();
+		}
+
+		if (!whole)
+		{
+			a_result.torn = true;
+			break;
+		}
+		offset += chunk.size;
+	}
+	a_result.end = offset;
+
+	// keeping what made it to disk of a chunk cut short
+	for (uint64_t chunkOffset : unindexed)
+	{
+		ChunkHeader chunk;
+		memcpy(&chunk, a_data + chunkOffset, sizeof(ChunkHeader));
+
+		size_t chunkEnd = chunkOffset + std::min<uint64_t>(chunk.size, a_size - chunkOffset);
+		size_t position = chunkOffset + sizeof(ChunkHeader);
+		for (uint32_t i = 0; i < chunk.frameCount; ++i)
+		{
+			FrameHeader frame;
+			if (position + sizeof(FrameHeader) > chunkEnd)
+				break;
+			memcpy(&frame, a_data + position, sizeof(FrameHeader));
+
+			size_t frameBytes = frameSize(frame.depthSize, frame.colourSize);
+			if (frame.magic != FrameMagic ||
+				position + frameBytes > chunkEnd)
+				break;
+
+			IndexEntry entry;
+			entry.offset = position;
+			entry.frameNumber = frame.frameNumber;
+			entry.timestamp = frame.timestamp;
+			entry.size = (uint32_t)frameBytes;
+			entry.camera = frame.camera;
+			entry.flags = frame.flags;
+			a_result.entries.push_back(entry);
+			position += frameBytes;
+		}
+	}
+
+	// only out of order when a checkpoint was bad
+	std::sort(a_result.entries.begin(), a_result.entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+		return a.offset < b.offset;
+	});
+	return !a_result.entries.empty();
+}
+
+bool SessionRecovery::recover(const std::string& a_filename)
+{
+	m_stats = Stats();
+
+	MappedFile file;
+	if (!file.open(a_filename))
+	{
+		std::cout << "Error: Unable to open session " << a_filename << std::endl;
+		return false;
+	}
+
+	const uint8_t* data = file.data();
+	size_t size = file.size();
+	FileHeader header;
+	if (size >= sizeof(FileHeader))
+		memcpy(&header, data, sizeof(FileHeader));
+	if (size < sizeof(FileHeader) ||
+		header.magic != FileMagic ||
+		header.version != Version ||
+		header.headerSize > size)
+	{
+		std::cout << "Error: " << a_filename << " is not a session" << std::endl;
+		return false;
+	}
+
+	m_stats.fileBytes = size;
+	if (hasIndex(data, size, header))
+	{
+		m_stats.hadIndex = true;
+		return true;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Result result;
+	bool found = scan(data, size, header, result);
+	m_stats.scanMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_stats.framesRecovered = result.entries.size();
+	m_stats.checkpointedFrames = result.checkpointedFrames;
+	m_stats.chunks = result.chunks;
+	m_stats.checkpoints = result.checkpoints;
+	m_stats.tornBytes = size - result.end;
+	file.close();
+
+	if (!found)
+	{
+		std::cout << "Error: No frames in session " << a_filename << std::endl;
+		return false;
+	}
+
+	// after everything already there, torn chunk included, on the next boundary so the
+	// session still reads as chunks if this footer is lost too
+	start = std::chrono::steady_clock::now();
+	uint64_t indexOffset = alignUp(size, Alignment);
+	size_t indexSize = result.entries.size() * sizeof(IndexEntry);
+	size_t padding = indexOffset - size;
+	std::vector<uint8_t> block(padding + alignUp(indexSize + sizeof(Footer), Alignment), 0);
+	memcpy(block.data() + padding, result.entries.data(), indexSize);
+
+	Footer footer;
+	footer.indexOffset = indexOffset;
+	footer.entryCount = result.entries.size();
+	footer.indexChecksum = Crc32::compute(result.entries.data(), indexSize);
+	footer.chunkCount = result.chunks;
+	memcpy(block.data() + block.size() - sizeof(Footer), &footer, sizeof(Footer));
+
+	UnbufferedFile out;
+	if (!out.openExisting(a_filename))
+		return false;
+	if (out.getSize() != size || !out.write(block.data(), block.size()) || !out.sync())
+	{
+		std::cout << "Error: Unable to write the session index to " << a_filename << std::endl;
+		return false;
+	}
+	out.close();
+	m_stats.writeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
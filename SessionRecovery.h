@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SessionFormat.h"
+
+// Rebuilds the index of a session that never got its footer (see SessionFormat.h), because
+// the application died, the disk filled or the power went mid-take. The file is walked
+// header to header, chunks and checkpoints alike, which for full chunks touches one page in
+// thousands, so it goes as fast as the disk can seek; the frames of the chunks a checkpoint
+// covers come from its entries, and only the chunks after the last whole checkpoint have
+// their frame headers read. A chunk cut short keeps the frames that made it whole.
+// SessionPlayer scans this way when it opens such a file; recover() also appends the
+// rebuilt index and footer, so from then on it opens like any other. Nothing already in
+// the file is rewritten.
+class SessionRecovery
+{
+public:
+
+	struct Result
+	{
+		std::vector<SessionFormat::IndexEntry>	entries;	// by offset
+		uint32_t		chunks = 0;
+		uint32_t		checkpoints = 0;		// whole, with a matching checksum
+		uint64_t		checkpointedFrames = 0;	// entries taken from checkpoints, the rest from frame headers
+		uint64_t		end = 0;				// offset after the last whole chunk or checkpoint
+		bool			torn = false;			// the one after that runs past the end of the file
+	};
+
+	struct Stats
+	{
+		bool			hadIndex = false;		// the footer was fine, nothing was done
+		uint64_t		fileBytes = 0;
+		uint64_t		framesRecovered = 0;
+		uint64_t		checkpointedFrames = 0;
+		uint32_t		chunks = 0;
+		uint32_t		checkpoints = 0;
+		uint64_t		tornBytes = 0;			// past the last whole chunk, frames in them kept
+		float			scanMs = 0;
+		float			writeMs = 0;			// appending the index and syncing it
+	};
+
+	SessionRecovery() = default;
+
+	// walks a mapped session after its header, false if no frame was found
+	static bool		scan(const uint8_t* a_data, size_t a_size, const SessionFormat::FileHeader& a_header, Result& a_result);
+
+	// appends a rebuilt index and footer to a_filename unless it already ends with a good one
+	bool			recover(const std::string& a_filename);
+
+	const Stats&	getStats() const		{	return m_stats;	}
+
+private:
+
+	Stats			m_stats;
+};
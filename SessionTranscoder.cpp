@@ -0,0 +1,525 @@
+#include "SessionTranscoder.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <format>
+#include <iostream>
+#include <numeric>
+
+#include <Eigen/LU>
+
+namespace
+{
+	// rs2_format values of the colour layouts that can be fused
+	constexpr uint32_t	FormatRgb8 = 5;
+	constexpr uint32_t	FormatBgr8 = 6;
+
+	template<class Function>
+	void forEachCamera(size_t a_count, Function a_function)
+	{
+		std::vector<size_t> cameras(a_count);
+		std::iota(cameras.begin(), cameras.end(), 0);
+		std::for_each(std::execution::par, cameras.begin(), cameras.end(), a_function);
+	}
+
+	template<class T>
+	uint64_t capacityBytes(const std::vector<T>& a_vector)
+	{
+		return a_vector.capacity() * sizeof(T);
+	}
+}
+
+const char* SessionTranscoder::getStageName(Stage a_stage)
+{
+	switch (a_stage)
+	{
+	case Stage::Read:		return "Read";
+	case Stage::Align:		return "Align";
+	case Stage::Deproject:	return "Deproject";
+	case Stage::Filter:		return "Filter";
+	case Stage::Fuse:		return "Fuse";
+	case Stage::Export:		return "Export";
+	}
+	return "";
+}
+
+uint64_t SessionTranscoder::Frame::bytes() const
+{
+	uint64_t bytes = 0;
+	for (auto& camera : cameras)
+		bytes += capacityBytes(camera.depth) + capacityBytes(camera.colour) + capacityBytes(camera.alignedDepth) +
+			capacityBytes(camera.vertices) + capacityBytes(camera.texcoords) +
+			capacityBytes(camera.filteredVertices) + capacityBytes(camera.filteredTexcoords);
+	return bytes;
+}
+
+void SessionTranscoder::Queue::push(std::unique_ptr<Frame> a_frame)
+{
+	{
+		std::lock_guard lock(mutex);
+		frames.push_back(std::move(a_frame));
+	}
+	wake.notify_one();
+}
+
+std::unique_ptr<SessionTranscoder::Frame> SessionTranscoder::Queue::pop()
+{
+	std::unique_lock lock(mutex);
+	wake.wait(lock, [this] { return closed || !frames.empty(); });
+	if (frames.empty())
+		return nullptr;
+	auto frame = std::move(frames.front());
+	frames.pop_front();
+	return frame;
+}
+
+void SessionTranscoder::Queue::close()
+{
+	{
+		std::lock_guard lock(mutex);
+		closed = true;
+	}
+	wake.notify_all();
+}
+
+bool SessionTranscoder::transcode(const std::string& a_session, const std::string& a_directory)
+{
+	if (!m_player.open(a_session))
+		return false;
+
+	auto& cameras = m_player.getCameras();
+	if (cameras.empty() || m_player.getFrameCount(0) == 0)
+	{
+		std::cout << "Error: No frames in " << a_session << std::endl;
+		m_player.close();
+		return false;
+	}
+
+	m_active = m_settings;
+
+	m_depthCodecs.assign(cameras.size(), DepthCodec());
+	m_colourCodecs.assign(cameras.size(), ColourCodec());
+	m_corrections.assign(cameras.size(), DepthCorrection());
+	m_filters.assign(cameras.size(), PointFilter());
+	for (size_t camera = 0; camera < cameras.size(); ++camera)
+	{
+		// sessions converted from .bag have no correction
+		auto& c = cameras[camera].depthCorrection;
+		if (c[1] != 0)
+			m_corrections[camera].setCoefficients({ c[0], c[1], c[2] });
+		m_corrections[camera].prepare(cameras[camera].depthUnits);
+		m_filters[camera].setSettings(m_active.filter);
+	}
+	m_dedup.setVoxelSize(m_active.dedupVoxelSize);
+
+	// one writer taking one cloud at a time, so the export stage waits for as long as the
+	// disk takes and its occupancy is the disk's
+	PointCloudExporter::Settings exporterSettings;
+	exporterSettings.format = m_active.format;
+	exporterSettings.normals = false;
+	exporterSettings.threads = 1;
+	exporterSettings.backlog = 1;
+	exporterSettings.wait = true;
+	m_exporter.setSettings(exporterSettings);
+	if (!m_exporter.start(a_directory))
+	{
+		m_player.close();
+		return false;
+	}
+
+	for (auto& queue : m_queues)
+	{
+		queue.frames.clear();
+		queue.closed = false;
+	}
+	for (unsigned int i = 0; i < std::max(m_active.frames, 1u); ++i)
+		m_queues[(int)Stage::Read].frames.push_back(std::make_unique<Frame>());
+
+	for (auto& times : m_times)
+	{
+		times.frames = 0;
+		times.busyNs = 0;
+		times.waitNs = 0;
+	}
+	m_nextTick = 0;
+	m_ticks = m_player.getFrameCount(0);
+	m_framesEmpty = 0;
+	m_decodeErrors = 0;
+	m_pointsDeprojected = 0;
+	m_poolBytes = 0;
+	m_start = std::chrono::steady_clock::now();
+	m_running = true;
+
+	std::vector<std::thread> threads;
+	for (int stage = 0; stage < StageCount; ++stage)
+		threads.emplace_back(&SessionTranscoder::runStage, this, (Stage)stage);
+	for (auto& thread : threads)
+		thread.join();
+
+	m_exporter.stop();
+	m_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count();
+	m_running = false;
+
+	// every frame is back in the pool, and has grown to the largest tick it carried
+	uint64_t poolBytes = 0;
+	for (auto& frame : m_queues[(int)Stage::Read].frames)
+		poolBytes += frame->bytes();
+	m_poolBytes = poolBytes;
+	m_queues[(int)Stage::Read].frames.clear();
+
+	m_player.close();
+	return m_exporter.getStats().framesDropped == 0;
+}
+
+void SessionTranscoder::runStage(Stage a_stage)
+{
+	using Clock = std::chrono::steady_clock;
+	auto ns = [](Clock::duration a_duration) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(a_duration).count();
+	};
+
+	int stage = (int)a_stage;
+	auto& times = m_times[stage];
+	auto& input = m_queues[stage];
+	auto& output = m_queues[(stage + 1) % StageCount];
+
+	// the pool is never closed, reading stops after the last tick instead
+	while (a_stage != Stage::Read || m_nextTick < m_ticks)
+	{
+		auto start = Clock::now();
+		auto frame = input.pop();
+		if (!frame)
+			break;
+		auto popped = Clock::now();
+
+		switch (a_stage)
+		{
+		case Stage::Read:		read(*frame);		break;
+		case Stage::Align:		align(*frame);		break;
+		case Stage::Deproject:	deproject(*frame);	break;
+		case Stage::Filter:		filter(*frame);		break;
+		case Stage::Fuse:		fuse(*frame);		break;
+		case Stage::Export:		write(*frame);		break;
+		}
+
+		times.waitNs += ns(popped - start);
+		times.busyNs += ns(Clock::now() - popped);
+		++times.frames;
+		output.push(std::move(frame));
+	}
+
+	// export hands its frames back to the pool, which stays open
+	if (a_stage != Stage::Export)
+		output.close();
+}
+
+void SessionTranscoder::read(Frame& a_frame)
+{
+	auto& cameras = m_player.getCameras();
+	a_frame.tick = m_nextTick++;
+	a_frame.cloud.reset();
+	a_frame.cameras.resize(cameras.size());
+
+	// the frames are looked up in turn, then decoded a camera per thread
+	double time = m_player.getTimestamp(0, a_frame.tick) - m_player.getStartTimestamp(0);
+	std::vector<SessionPlayer::FrameView> views(cameras.size());
+	for (size_t camera = 0; camera < cameras.size(); ++camera)
+	{
+		if (m_player.getFrameCount(camera) == 0)
+			continue;
+
+		size_t index = m_player.findFrame(camera, m_player.getStartTimestamp(camera) + time);
+		m_player.prefetch(camera, index + 1, 2);
+		views[camera] = m_player.getFrame(camera, index);
+	}
+
+	forEachCamera(cameras.size(), [&](size_t camera) {
+		readCamera(camera, views[camera], a_frame.cameras[camera]);
+	});
+}
+
+void SessionTranscoder::readCamera(size_t a_camera, const SessionPlayer::FrameView& a_view, CameraFrame& a_frame)
+{
+	auto& info = m_player.getCameras()[a_camera];
+	a_frame.valid = false;
+	a_frame.coloured = false;
+	a_frame.aligned = false;
+	if (!a_view || !a_view.depth)
+		return;
+
+	a_frame.depth.resize((size_t)info.depth.width * info.depth.height);
+	if (!m_player.decodeDepth(a_view, a_frame.depth.data(), m_depthCodecs[a_camera]))
+	{
+		++m_decodeErrors;
+		return;
+	}
+	if (!m_corrections[a_camera].isIdentity())
+		m_corrections[a_camera].apply(a_frame.depth.data(), a_frame.depth.data(), a_frame.depth.size());
+
+	// without a colour stream there is nothing to align to
+	a_frame.valid = true;
+	a_frame.aligned = m_active.align && info.colour.width > 0 && info.colour.fx > 0;
+	a_frame.pointsToCapture = Eigen::Map<const Eigen::Matrix4f>(a_view.header->transform);
+	if (a_frame.aligned)
+		a_frame.pointsToCapture *= Eigen::Map<const Eigen::Matrix4f>(info.depthToColor).inverse();
+
+	bool rgb = info.colour.format == FormatRgb8, bgr = info.colour.format == FormatBgr8;
+	if (!a_view.colour || !(rgb || bgr))
+		return;
+
+	a_frame.colour.resize((size_t)info.colour.width * info.colour.height * 3);
+	if (!m_player.decodeColour(a_view, a_frame.colour.data(), m_colourCodecs[a_camera]))
+	{
+		++m_decodeErrors;
+		return;
+	}
+	if (bgr)
+		for (size_t i = 0; i < a_frame.colour.size(); i += 3)
+			std::swap(a_frame.colour[i], a_frame.colour[i + 2]);
+	a_frame.coloured = true;
+}
+
+void SessionTranscoder::align(Frame& a_frame) const
+{
+	forEachCamera(a_frame.cameras.size(), [&](size_t camera) {
+		auto& frame = a_frame.cameras[camera];
+		if (frame.valid && frame.aligned)
+			alignCamera(camera, frame);
+	});
+}
+
+void SessionTranscoder::alignCamera(size_t a_camera, CameraFrame& a_frame) const
+{
+	auto& info = m_player.getCameras()[a_camera];
+	const auto& depth = info.depth;
+	const auto& colour = info.colour;
+	int width = (int)colour.width, height = (int)colour.height;
+	Eigen::Matrix4f depthToColour = Eigen::Map<const Eigen::Matrix4f>(info.depthToColor);
+	float units = info.depthUnits;
+
+	a_frame.alignedDepth.assign((size_t)width * height, 0);
+	for (uint32_t y = 0; y < depth.height; ++y)
+	{
+		const uint16_t* row = &a_frame.depth[(size_t)y * depth.width];
+		for (uint32_t x = 0; x < depth.width; ++x)
+		{
+			if (row[x] == 0)
+				continue;
+
+			// the pixel's footprint from its top left to its bottom right corner, so
+			// depth going to a larger colour image leaves no holes
+			float z = row[x] * units;
+			float u[2], v[2], colourZ = 0;
+			bool inFront = true;
+			for (int corner = 0; corner < 2; ++corner)
+			{
+				Eigen::Vector4f point(((float)x - 0.5f + corner - depth.cx) / depth.fx * z,
+									  ((float)y - 0.5f + corner - depth.cy) / depth.fy * z, z, 1);
+				Eigen::Vector4f projected = depthToColour * point;
+				if (projected.z() <= 0)
+				{
+					inFront = false;
+					break;
+				}
+				u[corner] = projected.x() / projected.z() * colour.fx + colour.cx;
+				v[corner] = projected.y() / projected.z() * colour.fy + colour.cy;
+				colourZ += projected.z() * 0.5f;
+			}
+			if (!inFront)
+				continue;
+
+			int u0 = std::max((int)std::lround(std::min(u[0], u[1])), 0);
+			int u1 = std::min((int)std::lround(std::max(u[0], u[1])), width - 1);
+			int v0 = std::max((int)std::lround(std::min(v[0], v[1])), 0);
+			int v1 = std::min((int)std::lround(std::max(v[0], v[1])), height - 1);
+			auto value = (uint16_t)std::min(std::lround(colourZ / units), 65535l);
+			if (value == 0)
+				continue;
+
+			// nearest wins where pixels land on the same colour pixel
+			for (int cy = v0; cy <= v1; ++cy)
+				for (int cx = u0; cx <= u1; ++cx)
+				{
+					auto& out = a_frame.alignedDepth[(size_t)cy * width + cx];
+					if (out == 0 || value < out)
+						out = value;
+				}
+		}
+	}
+}
+
+void SessionTranscoder::deproject(Frame& a_frame)
+{
+	std::vector<size_t> valid(a_frame.cameras.size(), 0);
+	forEachCamera(a_frame.cameras.size(), [&](size_t camera) {
+		auto& frame = a_frame.cameras[camera];
+		frame.count = 0;
+		if (!frame.valid)
+			return;
+
+		deprojectCamera(camera, frame);
+		for (size_t i = 0; i < frame.count; ++i)
+			valid[camera] += frame.vertices[i * 3 + 2] > 0;
+	});
+	m_pointsDeprojected += std::accumulate(valid.begin(), valid.end(), (size_t)0);
+}
+
+void SessionTranscoder::deprojectCamera(size_t a_camera, CameraFrame& a_frame) const
+{
+	auto& info = m_player.getCameras()[a_camera];
+	const auto& stream = a_frame.aligned ? info.colour : info.depth;
+	const auto& colour = info.colour;
+	const uint16_t* depth = a_frame.aligned ? a_frame.alignedDepth.data() : a_frame.depth.data();
+	Eigen::Matrix4f depthToColour = Eigen::Map<const Eigen::Matrix4f>(info.depthToColor);
+	bool mapColour = !a_frame.aligned && colour.width > 0 && colour.fx > 0;
+	float units = info.depthUnits;
+
+	a_frame.count = (size_t)stream.width * stream.height;
+	a_frame.vertices.resize(a_frame.count * 3);
+	a_frame.texcoords.resize(a_frame.count * 2);
+	for (uint32_t y = 0; y < stream.height; ++y)
+	{
+		for (uint32_t x = 0; x < stream.width; ++x)
+		{
+			size_t i = (size_t)y * stream.width + x;
+			float* vertex = &a_frame.vertices[i * 3];
+			float* texcoord = &a_frame.texcoords[i * 2];
+			float z = depth[i] * units;
+			if (z <= 0)
+			{
+				vertex[0] = vertex[1] = vertex[2] = 0;
+				texcoord[0] = texcoord[1] = 0;
+				continue;
+			}
+
+			vertex[0] = ((float)x - stream.cx) / stream.fx * z;
+			vertex[1] = ((float)y - stream.cy) / stream.fy * z;
+			vertex[2] = z;
+
+			// aligned points are the colour pixels themselves, otherwise they're projected
+			// into the colour image the way rs2::pointcloud maps them
+			if (a_frame.aligned)
+			{
+				texcoord[0] = ((float)x + 0.5f) / stream.width;
+				texcoord[1] = ((float)y + 0.5f) / stream.height;
+			}
+			else if (mapColour)
+			{
+				Eigen::Vector4f projected = depthToColour * Eigen::Vector4f(vertex[0], vertex[1], vertex[2], 1);
+				texcoord[0] = (projected.x() / projected.z() * colour.fx + colour.cx) / colour.width;
+				texcoord[1] = (projected.y() / projected.z() * colour.fy + colour.cy) / colour.height;
+			}
+			else
+				texcoord[0] = texcoord[1] = 0;
+		}
+	}
+}
+
+void SessionTranscoder::filter(Frame& a_frame)
+{
+	if (!m_filters[0].isEnabled())
+		return;
+
+	forEachCamera(a_frame.cameras.size(), [&](size_t camera) {
+		auto& frame = a_frame.cameras[camera];
+		frame.filteredCount = 0;
+		if (!frame.valid)
+			return;
+
+		auto& filter = m_filters[camera];
+		filter.process(frame.vertices.data(), frame.texcoords.data(), frame.count);
+		frame.filteredCount = filter.getCount();
+		frame.filteredVertices.assign(filter.getVertices(), filter.getVertices() + frame.filteredCount * 3);
+		frame.filteredTexcoords.assign(filter.getTexcoords(), filter.getTexcoords() + frame.filteredCount * 2);
+	});
+}
+
+void SessionTranscoder::fuse(Frame& a_frame)
+{
+	auto& cameras = m_player.getCameras();
+	bool filtered = m_filters[0].isEnabled();
+
+	// camera ids are the input index, so cameras without depth this tick keep their place
+	std::vector<PointCloudFusion::Input> inputs(a_frame.cameras.size());
+	size_t points = 0;
+	for (size_t camera = 0; camera < a_frame.cameras.size(); ++camera)
+	{
+		auto& frame = a_frame.cameras[camera];
+		if (!frame.valid)
+			continue;
+
+		auto& input = inputs[camera];
+		input.vertices = filtered ? frame.filteredVertices.data() : frame.vertices.data();
+		input.texcoords = filtered ? frame.filteredTexcoords.data() : frame.texcoords.data();
+		input.count = filtered ? frame.filteredCount : frame.count;
+		input.transform = frame.pointsToCapture;
+		if (frame.coloured)
+		{
+			input.colour = frame.colour.data();
+			input.colourWidth = (int)cameras[camera].colour.width;
+			input.colourHeight = (int)cameras[camera].colour.height;
+			input.colourStride = input.colourWidth * 3;
+		}
+		points += input.count;
+	}
+	if (points == 0)
+		return;
+
+	m_fusion.fuse(inputs);
+	a_frame.cloud = m_fusion.acquire();
+	if (m_active.dedup)
+	{
+		m_dedup.process(a_frame.cloud);
+		a_frame.cloud = m_dedup.acquire();
+	}
+	if (a_frame.cloud && a_frame.cloud->count == 0)
+		a_frame.cloud.reset();
+}
+
+void SessionTranscoder::write(Frame& a_frame)
+{
+	if (!a_frame.cloud)
+	{
+		++m_framesEmpty;
+		return;
+	}
+
+	// waits for the writer, and lets go of the cloud so fusion can reuse it once written
+	m_exporter.add(std::format("cloud_{:06}", a_frame.tick), std::move(a_frame.cloud));
+	a_frame.cloud.reset();
+}
+
+SessionTranscoder::Stats SessionTranscoder::getStats() const
+{
+	Stats stats;
+	stats.ticks = m_ticks;
+	stats.framesEmpty = m_framesEmpty;
+	stats.decodeErrors = m_decodeErrors;
+	stats.pointsDeprojected = m_pointsDeprojected;
+	stats.poolBytes = m_poolBytes;
+
+	auto exported = m_exporter.getStats();
+	stats.framesWritten = exported.framesWritten;
+	stats.framesFailed = exported.framesDropped;
+	stats.pointsWritten = exported.pointsWritten;
+	stats.bytesWritten = exported.bytesWritten;
+
+	stats.seconds = m_running ? std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count() : m_seconds.load();
+	for (int stage = 0; stage < StageCount; ++stage)
+	{
+		auto& times = m_times[stage];
+		auto& out = stats.stages[stage];
+		out.frames = times.frames;
+		if (out.frames > 0)
+			out.busyMs = float(double(times.busyNs) / 1e6 / double(out.frames));
+		if (stats.seconds > 0)
+		{
+			out.occupancy = float(double(times.busyNs) / 1e9 / stats.seconds);
+			out.waiting = float(double(times.waitNs) / 1e9 / stats.seconds);
+		}
+	}
+	stats.framesRead = stats.stages[(int)Stage::Read].frames;
+	if (stats.seconds > 0)
+		stats.framesPerSecond = float(stats.framesRead) / stats.seconds;
+	return stats;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "DepthCorrection.h"
+#include "PointCloudDedup.h"
+#include "PointCloudExporter.h"
+#include "PointCloudFusion.h"
+#include "PointFilter.h"
+#include "SessionPlayer.h"
+
+// Streams a recorded session (see SessionPlayer) into a fused point cloud file per tick,
+// for batch processing without the interactive app. Each tick goes through the stages live
+// capture has: read, which decodes every camera's depth and colour, the cameras in
+// parallel each on decoders of its own, and applies its depth correction; align, which reprojects depth into the colour camera as rs2::align does;
+// deproject; filter (see PointFilter); fuse, with the overlap deduplicated (see
+// PointCloudFusion and PointCloudDedup); and export (see PointCloudExporter).
+// Every stage runs on its own thread, so ticks are pipelined and throughput approaches the
+// slowest stage's. Ticks travel through the stages in a fixed pool of frames that are
+// reused from one tick to the next, so memory stays bounded however long the session is:
+// read waits for a free frame when the pool is used up. Ticks follow the first camera's
+// frames and every other camera plays the frame at the same time since its own first, as
+// playback does.
+// Each stage's time is split into working and waiting on a frame, from the stage before
+// or, for read, from the pool. The stage working the largest share of the run is the one
+// holding the others up.
+class SessionTranscoder
+{
+public:
+
+	enum class Stage : int
+	{
+		Read,
+		Align,
+		Deproject,
+		Filter,
+		Fuse,
+		Export,
+	};
+
+	static constexpr int	StageCount = (int)Stage::Export + 1;
+
+	static const char*	getStageName(Stage a_stage);
+
+	struct Settings
+	{
+		bool			align = true;			// depth reprojected into the colour camera, as live capture's default
+		PointFilter::Settings	filter;
+		bool			dedup = true;
+		float			dedupVoxelSize = 0.002f;
+		PointCloudExporter::Format	format = PointCloudExporter::Format::Ply;
+		unsigned int	frames = StageCount + 2;	// in the pool, a frame per stage and some slack
+	};
+
+	struct StageStats
+	{
+		uint64_t		frames = 0;
+		float			busyMs = 0;				// average per frame
+		float			occupancy = 0;			// fraction of the run spent working
+		float			waiting = 0;			// fraction spent waiting on a frame
+	};
+
+	struct Stats
+	{
+		uint64_t		ticks = 0;				// in the session
+		uint64_t		framesRead = 0;
+		uint64_t		framesWritten = 0;
+		uint64_t		framesEmpty = 0;		// no camera had depth, or nothing survived filtering
+		uint64_t		framesFailed = 0;		// the exporter couldn't write them
+		uint64_t		decodeErrors = 0;		// camera payloads left out of their tick
+		uint64_t		pointsDeprojected = 0;
+		uint64_t		pointsWritten = 0;
+		uint64_t		bytesWritten = 0;
+		uint64_t		poolBytes = 0;			// held by the frame pool, once the run has finished
+		float			seconds = 0;			// since start
+		float			framesPerSecond = 0;	// read
+		StageStats		stages[StageCount];
+	};
+
+	SessionTranscoder() = default;
+	~SessionTranscoder() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// transcodes a_session into a_directory, which is created, and returns when every tick
+	// is written. getStats() may be called from another thread meanwhile.
+	bool			transcode(const std::string& a_session, const std::string& a_directory);
+
+	Stats			getStats() const;
+
+private:
+
+	struct CameraFrame
+	{
+		bool					valid = false;		// has depth this tick
+		bool					coloured = false;
+		bool					aligned = false;	// points are in the colour camera
+		std::vector<uint16_t>	depth;				// Z16, corrected, at the depth resolution
+		std::vector<uint8_t>	colour;				// RGB8
+		std::vector<uint16_t>	alignedDepth;		// Z16 along the colour camera's axis, at its resolution
+		Eigen::Matrix4f			pointsToCapture = Eigen::Matrix4f::Identity();
+
+		// rs2::points style, every pixel with zero for no depth
+		std::vector<float>		vertices;
+		std::vector<float>		texcoords;
+		size_t					count = 0;
+
+		std::vector<float>		filteredVertices;
+		std::vector<float>		filteredTexcoords;
+		size_t					filteredCount = 0;
+	};
+
+	struct Frame
+	{
+		uint64_t				tick = 0;
+		std::vector<CameraFrame>	cameras;
+		std::shared_ptr<const FusedPointCloud>	cloud;
+
+		uint64_t				bytes() const;
+	};
+
+	// frames from one stage to the next, closed once the stage before has finished
+	struct Queue
+	{
+		std::mutex				mutex;
+		std::condition_variable	wake;
+		std::deque<std::unique_ptr<Frame>>	frames;
+		bool					closed = false;
+
+		void					push(std::unique_ptr<Frame> a_frame);
+		std::unique_ptr<Frame>	pop();		// null once closed and empty
+		void					close();
+	};
+
+	struct StageTimes
+	{
+		std::atomic<uint64_t>	frames = 0;
+		std::atomic<uint64_t>	busyNs = 0;
+		std::atomic<uint64_t>	waitNs = 0;
+	};
+
+	void			runStage(Stage a_stage);
+	void			read(Frame& a_frame);
+	void			align(Frame& a_frame) const;
+	void			deproject(Frame& a_frame);
+	void			filter(Frame& a_frame);
+	void			fuse(Frame& a_frame);
+	void			write(Frame& a_frame);
+
+	void			readCamera(size_t a_camera, const SessionPlayer::FrameView& a_view, CameraFrame& a_frame);
+	void			alignCamera(size_t a_camera, CameraFrame& a_frame) const;
+	void			deprojectCamera(size_t a_camera, CameraFrame& a_frame) const;
+
+	Settings				m_settings;
+	Settings				m_active;			// as of transcode()
+
+	SessionPlayer			m_player;
+	std::vector<DepthCodec>		m_depthCodecs;	// per camera
+	std::vector<ColourCodec>	m_colourCodecs;
+	std::vector<DepthCorrection>	m_corrections;
+	std::vector<PointFilter>	m_filters;		// per camera
+	PointCloudFusion		m_fusion;
+	PointCloudDedup			m_dedup;
+	PointCloudExporter		m_exporter;
+
+	// m_queues[stage] feeds that stage, the read stage's is the pool
+	Queue					m_queues[StageCount];
+	StageTimes				m_times[StageCount];
+	uint64_t				m_nextTick = 0;
+
+	std::atomic<bool>		m_running = false;
+	std::chrono::steady_clock::time_point	m_start;
+	std::atomic<float>		m_seconds = 0;		// of the last run, once finished
+	std::atomic<uint64_t>	m_ticks = 0;
+	std::atomic<uint64_t>	m_framesEmpty = 0;
+	std::atomic<uint64_t>	m_decodeErrors = 0;
+	std::atomic<uint64_t>	m_pointsDeprojected = 0;
+	std::atomic<uint64_t>	m_poolBytes = 0;
+};
@@ -0,0 +1,103 @@
+#include "TemporalFilter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#define TEMPORAL_SIMD 1
+#include <immintrin.h>
+#endif
+
+void TemporalFilter::reset()
+{
+	std::fill(m_depth.begin(), m_depth.end(), 0);
+	std::fill(m_age.begin(), m_age.end(), 255);
+}
+
+void TemporalFilter::apply(const uint16_t* a_in, uint16_t* a_out, int a_width, int a_height, float a_depthUnits)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	size_t count = (size_t)a_width * a_height;
+	if (a_width != m_width ||
+		a_height != m_height)
+	{
+		m_width = a_width;
+		m_height = a_height;
+		m_depth.resize(count);
+		m_age.resize(count);
+		reset();
+	}
+
+	// alpha as Q15 for pmulhrsw, delta in raw units capped so in-range differences fit in 16 bits
+	const int16_t alpha = (int16_t)std::clamp((int)std::lround(m_settings.alpha * 32768), 0, 32767);
+	const uint16_t delta = (uint16_t)std::clamp((int)std::lround(m_settings.delta / a_depthUnits), 1, 32767);
+	const uint8_t persistence = (uint8_t)std::clamp(m_settings.persistence, 0, 254);
+
+	uint16_t* state = m_depth.data();
+	uint8_t* age = m_age.data();
+	size_t i = 0;
+
+#ifdef TEMPORAL_SIMD
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaQ15 = _mm_set1_epi16(alpha);
+	const __m128i deltaLimit = _mm_set1_epi16((short)(delta - 1));
+	const __m128i persistenceLimit = _mm_set1_epi16(persistence);
+	const __m128i one = _mm_set1_epi16(1);
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(a_in + i));
+		__m128i s = _mm_loadu_si128((const __m128i*)(state + i));
+		__m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(age + i)), zero);
+
+		__m128i valid = _mm_xor_si128(_mm_cmpeq_epi16(d, zero), _mm_cmpeq_epi16(d, d));
+		__m128i hasState = _mm_xor_si128(_mm_cmpeq_epi16(s, zero), _mm_cmpeq_epi16(s, s));
+
+		// |d - s| < delta, where the wrapped 16 bit difference is exact
+		__m128i absDiff = _mm_or_si128(_mm_subs_epu16(d, s), _mm_subs_epu16(s, d));
+		__m128i close = _mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(absDiff, deltaLimit), zero), hasState);
+
+		__m128i blended = _mm_add_epi16(s, _mm_mulhrs_epi16(_mm_sub_epi16(d, s), alphaQ15));
+
+		// valid: blend when close, otherwise take the measurement. invalid: keep the state
+		__m128i next = _mm_or_si128(_mm_and_si128(close, blended), _mm_andnot_si128(close, d));
+		next = _mm_or_si128(_mm_and_si128(valid, next), _mm_andnot_si128(valid, s));
+
+		// age resets on a valid sample and saturates at 255 otherwise
+		a = _mm_andnot_si128(valid, _mm_min_epi16(_mm_add_epi16(a, one), _mm_set1_epi16(255)));
+
+		// invalid pixels only show the held value while it's young enough
+		__m128i held = _mm_cmpgt_epi16(_mm_add_epi16(persistenceLimit, one), a);
+		__m128i out = _mm_or_si128(_mm_and_si128(valid, next), _mm_andnot_si128(valid, _mm_and_si128(held, s)));
+
+		_mm_storeu_si128((__m128i*)(state + i), next);
+		_mm_storel_epi64((__m128i*)(age + i), _mm_packus_epi16(a, a));
+		_mm_storeu_si128((__m128i*)(a_out + i), out);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		uint16_t d = a_in[i];
+		uint16_t s = state[i];
+
+		if (d == 0)
+		{
+			age[i] = (uint8_t)std::min(age[i] + 1, 255);
+			a_out[i] = age[i] <= persistence ? s : 0;
+			continue;
+		}
+
+		if (s != 0 && std::abs((int)d - (int)s) < delta)
+			s = (uint16_t)(s + ((((int)d - (int)s) * alpha + 16384) >> 15));
+		else
+			s = d;
+
+		state[i] = s;
+		age[i] = 0;
+		a_out[i] = s;
+	}
+
+	m_lastFilterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
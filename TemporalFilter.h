@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Per-pixel temporal smoothing of raw Z16 depth for one camera. Each pixel blends
+// towards new measurements with an exponential moving average, but a change larger than
+// delta is taken as an edge or moving surface and replaces the state outright, so edges
+// don't smear. Pixels that drop out hold their last value for a few frames (persistence)
+// before going invalid, which removes most of the flicker at the cost of a short lag.
+// The state is two packed planes, 16 bit depth and 8 bit age since the last valid
+// measurement, updated in one SIMD pass per frame.
+class TemporalFilter
+{
+public:
+
+	struct Settings
+	{
+		float	alpha = 0.4f;		// weight of the new measurement
+		float	delta = 0.02f;		// metres, larger changes are edges and aren't blended
+		int		persistence = 3;	// frames an invalid pixel keeps its last value
+	};
+
+	TemporalFilter() = default;
+	~TemporalFilter() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// forgets all state, also happens when the frame size changes
+	void			reset();
+
+	// a_out may alias a_in
+	void			apply(const uint16_t* a_in, uint16_t* a_out, int a_width, int a_height, float a_depthUnits);
+
+	float			getLastFilterMs() const	{	return m_lastFilterMs;	}
+
+private:
+
+	Settings				m_settings;
+
+	int						m_width = 0;
+	int						m_height = 0;
+	std::vector<uint16_t>	m_depth;	// filtered depth, raw units
+	std::vector<uint8_t>	m_age;		// frames since the pixel was last valid
+
+	float					m_lastFilterMs = 0;
+};
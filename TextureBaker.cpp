@@ -0,0 +1,517 @@
+#include "TextureBaker.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include <Eigen/Geometry>
+
+namespace
+{
+	constexpr float		NearDepth = 0.05f;		// meters, corners closer to a camera are behind it
+	constexpr int		MinCellSize = 4;		// texels
+	constexpr int		MaxCellSize = 64;
+
+	// where a triangle's corners sit in its cell, texels from the cell's corner: the corner
+	// opposite its longest edge takes the right angle. The lower half's diagonal edge and the
+	// upper half's are 2.5 texels apart along x + y, so filtering at either edge reads next
+	// to nothing of the other half's texels.
+	constexpr float		Inset = 1.0f;
+	constexpr float		DiagonalGap = 1.25f;
+
+	template<class Function>
+	void forEachIndex(size_t a_count, bool a_parallel, Function a_function)
+	{
+		std::vector<size_t> indices(a_count);
+		std::iota(indices.begin(), indices.end(), 0);
+		if (a_parallel)
+			std::for_each(std::execution::par, indices.begin(), indices.end(), a_function);
+		else
+			std::for_each(indices.begin(), indices.end(), a_function);
+	}
+
+	int rightAngleCorner(const TriangleMesh& a_mesh, size_t a_triangle)
+	{
+		const uint32_t* corners = &a_mesh.indices[a_triangle * 3];
+		float longest = -1;
+		int corner = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			float length = (a_mesh.positions[corners[(i + 1) % 3]] - a_mesh.positions[corners[(i + 2) % 3]]).squaredNorm();
+			if (length > longest)
+			{
+				longest = length;
+				corner = i;
+			}
+		}
+		return corner;
+	}
+
+	// a_out[i] is where corner i of the triangle goes, a_slot 0 below the diagonal and 1 above
+	void cellCorners(int a_size, int a_slot, int a_rightAngle, Eigen::Vector2f a_out[3])
+	{
+		float size = (float)a_size;
+		float far = size - Inset - DiagonalGap;
+		Eigen::Vector2f corners[3] = { { Inset, Inset }, { far, Inset }, { Inset, far } };
+		for (int i = 0; i < 3; ++i)
+		{
+			auto& corner = a_out[(a_rightAngle + i) % 3];
+			corner = corners[i];
+			if (a_slot == 1)
+				corner = Eigen::Vector2f::Constant(size) - corner;
+		}
+	}
+
+	void sampleBilinear(const TextureBaker::Camera& a_camera, float a_x, float a_y, uint8_t* a_out)
+	{
+		float x = std::clamp(a_x - 0.5f, 0.0f, float(a_camera.width - 1));
+		float y = std::clamp(a_y - 0.5f, 0.0f, float(a_camera.height - 1));
+		int x0 = std::min((int)x, a_camera.width - 2);
+		int y0 = std::min((int)y, a_camera.height - 2);
+		int x1 = x0 + 1;
+		int y1 = y0 + 1;
+		float fx = x - x0, fy = y - y0;
+
+		const uint8_t* row0 = a_camera.rgb + (size_t)y0 * a_camera.stride;
+		const uint8_t* row1 = a_camera.rgb + (size_t)y1 * a_camera.stride;
+		for (int k = 0; k < 3; ++k)
+		{
+			float top = row0[x0 * 3 + k] + fx * (row0[x1 * 3 + k] - row0[x0 * 3 + k]);
+			float bottom = row1[x0 * 3 + k] + fx * (row1[x1 * 3 + k] - row1[x0 * 3 + k]);
+			a_out[k] = (uint8_t)(top + fy * (bottom - top) + 0.5f);
+		}
+	}
+}
+
+void TexturedMesh::clear()
+{
+	positions.clear();
+	normals.clear();
+	indices.clear();
+	texcoords.clear();
+	atlas.clear();
+	atlasWidth = 0;
+	atlasHeight = 0;
+}
+
+bool TexturedMesh::saveObj(const std::string& a_filename, const std::vector<uint8_t>& a_image, const char* a_imageExtension) const
+{
+	std::filesystem::path path(a_filename);
+	std::string stem = path.stem().string();
+	std::string imageName = stem + "." + a_imageExtension;
+
+	std::ofstream file(a_filename, std::ios::binary | std::ios::trunc);
+	std::ofstream material(std::filesystem::path(path).replace_extension(".mtl"), std::ios::binary | std::ios::trunc);
+	std::ofstream image(path.parent_path() / imageName, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false || material.is_open() == false || image.is_open() == false)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+
+	material << "newmtl atlas\nKa 1 1 1\nKd 1 1 1\nKs 0 0 0\nd 1\nillum 1\nmap_Kd " << imageName << "\n";
+	image.write((const char*)a_image.data(), a_image.size());
+
+	// OBJ texture coordinates have v up
+	std::string text;
+	text.reserve(positions.size() * 80 + indices.size() * 30);
+	auto out = std::back_inserter(text);
+	std::format_to(out, "mtllib {}.mtl\nusemtl atlas\n", stem);
+	for (auto& p : positions)
+		std::format_to(out, "v {} {} {}\n", p.x(), p.y(), p.z());
+	for (auto& n : normals)
+		std::format_to(out, "vn {} {} {}\n", n.x(), n.y(), n.z());
+	for (auto& t : texcoords)
+		std::format_to(out, "vt {} {}\n", t.x(), 1 - t.y());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		std::format_to(out, "f {0}/{1}/{0} {2}/{3}/{2} {4}/{5}/{4}\n", indices[i] + 1, i + 1, indices[i + 1] + 1, i + 2, indices[i + 2] + 1, i + 3);
+	file.write(text.data(), text.size());
+
+	return file.good() && material.good() && image.good();
+}
+
+bool TexturedMesh::saveGlb(const std::string& a_filename, const std::vector<uint8_t>& a_image, const char* a_mimeType) const
+{
+	// every corner has its own texture coordinate, so the primitive isn't indexed
+	size_t count = indices.size();
+	if (count == 0)
+	{
+		std::cout << "Error: Nothing to write to " << a_filename << std::endl;
+		return false;
+	}
+
+	auto align4 = [](size_t a_size) { return (a_size + 3) & ~size_t(3); };
+	size_t positionBytes = count * sizeof(float) * 3;
+	size_t texcoordBytes = count * sizeof(float) * 2;
+	size_t imageOffset = positionBytes * 2 + texcoordBytes;
+	size_t binarySize = align4(imageOffset + a_image.size());
+
+	std::vector<uint8_t> binary(binarySize, 0);
+	Eigen::Vector3f low = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+	Eigen::Vector3f high = -low;
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto& position = positions[indices[i]];
+		low = low.cwiseMin(position);
+		high = high.cwiseMax(position);
+		memcpy(&binary[i * 12], position.data(), 12);
+		memcpy(&binary[positionBytes + i * 12], normals[indices[i]].data(), 12);
+		memcpy(&binary[positionBytes * 2 + i * 8], texcoords[i].data(), 8);
+	}
+	if (!a_image.empty())
+		memcpy(&binary[imageOffset], a_image.data(), a_image.size());
+
+	std::string json = std::format(
+		"{{\"asset\":{{\"version\":\"2.0\"}},\"scene\":0,\"scenes\":[{{\"nodes\":[0]}}],\"nodes\":[{{\"mesh\":0}}],"
+		"\"meshes\":[{{\"primitives\":[{{\"attributes\":{{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2}},\"material\":0}}]}}],"
+		"\"materials\":[{{\"pbrMetallicRoughness\":{{\"baseColorTexture\":{{\"index\":0}},\"metallicFactor\":0,\"roughnessFactor\":1}}}}],"
+		"\"textures\":[{{\"sampler\":0,\"source\":0}}],"
+		"\"samplers\":[{{\"magFilter\":9729,\"minFilter\":9729,\"wrapS\":33071,\"wrapT\":33071}}],"
+		"\"images\":[{{\"bufferView\":3,\"mimeType\":\"{}\"}}],"
+		"\"buffers\":[{{\"byteLength\":{}}}],"
+		"\"bufferViews\":[{{\"buffer\":0,\"byteOffset\":0,\"byteLength\":{},\"target\":34962}},"
+		"{{\"buffer\":0,\"byteOffset\":{},\"byteLength\":{},\"target\":34962}},"
+		"{{\"buffer\":0,\"byteOffset\":{},\"byteLength\":{},\"target\":34962}},"
+		"{{\"buffer\":0,\"byteOffset\":{},\"byteLength\":{}}}],"
+		"\"accessors\":[{{\"bufferView\":0,\"componentType\":5126,\"count\":{},\"type\":\"VEC3\",\"min\":[{},{},{}],\"max\":[{},{},{}]}},"
+		"{{\"bufferView\":1,\"componentType\":5126,\"count\":{},\"type\":\"VEC3\"}},"
+		"{{\"bufferView\":2,\"componentType\":5126,\"count\":{},\"type\":\"VEC2\"}}]}}",
+		a_mimeType, binarySize,
+		positionBytes, positionBytes, positionBytes, positionBytes * 2, texcoordBytes, imageOffset, a_image.size(),
+		count, low.x(), low.y(), low.z(), high.x(), high.y(), high.z(), count, count);
+	json.resize(align4(json.size()), ' ');
+
+	std::ofstream file(a_filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+
+	// 'glTF' version 2, then the JSON and BIN chunks
+	uint32_t header[3] = { 0x46546C67, 2, uint32_t(12 + 8 + json.size() + 8 + binary.size()) };
+	uint32_t jsonChunk[2] = { (uint32_t)json.size(), 0x4E4F534A };
+	uint32_t binaryChunk[2] = { (uint32_t)binary.size(), 0x004E4942 };
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)jsonChunk, sizeof(jsonChunk));
+	file.write(json.data(), json.size());
+	file.write((const char*)binaryChunk, sizeof(binaryChunk));
+	file.write((const char*)binary.data(), binary.size());
+
+	return file.good();
+}
+
+void TextureBaker::bake(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras, TexturedMesh& a_out)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	a_out.clear();
+	a_out.positions = a_mesh.positions;
+	a_out.normals = a_mesh.normals;
+	a_out.indices = a_mesh.indices;
+
+	m_views.resize(a_cameras.size());
+	forEachIndex(a_cameras.size(), m_settings.parallel, [&](size_t i) {
+		render(a_mesh, a_cameras[i], m_views[i]);
+	});
+
+	choose(a_mesh, a_cameras);
+	layout(a_mesh, a_out);
+	fill(a_mesh, a_cameras, a_out);
+
+	m_lastBakeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TextureBaker::render(const TriangleMesh& a_mesh, const Camera& a_camera, View& a_view) const
+{
+	a_view.captureToCamera = a_camera.cameraToCapture.inverse();
+
+	a_view.projected.resize(a_mesh.positions.size());
+	Eigen::Affine3f toCamera(a_view.captureToCamera);
+	for (size_t i = 0; i < a_mesh.positions.size(); ++i)
+	{
+		Eigen::Vector3f p = toCamera * a_mesh.positions[i];
+		if (p.z() < NearDepth)
+			a_view.projected[i] = Eigen::Vector3f::Zero();
+		else
+			a_view.projected[i] = { a_camera.fx * p.x() / p.z() + a_camera.cx, a_camera.fy * p.y() / p.z() + a_camera.cy, p.z() };
+	}
+
+	int scale = std::max(m_settings.occlusionScale, 1);
+	a_view.width = (a_camera.width + scale - 1) / scale;
+	a_view.height = (a_camera.height + scale - 1) / scale;
+	a_view.depth.assign((size_t)a_view.width * a_view.height, std::numeric_limits<float>::max());
+
+	// the nearest depth at each pixel centre the triangle covers, either winding
+	float inverseScale = 1.0f / scale;
+	for (size_t t = 0; t + 2 < a_mesh.indices.size(); t += 3)
+	{
+		Eigen::Vector3f p[3];
+		bool visible = true;
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			p[corner] = a_view.projected[a_mesh.indices[t + corner]];
+			visible &= p[corner].z() > 0;
+			p[corner].x() *= inverseScale;
+			p[corner].y() *= inverseScale;
+		}
+		if (!visible)
+			continue;
+
+		float area = (p[1].x() - p[0].x()) * (p[2].y() - p[0].y()) - (p[2].x() - p[0].x()) * (p[1].y() - p[0].y());
+		if (area == 0)
+			continue;
+
+		int x0 = std::max(0, (int)std::floor(std::min({ p[0].x(), p[1].x(), p[2].x() }) - 0.5f));
+		int x1 = std::min(a_view.width - 1, (int)std::ceil(std::max({ p[0].x(), p[1].x(), p[2].x() }) - 0.5f));
+		int y0 = std::max(0, (int)std::floor(std::min({ p[0].y(), p[1].y(), p[2].y() }) - 0.5f));
+		int y1 = std::min(a_view.height - 1, (int)std::ceil(std::max({ p[0].y(), p[1].y(), p[2].y() }) - 0.5f));
+		float inverseArea = 1.0f / area;
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+			{
+				float px = x + 0.5f, py = y + 0.5f;
+				float w0 = ((p[1].x() - px) * (p[2].y() - py) - (p[2].x() - px) * (p[1].y() - py)) * inverseArea;
+				float w1 = ((p[2].x() - px) * (p[0].y() - py) - (p[0].x() - px) * (p[2].y() - py)) * inverseArea;
+				float w2 = 1 - w0 - w1;
+				if (w0 < 0 || w1 < 0 || w2 < 0)
+					continue;
+
+				float z = w0 * p[0].z() + w1 * p[1].z() + w2 * p[2].z();
+				float& depth = a_view.depth[(size_t)y * a_view.width + x];
+				depth = std::min(depth, z);
+			}
+	}
+}
+
+void TextureBaker::choose(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras)
+{
+	size_t triangleCount = a_mesh.indices.size() / 3;
+	m_cameraOf.assign(triangleCount, -1);
+	if (a_cameras.empty())
+	{
+		m_lastCoverage = 0;
+		return;
+	}
+
+	int scale = std::max(m_settings.occlusionScale, 1);
+	forEachIndex(triangleCount, m_settings.parallel, [&](size_t t) {
+		const uint32_t* corners = &a_mesh.indices[t * 3];
+		Eigen::Vector3f p0 = a_mesh.positions[corners[0]];
+		Eigen::Vector3f normal = (a_mesh.positions[corners[1]] - p0).cross(a_mesh.positions[corners[2]] - p0).normalized();
+		Eigen::Vector3f centroid = (p0 + a_mesh.positions[corners[1]] + a_mesh.positions[corners[2]]) / 3;
+
+		float bestScore = 0;
+		for (size_t c = 0; c < a_cameras.size(); ++c)
+		{
+			auto& camera = a_cameras[c];
+			auto& view = m_views[c];
+			if (camera.rgb == nullptr || camera.width < 2 || camera.height < 2)
+				continue;
+
+			// not the other way round, a sliver's normal is NaN
+			Eigen::Vector3f toCamera = camera.cameraToCapture.topRightCorner<3, 1>() - centroid;
+			float viewCos = normal.dot(toCamera) / toCamera.norm();
+			if (!(viewCos >= m_settings.minViewCos))
+				continue;
+
+			// every corner and the centre in the image and no further than the nearest surface there
+			Eigen::Vector3f c3 = Eigen::Affine3f(view.captureToCamera) * centroid;
+			Eigen::Vector3f points[4] = { view.projected[corners[0]], view.projected[corners[1]], view.projected[corners[2]],
+										  { camera.fx * c3.x() / c3.z() + camera.cx, camera.fy * c3.y() / c3.z() + camera.cy, c3.z() } };
+			bool seen = true;
+			for (auto& point : points)
+			{
+				if (point.z() < NearDepth ||
+					point.x() < 0 || point.x() >= camera.width ||
+					point.y() < 0 || point.y() >= camera.height)
+				{
+					seen = false;
+					break;
+				}
+				float nearest = view.depth[(size_t)((int)point.y() / scale) * view.width + (int)point.x() / scale];
+				if (point.z() > nearest + m_settings.depthTolerance)
+				{
+					seen = false;
+					break;
+				}
+			}
+			if (!seen)
+				continue;
+
+			// image pixels per meter of surface
+			float score = viewCos * camera.fx / c3.z();
+			if (score > bestScore)
+			{
+				bestScore = score;
+				m_cameraOf[t] = (int)c;
+			}
+		}
+	});
+
+	size_t covered = std::count_if(m_cameraOf.begin(), m_cameraOf.end(), [](int c) { return c >= 0; });
+	m_lastCoverage = triangleCount ? float(covered) / triangleCount : 0;
+}
+
+void TextureBaker::layout(const TriangleMesh& a_mesh, TexturedMesh& a_out)
+{
+	size_t triangleCount = a_mesh.indices.size() / 3;
+	m_cellSize.resize(triangleCount);
+
+	std::vector<float> longest(triangleCount);
+	forEachIndex(triangleCount, m_settings.parallel, [&](size_t t) {
+		const uint32_t* corners = &a_mesh.indices[t * 3];
+		auto& p0 = a_mesh.positions[corners[0]];
+		auto& p1 = a_mesh.positions[corners[1]];
+		auto& p2 = a_mesh.positions[corners[2]];
+		longest[t] = std::sqrt(std::max({ (p1 - p0).squaredNorm(), (p2 - p1).squaredNorm(), (p0 - p2).squaredNorm() }));
+	});
+
+	// the texels grow until the cells fit the atlas or are all the smallest
+	float texelSize = std::max(m_settings.texelSize, 1e-5f);
+	size_t sizeCount[MaxCellSize + 1];
+	std::vector<uint32_t> order(triangleCount);
+	int width = 0, height = 0;
+	for (;;)
+	{
+		std::fill(std::begin(sizeCount), std::end(sizeCount), 0);
+		uint64_t area = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			// the triangle's legs are its cell less the insets and the gap
+			float texels = std::ceil(longest[t] / texelSize + 2 * Inset + DiagonalGap);
+			int size = (int)std::clamp(texels, (float)MinCellSize, (float)MaxCellSize);
+			m_cellSize[t] = (uint8_t)size;
+			if (++sizeCount[size] % 2)
+				area += uint64_t(size) * size;
+		}
+
+		// pairs of triangles of the same size in cells, tallest first, packed in rows of a
+		// roughly square atlas
+		size_t offset = 0;
+		size_t offsets[MaxCellSize + 1];
+		for (int size = MaxCellSize; size >= MinCellSize; --size)
+		{
+			offsets[size] = offset;
+			offset += sizeCount[size];
+		}
+		for (size_t t = 0; t < triangleCount; ++t)
+			order[offsets[m_cellSize[t]]++] = (uint32_t)t;
+
+		width = (int)std::ceil(std::sqrt((double)area) * 1.02);
+		width = std::max((width + 3) & ~3, triangleCount ? (int)m_cellSize[order[0]] : 0);
+
+		m_cells.clear();
+		Eigen::Vector2i cursor(0, 0);
+		int rowHeight = 0;
+		for (size_t i = 0; i < triangleCount; )
+		{
+			Cell cell;
+			cell.size = m_cellSize[order[i]];
+			cell.triangles[0] = order[i++];
+			if (i < triangleCount && m_cellSize[order[i]] == cell.size)
+				cell.triangles[1] = order[i++];
+
+			if (cursor.x() + cell.size > width)
+			{
+				cursor = { 0, cursor.y() + rowHeight };
+				rowHeight = 0;
+			}
+			cell.corner = cursor;
+			cursor.x() += cell.size;
+			rowHeight = std::max(rowHeight, cell.size);
+			m_cells.push_back(cell);
+		}
+		height = cursor.y() + rowHeight;
+
+		if (std::max(width, height) <= m_settings.maxAtlasSize || sizeCount[MinCellSize] == triangleCount)
+			break;
+		texelSize *= 1.25f;
+	}
+	m_lastTexelSize = texelSize;
+
+	a_out.atlasWidth = width;
+	a_out.atlasHeight = height;
+	a_out.texcoords.resize(a_mesh.indices.size());
+	Eigen::Vector2f inverseSize(1.0f / std::max(width, 1), 1.0f / std::max(height, 1));
+	for (auto& cell : m_cells)
+		for (int slot = 0; slot < 2; ++slot)
+		{
+			uint32_t t = cell.triangles[slot];
+			if (t == ~0u)
+				continue;
+
+			Eigen::Vector2f uv[3];
+			cellCorners(cell.size, slot, rightAngleCorner(a_mesh, t), uv);
+			for (int corner = 0; corner < 3; ++corner)
+				a_out.texcoords[t * 3 + corner] = (uv[corner] + cell.corner.cast<float>()).cwiseProduct(inverseSize);
+		}
+}
+
+void TextureBaker::fill(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras, TexturedMesh& a_out) const
+{
+	a_out.atlas.assign((size_t)a_out.atlasWidth * a_out.atlasHeight * 3, 0);
+	bool colours = a_mesh.colours.size() == a_mesh.positions.size() * 3;
+
+	forEachIndex(m_cells.size(), m_settings.parallel, [&](size_t i) {
+		auto& cell = m_cells[i];
+		for (int slot = 0; slot < 2; ++slot)
+		{
+			uint32_t t = cell.triangles[slot];
+			if (t == ~0u)
+				continue;
+
+			const uint32_t* corners = &a_mesh.indices[t * 3];
+			Eigen::Vector2f uv[3];
+			cellCorners(cell.size, slot, rightAngleCorner(a_mesh, t), uv);
+			float area = (uv[1].x() - uv[0].x()) * (uv[2].y() - uv[0].y()) - (uv[2].x() - uv[0].x()) * (uv[1].y() - uv[0].y());
+
+			int camera = m_cameraOf[t];
+			Eigen::Affine3f toCamera(camera >= 0 ? m_views[camera].captureToCamera : Eigen::Matrix4f::Identity());
+
+			// texels on the diagonal itself belong to the lower half
+			for (int y = 0; y < cell.size; ++y)
+				for (int x = 0; x < cell.size; ++x)
+				{
+					if ((x + y + 1 <= cell.size) != (slot == 0))
+						continue;
+
+					// the nearest point of the triangle, near enough by clamping its weights
+					float px = x + 0.5f, py = y + 0.5f;
+					float w0 = ((uv[1].x() - px) * (uv[2].y() - py) - (uv[2].x() - px) * (uv[1].y() - py)) / area;
+					float w1 = ((uv[2].x() - px) * (uv[0].y() - py) - (uv[0].x() - px) * (uv[2].y() - py)) / area;
+					float w2 = 1 - w0 - w1;
+					w0 = std::max(w0, 0.0f);
+					w1 = std::max(w1, 0.0f);
+					w2 = std::max(w2, 0.0f);
+					float sum = w0 + w1 + w2;
+					w0 /= sum;
+					w1 /= sum;
+					w2 /= sum;
+
+					uint8_t* out = &a_out.atlas[((size_t)(cell.corner.y() + y) * a_out.atlasWidth + cell.corner.x() + x) * 3];
+					if (camera >= 0)
+					{
+						Eigen::Vector3f p = toCamera * (w0 * a_mesh.positions[corners[0]] + w1 * a_mesh.positions[corners[1]] + w2 * a_mesh.positions[corners[2]]);
+						auto& c = a_cameras[camera];
+						sampleBilinear(c, c.fx * p.x() / p.z() + c.cx, c.fy * p.y() / p.z() + c.cy, out);
+					}
+					else if (colours)
+					{
+						for (int k = 0; k < 3; ++k)
+							out[k] = (uint8_t)(w0 * a_mesh.colours[corners[0] * 3 + k] + w1 * a_mesh.colours[corners[1] * 3 + k] + w2 * a_mesh.colours[corners[2] * 3 + k] + 0.5f);
+					}
+					else
+						out[0] = out[1] = out[2] = 128;
+				}
+		}
+	});
+}
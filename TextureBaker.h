@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "MeshExtractor.h"
+
+// Triangle mesh with a texture atlas, in capture space
+struct TexturedMesh
+{
+	std::vector<Eigen::Vector3f>	positions;
+	std::vector<Eigen::Vector3f>	normals;
+	std::vector<uint32_t>			indices;
+	std::vector<Eigen::Vector2f>	texcoords;	// per index, atlas texels over its size with v down
+
+	std::vector<uint8_t>			atlas;		// RGB8, tightly packed rows
+	int								atlasWidth = 0;
+	int								atlasHeight = 0;
+
+	void	clear();
+
+	// a_image is the atlas already encoded, written next to the mesh with a_imageExtension
+	// (e.g. "jpg"). The OBJ references it through a material library written alongside.
+	bool	saveObj(const std::string& a_filename, const std::vector<uint8_t>& a_image, const char* a_imageExtension) const;
+
+	// binary glTF 2.0, the image embedded. a_mimeType is the image's, e.g. "image/jpeg".
+	bool	saveGlb(const std::string& a_filename, const std::vector<uint8_t>& a_image, const char* a_mimeType) const;
+};
+
+// Bakes a texture atlas for a mesh from the colour images of the cameras that see it.
+// Each triangle takes its colour from the one camera that sees it most squarely and from
+// closest, among those that see all of it: in front, inside the image and not behind
+// another part of the mesh, tested against a coarse depth buffer of the mesh rendered from
+// that camera. Triangles no camera sees keep their vertex colours.
+// The atlas is per triangle: every triangle is mapped onto one half of a square cell sized
+// to its longest edge at the texel size, with a gap along the diagonal between the two
+// halves, and the cells are packed in rows tallest first. Every texel of a cell takes the
+// colour of the nearest point of its half's triangle, so filtering at a triangle's edge
+// reads colours of that triangle. The texel size grows until the atlas fits the maximum
+// size.
+class TextureBaker
+{
+public:
+
+	struct Settings
+	{
+		float			texelSize = 0.002f;		// meters, before growing to fit
+		int				maxAtlasSize = 4096;	// texels along a side
+		float			minViewCos = 0.2f;		// cameras seeing a triangle more obliquely don't colour it
+		float			depthTolerance = 0.01f;	// meters a corner may be behind the nearest surface and still be seen
+		int				occlusionScale = 4;		// colour pixels per depth buffer pixel along each axis
+		bool			parallel = true;
+	};
+
+	// one camera's colour image, axes as librealsense projects them
+	struct Camera
+	{
+		const uint8_t*	rgb = nullptr;			// RGB8
+		int				width = 0;
+		int				height = 0;
+		int				stride = 0;				// bytes per row
+		float			fx = 0, fy = 0, cx = 0, cy = 0;
+
+		Eigen::Matrix4f	cameraToCapture = Eigen::Matrix4f::Identity();
+	};
+
+	TextureBaker() = default;
+	~TextureBaker() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	void			bake(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras, TexturedMesh& a_out);
+
+	float			getLastBakeMs() const		{	return m_lastBakeMs;		}
+	float			getLastTexelSize() const	{	return m_lastTexelSize;		}	// after growing to fit
+	float			getLastCoverage() const		{	return m_lastCoverage;		}	// of triangles coloured from a camera
+
+private:
+
+	// a square of the atlas holding up to two triangles, one either side of its diagonal
+	struct Cell
+	{
+		Eigen::Vector2i		corner;				// texels
+		int					size = 0;
+		uint32_t			triangles[2] = { ~0u, ~0u };
+	};
+
+	struct View
+	{
+		Eigen::Matrix4f		captureToCamera;
+		std::vector<Eigen::Vector3f>	projected;	// per vertex, colour pixel x, y and depth
+		std::vector<float>	depth;				// nearest surface per depth buffer pixel
+		int					width = 0;
+		int					height = 0;
+	};
+
+	void			render(const TriangleMesh& a_mesh, const Camera& a_camera, View& a_view) const;
+	void			choose(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras);
+	void			layout(const TriangleMesh& a_mesh, TexturedMesh& a_out);
+	void			fill(const TriangleMesh& a_mesh, const std::vector<Camera>& a_cameras, TexturedMesh& a_out) const;
+
+	Settings		m_settings;
+
+	// reused between calls
+	std::vector<View>		m_views;
+	std::vector<int>		m_cameraOf;		// per triangle, -1 for the vertex colours
+	std::vector<uint8_t>	m_cellSize;		// per triangle, texels
+	std::vector<Cell>		m_cells;
+
+	float			m_lastBakeMs = 0;
+	float			m_lastTexelSize = 0;
+	float			m_lastCoverage = 0;
+};
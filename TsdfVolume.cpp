@@ -0,0 +1,373 @@
+#include "TsdfVolume.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+#include <Eigen/LU>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define TSDF_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	template<class Iterator, class Function>
+	void forEach(bool a_parallel, Iterator a_begin, Iterator a_end, Function a_function)
+	{
+		if (a_parallel)
+			std::for_each(std::execution::par, a_begin, a_end, a_function);
+		else
+			std::for_each(a_begin, a_end, a_function);
+	}
+
+	// running average of a voxel's colour with a new sample
+	inline void blendColour(uint8_t* a_rgb, const uint8_t* a_sample, int a_weight)
+	{
+		for (int c = 0; c < 3; ++c)
+			a_rgb[c] = (uint8_t)((a_rgb[c] * a_weight + a_sample[c]) / (a_weight + 1));
+	}
+}
+
+void TsdfVolume::setSettings(const Settings& a_settings)
+{
+	bool resize = a_settings.voxelSize != m_settings.voxelSize;
+	m_settings = a_settings;
+	if (resize)
+		clear();
+}
+
+void TsdfVolume::clear()
+{
+	m_blocks.clear();
+	m_blockIndex.clear();
+	m_active.clear();
+	++m_generation;
+}
+
+const TsdfVolume::Block* TsdfVolume::findBlock(const Eigen::Vector3i& a_coord) const
+{
+	auto index = m_blockIndex.find(packVoxelKey(a_coord));
+	return index != nullptr ? m_blocks[*index].get() : nullptr;
+}
+
+void TsdfVolume::getBlocksUpdatedSince(uint64_t a_tick, std::vector<const Block*>& a_blocks) const
+{
+	a_blocks.clear();
+	for (auto& block : m_blocks)
+		if (block->updated > a_tick)
+			a_blocks.push_back(block.get());
+}
+
+void TsdfVolume::allocate(const DepthInput& a_input, std::vector<uint64_t>& a_keys) const
+{
+	const float blockSide = m_settings.voxelSize * BlockSize;
+	const float invBlockSide = 1.0f / blockSide;
+	const float trunc = m_settings.truncation;
+	const float step = std::min(trunc, blockSide * 0.5f);
+
+	const Eigen::Matrix3f R = a_input.cameraToCapture.topLeftCorner<3, 3>();
+	const Eigen::Vector3f T = a_input.cameraToCapture.topRightCorner<3, 1>();
+
+	// the same block comes up for runs of neighbouring pixels, dedupe locally before hashing
+	FlatHashMap<uint8_t> seen(16384);
+	uint64_t lastKey = FlatHashMap<uint8_t>::EmptyKey;
+
+	const int stride = std::max(1, m_settings.allocationStride);
+	for (int v = 0; v < a_input.height; v += stride)
+	{
+		const uint16_t* row = a_input.depth + v * a_input.width;
+		for (int u = 0; u < a_input.width; u += stride)
+		{
+			float d = row[u] * a_input.depthUnits;
+			if (d <= 0 || d > m_settings.maxDepth)
+				continue;
+
+			Eigen::Vector3f ray((u - a_input.cx) / a_input.fx, (v - a_input.cy) / a_input.fy, 1);
+			Eigen::Vector3f direction = R * ray;
+
+			// blocks covering the truncation band along the ray
+			for (float t = d - trunc; t <= d + trunc; t += step)
+			{
+				Eigen::Vector3f p = direction * t + T;
+				auto key = packVoxelKey((p * invBlockSide).array().floor().cast<int>());
+				if (key == lastKey)
+					continue;
+				lastKey = key;
+
+				if (seen.insert(key, 0).second)
+					a_keys.push_back(key);
+			}
+		}
+	}
+}
+
+void TsdfVolume::buildTiles(const DepthInput& a_input, DepthTiles& a_tiles) const
+{
+	a_tiles.width = (a_input.width + TileSize - 1) / TileSize;
+	a_tiles.height = (a_input.height + TileSize - 1) / TileSize;
+	a_tiles.maxDepth.assign((size_t)a_tiles.width * a_tiles.height, 0);
+
+	// beyond max depth counts as no depth, integrateBlock skips those pixels too
+	const uint16_t limit = (uint16_t)std::min(65535.0f, m_settings.maxDepth / a_input.depthUnits);
+	for (int v = 0; v < a_input.height; ++v)
+	{
+		const uint16_t* row = a_input.depth + (size_t)v * a_input.width;
+		uint16_t* tiles = &a_tiles.maxDepth[(size_t)(v / TileSize) * a_tiles.width];
+		for (int tile = 0, u = 0; u < a_input.width; ++tile)
+		{
+			int end = std::min(u + TileSize, a_input.width);
+			uint16_t deepest = tiles[tile];
+			for (; u < end; ++u)
+				deepest = std::max(deepest, row[u] <= limit ? row[u] : (uint16_t)0);
+			tiles[tile] = deepest;
+		}
+	}
+}
+
+void TsdfVolume::integrateBlock(Block& a_block, const std::vector<DepthInput>& a_inputs,
+								const std::vector<Eigen::Matrix4f>& a_captureToCamera) const
+{
+	const float voxelSize = m_settings.voxelSize;
+	const float trunc = m_settings.truncation;
+	const float invTrunc = 1.0f / trunc;
+	const Eigen::Vector3f origin = a_block.coord.cast<float>() * (voxelSize * BlockSize);
+
+	for (size_t camera = 0; camera < a_inputs.size(); ++camera)
+	{
+		auto& input = a_inputs[camera];
+		if (input.depth == nullptr)
+			continue;
+
+		const Eigen::Matrix3f R = a_captureToCamera[camera].topLeftCorner<3, 3>();
+		const Eigen::Vector3f T = a_captureToCamera[camera].topRightCorner<3, 1>();
+
+		// the pixels the voxel centres land on and how near the nearest one is, from the corners
+		// of the box through them; a block straddling the camera plane is taken as a whole
+		float zMin = FLT_MAX;
+		int u0 = 0, u1 = input.width - 1, v0 = 0, v1 = input.height - 1;
+		{
+			float uMin = FLT_MAX, uMax = -FLT_MAX, vMin = FLT_MAX, vMax = -FLT_MAX;
+			bool straddles = false;
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				Eigen::Vector3f offset((corner & 1) ? BlockSize - 0.5f : 0.5f, (corner & 2) ? BlockSize - 0.5f : 0.5f, (corner & 4) ? BlockSize - 0.5f : 0.5f);
+				Eigen::Vector3f p = R * (origin + offset * voxelSize) + T;
+				zMin = std::min(zMin, p.z());
+				if (p.z() <= 0)
+				{
+					straddles = true;
+					continue;
+				}
+				float u = input.fx * p.x() / p.z() + input.cx + 0.5f;
+				float v = input.fy * p.y() / p.z() + input.cy + 0.5f;
+				uMin = std::min(uMin, u);
+				uMax = std::max(uMax, u);
+				vMin = std::min(vMin, v);
+				vMax = std::max(vMax, v);
+			}
+			if (zMin == FLT_MAX || (straddles && uMin == FLT_MAX))
+				continue;
+			if (straddles == false)
+			{
+				// out of view
+				if (uMax < 0 || uMin >= input.width ||
+					vMax < 0 || vMin >= input.height)
+					continue;
+				// a pixel of slack for the rows' rounding
+				u0 = std::max(0, (int)uMin - 1);
+				u1 = std::min(input.width - 1, (int)uMax + 1);
+				v0 = std::max(0, (int)vMin - 1);
+				v1 = std::min(input.height - 1, (int)vMax + 1);
+			}
+			zMin = std::max(zMin, 0.0f);
+		}
+
+		// every voxel further than the truncation behind the deepest surface it could see is skipped
+		auto& tiles = m_tiles[camera];
+		uint16_t deepest = 0;
+		for (int ty = v0 / TileSize; ty <= v1 / TileSize; ++ty)
+			for (int tx = u0 / TileSize; tx <= u1 / TileSize; ++tx)
+				deepest = std::max(deepest, tiles.maxDepth[(size_t)ty * tiles.width + tx]);
+		if (zMin > deepest * input.depthUnits + trunc)
+			continue;
+
+		const Eigen::Vector3f stepX = R.col(0) * voxelSize;
+		const Eigen::Vector3f stepY = R.col(1) * voxelSize;
+		const Eigen::Vector3f stepZ = R.col(2) * voxelSize;
+		const Eigen::Vector3f first = R * (origin + Eigen::Vector3f::Constant(0.5f * voxelSize)) + T;
+
+#ifdef TSDF_SIMD
+		const __m128 lane = _mm_set_ps(3, 2, 1, 0);
+		const __m128 laneX = _mm_mul_ps(lane, _mm_set1_ps(stepX.x()));
+		const __m128 laneY = _mm_mul_ps(lane, _mm_set1_ps(stepX.y()));
+		const __m128 laneZ = _mm_mul_ps(lane, _mm_set1_ps(stepX.z()));
+		const __m128 fx = _mm_set1_ps(input.fx), fy = _mm_set1_ps(input.fy);
+		const __m128 cx = _mm_set1_ps(input.cx + 0.5f), cy = _mm_set1_ps(input.cy + 0.5f);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		const __m128 units = _mm_set1_ps(input.depthUnits), maxDepth = _mm_set1_ps(m_settings.maxDepth);
+		const __m128 minusTrunc = _mm_set1_ps(-trunc), invTruncs = _mm_set1_ps(invTrunc);
+		const __m128 maxWeight = _mm_set1_ps(m_settings.maxWeight);
+		const __m128i minusOne = _mm_set1_epi32(-1);
+		const __m128i width = _mm_set1_epi32(input.width), height = _mm_set1_epi32(input.height);
+		const __m128 rowPitch = _mm_set1_ps((float)input.width);
+#endif
+
+		for (int z = 0; z < BlockSize; ++z)
+		{
+			for (int y = 0; y < BlockSize; ++y)
+			{
+				Eigen::Vector3f p = first + stepY * (float)y + stepZ * (float)z;
+				int row = (z * BlockSize + y) * BlockSize;
+
+#ifdef TSDF_SIMD
+				for (int x = 0; x < BlockSize; x += 4)
+				{
+					int i = row + x;
+					__m128 px = _mm_add_ps(_mm_set1_ps(p.x() + stepX.x() * x), laneX);
+					__m128 py = _mm_add_ps(_mm_set1_ps(p.y() + stepX.y() * x), laneY);
+					__m128 pz = _mm_add_ps(_mm_set1_ps(p.z() + stepX.z() * x), laneZ);
+
+					__m128 invZ = _mm_div_ps(one, pz);
+					__m128i u = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fx, px), invZ), cx));
+					__m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fy, py), invZ), cy));
+
+					__m128i inU = _mm_and_si128(_mm_cmpgt_epi32(u, minusOne), _mm_cmplt_epi32(u, width));
+					__m128i inV = _mm_and_si128(_mm_cmpgt_epi32(v, minusOne), _mm_cmplt_epi32(v, height));
+					__m128 inside = _mm_and_ps(_mm_cmpgt_ps(pz, zero), _mm_castsi128_ps(_mm_and_si128(inU, inV)));
+					if (_mm_movemask_ps(inside) == 0)
+						continue;
+
+					// the pixel index stays exact in float, what's outside reads pixel 0 and is masked off
+					alignas(16) int pixel[4];
+					__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), rowPitch), _mm_cvtepi32_ps(u)));
+					_mm_store_si128((__m128i*)pixel, _mm_and_si128(index, _mm_castps_si128(inside)));
+					__m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_set_epi32(input.depth[pixel[3]], input.depth[pixel[2]],
+						input.depth[pixel[1]], input.depth[pixel[0]])), units);
+
+					__m128 sdf = _mm_sub_ps(d, pz);
+					__m128 update = _mm_and_ps(_mm_and_ps(inside, _mm_cmpgt_ps(d, zero)),
+						_mm_and_ps(_mm_cmple_ps(d, maxDepth), _mm_cmpge_ps(sdf, minusTrunc)));
+					int updated = _mm_movemask_ps(update);
+					if (updated == 0)
+						continue;
+
+					// running averages, weights widened to float and back
+					__m128i weight16 = _mm_loadl_epi64((const __m128i*)(a_block.weight + i));
+					__m128 weight = _mm_cvtepi32_ps(_mm_unpacklo_epi16(weight16, _mm_setzero_si128()));
+					__m128 tsdf = _mm_loadu_ps(a_block.tsdf + i);
+					__m128 sample = _mm_min_ps(one, _mm_mul_ps(sdf, invTruncs));
+					__m128 blended = _mm_div_ps(_mm_add_ps(_mm_mul_ps(tsdf, weight), sample), _mm_add_ps(weight, one));
+					_mm_storeu_ps(a_block.tsdf + i, _mm_or_ps(_mm_and_ps(update, blended), _mm_andnot_ps(update, tsdf)));
+
+					__m128 capped = _mm_min_ps(_mm_add_ps(weight, one), maxWeight);
+					__m128 nextWeight = _mm_or_ps(_mm_and_ps(update, capped), _mm_andnot_ps(update, weight));
+					__m128i next = _mm_sub_epi32(_mm_cvttps_epi32(nextWeight), _mm_set1_epi32(32768));
+					_mm_storel_epi64((__m128i*)(a_block.weight + i), _mm_xor_si128(_mm_packs_epi32(next, next), _mm_set1_epi16(-32768)));
+
+					if (input.colour != nullptr)
+					{
+						alignas(16) float sdfs[4];
+						alignas(16) float weights[4];
+						alignas(16) int us[4];
+						alignas(16) int vs[4];
+						_mm_store_ps(sdfs, sdf);
+						_mm_store_ps(weights, weight);
+						_mm_store_si128((__m128i*)us, u);
+						_mm_store_si128((__m128i*)vs, v);
+						for (int lane = 0; lane < 4; ++lane)
+							if (((updated >> lane) & 1) && sdfs[lane] < trunc)
+								blendColour(a_block.rgb + (i + lane) * 3, input.colour + vs[lane] * input.colourStride + us[lane] * 3, (int)weights[lane]);
+					}
+				}
+#else
+				for (int x = 0; x < BlockSize; ++x, p += stepX)
+				{
+					if (p.z() <= 0)
+						continue;
+
+					float invZ = 1.0f / p.z();
+					int u = (int)(input.fx * p.x() * invZ + input.cx + 0.5f);
+					int v = (int)(input.fy * p.y() * invZ + input.cy + 0.5f);
+					if (u < 0 || u >= input.width ||
+						v < 0 || v >= input.height)
+						continue;
+
+					float d = input.depth[v * input.width + u] * input.depthUnits;
+					if (d <= 0 || d > m_settings.maxDepth)
+						continue;
+
+					float sdf = d - p.z();
+					if (sdf < -trunc)
+						continue;
+
+					int i = row + x;
+					float weight = a_block.weight[i];
+					a_block.tsdf[i] = (a_block.tsdf[i] * weight + std::min(1.0f, sdf * invTrunc)) / (weight + 1);
+
+					if (input.colour != nullptr &&
+						sdf < trunc)
+						blendColour(a_block.rgb + i * 3, input.colour + v * input.colourStride + u * 3, (int)weight);
+
+					a_block.weight[i] = std::min<uint16_t>(a_block.weight[i] + 1, m_settings.maxWeight);
+				}
+#endif
+			}
+		}
+	}
+}
+
+void TsdfVolume::integrate(const std::vector<DepthInput>& a_inputs)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	++m_tick;
+
+	// find the blocks each camera's surface falls in and the tiles that cull them, in parallel per camera
+	std::vector<std::vector<uint64_t>> keys(a_inputs.size());
+	std::vector<unsigned int> cameras(a_inputs.size());
+	std::iota(cameras.begin(), cameras.end(), 0);
+
+	m_tiles.resize(a_inputs.size());
+	forEach(m_settings.parallel, cameras.begin(), cameras.end(), [&](unsigned int camera) {
+		if (a_inputs[camera].depth == nullptr)
+			return;
+		allocate(a_inputs[camera], keys[camera]);
+		buildTiles(a_inputs[camera], m_tiles[camera]);
+	});
+
+	// merge into the block hash; this is the only serial part
+	m_active.clear();
+	for (auto& cameraKeys : keys)
+	{
+		for (auto key : cameraKeys)
+		{
+			auto [index, inserted] = m_blockIndex.insert(key, (uint32_t)m_blocks.size());
+			if (inserted)
+			{
+				m_blocks.push_back(std::make_unique<Block>());
+				m_blocks.back()->coord = unpackVoxelKey(key);
+			}
+
+			auto& block = *m_blocks[*index];
+			if (block.updated != m_tick)
+			{
+				block.updated = m_tick;
+				m_active.push_back(*index);
+			}
+		}
+	}
+
+	std::vector<Eigen::Matrix4f> captureToCamera(a_inputs.size());
+	for (size_t i = 0; i < a_inputs.size(); ++i)
+		captureToCamera[i] = a_inputs[i].cameraToCapture.inverse();
+
+	forEach(m_settings.parallel, m_active.begin(), m_active.end(), [&](uint32_t index) {
+		integrateBlock(*m_blocks[index], a_inputs, captureToCamera);
+	});
+
+	m_lastIntegrateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
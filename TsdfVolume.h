@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "FlatHashMap.h"
+
+// Truncated signed distance volume stored as a sparse hash of 8x8x8 voxel blocks.
+// Each capture tick integrates the depth frames of every camera: blocks near the observed
+// surfaces are allocated from the depth pixels, then every touched block is updated against
+// all cameras in parallel, one task per block so no two threads write the same voxels.
+// A camera only visits a block's voxels if the block projects into its image and some of
+// it is in front of the surface there plus the truncation distance, judged from the corners
+// against a coarse map of the deepest pixel per tile; the rest are skipped a block at a time.
+class TsdfVolume
+{
+public:
+
+	static constexpr int	BlockSize = 8;
+	static constexpr int	BlockVoxels = BlockSize * BlockSize * BlockSize;
+
+	// voxels as separate arrays, indexed (z * BlockSize + y) * BlockSize + x, so a row of them
+	// is integrated a vector at a time
+	struct Block
+	{
+		Eigen::Vector3i	coord;			// in blocks
+		uint64_t		updated = 0;	// tick this block was last integrated
+		float			tsdf[BlockVoxels];
+		uint16_t		weight[BlockVoxels] = {};
+		uint8_t			rgb[BlockVoxels * 3] = {};
+
+		Block()			{	std::fill(std::begin(tsdf), std::end(tsdf), 1.0f);	}
+	};
+
+	struct Settings
+	{
+		float			voxelSize = 0.005f;
+		float			truncation = 0.02f;	// meters either side of the surface
+		float			maxDepth = 4.0f;
+		uint16_t		maxWeight = 64;		// caps the running average so the volume can still change
+		int				allocationStride = 4;	// pixels skipped when allocating blocks
+		bool			parallel = true;		// cameras and blocks across threads, off to measure a single core
+	};
+
+	// one camera's depth for this tick, with camera axes as librealsense deprojects them
+	struct DepthInput
+	{
+		const uint16_t*	depth = nullptr;
+		int				width = 0;
+		int				height = 0;
+		float			depthUnits = 0.001f;
+		float			fx = 0, fy = 0, cx = 0, cy = 0;
+
+		Eigen::Matrix4f	cameraToCapture = Eigen::Matrix4f::Identity();
+
+		const uint8_t*	colour = nullptr;	// RGB8 registered to the depth image, optional
+		int				colourStride = 0;
+	};
+
+	TsdfVolume() = default;
+	~TsdfVolume() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+
+	// changing voxel size clears the volume
+	void			setSettings(const Settings& a_settings);
+
+	void			clear();
+
+	void			integrate(const std::vector<DepthInput>& a_inputs);
+
+	uint64_t		getTick() const			{	return m_tick;			}
+	uint64_t		getGeneration() const	{	return m_generation;	}	// bumped by clear()
+	size_t			getBlockCount() const	{	return m_blocks.size();	}
+	size_t			getActiveBlockCount() const	{	return m_active.size();	}
+	float			getLastIntegrateMs() const	{	return m_lastIntegrateMs;	}
+
+	const Block*	findBlock(const Eigen::Vector3i& a_coord) const;
+
+	// blocks integrated since the given tick
+	void			getBlocksUpdatedSince(uint64_t a_tick, std::vector<const Block*>& a_blocks) const;
+
+	const std::vector<std::unique_ptr<Block>>&	getBlocks() const	{	return m_blocks;	}
+
+private:
+
+	static constexpr int	TileSize = 8;		// pixels per side of a depth tile
+
+	// deepest valid raw depth of each tile of a camera's image, 0 where there is none
+	struct DepthTiles
+	{
+		int						width = 0;
+		int						height = 0;
+		std::vector<uint16_t>	maxDepth;
+	};
+
+	void			allocate(const DepthInput& a_input, std::vector<uint64_t>& a_keys) const;
+	void			buildTiles(const DepthInput& a_input, DepthTiles& a_tiles) const;
+	void			integrateBlock(Block& a_block, const std::vector<DepthInput>& a_inputs,
+								const std::vector<Eigen::Matrix4f>& a_captureToCamera) const;
+
+	Settings		m_settings;
+
+	std::vector<std::unique_ptr<Block>>	m_blocks;
+	FlatHashMap<uint32_t>				m_blockIndex;	// packed block coord -> index into m_blocks
+	std::vector<uint32_t>				m_active;		// blocks touched this tick
+	std::vector<DepthTiles>				m_tiles;		// per camera, this tick
+
+	uint64_t		m_tick = 0;
+	uint64_t		m_generation = 0;
+	float			m_lastIntegrateMs = 0;
+};
@@ -0,0 +1,185 @@
+#include "UnbufferedFile.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+UnbufferedFile::~UnbufferedFile()
+{
+	close();
+}
+
+bool UnbufferedFile::open(const std::string& a_filename, bool a_unbuffered)
+{
+	close();
+
+#ifdef _WIN32
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+	HANDLE file = CreateFileA(a_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+		flags | (a_unbuffered ? FILE_FLAG_NO_BUFFERING : 0), nullptr);
+	if (file == INVALID_HANDLE_VALUE && a_unbuffered)
+	{
+		a_unbuffered = false;
+		file = CreateFileA(a_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr);
+	}
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+	m_file = file;
+#else
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	int file = -1;
+#ifdef O_DIRECT
+	if (a_unbuffered)
+		file = ::open(a_filename.c_str(), flags | O_DIRECT, 0644);
+#endif
+	if (file < 0)
+	{
+		a_unbuffered = false;
+		file = ::open(a_filename.c_str(), flags, 0644);
+	}
+	if (file < 0)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+	m_file = file;
+#endif
+
+	m_open = true;
+	m_unbuffered = a_unbuffered;
+	m_size = 0;
+	return true;
+}
+
+bool UnbufferedFile::openExisting(const std::string& a_filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(a_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER end = {};
+	if (file != INVALID_HANDLE_VALUE && SetFilePointerEx(file, end, &end, FILE_END) == FALSE)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+	m_file = file;
+	m_size = (uint64_t)end.QuadPart;
+#else
+	int file = ::open(a_filename.c_str(), O_WRONLY);
+	off_t end = file >= 0 ? lseek(file, 0, SEEK_END) : -1;
+	if (file >= 0 && end < 0)
+	{
+		::close(file);
+		file = -1;
+	}
+	if (file < 0)
+	{
+		std::cout << "Error: Unable to open file " << a_filename << " for writing!" << std::endl;
+		return false;
+	}
+	m_file = file;
+	m_size = (uint64_t)end;
+#endif
+
+	m_open = true;
+	m_unbuffered = false;
+	return true;
+}
+
+void UnbufferedFile::close()
+{
+#ifdef _WIN32
+	if (m_file != nullptr)
+		CloseHandle(m_file);
+	m_file = nullptr;
+#else
+	if (m_file >= 0)
+		::close(m_file);
+	m_file = -1;
+#endif
+
+	m_open = false;
+}
+
+bool UnbufferedFile::write(const void* a_data, size_t a_size)
+{
+	if (!m_open)
+		return false;
+
+	auto bytes = static_cast<const char*>(a_data);
+	while (a_size > 0)
+	{
+#ifdef _WIN32
+		DWORD written = 0;
+		DWORD request = (DWORD)std::min<size_t>(a_size, 1u << 30);
+		if (WriteFile(m_file, bytes, request, &written, nullptr) == FALSE || written == 0)
+			return false;
+#else
+		ssize_t written = ::write(m_file, bytes, a_size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+#endif
+		bytes += written;
+		a_size -= (size_t)written;
+		m_size += (uint64_t)written;
+	}
+	return true;
+}
+
+bool UnbufferedFile::truncate(uint64_t a_size)
+{
+	if (!m_open)
+		return false;
+
+#ifdef _WIN32
+	FILE_END_OF_FILE_INFO end;
+	end.EndOfFile.QuadPart = (LONGLONG)a_size;
+	if (SetFileInformationByHandle(m_file, FileEndOfFileInfo, &end, sizeof(end)) == FALSE)
+		return false;
+#else
+	if (ftruncate(m_file, (off_t)a_size) != 0)
+		return false;
+#endif
+	m_size = a_size;
+	return true;
+}
+
+bool UnbufferedFile::sync()
+{
+	if (!m_open)
+		return false;
+
+#ifdef _WIN32
+	return FlushFileBuffers(m_file) != FALSE;
+#elif defined(__linux__)
+	// the size is all the metadata reading the file back needs
+	while (fdatasync(m_file) != 0)
+		if (errno != EINTR)
+			return false;
+	return true;
+#else
+	while (fsync(m_file) != 0)
+		if (errno != EINTR)
+			return false;
+	return true;
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Write-only file for large sequential writes. When opened unbuffered, writes bypass the OS
+// cache (FILE_FLAG_NO_BUFFERING / O_DIRECT), so a long recording neither evicts everything
+// else from memory nor stalls when the cache flushes; each write's address and size must
+// then be multiples of Alignment. Falls back to buffered writes where direct I/O isn't
+// supported (tmpfs and friends).
+class UnbufferedFile
+{
+public:
+
+	static constexpr size_t	Alignment = 4096;
+
+	UnbufferedFile() = default;
+	~UnbufferedFile();
+
+	UnbufferedFile(const UnbufferedFile&) = delete;
+	UnbufferedFile& operator=(const UnbufferedFile&) = delete;
+
+	// creates or truncates the file
+	bool			open(const std::string& a_filename, bool a_unbuffered);
+
+	// opens an existing file, buffered, to write on the end of what's there
+	bool			openExisting(const std::string& a_filename);
+	void			close();
+
+	// appends, returns false on any error
+	bool			write(const void* a_data, size_t a_size);
+
+	// cuts the file to a_size bytes, for dropping the padding an unbuffered write needed
+	bool			truncate(uint64_t a_size);
+
+	// blocks until everything written so far, and the file's size, is on the disk. Unbuffered
+	// writes skip the cache but not the drive's, nor the metadata, so they need this too.
+	bool			sync();
+
+	bool			isOpen() const			{	return m_open;			}
+	bool			isUnbuffered() const	{	return m_unbuffered;	}
+	uint64_t		getSize() const			{	return m_size;			}
+
+	static size_t	alignUp(size_t a_size)	{	return (a_size + Alignment - 1) & ~(Alignment - 1);	}
+
+private:
+
+	bool				m_open = false;
+	bool				m_unbuffered = false;
+	uint64_t			m_size = 0;
+
+#ifdef _WIN32
+	void*				m_file = nullptr;
+#else
+	int					m_file = -1;
+#endif
+};
@@ -0,0 +1,736 @@
+#include "VolumetricCodec.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <numeric>
+
+using namespace VolumetricFormat;
+
+namespace
+{
+	// rANS with 16 bit renormalisation, as DepthCodec; states stay below 2^31 so the encoder's reciprocals are exact
+	constexpr uint32_t	ProbBits = 12;
+	constexpr uint32_t	ProbScale = 1 << ProbBits;
+	constexpr uint32_t	StateLow = 1 << 15;
+	constexpr int		Lanes = 4;
+	constexpr size_t	WordSlack = 8;				// zeroed words past a slice, a corrupt slice stops inside them
+
+	constexpr size_t	BlockPoints = 1 << 16;		// points per parallel block while quantizing
+	constexpr int		MaxTopLevels = 4;			// levels the points are bucketed by before slicing
+	constexpr int		DigitBits = 11;				// radix sort digit
+	constexpr int		GreenContext = 8;
+
+	// the decoder keeps a node as its x, y and z side by side rather than as a Morton code, so
+	// a child is its parent shifted up a bit per axis plus one of these
+	constexpr int		CoordinateBits = 21;
+	constexpr uint64_t	CoordinateMask = (1u << CoordinateBits) - 1;
+	constexpr uint64_t	ChildOffsets[8] = {
+		0, 1, 1ull << CoordinateBits, 1 | 1ull << CoordinateBits,
+		1ull << CoordinateBits * 2, 1 | 1ull << CoordinateBits * 2,
+		1ull << CoordinateBits | 1ull << CoordinateBits * 2, 1 | 1ull << CoordinateBits | 1ull << CoordinateBits * 2 };
+
+	struct Lookup
+	{
+		uint32_t	spread[256];			// a byte's bits to every third bit
+		uint8_t		childCount[256];		// occupancy byte -> children
+		uint8_t		children[256][8];		// and which they are, in Morton order
+
+		constexpr Lookup() : spread(), childCount(), children()
+		{
+			for (int value = 0; value < 256; ++value)
+			{
+				for (int bit = 0; bit < 8; ++bit)
+				{
+					if ((value >> bit) & 1)
+					{
+						spread[value] |= 1u << (bit * 3);
+						children[value][childCount[value]++] = uint8_t(bit);
+					}
+				}
+			}
+		}
+	};
+	constexpr Lookup Tables;
+
+	// spreads the low 21 bits of a_value to every third bit
+	inline uint64_t spreadBits(uint32_t a_value)
+	{
+		return Tables.spread[a_value & 0xFF] | uint64_t(Tables.spread[(a_value >> 8) & 0xFF]) << 24 |
+			uint64_t(Tables.spread[(a_value >> 16) & 0x1F]) << 48;
+	}
+
+	// one rANS step of a lane, the state moves to the next symbol and refills from a_in when low
+	inline uint8_t decodeSymbol(const uint32_t* a_table, const uint16_t*& a_in, uint32_t& a_state)
+	{
+		uint32_t entry = a_table[a_state & (ProbScale - 1)];
+		a_state = ((entry >> 8) & (ProbScale - 1)) * (a_state >> ProbBits) + (entry >> 20);
+		uint32_t renormalise = a_state < StateLow;
+		a_state = (a_state << (renormalise * 16)) | (*a_in & (0u - renormalise));
+		a_in += renormalise;
+		return (uint8_t)entry;
+	}
+
+	template<class Function>
+	void forEach(bool a_parallel, size_t a_count, Function a_function)
+	{
+		std::vector<size_t> items(a_count);
+		std::iota(items.begin(), items.end(), 0);
+		if (a_parallel)
+			std::for_each(std::execution::par, items.begin(), items.end(), a_function);
+		else
+			std::for_each(items.begin(), items.end(), a_function);
+	}
+
+	// scales counts to sum to ProbScale, every symbol that occurs keeps at least 1; all zero if none occur
+	void normalize(const uint32_t* a_counts, uint16_t* a_frequencies)
+	{
+		uint64_t total = 0;
+		int used = 0;
+		for (int s = 0; s < 256; ++s)
+		{
+			total += a_counts[s];
+			used += a_counts[s] > 0;
+		}
+
+		std::fill(a_frequencies, a_frequencies + 256, uint16_t(0));
+		if (total == 0)
+			return;
+
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; ++s)
+		{
+			a_frequencies[s] = a_counts[s] ? (uint16_t)std::max<uint64_t>(1, a_counts[s] * ProbScale / total) : 0;
+			sum += a_frequencies[s];
+		}
+
+		// a symbol can't have the whole range, the encoder's bounds need freq < ProbScale
+		if (used < 2)
+		{
+			int only = int(std::max_element(a_frequencies, a_frequencies + 256) - a_frequencies);
+			a_frequencies[only] = ProbScale - 1;
+			a_frequencies[only == 0 ? 1 : 0] = 1;
+			return;
+		}
+
+		// rounding error goes to or comes from the most frequent symbols
+		while (sum != ProbScale)
+		{
+			int largest = int(std::max_element(a_frequencies, a_frequencies + 256) - a_frequencies);
+			if (sum < ProbScale)
+			{
+				a_frequencies[largest] += uint16_t(ProbScale - sum);
+				sum = ProbScale;
+			}
+			else
+			{
+				uint32_t take = std::min<uint32_t>(sum - ProbScale, a_frequencies[largest] - 1u);
+				a_frequencies[largest] -= uint16_t(take);
+				sum -= take;
+			}
+		}
+	}
+
+	// a table as a byte per frequency below 128, two above, and a zero byte plus count for a run of unused symbols
+	void writeTable(const uint16_t* a_frequencies, std::vector<uint8_t>& a_out)
+	{
+		for (int s = 0; s < 256; )
+		{
+			uint16_t frequency = a_frequencies[s];
+			if (frequency == 0)
+			{
+				int run = 1;
+				while (s + run < 256 && a_frequencies[s + run] == 0)
+					++run;
+				a_out.push_back(0);
+				a_out.push_back(uint8_t(run - 1));
+				s += run;
+				continue;
+			}
+			if (frequency < 0x80)
+				a_out.push_back((uint8_t)frequency);
+			else
+			{
+				a_out.push_back(uint8_t(0x80 | (frequency & 0x7F)));
+				a_out.push_back(uint8_t(frequency >> 7));
+			}
+			++s;
+		}
+	}
+
+	bool readTable(const uint8_t*& a_in, const uint8_t* a_end, uint16_t* a_frequencies)
+	{
+		for (int s = 0; s < 256; )
+		{
+			if (a_in >= a_end)
+				return false;
+			uint8_t byte = *a_in++;
+			if (byte == 0)
+			{
+				if (a_in >= a_end)
+					return false;
+				int run = *a_in++ + 1;
+				if (s + run > 256)
+					return false;
+				std::fill(a_frequencies + s, a_frequencies + s + run, uint16_t(0));
+				s += run;
+			}
+			else if (byte < 0x80)
+				a_frequencies[s++] = byte;
+			else
+			{
+				if (a_in >= a_end)
+					return false;
+				a_frequencies[s++] = uint16_t((byte & 0x7F) | *a_in++ << 7);
+			}
+		}
+		return true;
+	}
+}
+
+void VolumetricCodec::encode(const FusedPointCloud& a_cloud, double a_timestamp, std::vector<uint8_t>& a_out)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	FrameHeader header;
+	header.frameNumber = a_cloud.frame;
+	header.timestamp = a_timestamp;
+	header.colourBits = (uint16_t)std::clamp(m_settings.colourBits, 1, 8);
+
+	size_t count = a_cloud.count;
+	size_t blocks = (count + BlockPoints - 1) / BlockPoints;
+
+	// bounds, then the coarsest grid that holds them at the voxel size
+	std::vector<float> blockBounds(blocks * 6);
+	forEach(m_settings.parallel, blocks, [&](size_t a_block) {
+		size_t begin = a_block * BlockPoints;
+		size_t end = std::min(count, begin + BlockPoints);
+		const float* coordinates[3] = { a_cloud.x.data(), a_cloud.y.data(), a_cloud.z.data() };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			auto [low, high] = std::minmax_element(coordinates[axis] + begin, coordinates[axis] + end);
+			blockBounds[a_block * 6 + axis] = *low;
+			blockBounds[a_block * 6 + 3 + axis] = *high;
+		}
+	});
+
+	float low[3] = { INFINITY, INFINITY, INFINITY };
+	float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (size_t block = 0; block < blocks; ++block)
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			low[axis] = std::min(low[axis], blockBounds[block * 6 + axis]);
+			high[axis] = std::max(high[axis], blockBounds[block * 6 + 3 + axis]);
+		}
+
+	// the grid is snapped to whole voxels, so what doesn't move quantizes the same every frame
+	float voxelSize = std::max(m_settings.voxelSize, 1e-4f);
+	int levels = 1;
+	if (count > 0)
+	{
+		for (;;)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+				low[axis] = std::floor(low[axis] / voxelSize) * voxelSize;
+			float extent = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2] });
+			if (extent / voxelSize < float(1 << MaxLevels) - 1)
+			{
+				while (extent / voxelSize >= float(1 << levels) - 1)
+					++levels;
+				break;
+			}
+			voxelSize *= 2;
+		}
+	}
+	header.voxelSize = voxelSize;
+	header.levels = (uint16_t)levels;
+	for (int axis = 0; axis < 3; ++axis)
+		header.origin[axis] = count > 0 ? low[axis] : 0;
+
+	// each point's Morton code and colour, bucketed by the top levels of the octree
+	int topLevels = std::min(levels, MaxTopLevels);
+	int bucketShift = 3 * (levels - topLevels);
+	size_t buckets = size_t(1) << (3 * topLevels);
+	std::vector<uint32_t> bucketCounts(blocks * buckets, 0);
+
+	m_records.resize(count);
+	m_sorted.resize(count);
+	forEach(m_settings.parallel, blocks, [&](size_t a_block) {
+		size_t begin = a_block * BlockPoints;
+		size_t end = std::min(count, begin + BlockPoints);
+		uint32_t* counts = bucketCounts.data() + a_block * buckets;
+		float scale = 1.0f / voxelSize;
+		int maxVoxel = (1 << levels) - 1;
+		for (size_t i = begin; i < end; ++i)
+		{
+			int x = std::clamp(int((a_cloud.x[i] - low[0]) * scale), 0, maxVoxel);
+			int y = std::clamp(int((a_cloud.y[i] - low[1]) * scale), 0, maxVoxel);
+			int z = std::clamp(int((a_cloud.z[i] - low[2]) * scale), 0, maxVoxel);
+			uint64_t morton = spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+			m_records[i] = morton << 24 | uint64_t(a_cloud.r[i]) << 16 | uint64_t(a_cloud.g[i]) << 8 | a_cloud.b[i];
+			++counts[morton >> bucketShift];
+		}
+	});
+
+	// stable scatter into bucket order, each block into its own run of every bucket
+	std::vector<size_t> bucketStart(buckets + 1, 0);
+	std::vector<size_t> offsets(blocks * buckets);
+	size_t running = 0;
+	for (size_t bucket = 0; bucket < buckets; ++bucket)
+	{
+		bucketStart[bucket] = running;
+		for (size_t block = 0; block < blocks; ++block)
+		{
+			offsets[block * buckets + bucket] = running;
+			running += bucketCounts[block * buckets + bucket];
+		}
+	}
+	bucketStart[buckets] = running;
+
+	forEach(m_settings.parallel, blocks, [&](size_t a_block) {
+		size_t begin = a_block * BlockPoints;
+		size_t end = std::min(count, begin + BlockPoints);
+		size_t* blockOffsets = offsets.data() + a_block * buckets;
+		for (size_t i = begin; i < end; ++i)
+			m_sorted[blockOffsets[(m_records[i] >> 24) >> bucketShift]++] = m_records[i];
+	});
+
+	// whole buckets to a slice, so a voxel never straddles two
+	size_t sliceCount = 0;
+	for (size_t bucket = 0; bucket < buckets; )
+	{
+		size_t first = bucket;
+		while (bucket < buckets && bucketStart[bucket] - bucketStart[first] < std::max<size_t>(m_settings.slicePoints, 1))
+			++bucket;
+		if (bucketStart[bucket] == bucketStart[first])
+			continue;
+		if (m_slices.size() <= sliceCount)
+			m_slices.resize(sliceCount + 1);
+		m_slices[sliceCount].begin = bucketStart[first];
+		m_slices[sliceCount].end = bucketStart[bucket];
+		++sliceCount;
+	}
+
+	forEach(m_settings.parallel, sliceCount, [&](size_t a_slice) {
+		modelSlice(m_slices[a_slice], levels, topLevels);
+	});
+
+	// one table per context for the frame
+	uint16_t frequencies[Contexts][256];
+	std::vector<uint8_t> tables;
+	for (int context = 0; context < Contexts; ++context)
+	{
+		uint32_t counts[256] = {};
+		for (size_t slice = 0; slice < sliceCount; ++slice)
+			for (int s = 0; s < 256; ++s)
+				counts[s] += m_slices[slice].histogram[context][s];
+		normalize(counts, frequencies[context]);
+		writeTable(frequencies[context], tables);
+
+		// reciprocal form of each symbol, so the coder divides by multiplying
+		uint32_t cumulative = 0;
+		for (int s = 0; s < 256; ++s)
+		{
+			EncodeSymbol& symbol = m_encodeSymbols[context][s];
+			uint32_t frequency = frequencies[context][s];
+			symbol.maxState = ((StateLow >> ProbBits) << 16) * frequency;
+			symbol.complement = uint16_t(ProbScale - frequency);
+			if (frequency < 2)
+			{
+				symbol.reciprocal = ~0u;
+				symbol.shift = 0;
+				symbol.bias = cumulative + ProbScale - 1;
+			}
+			else
+			{
+				uint32_t shift = 0;
+				while (frequency > (1u << shift))
+					++shift;
+				symbol.reciprocal = uint32_t(((1ull << (shift + 31)) + frequency - 1) / frequency);
+				symbol.shift = uint16_t(shift - 1);
+				symbol.bias = cumulative;
+			}
+			cumulative += frequency;
+		}
+	}
+
+	forEach(m_settings.parallel, sliceCount, [&](size_t a_slice) {
+		codeSlice(m_slices[a_slice]);
+	});
+
+	// header, tables, slice headers, words, padding
+	size_t size = sizeof(FrameHeader) + tables.size() + sliceCount * sizeof(SliceHeader);
+	for (size_t slice = 0; slice < sliceCount; ++slice)
+	{
+		size += (m_slices[slice].words.size() - m_slices[slice].firstWord) * sizeof(uint16_t);
+		header.pointCount += m_slices[slice].pointCount;
+	}
+	header.sliceCount = (uint32_t)sliceCount;
+	header.tableSize = (uint32_t)tables.size();
+	header.size = (uint32_t)alignUp(size, FrameAlignment);
+
+	size_t frameStart = a_out.size();
+	a_out.resize(frameStart + header.size, 0);
+	uint8_t* out = a_out.data() + frameStart;
+	memcpy(out, &header, sizeof(FrameHeader));
+	out += sizeof(FrameHeader);
+	memcpy(out, tables.data(), tables.size());
+	out += tables.size();
+	for (size_t slice = 0; slice < sliceCount; ++slice)
+	{
+		const Slice& s = m_slices[slice];
+		SliceHeader sliceHeader;
+		sliceHeader.pointCount = s.pointCount;
+		sliceHeader.symbolCount = (uint32_t)s.symbols.size();
+		sliceHeader.wordCount = uint32_t(s.words.size() - s.firstWord);
+		memcpy(out, &sliceHeader, sizeof(SliceHeader));
+		out += sizeof(SliceHeader);
+	}
+	for (size_t slice = 0; slice < sliceCount; ++slice)
+	{
+		const Slice& s = m_slices[slice];
+		size_t bytes = (s.words.size() - s.firstWord) * sizeof(uint16_t);
+		memcpy(out, s.words.data() + s.firstWord, bytes);
+		out += bytes;
+	}
+
+	m_lastEncodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void VolumetricCodec::modelSlice(Slice& a_slice, int a_levels, int a_topLevels)
+{
+	// the slice is in order by its top level buckets, radix sort by the Morton bits below them and
+	// the bucket bits that differ across the slice
+	size_t count = a_slice.end - a_slice.begin;
+	uint64_t* data = m_sorted.data() + a_slice.begin;
+	uint64_t* temp = m_records.data() + a_slice.begin;
+	int lowBits = std::max(3 * (a_levels - a_topLevels), (int)std::bit_width((data[0] ^ data[count - 1]) >> 24));
+	for (int shift = 0; shift < lowBits; shift += DigitBits)
+	{
+		uint32_t digits[1 << DigitBits] = {};
+		uint64_t mask = (1ull << std::min(DigitBits, lowBits - shift)) - 1;
+		for (size_t i = 0; i < count; ++i)
+			++digits[(data[i] >> (24 + shift)) & mask];
+		uint32_t sum = 0;
+		for (uint32_t& digit : digits)
+		{
+			uint32_t n = digit;
+			digit = sum;
+			sum += n;
+		}
+		for (size_t i = 0; i < count; ++i)
+			temp[digits[(data[i] >> (24 + shift)) & mask]++] = data[i];
+		std::swap(data, temp);
+	}
+
+	// one record per voxel into temp, its colour averaged and quantized
+	int colourShift = 8 - std::clamp(m_settings.colourBits, 1, 8);
+	size_t voxels = 0;
+	for (size_t i = 0; i < count; )
+	{
+		uint64_t key = data[i] >> 24;
+		uint32_t r = 0, g = 0, b = 0;
+		size_t j = i;
+		for (; j < count && data[j] >> 24 == key; ++j)
+		{
+			r += (data[j] >> 16) & 0xFF;
+			g += (data[j] >> 8) & 0xFF;
+			b += data[j] & 0xFF;
+		}
+		uint32_t n = uint32_t(j - i);
+		r = ((r + n / 2) / n) >> colourShift;
+		g = ((g + n / 2) / n) >> colourShift;
+		b = ((b + n / 2) / n) >> colourShift;
+		temp[voxels++] = key << 24 | r << 16 | g << 8 | b;
+		i = j;
+	}
+	a_slice.pointCount = (uint32_t)voxels;
+
+	// occupancy of every octree node, built bottom up by collapsing codes to their parents in
+	// place; the sorted records aren't needed any more and hold the codes
+	a_slice.occupancy.resize(a_levels);
+	uint64_t* nodes = data;
+	for (size_t i = 0; i < voxels; ++i)
+		nodes[i] = temp[i] >> 24;
+	size_t nodeCount = voxels;
+	size_t occupancyCount = 0;
+	for (int level = a_levels - 1; level >= 0; --level)
+	{
+		auto& bytes = a_slice.occupancy[level];
+		bytes.resize(nodeCount);
+		size_t parents = 0;
+		for (size_t i = 0; i < nodeCount; ++i)
+		{
+			uint64_t node = nodes[i];
+			uint64_t parent = node >> 3;
+			uint8_t bit = uint8_t(1 << (node & 7));
+			if (parents > 0 && nodes[parents - 1] == parent)
+				bytes[parents - 1] |= bit;
+			else
+			{
+				nodes[parents] = parent;
+				bytes[parents++] = bit;
+			}
+		}
+		bytes.resize(parents);
+		nodeCount = parents;
+		occupancyCount += parents;
+	}
+
+	size_t symbolCount = occupancyCount + voxels * 3;
+	a_slice.symbols.resize(symbolCount);
+	a_slice.contexts.resize(symbolCount);
+	uint8_t* symbols = a_slice.symbols.data();
+	uint8_t* contexts = a_slice.contexts.data();
+	auto histogram = a_slice.histogram;
+	memset(histogram, 0, sizeof(a_slice.histogram));
+
+	// breadth first, each node in the context of how many siblings it has
+	size_t symbol = 0;
+	symbols[symbol] = a_slice.occupancy[0][0];
+	contexts[symbol++] = 0;
+	++histogram[0][a_slice.occupancy[0][0]];
+	for (int level = 1; level < a_levels; ++level)
+	{
+		const uint8_t* child = a_slice.occupancy[level].data();
+		for (uint8_t parent : a_slice.occupancy[level - 1])
+		{
+			int siblings = std::popcount(parent);
+			for (int k = 0; k < siblings; ++k, ++symbol)
+			{
+				symbols[symbol] = *child++;
+				contexts[symbol] = uint8_t(siblings - 1);
+				++histogram[siblings - 1][symbols[symbol]];
+			}
+		}
+	}
+
+	// colours against the previous voxel's, red and blue relative to green's change
+	uint32_t previous = 0;
+	for (size_t i = 0; i < voxels; ++i, symbol += 3)
+	{
+		uint32_t colour = uint32_t(temp[i] & 0xFFFFFF);
+		int dg = int((colour >> 8) & 0xFF) - int((previous >> 8) & 0xFF);
+		int dr = int(colour >> 16) - int(previous >> 16);
+		int db = int(colour & 0xFF) - int(previous & 0xFF);
+		symbols[symbol] = uint8_t(dg);
+		symbols[symbol + 1] = uint8_t(dr - dg);
+		symbols[symbol + 2] = uint8_t(db - dg);
+		contexts[symbol] = GreenContext;
+		contexts[symbol + 1] = GreenContext + 1;
+		contexts[symbol + 2] = GreenContext + 2;
+		++histogram[GreenContext][symbols[symbol]];
+		++histogram[GreenContext + 1][symbols[symbol + 1]];
+		++histogram[GreenContext + 2][symbols[symbol + 2]];
+		previous = colour;
+	}
+}
+
+void VolumetricCodec::codeSlice(Slice& a_slice) const
+{
+	size_t symbolCount = a_slice.symbols.size();
+	a_slice.words.resize(symbolCount + Lanes * 2 + 2);
+	uint16_t* end = a_slice.words.data() + a_slice.words.size();
+	uint16_t* out = end;
+
+	// the decoder's renormalisation may read a word past the slice
+	*--out = 0;
+	*--out = 0;
+
+	uint32_t states[Lanes];
+	std::fill(states, states + Lanes, StateLow);
+	const uint8_t* symbols = a_slice.symbols.data();
+	const uint8_t* contexts = a_slice.contexts.data();
+	for (size_t i = symbolCount; i-- > 0; )
+	{
+		const EncodeSymbol& symbol = m_encodeSymbols[contexts[i]][symbols[i]];
+		uint32_t& state = states[i & (Lanes - 1)];
+		if (state >= symbol.maxState)
+		{
+			*--out = (uint16_t)state;
+			state >>= 16;
+		}
+		uint32_t quotient = uint32_t((uint64_t(state) * symbol.reciprocal) >> 32) >> symbol.shift;
+		state += symbol.bias + quotient * symbol.complement;
+	}
+
+	for (int lane = Lanes - 1; lane >= 0; --lane)
+	{
+		*--out = uint16_t(states[lane] >> 16);
+		*--out = (uint16_t)states[lane];
+	}
+	a_slice.firstWord = size_t(out - a_slice.words.data());
+}
+
+bool VolumetricCodec::decode(const uint8_t* a_in, size_t a_size, FusedPointCloud& a_out, DecodeStats* a_stats) const
+{
+	auto start = std::chrono::steady_clock::now();
+	if (a_stats)
+		*a_stats = DecodeStats();
+
+	FrameHeader header;
+	if (a_size < sizeof(FrameHeader))
+		return false;
+	memcpy(&header, a_in, sizeof(FrameHeader));
+	if (header.magic != FrameMagic ||
+		header.size > a_size ||
+		header.levels < 1 || header.levels > MaxLevels ||
+		header.colourBits < 1 || header.colourBits > 8 ||
+		sizeof(FrameHeader) + (size_t)header.tableSize + (size_t)header.sliceCount * sizeof(SliceHeader) > header.size)
+		return false;
+
+	a_out.resize(header.pointCount, 1);
+	a_out.frame = header.frameNumber;
+	a_out.cameraCount[0] = header.pointCount;
+	if (header.pointCount == 0)
+		return true;
+
+	// slot -> symbol | frequency << 8 | (slot - cumulative) << 20, per context
+	std::vector<uint32_t> tables((size_t)Contexts * ProbScale, 0);
+	const uint8_t* read = a_in + sizeof(FrameHeader);
+	const uint8_t* tablesEnd = read + header.tableSize;
+	for (int context = 0; context < Contexts; ++context)
+	{
+		uint16_t frequencies[256];
+		if (!readTable(read, tablesEnd, frequencies))
+			return false;
+
+		uint32_t* table = tables.data() + (size_t)context * ProbScale;
+		uint32_t cumulative = 0;
+		for (uint32_t s = 0; s < 256; ++s)
+		{
+			uint32_t frequency = frequencies[s];
+			if (cumulative + frequency > ProbScale)
+				return false;
+			for (uint32_t slot = 0; slot < frequency; ++slot)
+				table[cumulative + slot] = s | (frequency << 8) | (slot << 20);
+			cumulative += frequency;
+		}
+		if (cumulative != 0 && cumulative != ProbScale)
+			return false;
+	}
+
+	std::vector<SliceHeader> slices(header.sliceCount);
+	memcpy(slices.data(), tablesEnd, slices.size() * sizeof(SliceHeader));
+	std::vector<size_t> wordOffsets(slices.size());
+	std::vector<size_t> pointOffsets(slices.size());
+	size_t offset = sizeof(FrameHeader) + header.tableSize + slices.size() * sizeof(SliceHeader);
+	size_t points = 0;
+	for (size_t slice = 0; slice < slices.size(); ++slice)
+	{
+		wordOffsets[slice] = offset;
+		pointOffsets[slice] = points;
+		if (slices[slice].wordCount < Lanes * 2)
+			return false;
+		offset += (size_t)slices[slice].wordCount * sizeof(uint16_t);
+		points += slices[slice].pointCount;
+	}
+	if (offset > header.size || points != header.pointCount)
+		return false;
+
+	int levels = header.levels;
+	int colourBits = header.colourBits;
+	uint32_t colourMask = (1u << colourBits) - 1;
+	uint8_t dequantize[256] = {};
+	for (uint32_t q = 0; q <= colourMask; ++q)
+		dequantize[q] = uint8_t((q * 255 + colourMask / 2) / colourMask);
+
+	std::fill(a_out.camera.begin(), a_out.camera.begin() + header.pointCount, uint8_t(0));
+
+	std::vector<char> ok(slices.size(), 0);
+	std::vector<float> sliceMs(slices.size(), 0);
+	forEach(m_settings.parallel, slices.size(), [&](size_t a_slice) {
+		auto sliceStart = std::chrono::steady_clock::now();
+		const SliceHeader& slice = slices[a_slice];
+
+		std::vector<uint16_t> words(slice.wordCount + WordSlack, 0);
+		memcpy(words.data(), a_in + wordOffsets[a_slice], (size_t)slice.wordCount * sizeof(uint16_t));
+		const uint16_t* in = words.data();
+		const uint16_t* end = words.data() + slice.wordCount;
+
+		uint32_t states[Lanes];
+		for (int lane = 0; lane < Lanes; ++lane)
+		{
+			states[lane] = in[0] | uint32_t(in[1]) << 16;
+			in += 2;
+		}
+		size_t symbol = 0;
+
+		// the octree a level at a time, a node's children in Morton order after it. No level
+		// has more nodes than the slice has points.
+		size_t capacity = slice.pointCount;
+		std::vector<uint64_t> nodes(capacity + 8), children(capacity + 8);
+		std::vector<uint8_t> siblings(capacity + 8), childSiblings(capacity + 8);
+		size_t nodeCount = 1;
+		nodes[0] = 0;
+		siblings[0] = 1;
+		for (int level = 0; level < levels; ++level)
+		{
+			size_t childCount = 0;
+			for (size_t i = 0; i < nodeCount; ++i)
+			{
+				const uint32_t* table = tables.data() + (size_t)(siblings[i] - 1) * ProbScale;
+				uint32_t occupancy = decodeSymbol(table, in, states[symbol++ & (Lanes - 1)]);
+				if (occupancy == 0 || in > end)
+					return;
+
+				// all 8 are written, the arrays have room past capacity, and the count kept
+				uint8_t count = Tables.childCount[occupancy];
+				if (childCount + count > capacity)
+					return;
+				uint64_t first = nodes[i] << 1;
+				const uint8_t* order = Tables.children[occupancy];
+				for (int k = 0; k < 8; ++k)
+				{
+					children[childCount + k] = first | ChildOffsets[order[k]];
+					childSiblings[childCount + k] = count;
+				}
+				childCount += count;
+			}
+			std::swap(nodes, children);
+			std::swap(siblings, childSiblings);
+			nodeCount = childCount;
+		}
+		if (nodeCount != slice.pointCount)
+			return;
+
+		const uint32_t* green = tables.data() + (size_t)GreenContext * ProbScale;
+		const uint32_t* red = green + ProbScale;
+		const uint32_t* blue = red + ProbScale;
+		size_t first = pointOffsets[a_slice];
+		float voxelSize = header.voxelSize;
+		uint32_t r = 0, g = 0, b = 0;
+		for (size_t i = 0; i < nodeCount; ++i)
+		{
+			uint32_t dg = decodeSymbol(green, in, states[symbol++ & (Lanes - 1)]);
+			uint32_t dr = decodeSymbol(red, in, states[symbol++ & (Lanes - 1)]);
+			uint32_t db = decodeSymbol(blue, in, states[symbol++ & (Lanes - 1)]);
+			if (in > end)
+				return;
+			g = (g + dg) & colourMask;
+			r = (r + dg + dr) & colourMask;
+			b = (b + dg + db) & colourMask;
+
+			uint64_t node = nodes[i];
+			size_t out = first + i;
+			a_out.x[out] = header.origin[0] + (float(node & CoordinateMask) + 0.5f) * voxelSize;
+			a_out.y[out] = header.origin[1] + (float((node >> CoordinateBits) & CoordinateMask) + 0.5f) * voxelSize;
+			a_out.z[out] = header.origin[2] + (float(node >> CoordinateBits * 2) + 0.5f) * voxelSize;
+			a_out.r[out] = dequantize[r];
+			a_out.g[out] = dequantize[g];
+			a_out.b[out] = dequantize[b];
+		}
+		ok[a_slice] = symbol == slice.symbolCount;
+		sliceMs[a_slice] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sliceStart).count();
+	});
+
+	if (a_stats)
+	{
+		a_stats->ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		a_stats->slowestSliceMs = *std::max_element(sliceMs.begin(), sliceMs.end());
+		a_stats->slices = (uint32_t)slices.size();
+	}
+	return std::all_of(ok.begin(), ok.end(), [](char a_ok) { return a_ok != 0; });
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PointCloudFusion.h"
+#include "VolumetricFormat.h"
+
+// Compression of one fused point cloud into a volumetric video frame (see VolumetricFormat.h).
+// Points are quantized to a voxel grid and sorted into Morton order, points sharing a voxel
+// are merged with their colours averaged. Positions are coded as the octree over the occupied
+// voxels, breadth first: one occupancy byte per node, predicted from how many siblings the
+// node has. Colours are quantized and coded as the difference to the previous voxel in Morton
+// order, which is usually a spatial neighbour, green first and red and blue relative to its
+// change. All symbols go through static 4-way interleaved rANS with one frequency table per
+// context per frame. The cloud is cut into slices of whole octree branches coded
+// independently, so both directions run the slices in parallel.
+// Not thread safe, keep one per encoding thread; decode() may be called concurrently.
+class VolumetricCodec
+{
+public:
+
+	struct Settings
+	{
+		float		voxelSize = 0.002f;		// m, doubled for a frame whose extent needs more than MaxLevels
+		int			colourBits = 6;			// per channel, 1..8
+		size_t		slicePoints = 1 << 17;	// points coded independently of the other slices
+		bool		parallel = true;		// slices across threads, off to measure a single core
+	};
+
+	// what a decode() cost, returned rather than kept since decode() may run on several threads
+	struct DecodeStats
+	{
+		float		ms = 0;
+		float		slowestSliceMs = 0;		// the least decode could take with a core per slice
+		uint32_t	slices = 0;
+	};
+
+	static constexpr int	MaxLevels = 13;		// Morton codes keep 24 bits free for the colour while sorting
+	static constexpr int	Contexts = 11;		// 8 occupancy by sibling count, then green, red, blue
+
+	VolumetricCodec() = default;
+	~VolumetricCodec() = default;
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}
+
+	// appends the frame for a_cloud, header included, to a_out. a_timestamp is ms into the recording.
+	void			encode(const FusedPointCloud& a_cloud, double a_timestamp, std::vector<uint8_t>& a_out);
+
+	// a_in holds a whole frame as encode() wrote it. a_out gets one point per voxel as camera 0.
+	// False if the frame is corrupt.
+	bool			decode(const uint8_t* a_in, size_t a_size, FusedPointCloud& a_out, DecodeStats* a_stats = nullptr) const;
+
+	float			getLastEncodeMs() const	{	return m_lastEncodeMs;	}
+
+private:
+
+	// a run of top level octree branches and everything it codes
+	struct Slice
+	{
+		size_t					begin = 0;		// into m_sorted
+		size_t					end = 0;
+		std::vector<std::vector<uint8_t>>	occupancy;	// per octree level
+		std::vector<uint8_t>	symbols;
+		std::vector<uint8_t>	contexts;
+		std::vector<uint16_t>	words;			// rANS output, written back to front
+		size_t					firstWord = 0;
+		uint32_t				pointCount = 0;
+		uint32_t				histogram[Contexts][256] = {};
+	};
+
+	void			modelSlice(Slice& a_slice, int a_levels, int a_topLevels);
+	void			codeSlice(Slice& a_slice) const;
+
+	Settings				m_settings;
+	std::vector<uint64_t>	m_records;			// Morton code << 24 | RGB per point
+	std::vector<uint64_t>	m_sorted;
+	std::vector<Slice>		m_slices;
+
+	// rANS encoder symbols, see codeSlice()
+	struct EncodeSymbol
+	{
+		uint32_t	maxState = 0;
+		uint32_t	reciprocal = 0;
+		uint32_t	bias = 0;
+		uint16_t	complement = 0;
+		uint16_t	shift = 0;
+	};
+	EncodeSymbol			m_encodeSymbols[Contexts][256];
+
+	float					m_lastEncodeMs = 0;
+};
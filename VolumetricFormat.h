@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of a volumetric video (.vvol), a sequence of fused point clouds.
+//
+//	FileHeader
+//	frame 0: FrameHeader, tables, SliceHeader[sliceCount], slice words...	padded to FrameAlignment
+//	frame 1: ...
+//	IndexEntry[entryCount]
+//	Footer
+//
+// Every frame is coded on its own, so each one is a keyframe and any frame decodes straight
+// from its index entry; see VolumetricCodec for what the tables and slices hold. The file is
+// only ever appended to and a frame's header carries its size, so the index can be rebuilt
+// by walking the frames when the footer is missing. Everything is little-endian.
+namespace VolumetricFormat
+{
+	constexpr uint32_t	FileMagic = 0x4C4F5656;		// 'VVOL'
+	constexpr uint32_t	FrameMagic = 0x4D524656;	// 'VFRM'
+	constexpr uint32_t	FooterMagic = 0x58444956;	// 'VIDX'
+	constexpr uint32_t	Version = 1;
+
+	constexpr size_t	FrameAlignment = 64;
+
+	constexpr size_t	alignUp(size_t a_size, size_t a_alignment)	{	return (a_size + a_alignment - 1) & ~(a_alignment - 1);	}
+
+	struct FileHeader
+	{
+		uint32_t	magic = FileMagic;
+		uint32_t	version = Version;
+		int64_t		startTime = 0;		// system clock, ns since the epoch
+		float		voxelSize = 0;		// m, as recorded; a frame may use a coarser one to fit
+		uint32_t	colourBits = 0;		// per channel, as recorded
+		uint32_t	reserved[10] = {};
+	};
+
+	struct FrameHeader
+	{
+		uint32_t	magic = FrameMagic;
+		uint32_t	size = 0;			// bytes including this header and padding, the next frame follows
+		uint64_t	frameNumber = 0;	// of the fused cloud
+		double		timestamp = 0;		// ms since the recording started
+		uint32_t	pointCount = 0;		// occupied voxels
+		uint32_t	sliceCount = 0;
+		float		voxelSize = 0;		// m
+		float		origin[3] = {};		// capture space position of voxel 0's corner
+		uint16_t	levels = 0;			// octree depth, voxels are 2^levels per axis
+		uint16_t	colourBits = 0;		// per channel
+		uint32_t	tableSize = 0;		// bytes of frequency tables after this header
+	};
+
+	// the words of each slice follow the slice headers, back to back, in slice order
+	struct SliceHeader
+	{
+		uint32_t	pointCount = 0;
+		uint32_t	symbolCount = 0;
+		uint32_t	wordCount = 0;		// 16 bit rANS words
+	};
+
+	struct IndexEntry
+	{
+		uint64_t	offset = 0;			// of the FrameHeader, from the start of the file
+		double		timestamp = 0;
+		uint32_t	size = 0;
+		uint32_t	pointCount = 0;
+	};
+
+	struct Footer
+	{
+		uint32_t	magic = FooterMagic;
+		uint32_t	version = Version;
+		uint64_t	indexOffset = 0;
+		uint64_t	entryCount = 0;
+		uint32_t	indexChecksum = 0;	// CRC-32 of the entries
+		uint32_t	reserved[9] = {};
+	};
+
+	static_assert(sizeof(FileHeader) == 64);
+	static_assert(sizeof(FrameHeader) == 56);
+	static_assert(sizeof(SliceHeader) == 12);
+	static_assert(sizeof(IndexEntry) == 24);
+	static_assert(sizeof(Footer) == 64);
+}
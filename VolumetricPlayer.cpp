@@ -0,0 +1,248 @@
+#include "VolumetricPlayer.h"
+#include "Crc32.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace VolumetricFormat;
+
+VolumetricPlayer::~VolumetricPlayer()
+{
+	close();
+}
+
+bool VolumetricPlayer::open(const std::string& a_filename)
+{
+	close();
+
+	if (!m_file.open(a_filename))
+	{
+		std::cout << "Error: Unable to open volumetric video " << a_filename << std::endl;
+		return false;
+	}
+
+	if (m_file.size() < sizeof(FileHeader))
+	{
+		std::cout << "Error: " << a_filename << " is not a volumetric video" << std::endl;
+		close();
+		return false;
+	}
+	memcpy(&m_header, m_file.data(), sizeof(FileHeader));
+	if (m_header.magic != FileMagic ||
+		m_header.version != Version)
+	{
+		std::cout << "Error: " << a_filename << " is not a volumetric video" << std::endl;
+		close();
+		return false;
+	}
+
+	if (!readIndex())
+	{
+		m_recovered = true;
+		m_index.clear();
+		if (!scanFrames())
+		{
+			std::cout << "Error: No frames in volumetric video " << a_filename << std::endl;
+			close();
+			return false;
+		}
+	}
+
+	// frames are written in the order they were captured, this only guards against a clock step
+	std::stable_sort(m_index.begin(), m_index.end(), [](const IndexEntry& a, const IndexEntry& b) {
+		return a.timestamp < b.timestamp;
+	});
+
+	m_filename = a_filename;
+	m_quit = false;
+	m_thread = std::thread(&VolumetricPlayer::run, this);
+	return true;
+}
+
+void VolumetricPlayer::close()
+{
+	if (m_thread.joinable())
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+	}
+
+	m_file.close();
+	m_filename.clear();
+	m_recovered = false;
+	m_header = {};
+	m_index.clear();
+	m_requested = NoFrame;
+	m_decoding = NoFrame;
+	m_decoded = NoFrame;
+	m_front = nullptr;
+	m_back = nullptr;
+}
+
+bool VolumetricPlayer::readIndex()
+{
+	const uint8_t* data = m_file.data();
+	size_t size = m_file.size();
+	if (size < sizeof(FileHeader) + sizeof(Footer))
+		return false;
+
+	Footer footer;
+	memcpy(&footer, data + size - sizeof(Footer), sizeof(Footer));
+	if (footer.magic != FooterMagic ||
+		footer.version != Version ||
+		footer.indexOffset < sizeof(FileHeader) ||
+		footer.indexOffset > size - sizeof(Footer) ||
+		footer.entryCount > (size - sizeof(Footer) - footer.indexOffset) / sizeof(IndexEntry))
+		return false;
+
+	const uint8_t* entries = data + footer.indexOffset;
+	size_t entriesSize = footer.entryCount * sizeof(IndexEntry);
+	if (Crc32::compute(entries, entriesSize) != footer.indexChecksum)
+	{
+		std::cout << "Error: Volumetric index checksum mismatch, rebuilding it" << std::endl;
+		return false;
+	}
+
+	m_index.resize(footer.entryCount);
+	memcpy(m_index.data(), entries, entriesSize);
+	for (auto& entry : m_index)
+		if (entry.offset + entry.size > footer.indexOffset)
+			return false;
+	return !m_index.empty();
+}
+
+bool VolumetricPlayer::scanFrames()
+{
+	const uint8_t* data = m_file.data();
+	size_t size = m_file.size();
+
+	// stops at the first frame that didn't make it to disk whole
+	size_t offset = sizeof(FileHeader);
+	while (offset + sizeof(FrameHeader) <= size)
+	{
+		FrameHeader frame;
+		memcpy(&frame, data + offset, sizeof(FrameHeader));
+		if (frame.magic != FrameMagic ||
+			frame.size < sizeof(FrameHeader) ||
+			frame.size > size - offset)
+			break;
+
+		IndexEntry entry;
+		entry.offset = offset;
+		entry.timestamp = frame.timestamp;
+		entry.size = frame.size;
+		entry.pointCount = frame.pointCount;
+		m_index.push_back(entry);
+		offset += frame.size;
+	}
+	return !m_index.empty();
+}
+
+double VolumetricPlayer::getDuration() const
+{
+	return m_index.empty() ? 0 : m_index.back().timestamp - m_index.front().timestamp;
+}
+
+size_t VolumetricPlayer::findFrame(double a_timestamp) const
+{
+	auto next = std::upper_bound(m_index.begin(), m_index.end(), a_timestamp, [](double t, const IndexEntry& e) {
+		return t < e.timestamp;
+	});
+	return next == m_index.begin() ? 0 : size_t(next - m_index.begin()) - 1;
+}
+
+bool VolumetricPlayer::decode(size_t a_index, FusedPointCloud& a_out) const
+{
+	if (a_index >= m_index.size())
+		return false;
+
+	auto& entry = m_index[a_index];
+	return m_codec.decode(m_file.data() + entry.offset, entry.size, a_out);
+}
+
+void VolumetricPlayer::request(size_t a_index)
+{
+	if (a_index >= m_index.size())
+		return;
+
+	{
+		std::lock_guard lock(m_mutex);
+		if (a_index == m_decoding || (m_decoding == NoFrame && a_index == m_decoded))
+		{
+			m_requested = NoFrame;
+			return;
+		}
+		m_requested = a_index;
+	}
+	m_wake.notify_one();
+}
+
+std::shared_ptr<const FusedPointCloud> VolumetricPlayer::acquire() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_front;
+}
+
+size_t VolumetricPlayer::getDecodedIndex() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_decoded;
+}
+
+float VolumetricPlayer::getLastDecodeMs() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_lastDecodeMs;
+}
+
+void VolumetricPlayer::run()
+{
+	for (;;)
+	{
+		size_t index;
+		std::shared_ptr<FusedPointCloud> cloud;
+		{
+			std::unique_lock lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_quit || m_requested != NoFrame; });
+			if (m_quit)
+				return;
+			index = m_requested;
+			m_requested = NoFrame;
+			m_decoding = index;
+
+			// the back buffer is reused unless a reader still holds it
+			if (m_back != nullptr && m_back.use_count() == 1)
+				cloud = m_back;
+			m_back = nullptr;
+		}
+		if (!cloud)
+			cloud = std::make_shared<FusedPointCloud>();
+
+		auto& entry = m_index[index];
+		VolumetricCodec::DecodeStats stats;
+		bool ok = m_codec.decode(m_file.data() + entry.offset, entry.size, *cloud, &stats);
+		if (!ok)
+			std::cout << "Error: Volumetric frame " << index << " is corrupt" << std::endl;
+
+		// a corrupt frame shows as empty, and isn't decoded again until another is requested
+		std::lock_guard lock(m_mutex);
+		m_decoding = NoFrame;
+		m_decoded = index;
+		m_lastDecodeMs = stats.ms;
+		if (ok)
+		{
+			m_back = std::move(m_front);
+			m_front = std::move(cloud);
+		}
+		else
+		{
+			m_back = std::move(cloud);
+			m_front = nullptr;
+		}
+	}
+}
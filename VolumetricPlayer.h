@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "PointCloudFusion.h"
+#include "VolumetricCodec.h"
+#include "VolumetricFormat.h"
+
+// Random access playback of a volumetric video (see VolumetricFormat.h). The file is memory
+// mapped and every frame is a keyframe, so seeking is a binary search of the index and one
+// frame's decode. When the footer is missing (a recording that never stopped cleanly) the
+// index is rebuilt by walking the frames.
+// request() hands a frame to a decode thread and acquire() returns the newest decoded one,
+// double buffered like PointCloudFusion, so rendering never waits on a decode; a request
+// made while one is decoding replaces any still waiting, so playback skips frames rather
+// than falling behind when decoding is slower than the frame rate.
+class VolumetricPlayer
+{
+public:
+
+	VolumetricPlayer() = default;
+	~VolumetricPlayer();
+
+	VolumetricPlayer(const VolumetricPlayer&) = delete;
+	VolumetricPlayer& operator=(const VolumetricPlayer&) = delete;
+
+	bool			open(const std::string& a_filename);
+	void			close();
+
+	bool			isOpen() const			{	return m_file.isOpen();	}
+	const std::string&	getFilename() const	{	return m_filename;		}
+	bool			wasRecovered() const	{	return m_recovered;		}	// index rebuilt from the frames
+	uint64_t		getFileSize() const		{	return m_file.size();	}
+
+	const VolumetricFormat::FileHeader&	getHeader() const	{	return m_header;	}
+
+	size_t			getFrameCount() const	{	return m_index.size();	}
+	double			getTimestamp(size_t a_index) const	{	return m_index[a_index].timestamp;	}	// ms into the recording
+	uint32_t		getPointCount(size_t a_index) const	{	return m_index[a_index].pointCount;	}
+	double			getDuration() const;	// ms, first to last frame
+
+	// the last frame at or before a_timestamp, or the first frame if there is none before it
+	size_t			findFrame(double a_timestamp) const;
+
+	// decodes a frame on the calling thread, false if it is corrupt
+	bool			decode(size_t a_index, FusedPointCloud& a_out) const;
+
+	// decodes a frame on the decode thread unless it is the one decoding or last decoded
+	void			request(size_t a_index);
+
+	// latest decoded frame, stays valid for as long as the caller holds it
+	std::shared_ptr<const FusedPointCloud>	acquire() const;
+	size_t			getDecodedIndex() const;
+
+	float			getLastDecodeMs() const;	// of the decode thread
+
+private:
+
+	static constexpr size_t	NoFrame = ~size_t(0);
+
+	bool			readIndex();
+	bool			scanFrames();
+	void			run();
+
+	MappedFile		m_file;
+	std::string		m_filename;
+	bool			m_recovered = false;
+	VolumetricFormat::FileHeader	m_header;
+	std::vector<VolumetricFormat::IndexEntry>	m_index;	// by timestamp
+	VolumetricCodec	m_codec;			// decode() is const, shared with the decode thread
+
+	// shared with the decode thread
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	size_t					m_requested = NoFrame;		// waiting to be decoded
+	size_t					m_decoding = NoFrame;
+	size_t					m_decoded = NoFrame;		// in m_front
+	std::shared_ptr<FusedPointCloud>	m_front;
+	std::shared_ptr<FusedPointCloud>	m_back;
+	float					m_lastDecodeMs = 0;
+};
@@ -0,0 +1,189 @@
+#include "VolumetricRecorder.h"
+#include "Crc32.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace VolumetricFormat;
+
+VolumetricRecorder::~VolumetricRecorder()
+{
+	stop();
+}
+
+bool VolumetricRecorder::start(const std::string& a_filename)
+{
+	stop();
+
+	m_active = m_settings;
+	m_active.backlog = std::max(m_active.backlog, 1u);
+
+	// frames vary in size, so this goes through the OS cache
+	if (!m_file.open(a_filename, false))
+		return false;
+
+	FileHeader header;
+	header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	header.voxelSize = m_active.codec.voxelSize;
+	header.colourBits = (uint32_t)m_active.codec.colourBits;
+	if (!m_file.write(&header, sizeof(FileHeader)))
+	{
+		std::cout << "Error: Unable to write volumetric header to " << a_filename << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	m_filename = a_filename;
+	m_codec.setSettings(m_active.codec);
+	m_index.clear();
+	m_queue.clear();
+	m_encoding = false;
+	m_failed = false;
+	m_quit = false;
+	m_lastFrame = ~0ull;
+	m_framesWritten = 0;
+	m_framesDropped = 0;
+	m_pointsWritten = 0;
+	m_bytesWritten = sizeof(FileHeader);
+	m_frameBytes = 0;
+	m_encodeNs = 0;
+	m_start = std::chrono::steady_clock::now();
+
+	m_thread = std::thread(&VolumetricRecorder::run, this);
+	m_recording = true;
+	return true;
+}
+
+void VolumetricRecorder::stop()
+{
+	if (!m_recording)
+		return;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	// without every frame on disk the offsets would be wrong, leave the index off
+	if (!m_failed && !writeIndex())
+		std::cout << "Error: Unable to write the volumetric index to " << m_filename << std::endl;
+
+	m_file.close();
+	m_recording = false;
+}
+
+bool VolumetricRecorder::add(std::shared_ptr<const FusedPointCloud> a_cloud)
+{
+	if (!m_recording || !a_cloud || a_cloud->frame == m_lastFrame)
+		return false;
+	m_lastFrame = a_cloud->frame;
+
+	Job job;
+	job.cloud = std::move(a_cloud);
+	job.timestamp = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_queue.size() >= m_active.backlog)
+		{
+			++m_framesDropped;
+			return false;
+		}
+		m_queue.push_back(std::move(job));
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+void VolumetricRecorder::run()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+			if (m_queue.empty())
+				return;
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_encoding = true;
+		}
+
+		if (!m_failed)
+		{
+			m_frame.clear();
+			m_codec.encode(*job.cloud, job.timestamp, m_frame);
+
+			FrameHeader header;
+			memcpy(&header, m_frame.data(), sizeof(FrameHeader));
+			IndexEntry entry;
+			entry.offset = m_file.getSize();
+			entry.timestamp = header.timestamp;
+			entry.size = header.size;
+			entry.pointCount = header.pointCount;
+
+			if (m_file.write(m_frame.data(), m_frame.size()))
+			{
+				m_index.push_back(entry);
+				m_framesWritten += 1;
+				m_pointsWritten += header.pointCount;
+				m_bytesWritten += m_frame.size();
+				m_frameBytes += m_frame.size();
+				m_encodeNs += uint64_t(m_codec.getLastEncodeMs() * 1e6);
+			}
+			else
+			{
+				std::cout << "Error: Unable to write to " << m_filename << ", recording stopped" << std::endl;
+				m_failed = true;
+			}
+		}
+		if (m_failed)
+			++m_framesDropped;
+
+		// the cloud goes back to its owner before the queue looks empty
+		job.cloud.reset();
+		std::lock_guard lock(m_mutex);
+		m_encoding = false;
+	}
+}
+
+bool VolumetricRecorder::writeIndex()
+{
+	size_t indexSize = m_index.size() * sizeof(IndexEntry);
+
+	Footer footer;
+	footer.indexOffset = m_file.getSize();
+	footer.entryCount = m_index.size();
+	footer.indexChecksum = Crc32::compute(m_index.data(), indexSize);
+
+	if ((indexSize && !m_file.write(m_index.data(), indexSize)) ||
+		!m_file.write(&footer, sizeof(Footer)))
+		return false;
+	m_bytesWritten += indexSize + sizeof(Footer);
+	return true;
+}
+
+VolumetricRecorder::Stats VolumetricRecorder::getStats() const
+{
+	Stats stats;
+	stats.framesWritten = m_framesWritten;
+	stats.framesDropped = m_framesDropped;
+	stats.pointsWritten = m_pointsWritten;
+	stats.bytesWritten = m_bytesWritten;
+	{
+		std::lock_guard lock(m_mutex);
+		stats.queued = (unsigned int)m_queue.size() + (m_encoding ? 1 : 0);
+	}
+	if (m_recording)
+		stats.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start).count();
+	if (uint64_t frames = stats.framesWritten)
+		stats.encodeMs = float(double(m_encodeNs) / 1e6 / double(frames));
+	if (uint64_t points = stats.pointsWritten)
+	{
+		stats.bitsPerPoint = float(double(m_frameBytes) * 8 / double(points));
+		stats.ratio = float(double(points) * (3 * sizeof(float) + 3) / double(m_frameBytes));
+	}
+	return stats;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PointCloudFusion.h"
+#include "UnbufferedFile.h"
+#include "VolumetricCodec.h"
+#include "VolumetricFormat.h"
+
+// Records fused point clouds into a volumetric video (see VolumetricFormat.h). Capture only
+// hands over its shared cloud; a dedicated thread encodes each one (see VolumetricCodec, its
+// slices run across the cores) and appends the frame. The backlog of clouds waiting on the
+// encoder is small and bounded, past it clouds are dropped and counted rather than ever
+// holding up capture. Stopping drains the backlog and appends the frame index and footer.
+class VolumetricRecorder
+{
+public:
+
+	struct Settings
+	{
+		VolumetricCodec::Settings	codec;
+		unsigned int	backlog = 2;			// clouds waiting on the encoder before any are dropped
+	};
+
+	struct Stats
+	{
+		uint64_t		framesWritten = 0;
+		uint64_t		framesDropped = 0;
+		uint64_t		pointsWritten = 0;		// voxels
+		uint64_t		bytesWritten = 0;
+		unsigned int	queued = 0;				// waiting for or being encoded
+		float			seconds = 0;			// since start
+		float			encodeMs = 0;			// average per frame
+		float			bitsPerPoint = 0;
+		float			ratio = 1;				// against the same voxels as float xyz and byte rgb
+	};
+
+	VolumetricRecorder() = default;
+	~VolumetricRecorder();
+
+	const Settings&	getSettings() const		{	return m_settings;	}
+	void			setSettings(const Settings& a_settings)	{	m_settings = a_settings;	}	// takes effect on the next start()
+
+	bool			start(const std::string& a_filename);
+	void			stop();
+
+	bool			isRecording() const		{	return m_recording;	}
+	const std::string&	getFilename() const	{	return m_filename;	}
+
+	// queues a_cloud to be encoded, timestamped now. A cloud whose frame was already added is
+	// ignored; returns false if it had to be dropped.
+	bool			add(std::shared_ptr<const FusedPointCloud> a_cloud);
+
+	Stats			getStats() const;
+
+private:
+
+	struct Job
+	{
+		std::shared_ptr<const FusedPointCloud>	cloud;
+		double			timestamp = 0;		// ms since start
+	};
+
+	void			run();
+	bool			writeIndex();
+
+	Settings				m_settings;
+	Settings				m_active;			// as of start()
+	std::string				m_filename;
+	UnbufferedFile			m_file;
+	bool					m_recording = false;
+	bool					m_failed = false;	// a write failed, the rest of the recording is dropped
+	uint64_t				m_lastFrame = ~0ull;
+	std::chrono::steady_clock::time_point	m_start;
+
+	// shared with the encoder thread
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_wake;
+	std::thread				m_thread;
+	bool					m_quit = false;
+	std::deque<Job>			m_queue;
+	bool					m_encoding = false;
+
+	// encoder thread only
+	VolumetricCodec			m_codec;
+	std::vector<uint8_t>	m_frame;
+	std::vector<VolumetricFormat::IndexEntry>	m_index;
+
+	std::atomic<uint64_t>	m_framesWritten = 0;
+	std::atomic<uint64_t>	m_framesDropped = 0;
+	std::atomic<uint64_t>	m_pointsWritten = 0;
+	std::atomic<uint64_t>	m_bytesWritten = 0;
+	std::atomic<uint64_t>	m_frameBytes = 0;	// of frames, without the header and index
+	std::atomic<uint64_t>	m_encodeNs = 0;
+};
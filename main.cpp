@@ -7,9 +7,18 @@
 #include "imgui_impl_opengl3.h"
 
 #include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <execution>
+#include <thread>
+#include <atomic>
+#include <numeric>
 
 #include <librealsense2/rs.hpp>
 #include <librealsense2/hpp/rs_processing.hpp>
+#include <librealsense2/hpp/rs_internal.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/calib3d.hpp>
@@ -22,6 +31,32 @@
 
 #include "Gizmos.h"
 #include "Shader.h"
+#include "CalibrationCache.h"
+#include "DriftMonitor.h"
+#include "CalibrationAnalytics.h"
+#include "DepthCorrection.h"
+#include "CalibrationTargets.h"
+#include "PointCloudFusion.h"
+#include "PointCloudDedup.h"
+#include "TsdfVolume.h"
+#include "MeshExtractor.h"
+#include "MeshWriter.h"
+#include "PointFilter.h"
+#include "BackgroundModel.h"
+#include "TemporalFilter.h"
+#include "NormalEstimator.h"
+#include "RigIcp.h"
+#include "CaptureVolume.h"
+#include "SessionRecorder.h"
+#include "SessionPlayer.h"
+#include "SessionRecovery.h"
+#include "PointCloudExporter.h"
+#include "MeshSequenceExporter.h"
+#include "VolumetricRecorder.h"
+#include "VolumetricPlayer.h"
+#include "SessionTranscoder.h"
+#include "KeyframeWriter.h"
+#include "KeyframeIndex.h"
 
 #include  <Eigen/Geometry>
 
@@ -33,13 +68,51 @@ void copyFrameToGLTexture(GLuint& gl_handle, const rs2::video_frame& frame);
 
 static cv::Mat frame_to_mat(const rs2::frame& f);
 static cv::Mat depth_frame_to_meters(const rs2::depth_frame& f);
+static int64_t file_write_time(const std::string& filename);
+static SessionFormat::CameraInfo session_camera_info(const rs2::pipeline_profile& profile);
+static void record_frameset(SessionRecorder& recorder, uint16_t camera, const rs2::frameset& frames, const Eigen::Affine3f& depthToCapture);
+static int convert_bags(const std::vector<std::string>& bags, const std::string& output);
+static int benchmark_session(const std::string& filename);
+static int benchmark_depth_codec(const std::string& filename);
+static int benchmark_colour_codec(const std::string& filename);
+static int benchmark_volumetric(const std::string& filename);
+static int export_session_meshes(const std::string& filename, const std::string& directory, bool obj);
+static int transcode_session(const std::string& filename, const std::string& directory, bool pcd);
+static int index_session(const std::string& filename);
+static int recover_session(const std::string& filename);
+
+// every camera's depth at one tick of a recorded session, for the processing benchmarks
+struct session_tick {
+    std::vector<std::vector<uint16_t>> depth;       // per camera, empty if it had no frame
+    std::vector<Eigen::Matrix4f> depthToCapture;
+};
+static bool load_session_ticks(SessionPlayer& player, size_t maxTicks, std::vector<session_tick>& ticks);
+static std::vector<TsdfVolume::DepthInput> session_tick_inputs(const SessionPlayer& player, const session_tick& tick);
+static void session_tick_points(const SessionPlayer& player, const session_tick& tick, size_t camera, std::vector<float>& vertices, std::vector<float>& texcoords);
+static int benchmark_tsdf(const std::string& filename);
+static int benchmark_mesh(const std::string& filename);
+static int benchmark_filter(const std::string& filename);
+static int benchmark_temporal(const std::string& filename);
+static int benchmark_normals(const std::string& filename);
+static int benchmark_icp(const std::string& filename);
 
 class rs_camera {
 public:
 
-    rs_camera(rs2::pipeline& pipeline) : 
+    rs_camera(rs2::pipeline& pipeline, CalibrationCache& cache) : 
         pipe(pipeline), 
-        id(pipeline.get_active_profile().get_device().get_info(RS2_CAMERA_INFO_SERIAL_NUMBER)) {
+        id(pipeline.get_active_profile().get_device().get_info(RS2_CAMERA_INFO_SERIAL_NUMBER)),
+        calibrationCache(&cache) {
+
+        auto profile = pipe.get_active_profile();
+        auto colorProfile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+        calibrationProfile = { (uint32_t)colorProfile.width(), (uint32_t)colorProfile.height(),
+                               (uint32_t)colorProfile.format(), (uint32_t)colorProfile.fps() };
+
+        auto extrinsics = profile.get_stream(RS2_STREAM_DEPTH).get_extrinsics_to(colorProfile);
+        depthToColor.linear() = Eigen::Map<Eigen::Matrix3f>(extrinsics.rotation);
+        depthToColor.translation() = Eigen::Map<Eigen::Vector3f>(extrinsics.translation);
+
         loadCalibration();
     }
     ~rs_camera() {}
@@ -47,6 +120,9 @@ public:
     rs2::pipeline pipe;
     std::string id;
 
+    CalibrationCache* calibrationCache = nullptr;
+    CalibrationCache::ProfileKey calibrationProfile;
+
     GLuint color = 0;
     GLuint depth = 0;
     GLuint grabCut = 0;
@@ -64,24 +140,102 @@ public:
     bool locked = false;
 
     Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+    Eigen::Affine3f depthToColor = Eigen::Affine3f::Identity();
 
     GLuint vao = 0;
     GLuint vbo = 0;
     GLuint tbo = 0;
+    GLuint nbo = 0;
+    size_t bufferCapacity = 0;  // points the vbo/tbo were allocated for
+    size_t normalCapacity = 0;
 
     rs2::pointcloud pc;
     rs2::points points; 
+    size_t spanBegin = 0;   // rows of points that can be inside the capture volume
+    size_t spanCount = 0;
+
+    // per-point normals from the organized depth grid, for oriented splats
+    NormalEstimator normalEstimator;
+    bool estimateNormals = false;
+    bool pointsHaveNormals = false;
+
+    // downsampled/outlier rejected copy of points, used in place of them when enabled
+    PointFilter pointFilter;
+    bool pointsFiltered = false;
+    bool pointsPending = false;     // new points this frame, filtered with every other camera's
     rs2::align aligner = { RS2_STREAM_COLOR };
 
     rs2::frameset lastFrames;
+    rs2::frame processedDepth;  // aligned and corrected depth the points came from
 
     bool calibrated = false;
     std::vector<cv::Mat> capturedFrames;
     cv::Mat calibrationMatrix;
     cv::Mat calibrationDistanceCoeffs;
+    CalibrationAnalytics calibrationAnalytics;
+
+    // shared with the processing block, which outlives copies of this camera
+    std::shared_ptr<DepthCorrection> depthCorrection = std::make_shared<DepthCorrection>();
+    rs2::filter depthCorrectionBlock = makeDepthCorrectionBlock(depthCorrection);
+    bool correctDepth = true;
+
+    // static set removed from the raw depth, ahead of align and deprojection
+    std::shared_ptr<BackgroundModel> backgroundModel = std::make_shared<BackgroundModel>();
+    rs2::filter backgroundBlock = makeBackgroundBlock(backgroundModel);
+    bool subtractBackground = false;
+
+    // flicker removal on the raw depth, ours or librealsense's spatial + temporal chain
+    enum DepthFilter { DepthFilterNone, DepthFilterNative, DepthFilterLibrealsense };
+    int depthFilter = DepthFilterNone;
+    std::shared_ptr<TemporalFilter> temporalFilter = std::make_shared<TemporalFilter>();
+    rs2::filter temporalBlock = makeTemporalBlock(temporalFilter);
+    rs2::spatial_filter rsSpatialFilter;
+    rs2::temporal_filter rsTemporalFilter;
+    float depthFilterMs = 0;
+    float benchmarkNativeMs = 0;
+    float benchmarkLibrealsenseMs = 0;
+
+    // the capture volume's window of the raw depth, refreshed every frame before the crop runs
+    std::shared_ptr<CaptureVolume::Window> volumeWindow = std::make_shared<CaptureVolume::Window>();
+    rs2::filter volumeBlock = makeVolumeBlock(volumeWindow);
 
     bool detectMarker = false;
     bool markerboardFound = false;
+    CalibrationTargets::Detection targetDetection;
+    Eigen::Affine3f targetPose = Eigen::Affine3f::Identity();
+    float targetError = 0;
+
+    // detect the board's chessboard corners in a single image
+    static bool detectCharucoCorners(const cv::Mat& image, cv::Ptr<cv::aruco::CharucoBoard>& board,
+                                     std::vector<cv::Point2f>& charucoCorners, std::vector<int>& charucoIds) {
+
+        cv::Ptr<cv::aruco::DetectorParameters> params = cv::makePtr<cv::aruco::DetectorParameters>();
+        params->cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
+
+        std::vector<int> markerIds;
+        std::vector<std::vector<cv::Point2f> > markerCorners;
+        cv::aruco::detectMarkers(image, cv::makePtr<cv::aruco::Dictionary>(board->dictionary), markerCorners, markerIds, params);
+        // if at least one marker detected
+        if (markerIds.size() > 0)
+            cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, image, board, charucoCorners, charucoIds);
+
+        // if at least one charuco corner detected
+        return charucoIds.size() > 0;
+    }
+
+    // adds a captured frame's corners to the coverage map so the user can see where to put the board next
+    void captureFrame(const cv::Mat& image, cv::Ptr<cv::aruco::CharucoBoard>& board) {
+
+        if (capturedFrames.empty())
+            calibrationAnalytics.reset(image.cols, image.rows);
+
+        capturedFrames.push_back(image);
+
+        std::vector<cv::Point2f> charucoCorners;
+        std::vector<int> charucoIds;
+        if (detectCharucoCorners(image, board, charucoCorners, charucoIds))
+            calibrationAnalytics.addCoverage(&charucoCorners[0].x, charucoCorners.size());
+    }
 
     void calibrate(cv::Ptr<cv::aruco::CharucoBoard>& board) {
         if (capturedFrames.size() == 0) return;
@@ -92,34 +246,19 @@ public:
         cv::Size imgSize;
 
         // detech board from each image in captured frames
-        cv::Ptr<cv::aruco::DetectorParameters> params = cv::makePtr<cv::aruco::DetectorParameters>();
-        params->cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
-
         for (auto& image : capturedFrames) {
             imgSize = cv::Size(image.size[1], image.size[0]);
 
-            std::vector<int> markerIds;
-            std::vector<std::vector<cv::Point2f> > markerCorners;
-            cv::aruco::detectMarkers(image, cv::makePtr<cv::aruco::Dictionary>(board->dictionary), markerCorners, markerIds, params);
-            //or
-            //cv::aruco::detectMarkers(image, dictionary, markerCorners, markerIds, params);
-            // if at least one marker detected
-            if (markerIds.size() > 0) {
-                //    cv::aruco::drawDetectedMarkers(imageCopy, markerCorners, markerIds);
-                std::vector<cv::Point2f> charucoCorners;
-                std::vector<int> charucoIds;
-                cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, image, board, charucoCorners, charucoIds);
-                // if at least one charuco corner detected
-                if (charucoIds.size() > 0) {
-
-                    allCharucoCorners.push_back(charucoCorners);
-                    allCharucoIds.push_back(charucoIds);
-                    //        cv::aruco::drawDetectedCornersCharuco(imageCopy, charucoCorners, charucoIds, cv::Scalar(255, 0, 0));
-                }
+            std::vector<cv::Point2f> charucoCorners;
+            std::vector<int> charucoIds;
+            if (detectCharucoCorners(image, board, charucoCorners, charucoIds)) {
+                allCharucoCorners.push_back(charucoCorners);
+                allCharucoIds.push_back(charucoIds);
             }
         }
 
         std::vector<cv::Mat> rvecs, tvecs;
+        cv::Mat stdDeviationsIntrinsics, stdDeviationsExtrinsics, perViewErrors;
         int calibrationFlags = 0;
 
         // calibrate the lens for distortion etc
@@ -128,8 +267,26 @@ public:
             board,
             imgSize,
             calibrationMatrix, calibrationDistanceCoeffs, rvecs, tvecs,
+            stdDeviationsIntrinsics, stdDeviationsExtrinsics, perViewErrors,
             calibrationFlags);
 
+        // per-corner residuals, reprojecting each frame's board corners with the solved pose
+        calibrationAnalytics.clearResiduals();
+        for (size_t frame = 0; frame < allCharucoCorners.size(); ++frame) {
+            std::vector<cv::Point3f> objectPoints;
+            for (auto charucoId : allCharucoIds[frame])
+                objectPoints.push_back(board->chessboardCorners[charucoId]);
+
+            std::vector<cv::Point2f> projected;
+            cv::projectPoints(objectPoints, rvecs[frame], tvecs[frame], calibrationMatrix, calibrationDistanceCoeffs, projected);
+
+            for (size_t i = 0; i < projected.size(); ++i) {
+                auto& corner = allCharucoCorners[frame][i];
+                calibrationAnalytics.addResidual(corner.x, corner.y, (float)cv::norm(projected[i] - corner));
+            }
+            calibrationAnalytics.addFrameError((float)perViewErrors.at<double>((int)frame));
+        }
+
         capturedFrames.clear();
         calibrated = true;
 
@@ -142,80 +299,352 @@ public:
     }
 
     void loadCalibration() {
-        cv::FileStorage file(std::format("./calibration/{}.cal", id), cv::FileStorage::READ);
+        subtractBackground = backgroundModel->load(std::format("./calibration/{}.bg", id));
+
+        auto filename = std::format("./calibration/{}.cal", id);
+        auto sourceTime = file_write_time(filename);
+
+        // the binary cache is only stale if the yaml has been edited since it was imported
+        if (auto record = calibrationCache->find(id, calibrationProfile);
+            record != nullptr && record->sourceTime == sourceTime) {
+            calibrationMatrix = cv::Mat(3, 3, CV_64F, (void*)record->cameraMatrix).clone();
+            calibrationDistanceCoeffs = cv::Mat(1, record->distortionCount, CV_64F, (void*)record->distortion).clone();
+            if (record->flags & CalibrationCache::Transform)
+                transform.matrix() = Eigen::Map<const Eigen::Matrix4f>(record->transform);
+            if (record->flags & CalibrationCache::DepthCorrection)
+                depthCorrection->setCoefficients({ record->depthCorrection[0], record->depthCorrection[1], record->depthCorrection[2] });
+            calibrated = true;
+            return;
+        }
+
+        cv::FileStorage file(filename, cv::FileStorage::READ);
         if (file.isOpened()) {
             file["camera_matrix"] >> calibrationMatrix;
             file["distance_coeffs"] >> calibrationDistanceCoeffs;
+
+            cv::Mat transformMatrix;
+            file["transform"] >> transformMatrix;
+            if (transformMatrix.rows == 4 && transformMatrix.cols == 4) {
+                transformMatrix.convertTo(transformMatrix, CV_32F);
+                for (int r = 0; r < 4; ++r)
+                    for (int c = 0; c < 4; ++c)
+                        transform.matrix()(r, c) = transformMatrix.at<float>(r, c);
+            }
+
+            cv::Mat depthCoefficients;
+            file["depth_correction"] >> depthCoefficients;
+            if (depthCoefficients.total() == 3) {
+                depthCoefficients.convertTo(depthCoefficients, CV_64F);
+                depthCorrection->setCoefficients({ depthCoefficients.at<double>(0), depthCoefficients.at<double>(1), depthCoefficients.at<double>(2) });
+            }
+
             calibrated = true;
+            updateCalibrationCache(sourceTime);
         }
     }
 
     void saveCalibration() {
 
         if (calibrated) {
-            cv::FileStorage file(std::format("./calibration/{}.cal", id), cv::FileStorage::WRITE);
-            file << "camera_matrix" << calibrationMatrix;
-            file << "distance_coeffs" << calibrationDistanceCoeffs;
+            auto filename = std::format("./calibration/{}.cal", id);
+            {
+                cv::FileStorage file(filename, cv::FileStorage::WRITE);
+                file << "camera_matrix" << calibrationMatrix;
+                file << "distance_coeffs" << calibrationDistanceCoeffs;
+
+                cv::Mat transformMatrix(4, 4, CV_32F);
+                for (int r = 0; r < 4; ++r)
+                    for (int c = 0; c < 4; ++c)
+                        transformMatrix.at<float>(r, c) = transform.matrix()(r, c);
+                file << "transform" << transformMatrix;
+
+                auto& coefficients = depthCorrection->getCoefficients();
+                file << "depth_correction" << cv::Mat(1, 3, CV_64F, (void*)coefficients.data());
+            }
+
+            updateCalibrationCache(file_write_time(filename));
+            calibrationCache->save();
         }
+
+        if (backgroundModel->isValid())
+            backgroundModel->save(std::format("./calibration/{}.bg", id));
     }
 
-    bool findCharucoBoard(cv::Ptr<cv::aruco::CharucoBoard>& board) {
+    void updateCalibrationCache(int64_t sourceTime) {
 
-        markerboardFound = false;
+        CalibrationCache::Record record;
 
-        cv::Ptr<cv::aruco::DetectorParameters> params = cv::aruco::DetectorParameters::create();
+        // a .cal without a usable camera matrix isn't cached, the yaml is just read again next time
+        cv::Mat matrix, coeffs;
+        calibrationMatrix.convertTo(matrix, CV_64F);
+        calibrationDistanceCoeffs.convertTo(coeffs, CV_64F);
+        if (matrix.total() != std::size(record.cameraMatrix) || matrix.type() != CV_64F || !matrix.isContinuous())
+            return;
 
-        auto color = lastFrames.get_color_frame();
-        auto image = frame_to_mat(color);
+        std::snprintf(record.serial, sizeof(record.serial), "%s", id.c_str());
+        record.profile = calibrationProfile;
+        record.sourceTime = sourceTime;
+        record.flags = CalibrationCache::Intrinsics | CalibrationCache::Transform |
+                       CalibrationCache::DepthToColor | CalibrationCache::DepthCorrection;
 
-        std::vector<int> markerIds;
-        std::vector<std::vector<cv::Point2f> > markerCorners;
-        cv::aruco::detectMarkers(image, board->dictionary, markerCorners, markerIds, params);
+        std::memcpy(record.cameraMatrix, matrix.ptr<double>(), sizeof(record.cameraMatrix));
+        if (coeffs.type() == CV_64F && coeffs.isContinuous()) {
+            record.distortionCount = (uint32_t)std::min<size_t>(coeffs.total(), std::size(record.distortion));
+            if (record.distortionCount > 0)
+                std::memcpy(record.distortion, coeffs.ptr<double>(), record.distortionCount * sizeof(double));
+        }
 
-        // if at least one marker detected
-        if (markerIds.size() > 0) {
-            std::vector<cv::Point2f> charucoCorners;
-            std::vector<int> charucoIds;
-            cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, image, board, charucoCorners, charucoIds, calibrationMatrix, calibrationDistanceCoeffs);
-            // if at least one charuco corner detected
-            if (charucoIds.size() > 0) {
-                cv::Vec3d rvec, tvec;
-                bool valid = cv::aruco::estimatePoseCharucoBoard(charucoCorners, charucoIds, board, calibrationMatrix, calibrationDistanceCoeffs, rvec, tvec);
-                // if charuco pose is valid
-                if (valid) {
-                    //     cv::drawFrameAxes(imageCopy, cameraMatrix, distCoeffs, rvec, tvec, 0.1f);
-                    markerboardFound = true;
+        Eigen::Map<Eigen::Matrix4f>(record.transform) = transform.matrix();
+        Eigen::Map<Eigen::Matrix4f>(record.depthToColor) = depthToColor.matrix();
+        std::copy(depthCorrection->getCoefficients().begin(), depthCorrection->getCoefficients().end(), record.depthCorrection);
 
-                    // with the rvec and tvec we can create a matrix!
-                }
+        calibrationCache->store(record);
+    }
+
+    // stream profiles and calibration the session file needs to interpret this camera's frames
+    SessionFormat::CameraInfo getSessionInfo() const {
+        auto info = session_camera_info(pipe.get_active_profile());
+        std::copy(depthCorrection->getCoefficients().begin(), depthCorrection->getCoefficients().end(), info.depthCorrection);
+        Eigen::Map<Eigen::Matrix4f>(info.depthToColor) = depthToColor.matrix();
+        return info;
+    }
+
+    // rewrites the raw Z16 values through the correction table, ahead of deprojection
+    static rs2::filter makeDepthCorrectionBlock(std::shared_ptr<DepthCorrection> correction) {
+        return rs2::filter([correction](rs2::frame f, rs2::frame_source& source) {
+            auto depth = f.as<rs2::depth_frame>();
+            auto out = source.allocate_video_frame(depth.get_profile(), depth, 0, 0, 0, 0, RS2_EXTENSION_DEPTH_FRAME);
+
+            correction->prepare(depth.get_units());
+            correction->apply((const uint16_t*)depth.get_data(), (uint16_t*)const_cast<void*>(out.get_data()),
+                              (size_t)depth.get_width() * depth.get_height());
+
+            source.frame_ready(out);
+        });
+    }
+
+    // runs a per-pixel depth pass as a filter over framesets: the depth is replaced by a
+    // processed copy and the other streams pass through, so it can sit ahead of align
+    static rs2::filter makeFramesetDepthFilter(std::function<void(const rs2::depth_frame&, uint16_t*)> process) {
+        return rs2::filter([process](rs2::frame f, rs2::frame_source& source) {
+            auto frames = f.as<rs2::frameset>();
+            auto depth = frames.get_depth_frame();
+            if (!depth) {
+                source.frame_ready(f);
+                return;
             }
+
+            auto out = source.allocate_video_frame(depth.get_profile(), depth, 0, 0, 0, 0, RS2_EXTENSION_DEPTH_FRAME);
+            process(depth, (uint16_t*)const_cast<void*>(out.get_data()));
+
+            std::vector<rs2::frame> composite = { out };
+            for (auto&& frame : frames)
+                if (frame.get_profile().stream_type() != RS2_STREAM_DEPTH)
+                    composite.push_back(frame);
+            source.frame_ready(source.allocate_composite_frame(composite));
+        });
+    }
+
+    // zeroes the background so the aligner and everything after it only see the foreground
+    static rs2::filter makeBackgroundBlock(std::shared_ptr<BackgroundModel> model) {
+        return makeFramesetDepthFilter([model](const rs2::depth_frame& depth, uint16_t* out) {
+            model->apply((const uint16_t*)depth.get_data(), out, depth.get_width(), depth.get_height());
+        });
+    }
+
+    // zeroes every pixel that lands outside the capture volume, ahead of align
+    static rs2::filter makeVolumeBlock(std::shared_ptr<CaptureVolume::Window> window) {
+        return makeFramesetDepthFilter([window](const rs2::depth_frame& depth, uint16_t* out) {
+            CaptureVolume::crop(*window, (const uint16_t*)depth.get_data(), out);
+        });
+    }
+
+    static rs2::filter makeTemporalBlock(std::shared_ptr<TemporalFilter> filter) {
+        return makeFramesetDepthFilter([filter](const rs2::depth_frame& depth, uint16_t* out) {
+            filter->apply((const uint16_t*)depth.get_data(), out, depth.get_width(), depth.get_height(), depth.get_units());
+        });
+    }
+
+    // times our temporal filter against librealsense's spatial + temporal chain on the same
+    // raw depth frame, each on fresh state so the live filters aren't disturbed
+    void benchmarkDepthFilters(int iterations = 30) {
+
+        auto depth = lastFrames.get_depth_frame();
+        if (!depth) return;
+
+        TemporalFilter native;
+        native.setSettings(temporalFilter->getSettings());
+        std::vector<uint16_t> out((size_t)depth.get_width() * depth.get_height());
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            native.apply((const uint16_t*)depth.get_data(), out.data(), depth.get_width(), depth.get_height(), depth.get_units());
+        benchmarkNativeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+        rs2::spatial_filter spatial;
+        rs2::temporal_filter temporal;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            temporal.process(spatial.process(depth));
+        benchmarkLibrealsenseMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+    }
+
+    // compares the aligned depth at each board corner against the depth of the board plane
+    // solved from the colour image, giving one depth correction sample per corner
+    bool captureDepthSample(cv::Ptr<cv::aruco::CharucoBoard>& board) {
+
+        if (!calibrated) return false;
+
+        auto aligned = aligner.process(lastFrames);
+        auto color = aligned.get_color_frame();
+        auto depth = aligned.get_depth_frame();
+        if (!color || !depth) return false;
+
+        auto image = frame_to_mat(color);
+
+        std::vector<cv::Point2f> charucoCorners;
+        std::vector<int> charucoIds;
+        if (!detectCharucoCorners(image, board, charucoCorners, charucoIds))
+            return false;
+
+        cv::Vec3d rvec, tvec;
+        if (!cv::aruco::estimatePoseCharucoBoard(charucoCorners, charucoIds, board, calibrationMatrix, calibrationDistanceCoeffs, rvec, tvec))
+            return false;
+
+        cv::Matx33d rotation;
+        cv::Rodrigues(rvec, rotation);
+        cv::Vec3d normal(rotation(0, 2), rotation(1, 2), rotation(2, 2));
+        double planeDistance = normal.dot(tvec);
+
+        std::vector<cv::Point2f> rays;
+        cv::undistortPoints(charucoCorners, rays, calibrationMatrix, calibrationDistanceCoeffs);
+
+        for (size_t i = 0; i < charucoCorners.size(); ++i) {
+            // intersect the pixel's ray with the board plane
+            cv::Vec3d ray(rays[i].x, rays[i].y, 1);
+            double expected = planeDistance / normal.dot(ray);
+
+            float measured = depth.get_distance((int)charucoCorners[i].x, (int)charucoCorners[i].y);
+            depthCorrection->addSample(measured, (float)expected);
         }
+
+        return true;
+    }
+
+    void fitDepthCorrection() {
+
+        if (depthCorrection->fit()) {
+            auto& c = depthCorrection->getCoefficients();
+            std::cout << "Depth correction " << id << ": " << c[0] << " + " << c[1] << "z + " << c[2] << "z^2" << std::endl;
+            std::cout << "Error: " << depthCorrection->getFitError() << std::endl;
+
+            depthCorrection->clearSamples();
+            saveCalibration();
+        }
+    }
+
+    // finds every registered board and marker in the last colour frame in one pass and
+    // solves this camera's pose in capture space from all of their corners together
+    bool findTargets(const CalibrationTargets& targets) {
+
+        markerboardFound = false;
+        if (!calibrated) return false;
+
+        auto color = lastFrames.get_color_frame();
+        if (!color) return false;
+
+        auto image = frame_to_mat(color);
+
+        targetDetection = targets.detect(image, calibrationMatrix, calibrationDistanceCoeffs);
+        markerboardFound = targets.solvePose(targetDetection, calibrationMatrix, calibrationDistanceCoeffs, targetPose, targetError);
+        return markerboardFound;
+    }
+
+    // points are drawn Y flipped (see pc.vert) so the solved OpenCV camera pose needs the same flip
+    void applyTargetPose(const Eigen::Affine3f& captureSpaceMatrix) {
+        if (!markerboardFound || locked) return;
+
+        transform = captureSpaceMatrix.inverse() * targetPose * Eigen::Scaling(1.0f, -1.0f, 1.0f);
+    }
+
+    // the points everything downstream of the filter stage should use
+    const float* getVertices() const {
+        return pointsFiltered ? pointFilter.getVertices() : (const float*)points.get_vertices() + spanBegin * 3;
+    }
+    const float* getTexcoords() const {
+        return pointsFiltered ? pointFilter.getTexcoords() : (const float*)points.get_texture_coordinates() + spanBegin * 2;
+    }
+    size_t getPointCount() const {
+        return pointsFiltered ? pointFilter.getCount() : spanCount;
+    }
+    // nullptr unless normals were estimated for these points
+    const float* getNormals() const {
+        if (!pointsHaveNormals) return nullptr;
+        return pointsFiltered ? pointFilter.getNormals() : normalEstimator.getNormals() + spanBegin * 3;
+    }
+
+    // everything after deprojection only sees rows [rowBegin, rowEnd) of the organized points
+    void setPointSpan(int rowBegin, int rowEnd, int width) {
+        spanBegin = std::min((size_t)rowBegin * width, points.size());
+        spanCount = std::min((size_t)std::max(rowEnd - rowBegin, 0) * width, points.size() - spanBegin);
+    }
+
+    void estimatePointNormals(const rs2::depth_frame& depth) {
+        pointsHaveNormals = estimateNormals && points.size() == (size_t)depth.get_width() * depth.get_height();
+        if (pointsHaveNormals)
+            normalEstimator.compute((const float*)points.get_vertices(), depth.get_width(), depth.get_height());
+    }
+
+    void filterPoints() {
+        pointsFiltered = pointFilter.isEnabled();
+        if (pointsFiltered)
+            pointFilter.process((const float*)points.get_vertices() + spanBegin * 3, (const float*)points.get_texture_coordinates() + spanBegin * 2,
+                                spanCount, pointsHaveNormals ? normalEstimator.getNormals() + spanBegin * 3 : nullptr);
     }
 
     void updateBuffers() {
 
-        if (points.size() == 0) return;
+        size_t count = getPointCount();
+        if (count == 0) return;
+
+        // filtered counts change every frame, only reallocate when they outgrow the buffers
+        bool reallocate = count > bufferCapacity;
+        if (reallocate)
+            bufferCapacity = count;
 
         // update positions
-        if (vbo == 0) {
+        if (vbo == 0)
             glGenBuffers(1, &vbo);
-            glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(rs2::vertex), points.get_vertices(), GL_DYNAMIC_DRAW);
-        }
-        else {
-            glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, points.size() * sizeof(rs2::vertex), points.get_vertices());
-        }
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (reallocate)
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(rs2::vertex), getVertices(), GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(rs2::vertex), getVertices());
 
         // update textures
-        if (tbo == 0) {
+        if (tbo == 0)
             glGenBuffers(1, &tbo);
-            glBindBuffer(GL_ARRAY_BUFFER, tbo);
-            glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(rs2::texture_coordinate), points.get_texture_coordinates(), GL_DYNAMIC_DRAW);
-        }
-        else {
-            glBindBuffer(GL_ARRAY_BUFFER, tbo);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, points.size() * sizeof(rs2::texture_coordinate), points.get_texture_coordinates());
+        glBindBuffer(GL_ARRAY_BUFFER, tbo);
+        if (reallocate)
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(rs2::texture_coordinate), getTexcoords(), GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(rs2::texture_coordinate), getTexcoords());
+
+        // update normals, optional
+        auto normals = getNormals();
+        if (normals) {
+            bool reallocateNormals = count > normalCapacity;
+            if (reallocateNormals)
+                normalCapacity = count;
+
+            if (nbo == 0)
+                glGenBuffers(1, &nbo);
+            glBindBuffer(GL_ARRAY_BUFFER, nbo);
+            if (reallocateNormals)
+                glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 3, normals, GL_DYNAMIC_DRAW);
+            else
+                glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float) * 3, normals);
         }
 
         if (vao == 0) {
@@ -232,12 +661,25 @@ public:
 
             glBindVertexArray(0);
         }
+
+        // a disabled attribute reads as zero, which pc.geom takes as no normal
+        glBindVertexArray(vao);
+        if (normals) {
+            glBindBuffer(GL_ARRAY_BUFFER, nbo);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        }
+        else {
+            glDisableVertexAttribArray(2);
+            glVertexAttrib3f(2, 0, 0, 0);
+        }
+        glBindVertexArray(0);
     }
 
     void draw(Shader::UniformBase* a_modelUniform, const Eigen::Affine3f& captureSpaceMatrix,
               Shader::UniformBase* a_cutoffMinUniform, Shader::UniformBase* a_cutoffMaxUniform) {
 
-        if (points.size() == 0) return;
+        if (getPointCount() == 0) return;
 
         a_cutoffMinUniform->bind(depthMin);
         a_cutoffMaxUniform->bind(depthMax);
@@ -246,7 +688,229 @@ public:
         glBindTexture(GL_TEXTURE_2D, color);
 
         glBindVertexArray(vao);
-        glDrawArrays(GL_POINTS, 0, points.size());
+        glDrawArrays(GL_POINTS, 0, (GLsizei)getPointCount());
+    }
+};
+
+// GL copy of the extracted volume mesh
+struct mesh_buffer {
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint nbo = 0;
+    GLuint cbo = 0;
+    GLuint ibo = 0;
+    GLsizei indexCount = 0;
+
+    void update(const TriangleMesh& mesh) {
+
+        indexCount = (GLsizei)mesh.indices.size();
+        if (indexCount == 0) return;
+
+        if (vao == 0) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &nbo);
+            glGenBuffers(1, &cbo);
+            glGenBuffers(1, &ibo);
+        }
+
+        // the mesh changes size every update, so always respecify
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, mesh.positions.size() * sizeof(Eigen::Vector3f), mesh.positions.data(), GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, nbo);
+        glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(Eigen::Vector3f), mesh.normals.data(), GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, cbo);
+        glBufferData(GL_ARRAY_BUFFER, mesh.colours.size(), mesh.colours.data(), GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_DYNAMIC_DRAW);
+
+        glBindVertexArray(0);
+    }
+
+    void draw() {
+
+        if (indexCount == 0) return;
+
+        glBindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    }
+};
+
+// GL copy of a fused cloud, its arrays packed back to back in one buffer
+struct fused_buffer {
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLsizei pointCount = 0;
+    uint64_t frame = 0;
+
+    void update(const FusedPointCloud& cloud) {
+
+        frame = cloud.frame;
+        pointCount = (GLsizei)cloud.count;
+        if (pointCount == 0) return;
+
+        if (vao == 0) {
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+        }
+
+        size_t floats = cloud.count * sizeof(float);
+        size_t offsets[6] = { 0, floats, floats * 2, floats * 3, floats * 3 + cloud.count, floats * 3 + cloud.count * 2 };
+        const void* arrays[6] = { cloud.x.data(), cloud.y.data(), cloud.z.data(), cloud.r.data(), cloud.g.data(), cloud.b.data() };
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, floats * 3 + cloud.count * 3, nullptr, GL_STREAM_DRAW);
+        for (int i = 0; i < 6; ++i) {
+            glBufferSubData(GL_ARRAY_BUFFER, offsets[i], i < 3 ? floats : cloud.count, arrays[i]);
+            glEnableVertexAttribArray(i);
+            if (i < 3)
+                glVertexAttribPointer(i, 1, GL_FLOAT, GL_FALSE, 0, (const void*)offsets[i]);
+            else
+                glVertexAttribPointer(i, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0, (const void*)offsets[i]);
+        }
+        glBindVertexArray(0);
+    }
+
+    void draw() {
+
+        if (pointCount == 0) return;
+
+        glBindVertexArray(vao);
+        glDrawArrays(GL_POINTS, 0, pointCount);
+    }
+};
+
+// replays one recorded camera through a librealsense software device, so played frames are
+// ordinary framesets the processing takes unchanged. The pixels are not copied, the frames
+// point straight into the session's mapping and must be released before it is closed.
+// Compressed payloads are the exception, they are decoded into a buffer the frame owns.
+struct session_camera {
+
+    rs2::software_device device;
+    rs2::software_sensor depthSensor;
+    rs2::software_sensor colourSensor;
+    rs2::stream_profile depthProfile;
+    rs2::stream_profile colourProfile;
+    rs2::frame_queue depthQueue;
+    rs2::frame_queue colourQueue;
+    float depthUnits = 0.001f;
+
+    // bundles the depth with the colour waiting here into a frameset
+    rs2::frame pendingColour;
+    rs2::filter composer;
+
+    size_t index = SIZE_MAX;    // the played frame
+    rs2::frameset frames;
+
+    session_camera(const SessionFormat::CameraInfo& info) :
+        depthSensor(device.add_sensor("Depth")),
+        colourSensor(device.add_sensor("Color")),
+        depthUnits(info.depthUnits),
+        composer([this](rs2::frame f, rs2::frame_source& source) {
+            std::vector<rs2::frame> parts{ f };
+            if (pendingColour) parts.push_back(pendingColour);
+            source.frame_ready(source.allocate_composite_frame(parts));
+        }) {
+
+        auto intrinsics = [](const SessionFormat::StreamInfo& stream) {
+            rs2_intrinsics out{ (int)stream.width, (int)stream.height, stream.cx, stream.cy, stream.fx, stream.fy, (rs2_distortion)stream.model };
+            std::copy(std::begin(stream.coeffs), std::end(stream.coeffs), out.coeffs);
+            return out;
+        };
+        auto colourFormat = (rs2_format)info.colour.format;
+        int colourBpp = colourFormat == RS2_FORMAT_RGBA8 || colourFormat == RS2_FORMAT_BGRA8 ? 4 :
+                        colourFormat == RS2_FORMAT_YUYV || colourFormat == RS2_FORMAT_UYVY ? 2 :
+                        colourFormat == RS2_FORMAT_Y8 ? 1 : 3;
+
+        depthProfile = depthSensor.add_video_stream({ RS2_STREAM_DEPTH, 0, 0, (int)info.depth.width, (int)info.depth.height,
+            (int)info.depth.fps, 2, RS2_FORMAT_Z16, intrinsics(info.depth) }, true);
+        colourProfile = colourSensor.add_video_stream({ RS2_STREAM_COLOR, 0, 1, (int)info.colour.width, (int)info.colour.height,
+            (int)info.colour.fps, colourBpp, colourFormat, intrinsics(info.colour) }, true);
+        depthSensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, info.depthUnits);
+
+        Eigen::Map<const Eigen::Matrix4f> depthToColor(info.depthToColor);
+        rs2_extrinsics extrinsics;
+        Eigen::Map<Eigen::Matrix3f>(extrinsics.rotation) = depthToColor.topLeftCorner<3, 3>();
+        Eigen::Map<Eigen::Vector3f>(extrinsics.translation) = depthToColor.topRightCorner<3, 1>();
+        depthProfile.register_extrinsics_to(colourProfile, extrinsics);
+
+        depthSensor.open(depthProfile);
+        colourSensor.open(colourProfile);
+        depthSensor.start(depthQueue);
+        colourSensor.start(colourQueue);
+    }
+    session_camera(const session_camera&) = delete;
+    session_camera& operator=(const session_camera&) = delete;
+
+    // the frameset for a recorded frame, kept while the same frame is asked for again
+    const rs2::frameset& play(SessionPlayer& player, const SessionPlayer::FrameView& view, size_t frameIndex) {
+
+        if (frameIndex == index || !view) return frames;
+        index = frameIndex;
+
+        auto& header = *view.header;
+        rs2::frame depth, colour;
+        if (view.depth && header.depthCodec != SessionFormat::Raw) {
+            auto video = depthProfile.as<rs2::video_stream_profile>();
+            uint32_t size = uint32_t(video.width() * video.height() * sizeof(uint16_t));
+            auto pixels = new uint16_t[size / sizeof(uint16_t)];
+            if (player.decodeDepth(view, pixels))
+                depth = inject(depthSensor, depthProfile, depthQueue, pixels, size, header, [](void* p) { delete[] static_cast<uint16_t*>(p); });
+            else
+                delete[] pixels;
+        }
+        else if (view.depth)
+            depth = inject(depthSensor, depthProfile, depthQueue, view.depth, header.depthSize, header);
+        if (view.colour && header.colourCodec != SessionFormat::Raw) {
+            auto video = colourProfile.as<rs2::video_stream_profile>();
+            uint32_t size = uint32_t(video.width() * video.height() * 3);
+            auto pixels = new uint8_t[size];
+            if (player.decodeColour(view, pixels))
+                colour = inject(colourSensor, colourProfile, colourQueue, pixels, size, header, [](void* p) { delete[] static_cast<uint8_t*>(p); });
+            else
+                delete[] pixels;
+        }
+        else if (view.colour)
+            colour = inject(colourSensor, colourProfile, colourQueue, view.colour, header.colourSize, header);
+
+        if (!depth && !colour) return frames;
+        pendingColour = depth ? colour : rs2::frame();
+        frames = composer.process(depth ? depth : colour).as<rs2::frameset>();
+        pendingColour = rs2::frame();
+        return frames;
+    }
+
+    // both streams get the depth's timestamp, they were captured as one frameset
+    rs2::frame inject(rs2::software_sensor& sensor, const rs2::stream_profile& profile, rs2::frame_queue& queue,
+                      const void* pixels, uint32_t size, const SessionFormat::FrameHeader& header, void (*deleter)(void*) = [](void*) {}) {
+
+        auto video = profile.as<rs2::video_stream_profile>();
+        rs2_software_video_frame frame{};
+        frame.pixels = const_cast<void*>(pixels);
+        frame.deleter = deleter;
+        frame.stride = (int)(size / video.height());
+        frame.bpp = frame.stride / video.width();
+        frame.timestamp = header.timestamp;
+        frame.domain = RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK;
+        frame.frame_number = (int)header.frameNumber;
+        frame.profile = profile.get();
+        frame.depth_units = depthUnits;
+        sensor.on_video_frame(frame);
+        return queue.wait_for_frame();
     }
 };
 
@@ -340,7 +1004,40 @@ void updateCamera(GLFWwindow* window, Eigen::Vector3f& eyePosition, Eigen::Vecto
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+
+    // COMMAND LINE TOOLS
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.size() >= 3 && args[0] == "--convert")
+        return convert_bags({ args.begin() + 1, args.end() - 1 }, args.back());
+    if (args.size() == 2 && args[0] == "--benchmark-session")
+        return benchmark_session(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-depth-codec")
+        return benchmark_depth_codec(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-colour-codec")
+        return benchmark_colour_codec(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-volumetric")
+        return benchmark_volumetric(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-tsdf")
+        return benchmark_tsdf(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-mesh")
+        return benchmark_mesh(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-filter")
+        return benchmark_filter(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-temporal")
+        return benchmark_temporal(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-normals")
+        return benchmark_normals(args[1]);
+    if (args.size() == 2 && args[0] == "--benchmark-icp")
+        return benchmark_icp(args[1]);
+    if ((args.size() == 3 || (args.size() == 4 && args[3] == "obj")) && args[0] == "--export-meshes")
+        return export_session_meshes(args[1], args[2], args.size() == 4);
+    if ((args.size() == 3 || (args.size() == 4 && args[3] == "pcd")) && args[0] == "--transcode")
+        return transcode_session(args[1], args[2], args.size() == 4);
+    if (args.size() == 2 && args[0] == "--index")
+        return index_session(args[1]);
+    if (args.size() == 2 && args[0] == "--recover")
+        return recover_session(args[1]);
 
     // WINDOW & GL SETUP
     glfwInit();
@@ -386,20 +1083,49 @@ int main() {
 
     float pointSize = 0.001f;
 
+    // FUSED CLOUD SHADER
+    Shader* fusedShader = new Shader("Fused");
+    fusedShader->compileShaderFromFile(Shader::Stage::Vertex, "./shaders/fused.vert");
+    fusedShader->compileShaderFromFile(Shader::Stage::Geometry, "./shaders/fused.geom");
+    fusedShader->compileShaderFromFile(Shader::Stage::Fragment, "./shaders/fused.frag");
+    fusedShader->linkProgram();
+
+    Shader::UniformBase* fusedViewUniform = fusedShader->getUniform("View");
+    Shader::UniformBase* fusedProjectionUniform = fusedShader->getUniform("Projection");
+    Shader::UniformBase* fusedPointSizeUniform = fusedShader->getUniform("PointSize");
+
+    // MESH SHADER
+    Shader* meshShader = new Shader("Mesh");
+    meshShader->compileShaderFromFile(Shader::Stage::Vertex, "./shaders/mesh.vert");
+    meshShader->compileShaderFromFile(Shader::Stage::Fragment, "./shaders/mesh.frag");
+    meshShader->linkProgram();
+
+    Shader::UniformBase* meshViewUniform = meshShader->getUniform("View");
+    Shader::UniformBase* meshProjectionUniform = meshShader->getUniform("Projection");
+
     Eigen::Affine3f captureSpaceMatrix = Eigen::Affine3f::Identity();
 
     // CALIBRATION
-    auto arucoDictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_5X5_50);
-    auto charucoBoard = cv::aruco::CharucoBoard::create(5, 7, 0.04f, 0.02f, arucoDictionary);
- /*   cv::Mat boardImage, markerImage;
-    charucoBoard->draw(cv::Size(1200, 1000), boardImage);
-    cv::imwrite("DICT_5X5_50.jpg", boardImage);
-
-    for (int i = 0; i < 50; ++i) {
-        arucoDictionary.drawMarker(i, 400, markerImage, 1);
-        std::string filename = std::format("./aruco/marker{}.png", i);
-        cv::imwrite(filename, markerImage);
-    }*/
+    // DICT_5X5_250 starts with the DICT_5X5_50 markers, so boards printed from either still work
+    CalibrationTargets calibrationTargets(cv::aruco::DICT_5X5_250);
+
+    // the region worth capturing, cameras crop their depth to it when enabled
+    CaptureVolume captureVolume;
+    captureVolume.load("./calibration/volume.yml");
+    bool cropToVolume = false;
+    bool editVolume = false;
+
+    if (!calibrationTargets.load("./calibration/targets.yml"))
+        calibrationTargets.addBoard(5, 7, 0.04f, 0.02f, Eigen::Affine3f::Identity());
+
+    // intrinsics are calibrated against the first board
+    auto charucoBoard = calibrationTargets.getBoards().empty() ?
+        cv::aruco::CharucoBoard::create(5, 7, 0.04f, 0.02f, calibrationTargets.getDictionary()) :
+        calibrationTargets.getBoards()[0].board;
+
+    // binary calibration store, the yaml .cal files are only parsed when this is stale
+    CalibrationCache calibrationCache;
+    calibrationCache.open("./calibration/calibration.bin");
 
     // COLLECT REALSENSE DEVICES
     rs2::context rsContext;
@@ -413,11 +1139,16 @@ int main() {
         cfg.enable_stream(RS2_STREAM_COLOR, 1920, 1080, RS2_FORMAT_RGB8, 30);
         pipe.start(cfg);
 
-        rs_devices.push_back(rs_camera(pipe));
+        rs_devices.push_back(rs_camera(pipe, calibrationCache));
     }
 
+    // write back anything imported from yaml on this run
+    calibrationCache.save();
+
     if (rs_devices.size() == 0) {
         delete pcShader;
+        delete fusedShader;
+        delete meshShader;
         gizmos->destroy();
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
@@ -431,6 +1162,145 @@ int main() {
     rs2::colorizer colorizer;
     colorizer.set_option(RS2_OPTION_COLOR_SCHEME, 2);
 
+    // background extrinsic drift estimation, idle until enabled
+    DriftMonitor driftMonitor;
+
+    // joint ICP refinement of every unlocked camera, on demand or periodically, solved in the background
+    RigIcp rigIcp;
+    std::vector<RigIcp::Result> icpResults;
+    bool icpSaveResults = false;
+    bool snapPeriodically = false;
+    float snapIntervalS = 10;
+    auto lastSnap = std::chrono::steady_clock::now();
+
+    // all cameras in capture space, in one buffer
+    PointCloudFusion pointCloudFusion;
+    bool fusePoints = true;
+
+    // points several cameras see merged once per fused frame
+    PointCloudDedup pointCloudDedup;
+    bool dedupPoints = true;
+    bool drawFused = false;
+    fused_buffer fusedBuffer;
+
+    // volumetric integration of every camera's depth
+    TsdfVolume tsdfVolume;
+    bool integrateVolume = false;
+
+    // surface of the volume, re-meshed only where blocks changed
+    MeshExtractor meshExtractor;
+    mesh_buffer volumeMesh;
+    uint64_t volumeMeshRevision = 0;
+    bool extractMesh = false;
+    bool exportMesh = false;
+    unsigned int meshExportIndex = 0;
+    uint64_t meshExportRevision = 0;
+    MeshWriter meshWriter;
+
+    // simplified, textured meshes of the volume as a GLB or OBJ sequence, processed on a pool of threads
+    MeshSequenceExporter meshSequenceExporter;
+    unsigned int meshSequenceFrame = 0;
+    uint64_t meshSequenceRevision = 0;
+
+    // raw frames of every camera into one session file, written on its own thread
+    SessionRecorder sessionRecorder;
+
+    // per camera and fused point clouds as a PLY or PCD sequence, written on a pool of threads
+    PointCloudExporter pointExporter;
+    bool exportCameraPoints = true;
+    bool exportFusedPoints = false;
+    unsigned int pointExportFrame = 0;
+
+    // fused clouds as a compact volumetric video, and one replayed in place of the live clouds
+    VolumetricRecorder volumetricRecorder;
+    VolumetricPlayer volumetricPlayer;
+    fused_buffer volumetricBuffer;
+    std::shared_ptr<const FusedPointCloud> volumetricShown;
+    bool volumetricPlaying = false;
+    float volumetricTime = 0;   // s since the first frame
+
+    // a recorded session replayed in place of the live frames of the cameras it was recorded from
+    SessionPlayer sessionPlayer;
+    std::vector<std::unique_ptr<session_camera>> playbackCameras;
+    std::vector<int> playbackSource(rs_devices.size(), -1);    // per device, its camera in the session
+    bool playing = false;
+    float playbackTime = 0;     // s since each camera's first frame
+    float playbackDuration = 0;
+
+    // its keyframe sidecar, when there is one: thumbnails spread over the session to jump by,
+    // packed side by side into one texture, and the points the cameras saw at each keyframe
+    const int keyframeStripLength = 8;
+    KeyframeIndex keyframeIndex;
+    GLuint keyframeStrip = 0;
+    std::vector<float> keyframeStripTimes;    // s, per thumbnail
+    std::vector<float> keyframePoints;        // thousands
+
+    auto closeSession = [&]() {
+        // the played frames point into the mapping
+        for (auto& device : rs_devices) {
+            device.lastFrames = rs2::frameset();
+            device.processedDepth = rs2::frame();
+        }
+        playbackCameras.clear();
+        playbackSource.assign(rs_devices.size(), -1);
+        sessionPlayer.close();
+        keyframeIndex.close();
+        keyframeStripTimes.clear();
+        keyframePoints.clear();
+        playing = false;
+    };
+
+    auto openSession = [&](const std::string& filename) {
+        closeSession();
+        if (!sessionPlayer.open(filename)) return;
+
+        auto& cameras = sessionPlayer.getCameras();
+        playbackTime = 0;
+        playbackDuration = 0;
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            playbackCameras.push_back(std::make_unique<session_camera>(cameras[camera]));
+            if (sessionPlayer.getFrameCount(camera) > 0)
+                playbackDuration = std::max(playbackDuration,
+                    float(sessionPlayer.getEndTimestamp(camera) - sessionPlayer.getStartTimestamp(camera)) / 1000);
+
+            for (size_t device = 0; device < rs_devices.size(); ++device)
+                if (rs_devices[device].id == cameras[camera].serial && sessionPlayer.getFrameCount(camera) > 0)
+                    playbackSource[device] = (int)camera;
+        }
+
+        std::error_code error;
+        auto sidecar = KeyframeFormat::sidecarName(filename);
+        if (!std::filesystem::exists(sidecar, error) || !keyframeIndex.open(sidecar) || keyframeIndex.getKeyframeCount() == 0) return;
+
+        // the strip shows the camera the playback steps by
+        auto source = std::find_if(playbackSource.begin(), playbackSource.end(), [](int s) { return s >= 0; });
+        size_t stripCamera = source != playbackSource.end() ? (size_t)*source : 0;
+        auto& header = keyframeIndex.getHeader();
+        size_t thumbnailWidth = header.thumbnailWidth, thumbnailHeight = header.thumbnailHeight;
+        size_t stripWidth = thumbnailWidth * keyframeStripLength;
+        std::vector<uint8_t> strip(stripWidth * thumbnailHeight * 3, 64);
+        for (int i = 0; i < keyframeStripLength; ++i) {
+            size_t keyframe = i * (keyframeIndex.getKeyframeCount() - 1) / (keyframeStripLength - 1);
+            auto view = keyframeIndex.getKeyframe(keyframe, stripCamera);
+            keyframeStripTimes.push_back(view ? float(view.header->time / 1000) : float(keyframe * keyframeIndex.getIntervalMs() / 1000));
+            if (!view.thumbnail) continue;
+            for (size_t y = 0; y < thumbnailHeight; ++y)
+                std::copy_n(view.thumbnail + y * thumbnailWidth * 3, thumbnailWidth * 3, &strip[(y * stripWidth + i * thumbnailWidth) * 3]);
+        }
+        if (!keyframeStrip)
+            glGenTextures(1, &keyframeStrip);
+        glBindTexture(GL_TEXTURE_2D, keyframeStrip);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, (GLsizei)stripWidth, (GLsizei)thumbnailHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, strip.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        for (size_t keyframe = 0; keyframe < keyframeIndex.getKeyframeCount(); ++keyframe)
+            keyframePoints.push_back(keyframeIndex.getPointCount(keyframe) / 1000.0f);
+    };
+
     // Skips some frames to allow for auto-exposure stabilization
     for (int i = 0; i < 10; i++) rs_devices[0].pipe.wait_for_frames();
 
@@ -453,6 +1323,9 @@ int main() {
                 gizmos->addLine({ -.9f + i * 0.1f, 0, 1 }, { -.9f + i * 0.1f, 0, -1 }, { 0.5f, 0.5f, 0.5f, 1 });
                 gizmos->addLine({ 1, 0, -.9f + i * 0.1f }, { -1, 0, -.9f + i * 0.1f }, { 0.5f, 0.5f, 0.5f, 1 });
             }
+
+            calibrationTargets.draw(gizmos);
+            captureVolume.draw(gizmos, editVolume);
         }
 
         ImGui_ImplOpenGL3_NewFrame();
@@ -462,10 +1335,71 @@ int main() {
         if (ImGui::BeginMainMenuBar()) {
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::SliderFloat("Point Size", &pointSize, 0, 1);
+
+            // one sweep: every unlocked camera that can see any target gets its pose
+            if (ImGui::Button("Solve Rig")) {
+                for (auto& device : rs_devices) {
+                    if (!device.rgbOn || !device.findTargets(calibrationTargets)) continue;
+                    device.applyTargetPose(captureSpaceMatrix);
+                    device.saveCalibration();
+                }
+            }
+            if (ImGui::Button("Export Targets")) {
+                calibrationTargets.exportImages("./aruco");
+                calibrationTargets.save("./calibration/targets.yml");
+            }
+
+            ImGui::Checkbox("Fuse", &fusePoints);
+            if (auto fused = pointCloudFusion.acquire(); fusePoints && fused) {
+                ImGui::Text("%d pts %.2f ms", (int)fused->count, pointCloudFusion.getLastFuseMs());
+
+                ImGui::Checkbox("Dedup", &dedupPoints);
+                if (dedupPoints)
+                    ImGui::Text("-%.1f%% (%d voxels) %.2f ms", pointCloudDedup.getDedupRatio() * 100,
+                        (int)pointCloudDedup.getMergedVoxels(), pointCloudDedup.getLastDedupMs());
+                ImGui::Checkbox("Draw Fused", &drawFused);
+            }
+
+            if (!sessionRecorder.isRecording()) {
+                auto settings = sessionRecorder.getSettings();
+                bool changed = ImGui::Checkbox("Compress Depth", &settings.compressDepth);
+                changed |= ImGui::Checkbox("Compress Colour", &settings.compressColour);
+                if (settings.compressColour) {
+                    bool lossless = settings.colour.type == ColourCodec::Type::Qoi;
+                    changed |= ImGui::Checkbox("Lossless", &lossless);
+                    settings.colour.type = lossless ? ColourCodec::Type::Qoi : ColourCodec::Type::Jpeg;
+                    if (!lossless) {
+                        ImGui::SetNextItemWidth(100);
+                        changed |= ImGui::SliderInt("Quality", &settings.colour.quality, 50, 100);
+                    }
+                }
+                if (changed)
+                    sessionRecorder.setSettings(settings);
+                if (ImGui::Button("Record")) {
+                    std::vector<SessionFormat::CameraInfo> cameras;
+                    for (auto& device : rs_devices)
+                        cameras.push_back(device.getSessionInfo());
+                    std::filesystem::create_directories("./recordings");
+                    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+                    sessionRecorder.start(std::format("./recordings/session_{:%Y%m%d_%H%M%S}.vcs", now), cameras);
+                }
+            }
+            else {
+                if (ImGui::Button("Stop"))
+                    sessionRecorder.stop();
+                auto stats = sessionRecorder.getStats();
+                ImGui::Text("%.0fs %d frames %.0f MB (%d dropped) %.0f MB/s, %d queued", stats.seconds, (int)stats.framesWritten,
+                    stats.bytesWritten / 1e6, (int)stats.framesDropped, stats.writeMBps, (int)stats.queuedChunks);
+                ImGui::Text("depth %.1fx %.1f ms, colour %.1fx %.1f ms, %d encoding on %d threads", stats.depthRatio, stats.depthEncodeMs,
+                    stats.colourRatio, stats.colourEncodeMs, (int)stats.encodingFrames, (int)stats.encoderThreads);
+                ImGui::Text("%d syncs %.1f ms, %.0f MB unsynced, %d checkpoints", (int)stats.syncs, stats.syncMs,
+                    stats.unsyncedBytes / 1e6, (int)stats.checkpoints);
+            }
             ImGui::EndMainMenuBar();
         }
 
-        for (auto& device : rs_devices) {
+        for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+            auto& device = rs_devices[cameraIndex];
 
             ImGui::SetNextWindowSize(ImVec2{ 0,0 });
 
@@ -486,9 +1420,137 @@ int main() {
                 auto pcSize = device.points.size();
                 ImGui::LabelText(" - Points", "%d", pcSize);
 
+                if (ImGui::TreeNode("Normals")) {
+                    ImGui::Checkbox(" - Estimate", &device.estimateNormals);
+                    auto settings = device.normalEstimator.getSettings();
+                    float maxDepthChange = settings.maxDepthChange * 100;
+                    bool changed = ImGui::SliderInt(" - Radius", &settings.radius, 1, 15);
+                    changed |= ImGui::SliderFloat(" - Max Depth Change (%)", &maxDepthChange, 0.5f, 20);
+                    changed |= ImGui::SliderFloat(" - Min Support", &settings.minSupport, 0.05f, 1);
+                    changed |= ImGui::SliderInt(" - Step", &settings.step, 1, 4);
+                    if (changed) {
+                        settings.maxDepthChange = maxDepthChange / 100;
+                        device.normalEstimator.setSettings(settings);
+                    }
+                    if (device.pointsHaveNormals)
+                        ImGui::Text("%.2f ms", device.normalEstimator.getLastComputeMs());
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Point Filter")) {
+                    auto settings = device.pointFilter.getSettings();
+                    float voxelSizeMM = settings.voxelSize * 1000;
+                    int outlierMode = (int)settings.outlierMode;
+                    bool changed = ImGui::Checkbox(" - Downsample", &settings.downsample);
+                    changed |= ImGui::SliderFloat(" - Voxel (mm)", &voxelSizeMM, 1, 50);
+                    changed |= ImGui::Combo(" - Outliers", &outlierMode, "None\0Radius\0Statistical\0");
+                    if (outlierMode == (int)PointFilter::OutlierMode::Radius)
+                        changed |= ImGui::SliderInt(" - Min Neighbours", &settings.minNeighbours, 1, 100);
+                    if (outlierMode == (int)PointFilter::OutlierMode::Statistical)
+                        changed |= ImGui::SliderFloat(" - Std Dev Ratio", &settings.stdDevRatio, 0, 3);
+                    if (changed) {
+                        settings.voxelSize = voxelSizeMM / 1000;
+                        settings.outlierMode = (PointFilter::OutlierMode)outlierMode;
+                        device.pointFilter.setSettings(settings);
+                    }
+                    if (device.pointsFiltered)
+                        ImGui::Text("%d -> %d points, %.2f ms", (int)device.pointFilter.getInputCount(),
+                            (int)device.pointFilter.getCount(), device.pointFilter.getLastFilterMs());
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Depth Filter")) {
+                    if (ImGui::Combo(" - Filter", &device.depthFilter, "None\0Temporal\0Librealsense Spatial + Temporal\0"))
+                        device.temporalFilter->reset();
+
+                    auto settings = device.temporalFilter->getSettings();
+                    float deltaMM = settings.delta * 1000;
+                    bool changed = ImGui::SliderFloat(" - Alpha", &settings.alpha, 0, 1);
+                    changed |= ImGui::SliderFloat(" - Delta (mm)", &deltaMM, 1, 200);
+                    changed |= ImGui::SliderInt(" - Persistence", &settings.persistence, 0, 30);
+                    if (changed) {
+                        settings.delta = deltaMM / 1000;
+                        device.temporalFilter->setSettings(settings);
+                    }
+
+                    if (device.depthFilter != rs_camera::DepthFilterNone)
+                        ImGui::Text("%.2f ms", device.depthFilterMs);
+                    if (ImGui::Button("Benchmark"))
+                        device.benchmarkDepthFilters();
+                    if (device.benchmarkNativeMs > 0)
+                        ImGui::Text("Temporal %.2f ms, librealsense %.2f ms", device.benchmarkNativeMs, device.benchmarkLibrealsenseMs);
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNode("Background")) {
+                    auto& background = *device.backgroundModel;
+                    auto settings = background.getSettings();
+                    float minToleranceMM = settings.minTolerance * 1000;
+                    bool changed = ImGui::SliderInt(" - Frames", &settings.frames, 3, 255);
+                    changed |= ImGui::SliderFloat(" - Sigma", &settings.sigmaScale, 0, 10);
+                    changed |= ImGui::SliderFloat(" - Min Tolerance (mm)", &minToleranceMM, 0, 100);
+                    changed |= ImGui::SliderFloat(" - Relative Tolerance", &settings.relativeTolerance, 0, 0.1f);
+                    if (changed) {
+                        settings.minTolerance = minToleranceMM / 1000;
+                        background.setSettings(settings);
+                    }
+
+                    if (background.isLearning())
+                        ImGui::Text("Learning %d/%d", background.getLearnedFrames(), settings.frames);
+                    else if (background.isBuilding())
+                        ImGui::Text("Building...");
+                    else if (ImGui::Button("Learn Background"))
+                        background.startLearning();
+
+                    if (background.isValid()) {
+                        ImGui::Checkbox(" - Subtract", &device.subtractBackground);
+                        if (device.subtractBackground)
+                            ImGui::Text("Removed %.1f%%", background.getMaskedFraction() * 100);
+                        if (ImGui::Button("Save Background"))
+                            background.save(std::format("./calibration/{}.bg", device.id));
+                    }
+                    ImGui::TreePop();
+                }
+
                 if ((device.rgbOn || device.depthOn) /*&&
                     pipe.poll_for_frames(&device.lastFrames)*/) {
-                    device.lastFrames = device.pipe.wait_for_frames();
+                    if (int source = playbackSource[cameraIndex]; source >= 0) {
+                        double timestamp = sessionPlayer.getStartTimestamp(source) + playbackTime * 1000.0;
+                        size_t index = sessionPlayer.findFrame(source, timestamp);
+                        device.lastFrames = playbackCameras[source]->play(sessionPlayer, sessionPlayer.getFrame(source, index), index);
+                        if (playing)
+                            sessionPlayer.prefetch(source, index + 1, 4);
+                    }
+                    else
+                        device.lastFrames = device.pipe.wait_for_frames();
+
+                    if (sessionRecorder.isRecording()) {
+                        Eigen::Affine3f sensorToPoints = device.align ? device.depthToColor : Eigen::Affine3f::Identity();
+                        record_frameset(sessionRecorder, (uint16_t)cameraIndex, device.lastFrames,
+                            captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f) * sensorToPoints);
+                    }
+
+                    if (auto raw = device.lastFrames.get_depth_frame(); raw && device.backgroundModel->isLearning())
+                        device.backgroundModel->addFrame((const uint16_t*)raw.get_data(), raw.get_width(), raw.get_height(), raw.get_units());
+                    if (device.subtractBackground && device.backgroundModel->isValid())
+                        device.lastFrames = device.backgroundBlock.process(device.lastFrames).as<rs2::frameset>();
+
+                    auto filterStart = std::chrono::steady_clock::now();
+                    if (device.depthFilter == rs_camera::DepthFilterNative)
+                        device.lastFrames = device.temporalBlock.process(device.lastFrames).as<rs2::frameset>();
+                    else if (device.depthFilter == rs_camera::DepthFilterLibrealsense)
+                        device.lastFrames = device.rsTemporalFilter.process(device.rsSpatialFilter.process(device.lastFrames)).as<rs2::frameset>();
+                    device.depthFilterMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - filterStart).count();
+
+                    // the raw depth is in the depth sensor's frame, the pose is for the frame the points end up in
+                    if (auto raw = device.lastFrames.get_depth_frame(); cropToVolume && raw) {
+                        auto intrinsics = raw.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+                        Eigen::Affine3f sensorToPoints = device.align ? device.depthToColor : Eigen::Affine3f::Identity();
+                        *device.volumeWindow = captureVolume.computeWindow(raw.get_width(), raw.get_height(),
+                            intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy, raw.get_units(),
+                            (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f) * sensorToPoints).matrix());
+                        device.lastFrames = device.volumeBlock.process(device.lastFrames).as<rs2::frameset>();
+                    }
 
                     if (device.rgbOn) {
                         auto color = device.lastFrames.get_color_frame();
@@ -497,7 +1559,7 @@ int main() {
                         device.pc.map_to(color);
 
                         if (ImGui::Button("Capture Frame")) {
-                            device.capturedFrames.push_back(frame_to_mat(color));
+                            device.captureFrame(frame_to_mat(color), charucoBoard);
                         }
                     }
 
@@ -509,13 +1571,35 @@ int main() {
 
                         rs2::depth_frame depth = device.align ? aligned_set.get_depth_frame() : device.lastFrames.get_depth_frame();
 
+                        if (device.correctDepth && !device.depthCorrection->isIdentity())
+                            depth = device.depthCorrectionBlock.process(depth);
+
                         auto color_depth = colorizer.colorize(depth);
                         copyFrameToGLTexture(device.depth, color_depth);
 
                         device.points = device.pc.calculate(depth);
+                        device.processedDepth = depth;
+
+                        // only the rows the volume covers go on to filtering, fusion and upload
+                        if (cropToVolume) {
+                            auto intrinsics = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+                            auto window = captureVolume.computeWindow(depth.get_width(), depth.get_height(),
+                                intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy, depth.get_units(),
+                                (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f)).matrix());
+                            device.setPointSpan(window.visible ? window.y0 : 0, window.visible ? window.y1 : 0, depth.get_width());
+                        }
+                        else
+                            device.setPointSpan(0, depth.get_height(), depth.get_width());
+                        device.estimatePointNormals(depth);
+                        device.pointsPending = true;
                     }
                 }
 
+                if (auto drift = driftMonitor.getResult(cameraIndex); drift.valid) {
+                    ImGui::Text("Drift: %.1f mm RMS, %.1f mm / %.2f deg (%d pts)",
+                        drift.rmsError * 1000, drift.translation * 1000, drift.rotation, drift.overlap);
+                }
+
                 if (device.capturedFrames.size() >= 10 &&
                     ImGui::Button("Calibrate")) {
                     device.calibrate(charucoBoard);
@@ -523,11 +1607,43 @@ int main() {
 
                 if (device.capturedFrames.size() > 0)
                 ImGui::Text("Captured Frames: %d", device.capturedFrames.size());
-                if (device.rgbOn) {
-                    if (ImGui::Checkbox(" - Detect Board", &device.detectMarker)) {
-                        device.findCharucoBoard(charucoBoard);
 
-                        ImGui::Text("Found: %d", device.markerboardFound ? 1 : 0);
+                if (device.calibrated && device.rgbOn && device.depthOn) {
+                    if (ImGui::Button("Capture Depth Sample"))
+                        device.captureDepthSample(charucoBoard);
+                    if (device.depthCorrection->getSampleCount() > 0) {
+                        ImGui::SameLine();
+                        ImGui::Text("Samples: %d", device.depthCorrection->getSampleCount());
+                        ImGui::SameLine();
+                        if (ImGui::Button("Fit Depth"))
+                            device.fitDepthCorrection();
+                    }
+                }
+                if (!device.depthCorrection->isIdentity())
+                    ImGui::Checkbox(" - Depth Correction", &device.correctDepth);
+
+                auto& analytics = device.calibrationAnalytics;
+                if (analytics.getFrameCount() > 0) {
+                    analytics.updateTextures();
+
+                    ImGui::Text("Coverage %.0f%%: %s", analytics.getCoveredFraction() * 100, analytics.suggestPlacement().c_str());
+                    ImGui::Image((void*)(intptr_t)analytics.getCoverageTexture(), ImVec2(160, 90));
+                    if (analytics.getFrameErrors().size() > 0) {
+                        ImGui::SameLine();
+                        ImGui::Image((void*)(intptr_t)analytics.getResidualTexture(), ImVec2(160, 90));
+                        ImGui::PlotHistogram(" - Frame Error", analytics.getFrameErrors().data(), (int)analytics.getFrameErrors().size(),
+                            0, std::format("max corner {:.2f} px", analytics.getMaxResidual()).c_str(), 0, FLT_MAX, ImVec2(320, 40));
+                    }
+                }
+                if (device.rgbOn && device.calibrated) {
+                    ImGui::Checkbox(" - Detect Targets", &device.detectMarker);
+                    if (device.detectMarker && device.findTargets(calibrationTargets)) {
+                        ImGui::Text("Found: %d boards, %d markers, %.2f px", device.targetDetection.boards,
+                            device.targetDetection.markers, device.targetError);
+                        if (!device.locked && ImGui::Button("Apply Pose")) {
+                            device.applyTargetPose(captureSpaceMatrix);
+                            device.saveCalibration();
+                        }
                     }
                 }
 
@@ -539,15 +1655,552 @@ int main() {
                 gizmos->addTransform(device.transform.matrix(), 0.1f);
             }
             ImGui::End();
+        }
 
+        // each camera has its own filter, so they all run at once
+        std::for_each(std::execution::par, rs_devices.begin(), rs_devices.end(), [](rs_camera& device) {
+            if (device.pointsPending)
+                device.filterPoints();
+        });
+
+        for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+            auto& device = rs_devices[cameraIndex];
+            if (device.pointsPending) {
+                // small incremental corrections from the drift monitor, never for locked cameras;
+                // taken first so the next snapshot is drawn with the corrected pose
+                if (Eigen::Affine3f correction; !device.locked && driftMonitor.takeCorrection(cameraIndex, correction))
+                    device.transform = captureSpaceMatrix.inverse() * correction * captureSpaceMatrix * device.transform;
+
+                if (driftMonitor.isSubmissionDue())
+                    driftMonitor.submit(cameraIndex, device.getVertices(), device.getPointCount(),
+                                        sizeof(rs2::vertex), captureSpaceMatrix * device.transform);
+                device.pointsPending = false;
+            }
             device.updateBuffers();
         }
 
+        // camera ids in the fused cloud are indices into rs_devices
+        if (fusePoints) {
+            std::vector<PointCloudFusion::Input> fusionInputs(rs_devices.size());
+            for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+                auto& device = rs_devices[cameraIndex];
+                if (!device.depthOn || device.getPointCount() == 0) continue;
+
+                auto& input = fusionInputs[cameraIndex];
+                input.vertices = device.getVertices();
+                input.texcoords = device.getTexcoords();
+                input.count = device.getPointCount();
+                // same Y flip as pc.vert
+                input.transform = (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f)).matrix();
+
+                if (auto color = device.lastFrames.get_color_frame(); device.rgbOn && color) {
+                    input.colour = (const uint8_t*)color.get_data();
+                    input.colourWidth = color.get_width();
+                    input.colourHeight = color.get_height();
+                    input.colourStride = color.get_stride_in_bytes();
+                }
+            }
+            pointCloudFusion.fuse(fusionInputs);
+
+            if (dedupPoints)
+                pointCloudDedup.process(pointCloudFusion.acquire());
+        }
+
+        if (volumetricRecorder.isRecording() && fusePoints)
+            volumetricRecorder.add(dedupPoints ? pointCloudDedup.acquire() : pointCloudFusion.acquire());
+
+        if (pointExporter.isRunning()) {
+            if (exportCameraPoints) {
+                for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+                    auto& device = rs_devices[cameraIndex];
+                    if (!device.depthOn || device.getPointCount() == 0) continue;
+
+                    PointCloudExporter::Input input;
+                    input.vertices = device.getVertices();
+                    input.texcoords = device.getTexcoords();
+                    input.normals = device.getNormals();
+                    input.count = device.getPointCount();
+                    input.transform = (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f)).matrix();
+
+                    if (auto color = device.lastFrames.get_color_frame(); device.rgbOn && color) {
+                        input.colour = (const uint8_t*)color.get_data();
+                        input.colourWidth = color.get_width();
+                        input.colourHeight = color.get_height();
+                        input.colourStride = color.get_stride_in_bytes();
+                    }
+                    pointExporter.add(std::format("cam{}_{:06}", cameraIndex, pointExportFrame), input);
+                }
+            }
+            if (exportFusedPoints && fusePoints) {
+                if (auto fused = dedupPoints ? pointCloudDedup.acquire() : pointCloudFusion.acquire())
+                    pointExporter.add(std::format("fused_{:06}", pointExportFrame), fused);
+            }
+            ++pointExportFrame;
+        }
+
+        if (integrateVolume) {
+            std::vector<TsdfVolume::DepthInput> volumeInputs(rs_devices.size());
+            for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+                auto& device = rs_devices[cameraIndex];
+                if (!device.depthOn || !device.processedDepth) continue;
+
+                auto depth = device.processedDepth.as<rs2::depth_frame>();
+                auto intrinsics = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+
+                auto& input = volumeInputs[cameraIndex];
+                input.depth = (const uint16_t*)depth.get_data();
+                input.width = depth.get_width();
+                input.height = depth.get_height();
+                input.depthUnits = depth.get_units();
+                input.fx = intrinsics.fx;
+                input.fy = intrinsics.fy;
+                input.cx = intrinsics.ppx;
+                input.cy = intrinsics.ppy;
+                input.cameraToCapture = (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f)).matrix();
+
+                // colour only lines up with depth pixels once aligned
+                if (auto color = device.lastFrames.get_color_frame(); device.align && device.rgbOn && color) {
+                    input.colour = (const uint8_t*)color.get_data();
+                    input.colourStride = color.get_stride_in_bytes();
+                }
+            }
+            tsdfVolume.integrate(volumeInputs);
+        }
+
+        if (extractMesh)
+            meshExtractor.update(tsdfVolume);
+        if (meshExtractor.getRevision() != volumeMeshRevision) {
+            volumeMesh.update(meshExtractor.getMesh());
+            volumeMeshRevision = meshExtractor.getRevision();
+        }
+
+        // each new surface as a PLY, packed and written on the mesh writer's thread
+        if (extractMesh && exportMesh && meshExtractor.getRevision() != meshExportRevision) {
+            if (!meshWriter.isRunning())
+                meshWriter.start("./export");
+            meshWriter.add(std::format("mesh_{:06}", meshExportIndex++), meshExtractor.getMesh());
+            meshExportRevision = meshExtractor.getRevision();
+        }
+        else if (!exportMesh && meshWriter.isRunning())
+            meshWriter.stop();
+
+        // a textured mesh whenever the surface changes, its atlas from every camera's latest colour
+        if (extractMesh && meshSequenceExporter.isRunning() && meshExtractor.getRevision() != meshSequenceRevision) {
+            std::vector<TextureBaker::Camera> cameras;
+            for (auto& device : rs_devices) {
+                auto colour = device.lastFrames.get_color_frame();
+                if (!device.rgbOn || !colour || colour.get_profile().format() != RS2_FORMAT_RGB8) continue;
+
+                auto intrinsics = colour.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+                TextureBaker::Camera camera;
+                camera.rgb = (const uint8_t*)colour.get_data();
+                camera.width = colour.get_width();
+                camera.height = colour.get_height();
+                camera.stride = colour.get_stride_in_bytes();
+                camera.fx = intrinsics.fx;
+                camera.fy = intrinsics.fy;
+                camera.cx = intrinsics.ppx;
+                camera.cy = intrinsics.ppy;
+
+                // the device transform places the points, which are in the colour sensor's frame only when aligned
+                Eigen::Affine3f sensorToPoints = device.align ? device.depthToColor : Eigen::Affine3f::Identity();
+                camera.cameraToCapture = (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f) *
+                                          sensorToPoints * device.depthToColor.inverse()).matrix();
+                cameras.push_back(camera);
+            }
+            meshSequenceExporter.add(std::format("mesh_{:06}", meshSequenceFrame++), meshExtractor.getMesh(), cameras);
+            meshSequenceRevision = meshExtractor.getRevision();
+        }
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Volume")) {
+            ImGui::Checkbox(" - Integrate", &integrateVolume);
+
+            auto settings = tsdfVolume.getSettings();
+            float voxelSizeMM = settings.voxelSize * 1000;
+            float truncationMM = settings.truncation * 1000;
+            bool changed = ImGui::SliderFloat(" - Voxel (mm)", &voxelSizeMM, 2, 50);
+            changed |= ImGui::SliderFloat(" - Truncation (mm)", &truncationMM, 5, 200);
+            changed |= ImGui::SliderFloat(" - Max Depth", &settings.maxDepth, 0.5f, 10);
+            if (changed) {
+                settings.voxelSize = voxelSizeMM / 1000;
+                settings.truncation = truncationMM / 1000;
+                tsdfVolume.setSettings(settings);
+            }
+            if (ImGui::Button("Clear"))
+                tsdfVolume.clear();
+
+            ImGui::Text("Blocks: %d (%d active)", (int)tsdfVolume.getBlockCount(), (int)tsdfVolume.getActiveBlockCount());
+            ImGui::Text("Integrate: %.2f ms", tsdfVolume.getLastIntegrateMs());
+
+            ImGui::Checkbox(" - Mesh", &extractMesh);
+            ImGui::SameLine();
+            if (ImGui::Button("Full Rebuild"))
+                meshExtractor.rebuild(tsdfVolume);
+            ImGui::Checkbox(" - Export Mesh", &exportMesh);
+            if (meshWriter.isRunning()) {
+                auto stats = meshWriter.getStats();
+                ImGui::Text("%d written (%d dropped), copy %.2f ms, write %.0f ms", (int)stats.meshesWritten,
+                    (int)stats.meshesDropped, stats.copyMs, stats.writeMs);
+            }
+            ImGui::Text("Triangles: %d", (int)meshExtractor.getMesh().indices.size() / 3);
+            ImGui::Text("Incremental: %.2f ms (%d blocks), Full: %.2f ms", meshExtractor.getLastUpdateMs(),
+                (int)meshExtractor.getLastBlockCount(), meshExtractor.getLastRebuildMs());
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Mesh Export")) {
+            if (!meshSequenceExporter.isRunning()) {
+                auto settings = meshSequenceExporter.getSettings();
+                bool obj = settings.format == MeshSequenceExporter::Format::Obj;
+                float keepPercent = settings.simplifier.targetRatio * 100;
+                float texelSizeMM = settings.baker.texelSize * 1000;
+                int minTriangles = (int)settings.simplifier.minComponentTriangles;
+                bool changed = ImGui::Checkbox(" - OBJ", &obj);
+                changed |= ImGui::SliderFloat(" - Keep (%)", &keepPercent, 1, 100);
+                changed |= ImGui::SliderInt(" - Min Piece (tris)", &minTriangles, 0, 5000);
+                changed |= ImGui::SliderFloat(" - Texel (mm)", &texelSizeMM, 0.5f, 10);
+                changed |= ImGui::SliderInt(" - JPEG Quality", &settings.jpegQuality, 50, 100);
+                if (changed) {
+                    settings.format = obj ? MeshSequenceExporter::Format::Obj : MeshSequenceExporter::Format::Glb;
+                    settings.simplifier.targetRatio = keepPercent / 100;
+                    settings.simplifier.minComponentTriangles = (unsigned int)minTriangles;
+                    settings.baker.texelSize = texelSizeMM / 1000;
+                    meshSequenceExporter.setSettings(settings);
+                }
+                if (!extractMesh)
+                    ImGui::Text("Mesh the volume to export");
+                else if (ImGui::Button("Start")) {
+                    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+                    meshSequenceFrame = 0;
+                    meshSequenceRevision = meshExtractor.getRevision();
+                    meshSequenceExporter.start(std::format("./export/meshes_{:%Y%m%d_%H%M%S}", now));
+                }
+            }
+            else {
+                if (ImGui::Button("Stop"))
+                    meshSequenceExporter.stop();
+                auto stats = meshSequenceExporter.getStats();
+                ImGui::Text("%.0fs %d meshes %.0f MB (%d dropped, %d empty), %d queued on %d threads", stats.seconds, (int)stats.framesWritten,
+                    stats.bytesWritten / 1e6, (int)stats.framesDropped, (int)stats.framesEmpty, (int)stats.queued, (int)stats.threads);
+                ImGui::Text("%.2f s/frame: simplify %.0f ms, bake %.0f ms, write %.0f ms", stats.secondsPerFrame,
+                    stats.simplifyMs, stats.bakeMs, stats.writeMs);
+            }
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Drift Monitor")) {
+            auto settings = driftMonitor.getSettings();
+            bool changed = false;
+            changed |= ImGui::Checkbox(" - Enabled", &settings.enabled);
+            changed |= ImGui::Checkbox(" - Apply Corrections", &settings.applyCorrections);
+            int anchor = (int)settings.anchorCamera;
+            if (ImGui::SliderInt(" - Anchor Camera", &anchor, 0, std::max(0, (int)rs_devices.size() - 1))) {
+                settings.anchorCamera = (unsigned int)anchor;
+                changed = true;
+            }
+            changed |= ImGui::SliderFloat(" - Correction Rate", &settings.correctionRate, 0, 1);
+            changed |= ImGui::SliderFloat(" - Interval (ms)", &settings.intervalMs, 100, 10000);
+            changed |= ImGui::SliderFloat(" - Budget (ms)", &settings.budgetMs, 1, 50);
+            changed |= ImGui::SliderFloat(" - Pair Distance", &settings.maxPairDistance, 0.005f, 0.1f);
+            if (changed)
+                driftMonitor.setSettings(settings);
+            ImGui::Text("Last round: %.2f ms", driftMonitor.getLastRoundMs());
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Capture Volume")) {
+            ImGui::Checkbox(" - Crop", &cropToVolume);
+            ImGui::SameLine();
+            ImGui::Checkbox(" - Edit", &editVolume);
+
+            Eigen::Vector3f center = captureVolume.getCenter();
+            Eigen::Vector3f size = captureVolume.getExtents() * 2;
+            float yaw = captureVolume.getYaw();
+            if (ImGui::DragFloat3(" - Center", center.data(), 0.01f))
+                captureVolume.setCenter(center);
+            if (ImGui::DragFloat3(" - Size", size.data(), 0.01f, 0.1f, 20))
+                captureVolume.setExtents(size * 0.5f);
+            if (ImGui::SliderFloat(" - Yaw", &yaw, -180, 180))
+                captureVolume.setYaw(yaw);
+            if (ImGui::Button("Save"))
+                captureVolume.save("./calibration/volume.yml");
+
+            if (cropToVolume) {
+                for (auto& device : rs_devices) {
+                    auto& window = *device.volumeWindow;
+                    if (window.visible)
+                        ImGui::Text("%s: %.0f%% of pixels, %.2f - %.2f m", device.id.c_str(), window.getCoverage() * 100,
+                            window.depthMin * window.depthUnits, window.depthMax * window.depthUnits);
+                    else
+                        ImGui::Text("%s: outside", device.id.c_str());
+                }
+            }
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Point Export")) {
+            ImGui::Checkbox(" - Per Camera", &exportCameraPoints);
+            ImGui::Checkbox(" - Fused", &exportFusedPoints);
+
+            if (!pointExporter.isRunning()) {
+                auto settings = pointExporter.getSettings();
+                bool pcd = settings.format == PointCloudExporter::Format::Pcd;
+                bool changed = ImGui::Checkbox(" - PCD", &pcd);
+                changed |= ImGui::Checkbox(" - Normals", &settings.normals);
+                changed |= ImGui::Checkbox(" - Unbuffered", &settings.unbuffered);
+                if (changed) {
+                    settings.format = pcd ? PointCloudExporter::Format::Pcd : PointCloudExporter::Format::Ply;
+                    pointExporter.setSettings(settings);
+                }
+                if (ImGui::Button("Start")) {
+                    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+                    pointExportFrame = 0;
+                    pointExporter.start(std::format("./export/points_{:%Y%m%d_%H%M%S}", now));
+                }
+            }
+            else {
+                if (ImGui::Button("Stop"))
+                    pointExporter.stop();
+                auto stats = pointExporter.getStats();
+                ImGui::Text("%.0fs %d clouds %.0f MB (%d dropped), %d queued on %d threads", stats.seconds, (int)stats.framesWritten,
+                    stats.bytesWritten / 1e6, (int)stats.framesDropped, (int)stats.queued, (int)stats.threads);
+                ImGui::Text("added %.1f/s, written %.1f/s %.0f MB/s, lag %.0f ms, copy %.1f ms", stats.addedPerSecond,
+                    stats.writtenPerSecond, stats.writeMBps, stats.lagMs, stats.copyMs);
+            }
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Volumetric Video")) {
+            if (!volumetricRecorder.isRecording()) {
+                auto settings = volumetricRecorder.getSettings();
+                float voxelSizeMM = settings.codec.voxelSize * 1000;
+                bool changed = ImGui::SliderFloat(" - Voxel (mm)", &voxelSizeMM, 1, 10);
+                changed |= ImGui::SliderInt(" - Colour Bits", &settings.codec.colourBits, 4, 8);
+                if (changed) {
+                    settings.codec.voxelSize = voxelSizeMM / 1000;
+                    volumetricRecorder.setSettings(settings);
+                }
+                if (!fusePoints)
+                    ImGui::Text("Fuse to record");
+                else if (ImGui::Button("Record")) {
+                    std::filesystem::create_directories("./volumetric");
+                    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+                    volumetricRecorder.start(std::format("./volumetric/volume_{:%Y%m%d_%H%M%S}.vvol", now));
+                }
+            }
+            else {
+                if (ImGui::Button("Stop"))
+                    volumetricRecorder.stop();
+                auto stats = volumetricRecorder.getStats();
+                ImGui::Text("%.0fs %d frames %.0f MB (%d dropped), %d queued", stats.seconds, (int)stats.framesWritten,
+                    stats.bytesWritten / 1e6, (int)stats.framesDropped, (int)stats.queued);
+                ImGui::Text("%.1f bits/point, %.1fx, encode %.1f ms", stats.bitsPerPoint, stats.ratio, stats.encodeMs);
+            }
+
+            ImGui::Separator();
+            if (!volumetricPlayer.isOpen()) {
+                std::error_code error;
+                for (auto& entry : std::filesystem::directory_iterator("./volumetric", error)) {
+                    if (entry.path().extension() != ".vvol") continue;
+                    if (ImGui::Selectable(entry.path().filename().string().c_str()) && volumetricPlayer.open(entry.path().string()))
+                        volumetricTime = 0;
+                }
+            }
+            else {
+                ImGui::Text("%s%s", std::filesystem::path(volumetricPlayer.getFilename()).filename().string().c_str(),
+                    volumetricPlayer.wasRecovered() ? " (index rebuilt)" : "");
+                ImGui::Text("%d frames, %.0f MB", (int)volumetricPlayer.getFrameCount(), volumetricPlayer.getFileSize() / 1e6);
+
+                float duration = float(volumetricPlayer.getDuration() / 1000);
+                ImGui::Checkbox(" - Play", &volumetricPlaying);
+                if (volumetricPlaying) {
+                    volumetricTime += ImGui::GetIO().DeltaTime;
+                    if (volumetricTime > duration)
+                        volumetricTime = 0;
+                }
+                ImGui::SliderFloat(" - Time (s)", &volumetricTime, 0, duration);
+
+                size_t index = volumetricPlayer.findFrame(volumetricPlayer.getTimestamp(0) + volumetricTime * 1000.0);
+                volumetricPlayer.request(index);
+                ImGui::Text("frame %d, %d points, decode %.1f ms", (int)index, (int)volumetricPlayer.getPointCount(index),
+                    volumetricPlayer.getLastDecodeMs());
+
+                if (ImGui::Button("Close")) {
+                    volumetricPlayer.close();
+                    volumetricShown = nullptr;
+                    volumetricPlaying = false;
+                }
+            }
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Playback")) {
+            if (!sessionPlayer.isOpen()) {
+                std::error_code error;
+                for (auto& entry : std::filesystem::directory_iterator("./recordings", error)) {
+                    if (entry.path().extension() != ".vcs") continue;
+                    if (ImGui::Selectable(entry.path().filename().string().c_str()))
+                        openSession(entry.path().string());
+                }
+            }
+            else {
+                ImGui::Text("%s%s", std::filesystem::path(sessionPlayer.getFilename()).filename().string().c_str(),
+                    sessionPlayer.wasRecovered() ? " (index rebuilt)" : "");
+                ImGui::Text("%d frames, %.2f GB", (int)sessionPlayer.getTotalFrameCount(), sessionPlayer.getFileSize() / 1e9);
+                auto& cameras = sessionPlayer.getCameras();
+                for (size_t camera = 0; camera < cameras.size(); ++camera) {
+                    bool connected = std::find(playbackSource.begin(), playbackSource.end(), (int)camera) != playbackSource.end();
+                    ImGui::Text(" - %s: %d frames%s", cameras[camera].serial, (int)sessionPlayer.getFrameCount(camera),
+                        connected ? "" : " (not connected)");
+                }
+
+                ImGui::Checkbox(" - Play", &playing);
+                if (playing) {
+                    playbackTime += ImGui::GetIO().DeltaTime;
+                    if (playbackTime > playbackDuration)
+                        playbackTime = 0;
+                }
+                ImGui::SliderFloat(" - Time (s)", &playbackTime, 0, playbackDuration);
+
+                // steps by the frames of the first camera being played
+                auto source = std::find_if(playbackSource.begin(), playbackSource.end(), [](int s) { return s >= 0; });
+                if (source != playbackSource.end()) {
+                    int camera = *source;
+                    double start = sessionPlayer.getStartTimestamp(camera);
+                    size_t index = sessionPlayer.findFrame(camera, start + playbackTime * 1000.0);
+                    if (ImGui::Button("<") && index > 0)
+                        playbackTime = float(sessionPlayer.getTimestamp(camera, index - 1) - start) / 1000;
+                    ImGui::SameLine();
+                    if (ImGui::Button(">") && index + 1 < sessionPlayer.getFrameCount(camera))
+                        playbackTime = float(sessionPlayer.getTimestamp(camera, index + 1) - start) / 1000;
+                    ImGui::SameLine();
+                    ImGui::Text("frame %d", (int)index);
+                }
+
+                // jumping only moves the time, the frames are found and decoded as for any seek
+                if (!keyframeStripTimes.empty()) {
+                    auto& header = keyframeIndex.getHeader();
+                    for (int i = 0; i < keyframeStripLength; ++i) {
+                        if (i > 0) ImGui::SameLine(0, 2);
+                        ImGui::Image((void*)(intptr_t)keyframeStrip, ImVec2((float)header.thumbnailWidth, (float)header.thumbnailHeight),
+                            ImVec2(float(i) / keyframeStripLength, 0), ImVec2(float(i + 1) / keyframeStripLength, 1));
+                        if (ImGui::IsItemClicked())
+                            playbackTime = keyframeStripTimes[i];
+                    }
+
+                    size_t keyframe = keyframeIndex.findKeyframe(playbackTime * 1000.0);
+                    ImGui::PlotLines(" - Points (k)", keyframePoints.data(), (int)keyframePoints.size(), 0,
+                        std::format("{:.0f}k at keyframe {}", keyframePoints[keyframe], keyframe).c_str(), 0, FLT_MAX, ImVec2(0, 40));
+                    if (source != playbackSource.end()) {
+                        if (auto view = keyframeIndex.getKeyframe(keyframe, *source)) {
+                            std::vector<float> bins(view.histogram, view.histogram + header.histogramBins);
+                            ImGui::PlotHistogram(std::format(" - Depth 0-{:.0f} m", header.histogramMaxDepth).c_str(), bins.data(), (int)bins.size(),
+                                0, nullptr, 0, FLT_MAX, ImVec2(0, 40));
+                        }
+                    }
+                }
+
+                if (ImGui::Button("Close"))
+                    closeSession();
+            }
+        }
+        ImGui::End();
+
+        ImGui::SetNextWindowSize(ImVec2{ 0,0 });
+        if (ImGui::Begin("Rig ICP")) {
+            auto settings = rigIcp.getSettings();
+            float maxDistanceMM = settings.maxDistance * 1000;
+            bool changed = ImGui::SliderInt(" - Levels", &settings.levels, 1, 5);
+            changed |= ImGui::SliderInt(" - Iterations", &settings.iterations, 1, 20);
+            changed |= ImGui::SliderInt(" - Stride", &settings.stride, 1, 4);
+            changed |= ImGui::SliderFloat(" - Max Distance (mm)", &maxDistanceMM, 5, 200);
+            if (changed) {
+                settings.maxDistance = maxDistanceMM / 1000;
+                rigIcp.setSettings(settings);
+            }
+
+            bool snap = ImGui::Button("Snap");
+            ImGui::SameLine();
+            ImGui::Checkbox(" - Periodic", &snapPeriodically);
+            ImGui::SliderFloat(" - Interval (s)", &snapIntervalS, 1, 60);
+
+            auto now = std::chrono::steady_clock::now();
+            bool periodic = snapPeriodically && std::chrono::duration<float>(now - lastSnap).count() >= snapIntervalS;
+
+            // a refinement still being solved holds off the next, the button included
+            if ((snap || periodic) && !rigIcp.isBusy()) {
+                std::vector<RigIcp::Input> icpInputs(rs_devices.size());
+                for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size(); ++cameraIndex) {
+                    auto& device = rs_devices[cameraIndex];
+                    if (!device.depthOn || !device.processedDepth) continue;
+
+                    auto depth = device.processedDepth.as<rs2::depth_frame>();
+                    auto intrinsics = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+
+                    auto& input = icpInputs[cameraIndex];
+                    input.depth = (const uint16_t*)depth.get_data();
+                    input.width = depth.get_width();
+                    input.height = depth.get_height();
+                    input.depthUnits = depth.get_units();
+                    input.fx = intrinsics.fx;
+                    input.fy = intrinsics.fy;
+                    input.cx = intrinsics.ppx;
+                    input.cy = intrinsics.ppy;
+                    input.cameraToCapture = (captureSpaceMatrix * device.transform * Eigen::Scaling(1.0f, -1.0f, 1.0f)).matrix();
+                    input.fixed = device.locked;
+                }
+
+                if (rigIcp.submit(icpInputs)) {
+                    lastSnap = now;
+                    icpSaveResults = snap;
+                }
+            }
+
+            // corrections pre-multiply, so cameras moved since the submission keep that move
+            if (rigIcp.takeResults(icpResults)) {
+                for (unsigned int cameraIndex = 0; cameraIndex < rs_devices.size() && cameraIndex < icpResults.size(); ++cameraIndex) {
+                    auto& device = rs_devices[cameraIndex];
+                    auto& result = icpResults[cameraIndex];
+                    if (device.locked || !result.valid) continue;
+
+                    device.transform = captureSpaceMatrix.inverse() * result.correction * captureSpaceMatrix * device.transform;
+
+                    // a snap is deliberate, periodic refinements are only kept for this session
+                    if (icpSaveResults)
+                        device.saveCalibration();
+                }
+            }
+
+            ImGui::Text("Pyramids: %.2f ms, Solve: %.2f ms%s", rigIcp.getLastPyramidMs(), rigIcp.getLastSolveMs(), rigIcp.isBusy() ? " (solving)" : "");
+            for (unsigned int cameraIndex = 0; cameraIndex < icpResults.size() && cameraIndex < rs_devices.size(); ++cameraIndex) {
+                auto& result = icpResults[cameraIndex];
+                if (result.pairs == 0) continue;
+                ImGui::Text("%s: %.2f -> %.2f mm RMS (%d pairs)%s", rs_devices[cameraIndex].id.c_str(),
+                    result.rmsBefore * 1000, result.rmsAfter * 1000, result.pairs, result.valid ? "" : " (not moved)");
+            }
+        }
+        ImGui::End();
+
         ImGui::Render();
 
         updateCamera(window, eyePosition, eyeTarget);
         viewMatrix = CalculateViewMatrixLookAt(eyePosition, eyeTarget);
 
+        // volume faces are dragged with the left button, unless the mouse is over a window
+        if (editVolume) {
+            auto& io = ImGui::GetIO();
+            bool pressed = ImGui::IsMouseDown(ImGuiMouseButton_Left) && (captureVolume.isDragging() || !io.WantCaptureMouse);
+            Eigen::Vector2f mouse(io.MousePos.x / io.DisplaySize.x * 2 - 1, 1 - io.MousePos.y / io.DisplaySize.y * 2);
+            captureVolume.drag(projectionMatrix * viewMatrix, mouse, pressed);
+        }
+
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
@@ -559,16 +2212,63 @@ int main() {
         pointSizeUniform->bind(pointSize);
         viewUniform->bind(viewMatrix);
         projectionUniform->bind(projectionMatrix);
-        for (auto& cam : rs_devices)
-            if (cam.depthOn)
-                cam.draw(modelUniform, captureSpaceMatrix, cutoffMinUniform, cutoffMaxUniform);
+        // a volumetric video being played replaces the live clouds
+        bool drawVolumetric = volumetricPlayer.isOpen();
+        if (!(fusePoints && drawFused) && !drawVolumetric)
+            for (auto& cam : rs_devices)
+                if (cam.depthOn)
+                    cam.draw(modelUniform, captureSpaceMatrix, cutoffMinUniform, cutoffMaxUniform);
         pcShader->unBind();
 
+        // the fused cloud replaces the per camera clouds, so overlaps are drawn once when deduped
+        if (fusePoints && drawFused && !drawVolumetric) {
+            auto fused = dedupPoints ? pointCloudDedup.acquire() : pointCloudFusion.acquire();
+            if (fused && fused->frame != fusedBuffer.frame)
+                fusedBuffer.update(*fused);
+
+            fusedShader->bind();
+            fusedPointSizeUniform->bind(pointSize);
+            fusedViewUniform->bind(viewMatrix);
+            fusedProjectionUniform->bind(projectionMatrix);
+            fusedBuffer.draw();
+            fusedShader->unBind();
+        }
+
+        if (drawVolumetric) {
+            // holding the shown frame keeps the player from decoding into it
+            if (auto cloud = volumetricPlayer.acquire(); cloud != volumetricShown) {
+                volumetricShown = cloud;
+                if (cloud)
+                    volumetricBuffer.update(*cloud);
+                else
+                    volumetricBuffer.pointCount = 0;
+            }
+
+            fusedShader->bind();
+            fusedPointSizeUniform->bind(pointSize);
+            fusedViewUniform->bind(viewMatrix);
+            fusedProjectionUniform->bind(projectionMatrix);
+            volumetricBuffer.draw();
+            fusedShader->unBind();
+        }
+
+        if (extractMesh) {
+            glEnable(GL_DEPTH_TEST);
+            meshShader->bind();
+            meshViewUniform->bind(viewMatrix);
+            meshProjectionUniform->bind(projectionMatrix);
+            volumeMesh.draw();
+            meshShader->unBind();
+            glDisable(GL_DEPTH_TEST);
+        }
+
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         glfwSwapBuffers(window);
     }
 
     delete pcShader;
+    delete fusedShader;
+    delete meshShader;
     gizmos->destroy();
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -666,3 +2366,1133 @@ static cv::Mat depth_frame_to_meters(const rs2::depth_frame& f)
     dm = dm * f.get_units();
     return dm;
 }
+
+// Last write time of a file as a raw tick count, or 0 if it doesn't exist
+static int64_t file_write_time(const std::string& filename)
+{
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(filename, error);
+    if (error)
+        return 0;
+    return (int64_t)time.time_since_epoch().count();
+}
+
+// describes a pipeline's depth and colour streams for a session file
+static SessionFormat::CameraInfo session_camera_info(const rs2::pipeline_profile& profile)
+{
+    SessionFormat::CameraInfo info;
+    std::snprintf(info.serial, sizeof(info.serial), "%s", profile.get_device().get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+
+    auto describe = [](const rs2::video_stream_profile& stream, SessionFormat::StreamInfo& out) {
+        auto intrinsics = stream.get_intrinsics();
+        out.width = (uint32_t)stream.width();
+        out.height = (uint32_t)stream.height();
+        out.format = (uint32_t)stream.format();
+        out.fps = (uint32_t)stream.fps();
+        out.fx = intrinsics.fx;
+        out.fy = intrinsics.fy;
+        out.cx = intrinsics.ppx;
+        out.cy = intrinsics.ppy;
+        out.model = (uint32_t)intrinsics.model;
+        std::copy(std::begin(intrinsics.coeffs), std::end(intrinsics.coeffs), out.coeffs);
+    };
+
+    auto depth = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    auto colour = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    describe(depth, info.depth);
+    describe(colour, info.colour);
+    info.depthUnits = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    auto extrinsics = depth.get_extrinsics_to(colour);
+    Eigen::Affine3f depthToColor = Eigen::Affine3f::Identity();
+    depthToColor.linear() = Eigen::Map<Eigen::Matrix3f>(extrinsics.rotation);
+    depthToColor.translation() = Eigen::Map<Eigen::Vector3f>(extrinsics.translation);
+    Eigen::Map<Eigen::Matrix4f>(info.depthToColor) = depthToColor.matrix();
+    return info;
+}
+
+// hands an unprocessed frameset to the recorder, which copies (or compresses) it and returns without waiting on the disk
+static void record_frameset(SessionRecorder& recorder, uint16_t camera, const rs2::frameset& frames, const Eigen::Affine3f& depthToCapture)
+{
+    auto depth = frames.get_depth_frame();
+    auto colour = frames.get_color_frame();
+    if (!depth && !colour) return;
+
+    rs2::frame first = depth ? rs2::frame(depth) : rs2::frame(colour);
+    SessionFormat::FrameHeader header;
+    header.camera = camera;
+    header.frameNumber = first.get_frame_number();
+    header.timestamp = first.get_timestamp();
+    header.colourTimestamp = colour ? colour.get_timestamp() : 0;
+    if (first.supports_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL))
+        header.systemTime = first.get_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL) * 1000000;
+    else
+        header.systemTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    header.depthSize = depth ? (uint32_t)depth.get_data_size() : 0;
+    header.colourSize = colour ? (uint32_t)colour.get_data_size() : 0;
+    Eigen::Map<Eigen::Matrix4f>(header.transform) = depthToCapture.matrix();
+
+    recorder.addFrame(header, depth ? depth.get_data() : nullptr, colour ? colour.get_data() : nullptr);
+}
+
+// rewrites .bag recordings, one camera each, into a single indexed session
+static int convert_bags(const std::vector<std::string>& bags, const std::string& output)
+{
+    std::vector<rs2::pipeline> pipes;
+    std::vector<SessionFormat::CameraInfo> cameras;
+    for (auto& bag : bags) {
+        rs2::pipeline pipe;
+        rs2::config cfg;
+        cfg.enable_device_from_file(bag, false);
+        try {
+            auto profile = pipe.start(cfg);
+            profile.get_device().as<rs2::playback>().set_real_time(false);
+            cameras.push_back(session_camera_info(profile));
+        }
+        catch (const rs2::error& e) {
+            std::cout << "Error: Unable to play " << bag << ": " << e.what() << std::endl;
+            return -1;
+        }
+        pipes.push_back(pipe);
+    }
+
+    // offline, so wait on the disk rather than drop frames
+    SessionRecorder recorder;
+    auto settings = recorder.getSettings();
+    settings.dropFrames = false;
+    recorder.setSettings(settings);
+    if (!recorder.start(output, cameras))
+        return -1;
+
+    // a camera at a time, so the session ends up interleaved much as a live recording would
+    std::vector<bool> playing(pipes.size(), true);
+    size_t frameCount = 0;
+    while (std::find(playing.begin(), playing.end(), true) != playing.end()) {
+        for (size_t camera = 0; camera < pipes.size(); ++camera) {
+            rs2::frameset frames;
+            if (!playing[camera]) continue;
+            if (!pipes[camera].try_wait_for_frames(&frames, 1000)) {
+                playing[camera] = false;
+                continue;
+            }
+            // bags carry no rig pose
+            record_frameset(recorder, (uint16_t)camera, frames, Eigen::Affine3f::Identity());
+            ++frameCount;
+        }
+    }
+
+    for (auto& pipe : pipes)
+        pipe.stop();
+    recorder.stop();
+
+    auto stats = recorder.getStats();
+    std::cout << "Converted " << frameCount << " frames into " << output << " (" << stats.bytesWritten / 1e6 << " MB)" << std::endl;
+    return stats.framesDropped == 0 ? 0 : -1;
+}
+
+// sequential and random-seek read throughput of a session, payloads summed so every byte is touched
+static int benchmark_session(const std::string& filename)
+{
+    auto openStart = std::chrono::steady_clock::now();
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+    float openMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - openStart).count();
+
+    auto& cameras = player.getCameras();
+    std::cout << filename << ": " << cameras.size() << " cameras, " << player.getTotalFrameCount() << " frames, "
+              << player.getFileSize() / 1e9 << " GB, opened in " << openMs << " ms" << (player.wasRecovered() ? " (index rebuilt)" : "") << std::endl;
+
+    uint64_t checksum = 0;
+    auto touch = [&](const SessionPlayer::FrameView& view) {
+        size_t bytes = 0;
+        auto sum = [&](const void* data, size_t size) {
+            auto words = static_cast<const uint64_t*>(data);
+            for (size_t i = 0; i < size / 8; ++i)
+                checksum += words[i];
+            bytes += size;
+        };
+        if (view.depth) sum(view.depth, view.header->depthSize);
+        if (view.colour) sum(view.colour, view.header->colourSize);
+        return bytes;
+    };
+
+    // in time order across the cameras, as playback reads it, prefetching a few frames ahead
+    size_t maxFrames = 0;
+    for (size_t camera = 0; camera < cameras.size(); ++camera)
+        maxFrames = std::max(maxFrames, player.getFrameCount(camera));
+
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = 0, frames = 0;
+    for (size_t index = 0; index < maxFrames; ++index) {
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            if (index >= player.getFrameCount(camera)) continue;
+            player.prefetch(camera, index + 4, 1);
+            bytes += touch(player.getFrame(camera, index));
+            ++frames;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Sequential: " << frames / seconds << " frames/s, " << bytes / 1e6 / seconds << " MB/s" << std::endl;
+
+    // seek every camera to a random time, the way scrubbing does
+    std::mt19937 random(1);
+    const int seeks = 1000;
+    start = std::chrono::steady_clock::now();
+    bytes = 0;
+    for (int seek = 0; seek < seeks; ++seek) {
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            if (player.getFrameCount(camera) == 0) continue;
+            double from = player.getStartTimestamp(camera), to = player.getEndTimestamp(camera);
+            double timestamp = std::uniform_real_distribution<double>(from, to)(random);
+            bytes += touch(player.getFrame(camera, player.findFrame(camera, timestamp)));
+        }
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Random seek: " << seconds * 1000 / seeks << " ms per seek of every camera, " << bytes / 1e6 / seconds << " MB/s" << std::endl;
+
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    return 0;
+}
+
+// lossless check, compression ratio and encode/decode speed of DepthCodec on a session's depth,
+// on one core and with the bands spread over every core
+static int benchmark_depth_codec(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    // up to 100 frames per camera, spread over the session
+    std::vector<std::vector<uint16_t>> frames;
+    std::vector<std::pair<int, int>> sizes;
+    auto& cameras = player.getCameras();
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        size_t count = player.getFrameCount(camera);
+        size_t step = std::max<size_t>(1, count / 100);
+        int width = (int)cameras[camera].depth.width, height = (int)cameras[camera].depth.height;
+        for (size_t index = 0; index < count; index += step) {
+            auto view = player.getFrame(camera, index);
+            std::vector<uint16_t> depth(size_t(width) * height);
+            if (!view.depth || !player.decodeDepth(view, depth.data())) continue;
+            frames.push_back(std::move(depth));
+            sizes.emplace_back(width, height);
+        }
+    }
+    if (frames.empty()) {
+        std::cout << "Error: No depth frames in " << filename << std::endl;
+        return -1;
+    }
+
+    size_t maxSize = 0;
+    double pixels = 0;
+    for (auto& [width, height] : sizes) {
+        maxSize = std::max(maxSize, DepthCodec::getMaxEncodedSize(width, height));
+        pixels += double(width) * height;
+    }
+    std::vector<uint8_t> encoded(maxSize);
+    std::vector<uint16_t> decoded;
+
+    bool lossless = true;
+    for (bool parallel : { false, true }) {
+        DepthCodec codec;
+        auto settings = codec.getSettings();
+        settings.parallel = parallel;
+        codec.setSettings(settings);
+
+        double encodeMs = 0, decodeMs = 0, bytes = 0;
+        for (size_t frame = 0; frame < frames.size(); ++frame) {
+            auto [width, height] = sizes[frame];
+            size_t size = codec.encode(frames[frame].data(), width, height, encoded.data());
+            encodeMs += codec.getLastEncodeMs();
+            bytes += size;
+
+            decoded.assign(frames[frame].size(), 0);
+            if (!codec.decode(encoded.data(), size, decoded.data(), width, height) || decoded != frames[frame])
+                lossless = false;
+            decodeMs += codec.getLastDecodeMs();
+        }
+
+        double raw = pixels * sizeof(uint16_t);
+        std::cout << (parallel ? "All cores: " : "One core:  ") << frames.size() << " frames, ratio " << raw / bytes
+                  << " (" << bytes * 8 / pixels << " bits/pixel), encode " << pixels / 1e3 / encodeMs << " MP/s ("
+                  << encodeMs / frames.size() << " ms/frame), decode " << pixels / 1e3 / decodeMs << " MP/s ("
+                  << decodeMs / frames.size() << " ms/frame)" << std::endl;
+    }
+
+    std::cout << (lossless ? "Lossless" : "Error: Decoded frames differ from the originals") << std::endl;
+    return lossless ? 0 : -1;
+}
+
+// size, speed and quality of each colour codec setting on a session's colour frames. Encoding
+// on every core shows how many cameras the recorder's encoder pool keeps up with.
+static int benchmark_colour_codec(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    // up to 30 RGB frames per camera, spread over the session
+    struct colour_frame { std::vector<uint8_t> pixels; int width, height; };
+    std::vector<colour_frame> frames;
+    auto& cameras = player.getCameras();
+    float fps = 0;
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        auto& stream = cameras[camera].colour;
+        if (stream.format != RS2_FORMAT_RGB8) continue;
+        fps = std::max(fps, (float)stream.fps);
+        size_t count = player.getFrameCount(camera);
+        size_t step = std::max<size_t>(1, count / 30);
+        for (size_t index = 0; index < count; index += step) {
+            auto view = player.getFrame(camera, index);
+            colour_frame frame{ std::vector<uint8_t>((size_t)stream.width * stream.height * 3), (int)stream.width, (int)stream.height };
+            if (!view.colour || !player.decodeColour(view, frame.pixels.data())) continue;
+            frames.push_back(std::move(frame));
+        }
+    }
+    if (frames.empty()) {
+        std::cout << "Error: No RGB8 colour frames in " << filename << std::endl;
+        return -1;
+    }
+
+    std::vector<ColourCodec::Settings> settings{ { ColourCodec::Type::Qoi } };
+    for (int quality : { 50, 75, 85, 90, 95 })
+        settings.push_back({ ColourCodec::Type::Jpeg, quality });
+
+    std::cout << frames.size() << " frames, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+    for (auto& setting : settings) {
+        ColourCodec codec;
+        codec.setSettings(setting);
+
+        // one core, with PSNR against the original
+        std::vector<uint8_t> encoded, decoded;
+        double encodeMs = 0, decodeMs = 0, bytes = 0, raw = 0, squaredError = 0;
+        for (auto& frame : frames) {
+            codec.encode(frame.pixels.data(), frame.width, frame.height, encoded);
+            encodeMs += codec.getLastEncodeMs();
+            bytes += encoded.size();
+            raw += frame.pixels.size();
+
+            decoded.resize(frame.pixels.size());
+            codec.decode(setting.type, encoded.data(), encoded.size(), decoded.data(), frame.width, frame.height);
+            decodeMs += codec.getLastDecodeMs();
+            for (size_t i = 0; i < decoded.size(); ++i)
+                squaredError += double(int(decoded[i]) - int(frame.pixels[i])) * double(int(decoded[i]) - int(frame.pixels[i]));
+        }
+        double mse = squaredError / raw;
+
+        // every core, a codec per frame the way the pool keeps one per thread
+        auto start = std::chrono::steady_clock::now();
+        std::for_each(std::execution::par, frames.begin(), frames.end(), [&](const colour_frame& frame) {
+            ColourCodec local;
+            local.setSettings(setting);
+            std::vector<uint8_t> out;
+            local.encode(frame.pixels.data(), frame.width, frame.height, out);
+        });
+        double framesPerSecond = frames.size() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (setting.type == ColourCodec::Type::Qoi) std::cout << "QOI:      ";
+        else std::cout << "JPEG " << setting.quality << ": ";
+        std::cout << "ratio " << raw / bytes << ", PSNR " << (mse > 0 ? std::format("{:.1f} dB", 10 * std::log10(255.0 * 255.0 / mse)) : "lossless")
+                  << ", encode " << encodeMs / frames.size() << " ms/frame (" << raw / 1e3 / encodeMs << " MB/s), decode "
+                  << decodeMs / frames.size() << " ms/frame, all cores " << framesPerSecond << " frames/s";
+        if (fps > 0) std::cout << " (" << framesPerSecond / fps << " cameras at " << fps << " fps)";
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// decode and encode speed and size of a volumetric video. Decoding has to fit in a 60 fps frame to
+// play back, encoding in a capture frame for the recorder to keep up; the frames are re-encoded
+// at the file's own settings, on one core and with the slices on every core. The slowest slice
+// is what decoding would come down to with a core for every slice.
+static int benchmark_volumetric(const std::string& filename)
+{
+    VolumetricPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    VolumetricCodec::Settings settings;
+    settings.voxelSize = player.getHeader().voxelSize;
+    settings.colourBits = (int)player.getHeader().colourBits;
+
+    std::cout << player.getFrameCount() << " frames, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+    for (bool parallel : { false, true }) {
+        settings.parallel = parallel;
+        VolumetricCodec codec;
+        codec.setSettings(settings);
+
+        FusedPointCloud cloud, decoded;
+        std::vector<uint8_t> encoded;
+        double decodeMs = 0, encodeMs = 0, maxDecodeMs = 0, maxEncodeMs = 0, sliceMs = 0, slices = 0, points = 0, bytes = 0;
+        size_t frames = 0;
+        for (size_t index = 0; index < player.getFrameCount(); ++index) {
+            if (!player.decode(index, cloud)) {
+                std::cout << "Error: Frame " << index << " is corrupt" << std::endl;
+                continue;
+            }
+            encoded.clear();
+            codec.encode(cloud, player.getTimestamp(index), encoded);
+            VolumetricCodec::DecodeStats stats;
+            codec.decode(encoded.data(), encoded.size(), decoded, &stats);
+
+            decodeMs += stats.ms;
+            encodeMs += codec.getLastEncodeMs();
+            sliceMs += stats.slowestSliceMs;
+            slices += stats.slices;
+            maxDecodeMs = std::max<double>(maxDecodeMs, stats.ms);
+            maxEncodeMs = std::max<double>(maxEncodeMs, codec.getLastEncodeMs());
+            points += cloud.count;
+            bytes += encoded.size();
+            ++frames;
+        }
+        if (frames == 0 || points == 0)
+            return -1;
+
+        std::cout << (parallel ? "All cores: " : "One core:  ") << points / frames << " points/frame, " << bytes * 8 / points
+                  << " bits/point, " << points * (3 * sizeof(float) + 3) / bytes << "x, decode " << decodeMs / frames << " ms/frame (max "
+                  << maxDecodeMs << "), encode " << encodeMs / frames << " ms/frame (max " << maxEncodeMs << ")" << std::endl;
+        std::cout << "           " << points / decodeMs / 1000 << " M points/s decoded, " << slices / frames << " slices/frame, slowest "
+                  << sliceMs / frames << " ms/frame" << std::endl;
+    }
+    return 0;
+}
+
+// reconstructs, textures and writes a mesh per tick of a recorded session, a worker per core
+// taking the ticks in parallel. Ticks follow the first camera's frames and every other camera
+// plays the frame at the same time since its own first, as playback does. The depth is as
+// recorded, with the camera's depth correction but none of the live filters.
+static int export_session_meshes(const std::string& filename, const std::string& directory, bool obj)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    auto& cameras = player.getCameras();
+    if (cameras.empty() || player.getFrameCount(0) == 0) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    std::vector<DepthCorrection> corrections(cameras.size());
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        auto& c = cameras[camera].depthCorrection;
+        if (c[1] != 0)  // sessions converted from .bag have none
+            corrections[camera].setCoefficients({ c[0], c[1], c[2] });
+        corrections[camera].prepare(cameras[camera].depthUnits);
+        if (cameras[camera].colour.format != RS2_FORMAT_RGB8)
+            std::cout << cameras[camera].serial << "'s colour isn't RGB8, what only it sees is left grey" << std::endl;
+    }
+
+    MeshSequenceExporter exporter;
+    auto settings = exporter.getSettings();
+    settings.format = obj ? MeshSequenceExporter::Format::Obj : MeshSequenceExporter::Format::Glb;
+    settings.threads = std::max(1u, std::thread::hardware_concurrency());
+    settings.wait = true;
+    exporter.setSettings(settings);
+    if (!exporter.start(directory))
+        return -1;
+
+    std::vector<std::vector<uint16_t>> depth(cameras.size());
+    std::vector<std::vector<uint8_t>> colour(cameras.size());
+    auto start = std::chrono::steady_clock::now();
+    size_t ticks = player.getFrameCount(0);
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        double time = player.getTimestamp(0, tick) - player.getStartTimestamp(0);
+
+        std::vector<TsdfVolume::DepthInput> depthInputs;
+        std::vector<TextureBaker::Camera> colourInputs;
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            if (player.getFrameCount(camera) == 0) continue;
+            auto& info = cameras[camera];
+            auto view = player.getFrame(camera, player.findFrame(camera, player.getStartTimestamp(camera) + time));
+            if (!view || !view.depth) continue;
+
+            depth[camera].resize((size_t)info.depth.width * info.depth.height);
+            if (!player.decodeDepth(view, depth[camera].data())) continue;
+            if (!corrections[camera].isIdentity())
+                corrections[camera].apply(depth[camera].data(), depth[camera].data(), depth[camera].size());
+
+            Eigen::Matrix4f depthToCapture = Eigen::Map<const Eigen::Matrix4f>(view.header->transform);
+            TsdfVolume::DepthInput input;
+            input.depth = depth[camera].data();
+            input.width = (int)info.depth.width;
+            input.height = (int)info.depth.height;
+            input.depthUnits = info.depthUnits;
+            input.fx = info.depth.fx;
+            input.fy = info.depth.fy;
+            input.cx = info.depth.cx;
+            input.cy = info.depth.cy;
+            input.cameraToCapture = depthToCapture;
+            depthInputs.push_back(input);
+
+            colour[camera].resize((size_t)info.colour.width * info.colour.height * 3);
+            if (info.colour.format != RS2_FORMAT_RGB8 || !view.colour || !player.decodeColour(view, colour[camera].data())) continue;
+
+            TextureBaker::Camera colourInput;
+            colourInput.rgb = colour[camera].data();
+            colourInput.width = (int)info.colour.width;
+            colourInput.height = (int)info.colour.height;
+            colourInput.stride = colourInput.width * 3;
+            colourInput.fx = info.colour.fx;
+            colourInput.fy = info.colour.fy;
+            colourInput.cx = info.colour.cx;
+            colourInput.cy = info.colour.cy;
+            colourInput.cameraToCapture = depthToCapture * Eigen::Map<const Eigen::Matrix4f>(info.depthToColor).inverse();
+            colourInputs.push_back(colourInput);
+        }
+        if (!depthInputs.empty())
+            exporter.add(std::format("mesh_{:06}", tick), depthInputs, colourInputs);
+    }
+    exporter.stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = exporter.getStats();
+    std::cout << "Exported " << stats.framesWritten << " of " << ticks << " ticks to " << directory << " (" << stats.framesEmpty << " empty, "
+              << stats.framesDropped << " failed), " << stats.bytesWritten / 1e6 << " MB" << std::endl;
+    if (stats.framesWritten == 0)
+        return -1;
+    std::cout << stats.secondsPerFrame << " s/frame on a worker (reconstruct " << stats.reconstructMs << " ms, simplify " << stats.simplifyMs
+              << " ms, bake " << stats.bakeMs << " ms, write " << stats.writeMs << " ms), " << stats.trianglesWritten / stats.framesWritten
+              << " triangles/frame" << std::endl;
+    std::cout << seconds / stats.framesWritten << " s/frame overall with " << settings.threads << " workers" << std::endl;
+    return stats.framesDropped == 0 ? 0 : -1;
+}
+
+// streams a recorded session through align, deproject, filter, fuse and export into a fused
+// cloud per tick, a thread per stage, printing progress while it runs and which stage held
+// the others up once it's done. A .bag is converted into the output directory first.
+static int transcode_session(const std::string& filename, const std::string& directory, bool pcd)
+{
+    std::string session = filename;
+    if (filename.ends_with(".bag")) {
+        std::filesystem::create_directories(directory);
+        session = directory + "/session.vcs";
+        if (convert_bags({ filename }, session) != 0)
+            return -1;
+    }
+
+    SessionTranscoder transcoder;
+    auto settings = transcoder.getSettings();
+    settings.format = pcd ? PointCloudExporter::Format::Pcd : PointCloudExporter::Format::Ply;
+    transcoder.setSettings(settings);
+
+    std::atomic<bool> done = false;
+    bool transcoded = false;
+    std::thread thread([&] {
+        transcoded = transcoder.transcode(session, directory);
+        done = true;
+    });
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto stats = transcoder.getStats();
+        if (!done && stats.ticks > 0)
+            std::cout << stats.framesRead << "/" << stats.ticks << " ticks, " << stats.framesPerSecond << " ticks/s" << std::endl;
+    }
+    thread.join();
+
+    auto stats = transcoder.getStats();
+    std::cout << "Transcoded " << stats.framesWritten << " of " << stats.ticks << " ticks to " << directory << " in " << stats.seconds << " s ("
+              << stats.framesPerSecond << " ticks/s, " << stats.framesEmpty << " empty, " << stats.framesFailed << " failed, "
+              << stats.decodeErrors << " payloads undecodable), " << stats.bytesWritten / 1e6 << " MB, frame pool " << stats.poolBytes / 1e6 << " MB" << std::endl;
+    if (stats.framesWritten > 0)
+        std::cout << stats.pointsDeprojected / stats.framesRead << " points/tick deprojected, " << stats.pointsWritten / stats.framesWritten << " written" << std::endl;
+
+    int slowest = 0;
+    for (int stage = 0; stage < SessionTranscoder::StageCount; ++stage) {
+        auto& s = stats.stages[stage];
+        std::cout << std::format("{:<10} {:8.1f} ms/tick, working {:5.1f}%, waiting {:5.1f}%", SessionTranscoder::getStageName((SessionTranscoder::Stage)stage),
+                                 s.busyMs, s.occupancy * 100, s.waiting * 100) << std::endl;
+        if (s.occupancy > stats.stages[slowest].occupancy)
+            slowest = stage;
+    }
+    std::cout << SessionTranscoder::getStageName((SessionTranscoder::Stage)slowest) << " is the slowest stage" << std::endl;
+    return transcoded ? 0 : -1;
+}
+
+// writes the keyframe sidecar of a recorded session, for one recorded without it or converted
+// from .bag, taking the frames recording would have. Then times what browsing does: opening
+// the sidecar, and jumping to random keyframes, every camera's frame found and decoded.
+static int index_session(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    auto& cameras = player.getCameras();
+    auto sidecar = KeyframeFormat::sidecarName(filename);
+    KeyframeWriter writer;
+    if (!writer.start(sidecar, cameras, player.getHeader().startTime))
+        return -1;
+
+    double interval = writer.getSettings().intervalMs, duration = 0;
+    for (size_t camera = 0; camera < cameras.size(); ++camera)
+        if (player.getFrameCount(camera) > 0)
+            duration = std::max(duration, player.getEndTimestamp(camera) - player.getStartTimestamp(camera));
+
+    std::vector<uint16_t> depth;
+    std::vector<uint8_t> colour;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t keyframe = 0; keyframe * interval <= duration; ++keyframe) {
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            size_t count = player.getFrameCount(camera);
+            if (count == 0) continue;
+
+            // the first frame at or after the keyframe's time
+            double timestamp = player.getStartTimestamp(camera) + keyframe * interval;
+            size_t index = player.findFrame(camera, timestamp);
+            if (player.getTimestamp(camera, index) < timestamp && index + 1 < count) ++index;
+            auto view = player.getFrame(camera, index);
+            if (!view) continue;
+
+            // the writer takes frames as capture has them, uncompressed
+            auto& info = cameras[camera];
+            SessionFormat::FrameHeader header = *view.header;
+            header.depthSize = (uint32_t)(info.depth.width * info.depth.height * sizeof(uint16_t));
+            header.colourSize = header.colourCodec == SessionFormat::Raw ? header.colourSize : info.colour.width * info.colour.height * 3;
+            depth.resize(header.depthSize / sizeof(uint16_t));
+            colour.resize(header.colourSize);
+            bool hasDepth = view.depth && player.decodeDepth(view, depth.data());
+            bool hasColour = view.colour && player.decodeColour(view, colour.data());
+            writer.addFrame(header, hasDepth ? depth.data() : nullptr, hasColour ? colour.data() : nullptr);
+        }
+    }
+    writer.stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = writer.getStats();
+    std::cout << "Wrote " << stats.keyframesWritten << " keyframes to " << sidecar << " in " << seconds << " s, " << stats.bytesWritten / 1e6
+              << " MB, " << stats.buildMs << " ms each to build" << std::endl;
+
+    // a fresh player too, browsing opens both
+    auto openStart = std::chrono::steady_clock::now();
+    KeyframeIndex index;
+    SessionPlayer browser;
+    if (!index.open(sidecar) || !browser.open(filename) || index.getKeyframeCount() == 0)
+        return -1;
+    float openMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - openStart).count();
+
+    std::mt19937 random(1);
+    const int jumps = 100;
+    float maxJumpMs = 0, totalJumpMs = 0;
+    for (int jump = 0; jump < jumps; ++jump) {
+        auto jumpStart = std::chrono::steady_clock::now();
+        size_t keyframe = std::uniform_int_distribution<size_t>(0, index.getKeyframeCount() - 1)(random);
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            auto key = index.getKeyframe(keyframe, camera);
+            if (!key) continue;
+            auto view = browser.getFrame(camera, browser.findFrame(camera, key.header->timestamp));
+            if (!view) continue;
+            depth.resize((size_t)cameras[camera].depth.width * cameras[camera].depth.height);
+            colour.resize(std::max<size_t>((size_t)cameras[camera].colour.width * cameras[camera].colour.height * 3, view.header->colourSize));
+            if (view.depth) browser.decodeDepth(view, depth.data());
+            if (view.colour) browser.decodeColour(view, colour.data());
+        }
+        float jumpMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - jumpStart).count();
+        maxJumpMs = std::max(maxJumpMs, jumpMs);
+        totalJumpMs += jumpMs;
+    }
+    std::cout << index.getKeyframeCount() << " keyframes of " << cameras.size() << " cameras, opened with the session in " << openMs
+              << " ms; jump to a keyframe " << totalJumpMs / jumps << " ms (max " << maxJumpMs << ")" << std::endl;
+    return 0;
+}
+
+// makes a session that never stopped cleanly open like one that did, rebuilding its index
+// from the chunk headers and checkpoints and appending it. Then opens it to check.
+static int recover_session(const std::string& filename)
+{
+    SessionRecovery recovery;
+    if (!recovery.recover(filename))
+        return -1;
+
+    auto& stats = recovery.getStats();
+    if (stats.hadIndex) {
+        std::cout << filename << " already has its index" << std::endl;
+        return 0;
+    }
+    std::cout << "Scanned " << stats.fileBytes / 1e9 << " GB in " << stats.scanMs << " ms (" << stats.fileBytes / 1e6 / std::max(stats.scanMs, 0.001f)
+              << " GB/s): " << stats.chunks << " chunks, " << stats.checkpoints << " checkpoints, " << stats.framesRecovered << " frames ("
+              << stats.checkpointedFrames << " from checkpoints)";
+    if (stats.tornBytes)
+        std::cout << ", " << stats.tornBytes / 1e6 << " MB torn at the end";
+    std::cout << std::endl << "Index appended in " << stats.writeMs << " ms" << std::endl;
+
+    auto openStart = std::chrono::steady_clock::now();
+    SessionPlayer player;
+    if (!player.open(filename) || player.wasRecovered())
+        return -1;
+    float openMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - openStart).count();
+    std::cout << filename << ": " << player.getTotalFrameCount() << " frames, opened in " << openMs << " ms" << std::endl;
+    return 0;
+}
+
+// the first ticks of a session, consecutive so the processing sees the motion it would live.
+// Ticks follow the first camera's frames and every other camera plays the frame at the same
+// time since its own first, as playback does; depth is as recorded plus the camera's
+// depth correction.
+static bool load_session_ticks(SessionPlayer& player, size_t maxTicks, std::vector<session_tick>& ticks)
+{
+    auto& cameras = player.getCameras();
+    if (cameras.empty() || player.getFrameCount(0) == 0)
+        return false;
+
+    std::vector<DepthCorrection> corrections(cameras.size());
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        auto& c = cameras[camera].depthCorrection;
+        if (c[1] != 0)  // sessions converted from .bag have none
+            corrections[camera].setCoefficients({ c[0], c[1], c[2] });
+        corrections[camera].prepare(cameras[camera].depthUnits);
+    }
+
+    ticks.resize(std::min(maxTicks, player.getFrameCount(0)));
+    for (size_t index = 0; index < ticks.size(); ++index) {
+        auto& tick = ticks[index];
+        tick.depth.resize(cameras.size());
+        tick.depthToCapture.resize(cameras.size(), Eigen::Matrix4f::Identity());
+
+        double time = player.getTimestamp(0, index) - player.getStartTimestamp(0);
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            if (player.getFrameCount(camera) == 0) continue;
+            auto& info = cameras[camera];
+            auto view = player.getFrame(camera, player.findFrame(camera, player.getStartTimestamp(camera) + time));
+            if (!view || !view.depth) continue;
+
+            auto& depth = tick.depth[camera];
+            depth.resize((size_t)info.depth.width * info.depth.height);
+            if (!player.decodeDepth(view, depth.data())) {
+                depth.clear();
+                continue;
+            }
+            if (!corrections[camera].isIdentity())
+                corrections[camera].apply(depth.data(), depth.data(), depth.size());
+            tick.depthToCapture[camera] = Eigen::Map<const Eigen::Matrix4f>(view.header->transform);
+        }
+    }
+    return !ticks.empty();
+}
+
+static std::vector<TsdfVolume::DepthInput> session_tick_inputs(const SessionPlayer& player, const session_tick& tick)
+{
+    std::vector<TsdfVolume::DepthInput> inputs;
+    auto& cameras = player.getCameras();
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        if (tick.depth[camera].empty()) continue;
+        auto& info = cameras[camera];
+        TsdfVolume::DepthInput input;
+        input.depth = tick.depth[camera].data();
+        input.width = (int)info.depth.width;
+        input.height = (int)info.depth.height;
+        input.depthUnits = info.depthUnits;
+        input.fx = info.depth.fx;
+        input.fy = info.depth.fy;
+        input.cx = info.depth.cx;
+        input.cy = info.depth.cy;
+        input.cameraToCapture = tick.depthToCapture[camera];
+        inputs.push_back(input);
+    }
+    return inputs;
+}
+
+// a camera's points at a tick as rs2::pointcloud deprojects them, one per depth pixel with
+// zero depth left at z = 0, and texcoords into a colour image the depth is aligned to
+static void session_tick_points(const SessionPlayer& player, const session_tick& tick, size_t camera, std::vector<float>& vertices, std::vector<float>& texcoords)
+{
+    auto& depth = tick.depth[camera];
+    auto& info = player.getCameras()[camera];
+    auto& stream = info.depth;
+    vertices.resize(depth.size() * 3);
+    texcoords.resize(depth.size() * 2);
+    for (size_t i = 0; i < depth.size(); ++i) {
+        float x = float(i % stream.width), y = float(i / stream.width);
+        float z = depth[i] * info.depthUnits;
+        vertices[i * 3] = (x - stream.cx) / stream.fx * z;
+        vertices[i * 3 + 1] = (y - stream.cy) / stream.fy * z;
+        vertices[i * 3 + 2] = z;
+        texcoords[i * 2] = (x + 0.5f) / stream.width;
+        texcoords[i * 2 + 1] = (y + 0.5f) / stream.height;
+    }
+}
+
+// integrates the first 100 ticks of a session into a fresh volume with the default settings,
+// on one core and then on all of them, against the 33 ms a tick has at 30 fps. The first
+// tick allocates every block and is reported apart.
+static int benchmark_tsdf(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    std::vector<session_tick> ticks;
+    if (!load_session_ticks(player, 100, ticks)) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    std::cout << ticks.size() << " ticks of " << player.getCameras().size() << " cameras, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    for (bool parallel : { false, true }) {
+        TsdfVolume volume;
+        auto settings = volume.getSettings();
+        settings.parallel = parallel;
+        volume.setSettings(settings);
+
+        double totalMs = 0, maxMs = 0, active = 0, firstMs = 0;
+        for (size_t tick = 0; tick < ticks.size(); ++tick) {
+            volume.integrate(session_tick_inputs(player, ticks[tick]));
+            if (tick == 0) {
+                firstMs = volume.getLastIntegrateMs();
+                continue;
+            }
+            totalMs += volume.getLastIntegrateMs();
+            maxMs = std::max<double>(maxMs, volume.getLastIntegrateMs());
+            active += volume.getActiveBlockCount();
+        }
+
+        size_t measured = std::max<size_t>(1, ticks.size() - 1);
+        std::cout << (parallel ? "All cores: " : "One core:  ") << totalMs / measured << " ms/tick (max " << maxMs << ", first "
+                  << firstMs << "), " << active / measured << " active of " << volume.getBlockCount() << " blocks" << std::endl;
+    }
+    return 0;
+}
+
+// integrates the first 100 ticks of a session and meshes the volume after each, incrementally
+// and from scratch, so the two are timed on the same surface. The last mesh is then written as
+// the live export did, in place, and handed to a MeshWriter, which only costs the copy.
+static int benchmark_mesh(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    std::vector<session_tick> ticks;
+    if (!load_session_ticks(player, 100, ticks)) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    std::cout << ticks.size() << " ticks of " << player.getCameras().size() << " cameras, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    TsdfVolume volume;
+    MeshExtractor incremental, full;
+    double updateMs = 0, maxUpdateMs = 0, rebuildMs = 0, maxRebuildMs = 0, blocks = 0;
+    for (size_t tick = 0; tick < ticks.size(); ++tick) {
+        volume.integrate(session_tick_inputs(player, ticks[tick]));
+        incremental.update(volume);
+        full.rebuild(volume);
+        if (tick == 0) continue;
+
+        updateMs += incremental.getLastUpdateMs();
+        maxUpdateMs = std::max<double>(maxUpdateMs, incremental.getLastUpdateMs());
+        blocks += incremental.getLastBlockCount();
+        rebuildMs += full.getLastRebuildMs();
+        maxRebuildMs = std::max<double>(maxRebuildMs, full.getLastRebuildMs());
+    }
+
+    size_t measured = std::max<size_t>(1, ticks.size() - 1);
+    auto& mesh = incremental.getMesh();
+    std::cout << mesh.indices.size() / 3 << " triangles, " << volume.getBlockCount() << " blocks" << std::endl;
+    std::cout << "Incremental: " << updateMs / measured << " ms/tick (max " << maxUpdateMs << "), "
+              << blocks / measured << " blocks re-meshed" << std::endl;
+    std::cout << "Full:        " << rebuildMs / measured << " ms/tick (max " << maxRebuildMs << ")" << std::endl;
+
+    auto directory = std::filesystem::temp_directory_path() / "benchmark_mesh";
+    std::filesystem::create_directories(directory);
+    auto start = std::chrono::steady_clock::now();
+    mesh.savePly((directory / "mesh.ply").string());
+    double saveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // a few times over, since the writer's copies only reuse their memory from the second one on
+    MeshWriter writer;
+    writer.setSettings({ 1 });
+    writer.start(directory.string());
+    for (int i = 0; i < 3; ++i) {
+        writer.add(std::format("mesh_writer_{}", i), mesh);
+        while (writer.getStats().queued > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    writer.stop();
+    auto stats = writer.getStats();
+    std::cout << "PLY in place: " << saveMs << " ms, MeshWriter: " << stats.copyMs << " ms copy, "
+              << stats.writeMs << " ms on its thread" << std::endl;
+    std::filesystem::remove_all(directory);
+    return 0;
+}
+
+// filters the points of the first 30 ticks of a session, every camera's as rs2::pointcloud
+// would deproject its depth, with each camera's own PointFilter. The cameras are filtered one
+// after another and then all at once, as the live loop does, against the 5 ms target.
+static int benchmark_filter(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    std::vector<session_tick> ticks;
+    if (!load_session_ticks(player, 30, ticks)) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    auto& cameras = player.getCameras();
+    std::vector<std::vector<std::vector<float>>> vertices(ticks.size()), texcoords(ticks.size());
+    for (size_t tick = 0; tick < ticks.size(); ++tick) {
+        vertices[tick].resize(cameras.size());
+        texcoords[tick].resize(cameras.size());
+        for (size_t camera = 0; camera < cameras.size(); ++camera)
+            session_tick_points(player, ticks[tick], camera, vertices[tick][camera], texcoords[tick][camera]);
+    }
+
+    std::cout << ticks.size() << " ticks of " << cameras.size() << " cameras, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    std::vector<PointFilter> filters(cameras.size());
+    std::vector<size_t> cameraIndices(cameras.size());
+    std::iota(cameraIndices.begin(), cameraIndices.end(), 0);
+    for (auto mode : { PointFilter::OutlierMode::None, PointFilter::OutlierMode::Radius, PointFilter::OutlierMode::Statistical }) {
+        PointFilter::Settings settings;
+        settings.downsample = true;
+        settings.outlierMode = mode;
+        for (auto& filter : filters)
+            filter.setSettings(settings);
+
+        const char* names[] = { "Downsample", "+ radius", "+ statistical" };
+        std::cout << names[(int)mode] << std::endl;
+        for (bool parallel : { false, true }) {
+            double totalMs = 0, maxMs = 0, input = 0, output = 0;
+            for (size_t tick = 0; tick < ticks.size(); ++tick) {
+                auto filter = [&](size_t camera) {
+                    auto& points = vertices[tick][camera];
+                    filters[camera].process(points.data(), texcoords[tick][camera].data(), points.size() / 3);
+                };
+
+                auto start = std::chrono::steady_clock::now();
+                if (parallel)
+                    std::for_each(std::execution::par, cameraIndices.begin(), cameraIndices.end(), filter);
+                else
+                    std::for_each(cameraIndices.begin(), cameraIndices.end(), filter);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                totalMs += ms;
+                maxMs = std::max(maxMs, ms);
+                for (auto& filter : filters) {
+                    input += filter.getInputCount();
+                    output += filter.getCount();
+                }
+            }
+            std::cout << (parallel ? "  All cores: " : "  One core:  ") << totalMs / ticks.size() << " ms/tick (max " << maxMs << "), "
+                      << input / ticks.size() << " -> " << output / ticks.size() << " points" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// every camera's first 100 frames, consecutive as temporal filters need them, through the
+// native TemporalFilter and through librealsense's temporal_filter, alone and after its
+// spatial_filter as the Depth Filter panel chains them. Each filter keeps its own state
+// from the first frame, and only the filtering is timed.
+static int benchmark_temporal(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    auto& cameras = player.getCameras();
+    double nativeMs = 0, temporalMs = 0, chainMs = 0, pixels = 0;
+    size_t frames = 0;
+    for (size_t camera = 0; camera < cameras.size(); ++camera) {
+        auto& info = cameras[camera];
+        int width = (int)info.depth.width, height = (int)info.depth.height;
+        session_camera source(info);
+        TemporalFilter native;
+        rs2::temporal_filter temporal, chainTemporal;
+        rs2::spatial_filter spatial;
+        std::vector<uint16_t> filtered((size_t)width * height);
+
+        for (size_t index = 0; index < std::min<size_t>(100, player.getFrameCount(camera)); ++index) {
+            auto view = player.getFrame(camera, index);
+            if (!view.depth) continue;
+            auto depth = source.play(player, view, index).get_depth_frame();
+            if (!depth) continue;
+
+            auto start = std::chrono::steady_clock::now();
+            native.apply((const uint16_t*)depth.get_data(), filtered.data(), width, height, info.depthUnits);
+            auto end = std::chrono::steady_clock::now();
+            nativeMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+            start = end;
+            temporal.process(depth);
+            end = std::chrono::steady_clock::now();
+            temporalMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+            start = end;
+            chainTemporal.process(spatial.process(depth));
+            chainMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            pixels += double(width) * height;
+            ++frames;
+        }
+    }
+    if (frames == 0) {
+        std::cout << "Error: No depth frames in " << filename << std::endl;
+        return -1;
+    }
+
+    std::cout << frames << " frames of " << cameras.size() << " cameras" << std::endl;
+    std::cout << "Temporal:                        " << nativeMs / frames << " ms/frame, " << pixels / 1e3 / nativeMs << " MP/s" << std::endl;
+    std::cout << "librealsense temporal:           " << temporalMs / frames << " ms/frame, " << pixels / 1e3 / temporalMs << " MP/s" << std::endl;
+    std::cout << "librealsense spatial + temporal: " << chainMs / frames << " ms/frame, " << pixels / 1e3 / chainMs << " MP/s" << std::endl;
+    return 0;
+}
+
+// estimates normals for every camera's points over the first 30 ticks of a session, at every
+// pixel and at each coarser step, against the 720p budget. The coarser normals are compared
+// with the full resolution ones where both exist.
+static int benchmark_normals(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    std::vector<session_tick> ticks;
+    if (!load_session_ticks(player, 30, ticks)) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    auto& cameras = player.getCameras();
+    std::cout << ticks.size() << " ticks of " << cameras.size() << " cameras, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    // full resolution normals of every frame, the reference for the coarser steps
+    std::vector<std::vector<float>> reference;
+    std::vector<float> vertices, texcoords;
+    for (int step = 1; step <= 4; step *= 2) {
+        double totalMs = 0, maxMs = 0, angles = 0, compared = 0, points = 0, withNormals = 0;
+        size_t frames = 0;
+        for (size_t camera = 0; camera < cameras.size(); ++camera) {
+            NormalEstimator estimator;
+            auto settings = estimator.getSettings();
+            settings.step = step;
+            estimator.setSettings(settings);
+
+            for (size_t tick = 0; tick < ticks.size(); ++tick) {
+                if (ticks[tick].depth[camera].empty()) continue;
+                session_tick_points(player, ticks[tick], camera, vertices, texcoords);
+                estimator.compute(vertices.data(), (int)cameras[camera].depth.width, (int)cameras[camera].depth.height);
+                totalMs += estimator.getLastComputeMs();
+                maxMs = std::max<double>(maxMs, estimator.getLastComputeMs());
+
+                const float* normals = estimator.getNormals();
+                size_t count = estimator.getCount();
+                if (step == 1)
+                    reference.emplace_back(normals, normals + count * 3);
+                for (size_t i = 0; i < count; ++i) {
+                    if (vertices[i * 3 + 2] <= 0) continue;
+                    ++points;
+                    const float* n = normals + i * 3;
+                    if (n[0] == 0 && n[1] == 0 && n[2] == 0) continue;
+                    ++withNormals;
+
+                    const float* r = reference[frames].data() + i * 3;
+                    if (r[0] == 0 && r[1] == 0 && r[2] == 0) continue;
+                    angles += std::acos(std::clamp(n[0] * r[0] + n[1] * r[1] + n[2] * r[2], -1.0f, 1.0f));
+                    ++compared;
+                }
+                ++frames;
+            }
+        }
+
+        std::cout << "Step " << step << ": " << totalMs / std::max<size_t>(frames, 1) << " ms/frame (max " << maxMs << "), "
+                  << 100 * withNormals / std::max(points, 1.0) << "% of points with normals";
+        if (step > 1)
+            std::cout << ", " << angles / std::max(compared, 1.0) * 180 / 3.14159265 << " deg mean from step 1";
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// refines the rig at 10 ticks of a session with every camera but the first knocked off its
+// recorded pose by up to a centimetre and half a degree, as a bumped tripod would be, against
+// the 50 ms a periodic refinement may take. The recorded poses are the reference. The first
+// solve allocates the pyramids and is reported apart.
+static int benchmark_icp(const std::string& filename)
+{
+    SessionPlayer player;
+    if (!player.open(filename))
+        return -1;
+
+    std::vector<session_tick> ticks;
+    if (!load_session_ticks(player, 10, ticks)) {
+        std::cout << "Error: No frames in " << filename << std::endl;
+        return -1;
+    }
+
+    auto& cameras = player.getCameras();
+    std::cout << ticks.size() << " ticks of " << cameras.size() << " cameras, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    RigIcp icp;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    double firstMs = 0, pyramidMs = 0, solveMs = 0, maxMs = 0, before = 0, after = 0, angle = 0;
+    size_t solves = 0, moved = 0;
+    for (auto& tick : ticks) {
+        auto depthInputs = session_tick_inputs(player, tick);
+        std::vector<RigIcp::Input> inputs(depthInputs.size());
+        std::vector<Eigen::Affine3f> truth(inputs.size());
+        for (size_t camera = 0; camera < inputs.size(); ++camera) {
+            auto& in = depthInputs[camera];
+            auto& input = inputs[camera];
+            input.depth = in.depth;
+            input.width = in.width;
+            input.height = in.height;
+            input.depthUnits = in.depthUnits;
+            input.fx = in.fx;
+            input.fy = in.fy;
+            input.cx = in.cx;
+            input.cy = in.cy;
+            input.fixed = camera == 0;
+            truth[camera] = Eigen::Affine3f(in.cameraToCapture);
+
+            Eigen::Affine3f bump = Eigen::Affine3f::Identity();
+            if (camera > 0) {
+                Eigen::Vector3f axis(unit(random), unit(random), unit(random));
+                bump.linear() = Eigen::AngleAxisf(0.5f * 3.14159265f / 180, axis.normalized()).toRotationMatrix();
+                bump.translation() = Eigen::Vector3f(unit(random), unit(random), unit(random)) * 0.01f;
+            }
+            input.cameraToCapture = (bump * truth[camera]).matrix();
+        }
+
+        if (!icp.solve(inputs)) continue;
+        if (++solves == 1) {
+            firstMs = icp.getLastPyramidMs() + icp.getLastSolveMs();
+        } else {
+            pyramidMs += icp.getLastPyramidMs();
+            solveMs += icp.getLastSolveMs();
+            maxMs = std::max<double>(maxMs, icp.getLastPyramidMs() + icp.getLastSolveMs());
+        }
+
+        for (size_t camera = 1; camera < inputs.size(); ++camera) {
+            auto& result = icp.getResult((unsigned int)camera);
+            Eigen::Affine3f start(inputs[camera].cameraToCapture);
+            Eigen::Affine3f refined = result.correction * start;
+            before += (start.translation() - truth[camera].translation()).norm();
+            after += (refined.translation() - truth[camera].translation()).norm();
+            angle += Eigen::AngleAxisf(refined.linear() * truth[camera].linear().transpose()).angle();
+            moved += result.valid;
+        }
+    }
+
+    size_t refined = solves * (cameras.size() - 1);
+    if (!refined) {
+        std::cout << "Error: Fewer than two cameras with depth" << std::endl;
+        return -1;
+    }
+    std::cout << "First: " << firstMs << " ms" << std::endl;
+    if (solves > 1)
+        std::cout << "Pyramids: " << pyramidMs / (solves - 1) << " ms, solve: " << solveMs / (solves - 1) << " ms, max total: " << maxMs << " ms" << std::endl;
+    std::cout << moved << " of " << refined << " cameras moved, position error " << before / refined * 1000 << " -> "
+              << after / refined * 1000 << " mm, rotation error " << angle / refined * 180 / 3.14159265 << " deg" << std::endl;
+    return 0;
+}
@@ -0,0 +1,9 @@
+#version 410
+
+layout( location = 0 ) in vec3 Colour;
+
+out vec4 FragColour;
+
+void main() {
+	FragColour = vec4(Colour,1);
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 410
+
+// fused clouds are structure of arrays, one attribute per array
+layout( location = 0 ) in float X;
+layout( location = 1 ) in float Y;
+layout( location = 2 ) in float Z;
+layout( location = 3 ) in float R;
+layout( location = 4 ) in float G;
+layout( location = 5 ) in float B;
+
+out Vertex {
+	vec3 Colour;
+} vertex;
+
+uniform mat4 View;
+
+void main() {
+	vertex.Colour = vec3(R,G,B);
+
+	// already in capture space with the camera Y flip applied
+	gl_Position = View * vec4(X,Y,Z,1);
+}
\ No newline at end of file
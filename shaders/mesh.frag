@@ -0,0 +1,13 @@
+#version 410
+
+layout( location = 0 ) in vec3 ViewNormal;
+layout( location = 1 ) in vec3 VertexColour;
+
+out vec4 FragColour;
+
+void main() {
+	// headlight so the surface shape reads even without colour
+	float NdotL = abs(normalize(ViewNormal).z);
+
+	FragColour = vec4(VertexColour * (0.3 + 0.7 * NdotL),1);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 410
+
+layout( location = 0 ) in vec3 Position;
+layout( location = 1 ) in vec3 Normal;
+layout( location = 2 ) in vec3 Colour;
+
+layout( location = 0 ) out vec3 ViewNormal;
+layout( location = 1 ) out vec3 VertexColour;
+
+uniform mat4 View;
+uniform mat4 Projection;
+
+void main() {
+	// mesh vertices are already in capture space
+	ViewNormal = mat3(View) * Normal;
+	VertexColour = Colour;
+
+	gl_Position = Projection * View * vec4(Position,1);
+}
\ No newline at end of file
@@ -2,16 +2,23 @@
 
 layout( location = 0 ) in vec3 Position;
 layout( location = 1 ) in vec2 UV;
+layout( location = 2 ) in vec3 Normal;	// zero when normals are off
 
-layout( location = 0 ) out vec2 TexCoord;
+out Vertex {
+	vec2 TexCoord;
+	vec3 Normal;
+} vertex;
 
 uniform mat4 View;
 uniform mat4 Model;
 
 void main() {
-	TexCoord = UV;
+	vertex.TexCoord = UV;
 
 	vec3 P = Position * vec3(1,-1,1);
+	vec3 N = Normal * vec3(1,-1,1);
+
+	vertex.Normal = mat3(View * Model) * N;
 
 	gl_Position = View * Model * vec4(P,1);
 }
\ No newline at end of file